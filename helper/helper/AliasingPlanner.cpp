@@ -0,0 +1,125 @@
+#include "AliasingPlanner.h"
+
+#include <algorithm>
+#include <cassert>
+
+namespace {
+
+uint64_t alignUp(uint64_t value, uint64_t alignment) {
+  return (value + alignment - 1) & ~(alignment - 1);
+}
+
+bool overlapLifetime(const AliasingPlanner::Request& a,
+                     const AliasingPlanner::Request& b) {
+  return a.firstPass <= b.lastPass && b.firstPass <= a.lastPass;
+}
+
+}  // namespace
+
+uint32_t AliasingPlanner::add(const Request& request) {
+  assert(request.size > 0);
+  assert(request.alignment > 0 &&
+         (request.alignment & (request.alignment - 1)) == 0);
+  assert(request.firstPass <= request.lastPass);
+  requests.push_back(request);
+  planned = false;
+  return uint32_t(requests.size() - 1);
+}
+
+void AliasingPlanner::clear() {
+  requests.clear();
+  placements.clear();
+  heapSize = 0;
+  heapAlignment = 1;
+  planned = false;
+}
+
+void AliasingPlanner::plan() {
+  placements.assign(requests.size(), Placement{});
+  heapSize = 0;
+  heapAlignment = 1;
+
+  // the biggest resources are placed first, they are the hardest to fit
+  std::vector<uint32_t> order(requests.size());
+  for (uint32_t i = 0; i < order.size(); ++i) order[i] = i;
+  std::stable_sort(order.begin(), order.end(), [&](uint32_t a, uint32_t b) {
+    return requests[a].size > requests[b].size;
+  });
+
+  struct Interval {
+    uint64_t begin;
+    uint64_t end;
+  };
+  std::vector<uint32_t> placed;
+  std::vector<Interval> occupied;
+  placed.reserve(requests.size());
+
+  for (uint32_t id : order) {
+    const Request& req = requests[id];
+
+    // memory ranges already taken by resources that are live at the same time
+    occupied.clear();
+    for (uint32_t other : placed) {
+      if (overlapLifetime(req, requests[other])) {
+        uint64_t begin = placements[other].offset;
+        occupied.push_back({begin, begin + requests[other].size});
+      }
+    }
+    std::sort(occupied.begin(), occupied.end(),
+              [](const Interval& a, const Interval& b) {
+                return a.begin < b.begin;
+              });
+
+    // first fit from the bottom of the heap
+    uint64_t offset = 0;
+    for (const Interval& range : occupied) {
+      if (offset + req.size <= range.begin) break;
+      offset = std::max(offset, alignUp(range.end, req.alignment));
+    }
+
+    placements[id].offset = offset;
+    placed.push_back(id);
+    heapSize = std::max(heapSize, offset + req.size);
+    heapAlignment = std::max(heapAlignment, req.alignment);
+  }
+
+  for (uint32_t i = 0; i < requests.size(); ++i) {
+    for (uint32_t j = i + 1; j < requests.size(); ++j) {
+      uint64_t iBegin = placements[i].offset;
+      uint64_t jBegin = placements[j].offset;
+      if (iBegin < jBegin + requests[j].size &&
+          jBegin < iBegin + requests[i].size) {
+        assert(!overlapLifetime(requests[i], requests[j]));
+        placements[i].aliased = placements[j].aliased = true;
+      }
+    }
+  }
+
+  planned = true;
+}
+
+const AliasingPlanner::Placement& AliasingPlanner::getPlacement(
+    uint32_t id) const {
+  assert(planned && id < placements.size());
+  return placements[id];
+}
+
+uint64_t AliasingPlanner::getNaiveSize() const {
+  uint64_t size = 0;
+  for (const Request& req : requests) size = alignUp(size, req.alignment) + req.size;
+  return size;
+}
+
+uint64_t AliasingPlanner::getPeakLiveSize() const {
+  uint64_t peak = 0;
+  for (const Request& at : requests) {
+    // the live set only changes where some resource becomes live
+    uint64_t live = 0;
+    for (const Request& req : requests) {
+      if (req.firstPass <= at.firstPass && at.firstPass <= req.lastPass)
+        live += req.size;
+    }
+    peak = std::max(peak, live);
+  }
+  return peak;
+}
@@ -0,0 +1,47 @@
+#pragma once
+#include <cstdint>
+#include <vector>
+
+// Places transient resources in one shared heap.
+// A resource is live during the pass interval [firstPass, lastPass]; two
+// resources may share memory only when their intervals do not intersect.
+// No graphics API is referenced here, so the planner also builds off Windows.
+class AliasingPlanner {
+ public:
+  struct Request {
+    uint64_t size = 0;
+    uint64_t alignment = 1;  // power of two
+    uint32_t firstPass = 0;
+    uint32_t lastPass = 0;
+  };
+
+  struct Placement {
+    uint64_t offset = 0;
+    bool aliased = false;  // shares memory with another resource
+  };
+
+ private:
+  std::vector<Request> requests;
+  std::vector<Placement> placements;
+  uint64_t heapSize = 0;
+  uint64_t heapAlignment = 1;
+  bool planned = false;
+
+ public:
+  uint32_t add(const Request& request);
+  void clear();
+  void plan();
+
+  uint32_t count() const { return uint32_t(requests.size()); }
+  const Request& getRequest(uint32_t id) const { return requests[id]; }
+  const Placement& getPlacement(uint32_t id) const;
+
+  // size of the shared heap after aliasing
+  uint64_t getHeapSize() const { return heapSize; }
+  // largest alignment among the requests, the heap must honor it
+  uint64_t getHeapAlignment() const { return heapAlignment; }
+  // size required when every resource gets its own allocation
+  uint64_t getNaiveSize() const;
+  // sum of the live sizes at the busiest pass, a lower bound of getHeapSize()
+  uint64_t getPeakLiveSize() const;
+};
@@ -0,0 +1,108 @@
+#include "DescriptorAllocator.h"
+
+#include <cassert>
+
+DescriptorPool::DescriptorPool(uint32_t pageSize, uint32_t incrementSize,
+                               uint32_t maxPages)
+    : pageSize(pageSize), maxPages(maxPages), incrementSize(incrementSize) {
+  assert(pageSize > 0 && maxPages > 0);
+}
+
+DescriptorPool::Slot DescriptorPool::allocate(uint32_t count) {
+  assert(count > 0);
+  if (count > pageSize) return {};
+
+  for (uint32_t page = 0; page < freeRanges.size(); ++page) {
+    std::vector<Range>& ranges = freeRanges[page];
+    for (uint32_t i = 0; i < ranges.size(); ++i) {
+      Range& range = ranges[i];
+      if (range.count < count) continue;
+
+      Slot slot{page, range.begin};
+      range.begin += count;
+      range.count -= count;
+      if (range.count == 0) ranges.erase(ranges.begin() + i);
+      used += count;
+      return slot;
+    }
+  }
+
+  if (freeRanges.size() >= maxPages) return {};
+  freeRanges.push_back({{count, pageSize - count}});
+  if (freeRanges.back()[0].count == 0) freeRanges.back().clear();
+  used += count;
+  return {uint32_t(freeRanges.size() - 1), 0};
+}
+
+void DescriptorPool::free(Slot slot, uint32_t count) {
+  assert(slot.valid() && slot.page < freeRanges.size());
+  assert(slot.index + count <= pageSize);
+  std::vector<Range>& ranges = freeRanges[slot.page];
+
+  // first free range after the freed one
+  uint32_t i = 0;
+  while (i < ranges.size() && ranges[i].begin < slot.index) ++i;
+
+  // freeing twice would overlap a free range
+  assert(i == ranges.size() || slot.index + count <= ranges[i].begin);
+  assert(i == 0 ||
+         ranges[i - 1].begin + ranges[i - 1].count <= slot.index);
+
+  bool mergePrev =
+      i > 0 && ranges[i - 1].begin + ranges[i - 1].count == slot.index;
+  bool mergeNext =
+      i < ranges.size() && slot.index + count == ranges[i].begin;
+
+  if (mergePrev && mergeNext) {
+    ranges[i - 1].count += count + ranges[i].count;
+    ranges.erase(ranges.begin() + i);
+  } else if (mergePrev) {
+    ranges[i - 1].count += count;
+  } else if (mergeNext) {
+    ranges[i].begin = slot.index;
+    ranges[i].count += count;
+  } else {
+    ranges.insert(ranges.begin() + i, {slot.index, count});
+  }
+  used -= count;
+}
+
+DescriptorRing::DescriptorRing(uint32_t capacity, uint32_t incrementSize)
+    : capacity(capacity), incrementSize(incrementSize) {
+  assert(capacity > 0);
+}
+
+uint32_t DescriptorRing::allocate(uint32_t count) {
+  assert(count > 0);
+  if (count > capacity - used) return invalid;
+
+  // the free space is [head, tail) going around, split in two at the end
+  uint32_t skip = 0;
+  if (head >= tail && head + count > capacity) {
+    // a table must be contiguous : skip the end and restart at 0
+    skip = capacity - head;
+    if (count > tail || count + skip > capacity - used) return invalid;
+  }
+
+  uint32_t index = (head + skip) % capacity;
+  head = (index + count) % capacity;
+  used += skip + count;
+  frameSize += skip + count;
+  return index;
+}
+
+void DescriptorRing::endFrame(uint64_t fenceValue) {
+  frames.push_back({fenceValue, head, frameSize});
+  frameSize = 0;
+}
+
+void DescriptorRing::retire(uint64_t completedValue) {
+  while (!frames.empty() && frames.front().fenceValue <= completedValue) {
+    tail = frames.front().end;
+    used -= frames.front().size;
+    frames.pop_front();
+  }
+  // empty : start over at 0, else the free space stays split at the end and
+  // a table longer than either part would not fit
+  if (used == 0) head = tail = 0;
+}
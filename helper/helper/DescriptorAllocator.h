@@ -0,0 +1,89 @@
+#pragma once
+#include <cstdint>
+#include <deque>
+#include <vector>
+
+// Slot bookkeeping for descriptor heaps, without the heaps themselves.
+// Offsets are returned in bytes from the start of a heap, using the handle
+// increment size of the descriptor type, so the D3D side only adds them to
+// the heap start.
+
+// Persistent descriptors.
+// Slots live in fixed size pages, one heap per page. Freed ranges are merged
+// and reused first, a page is added when no free range fits.
+class DescriptorPool {
+ public:
+  static const uint32_t invalid = UINT32_MAX;
+
+  struct Slot {
+    uint32_t page = invalid;
+    uint32_t index = 0;  // in the page
+    bool valid() const { return page != invalid; }
+  };
+
+ private:
+  struct Range {
+    uint32_t begin;
+    uint32_t count;
+  };
+
+  uint32_t pageSize;
+  uint32_t maxPages;
+  uint32_t incrementSize;
+  std::vector<std::vector<Range>> freeRanges;  // per page, sorted by begin
+  uint32_t used = 0;
+
+ public:
+  DescriptorPool(uint32_t pageSize, uint32_t incrementSize,
+                 uint32_t maxPages = UINT32_MAX);
+
+  // count contiguous slots in one page, invalid when every page is full and
+  // no page can be added
+  Slot allocate(uint32_t count = 1);
+  void free(Slot slot, uint32_t count = 1);
+
+  uint64_t getOffset(Slot slot) const {
+    return uint64_t(slot.index) * incrementSize;
+  }
+  uint32_t getPageSize() const { return pageSize; }
+  uint32_t getPageCount() const { return uint32_t(freeRanges.size()); }
+  uint32_t getUsedCount() const { return used; }
+};
+
+// Transient descriptors, e.g. the tables copied in for one frame.
+// Slots are handed out linearly and contiguously, wrapping around the end;
+// what a frame took comes back once its fence value is retired.
+class DescriptorRing {
+ public:
+  static const uint32_t invalid = UINT32_MAX;
+
+ private:
+  struct Frame {
+    uint64_t fenceValue;
+    uint32_t end;   // head when the frame ended
+    uint32_t size;  // slots taken, including the ones skipped at the wrap
+  };
+
+  uint32_t capacity;
+  uint32_t incrementSize;
+  uint32_t head = 0;  // next slot
+  uint32_t tail = 0;  // oldest slot in use
+  uint32_t used = 0;
+  uint32_t frameSize = 0;  // taken by the open frame
+  std::deque<Frame> frames;
+
+ public:
+  DescriptorRing(uint32_t capacity, uint32_t incrementSize);
+
+  // index of the first of count contiguous slots, invalid when full
+  uint32_t allocate(uint32_t count);
+  // closes the open frame, its slots are in use until fenceValue retires
+  void endFrame(uint64_t fenceValue);
+  void retire(uint64_t completedValue);
+
+  uint64_t getOffset(uint32_t index) const {
+    return uint64_t(index) * incrementSize;
+  }
+  uint32_t getCapacity() const { return capacity; }
+  uint32_t getUsedCount() const { return used; }
+};
@@ -0,0 +1,35 @@
+#include "FenceTimeline.h"
+
+#include <algorithm>
+
+void FenceTimeline::onCompletion(uint64_t value, Callback callback) {
+  if (isCompleted(value)) {
+    callback();
+    return;
+  }
+
+  // values come in submission order almost always, keep insertion order for
+  // equal values
+  if (pending.empty() || pending.back().value <= value) {
+    pending.push_back({value, std::move(callback)});
+    return;
+  }
+  auto it = std::upper_bound(
+      pending.begin(), pending.end(), value,
+      [](uint64_t v, const Entry& entry) { return v < entry.value; });
+  pending.insert(it, {value, std::move(callback)});
+}
+
+uint32_t FenceTimeline::retire(uint64_t completedValue) {
+  completed = std::max(completed, completedValue);
+
+  uint32_t count = 0;
+  while (!pending.empty() && pending.front().value <= completed) {
+    // a callback may queue more work, so take it out before running it
+    Callback callback = std::move(pending.front().callback);
+    pending.pop_front();
+    callback();
+    ++count;
+  }
+  return count;
+}
@@ -0,0 +1,37 @@
+#pragma once
+#include <cstdint>
+#include <deque>
+#include <functional>
+
+// Work waiting for a fence value.
+// Callbacks are queued with the fence value they wait for and run, in value
+// order, when retire() is told the fence got there. The fence itself stays
+// outside, so the timeline can be driven by a simulated counter.
+class FenceTimeline {
+ public:
+  using Callback = std::function<void()>;
+
+ private:
+  struct Entry {
+    uint64_t value;
+    Callback callback;
+  };
+
+  std::deque<Entry> pending;  // sorted by value
+  uint64_t completed = 0;
+
+ public:
+  // runs callback once the completed value reaches value, right away when it
+  // already has
+  void onCompletion(uint64_t value, Callback callback);
+  // advances the completed value and runs what retired, returns how many ran
+  uint32_t retire(uint64_t completedValue);
+
+  uint64_t getCompletedValue() const { return completed; }
+  bool isCompleted(uint64_t value) const { return value <= completed; }
+  uint32_t pendingCount() const { return uint32_t(pending.size()); }
+  // the value the last pending callback waits for, 0 when nothing is pending
+  uint64_t lastPendingValue() const {
+    return pending.empty() ? 0 : pending.back().value;
+  }
+};
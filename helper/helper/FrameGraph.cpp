@@ -0,0 +1,143 @@
+#include "FrameGraph.h"
+
+D3D12_RESOURCE_STATES toResourceState(ResourceUsage usage) {
+  switch (usage) {
+    case ResourceUsage::renderTarget:
+      return D3D12_RESOURCE_STATE_RENDER_TARGET;
+    case ResourceUsage::depthWrite:
+      return D3D12_RESOURCE_STATE_DEPTH_WRITE;
+    case ResourceUsage::depthRead:
+      return D3D12_RESOURCE_STATE_DEPTH_READ;
+    case ResourceUsage::shaderResource:
+      return D3D12_RESOURCE_STATE_PIXEL_SHADER_RESOURCE |
+             D3D12_RESOURCE_STATE_NON_PIXEL_SHADER_RESOURCE;
+    case ResourceUsage::unorderedAccess:
+      return D3D12_RESOURCE_STATE_UNORDERED_ACCESS;
+    case ResourceUsage::copySource:
+      return D3D12_RESOURCE_STATE_COPY_SOURCE;
+    case ResourceUsage::copyDest:
+      return D3D12_RESOURCE_STATE_COPY_DEST;
+    case ResourceUsage::present:
+      return D3D12_RESOURCE_STATE_PRESENT;
+    default:
+      assert(false);
+      return D3D12_RESOURCE_STATE_COMMON;
+  }
+}
+
+FrameGraph::ResourceId FrameGraph::importResource(const char* name,
+                                                  const dxResource* resource,
+                                                  ResourceUsage initialUsage,
+                                                  ResourceUsage finalUsage) {
+  ResourceId id = graph.importResource(name, initialUsage, finalUsage);
+  resources.push_back(resource);
+  transients.push_back({});
+  return id;
+}
+
+FrameGraph::ResourceId FrameGraph::createRenderTarget(const char* name,
+                                                      DXGI_FORMAT format,
+                                                      UINT width,
+                                                      UINT height,
+                                                      bool unorderedAccess) {
+  ResourceId id = graph.createTransient(name);
+  resources.push_back(nullptr);
+  transients.push_back({format, width, height, unorderedAccess});
+  return id;
+}
+
+FrameGraph::PassId FrameGraph::addPass(const char* name, PassFunc func,
+                                       bool sideEffect) {
+  PassId id = graph.addPass(name, sideEffect);
+  passFuncs.push_back(std::move(func));
+  passHashes.push_back(nullptr);
+  passEnabled.push_back(true);
+  return id;
+}
+
+void FrameGraph::compile() {
+  if (!graph.compile()) Error(graph.getError().c_str());
+
+  pool->beginFrame();
+  for (ResourceId id = 0; id < graph.resourceCount(); ++id) {
+    TransientTarget& t = transients[id];
+    if (graph.isImported(id) || graph.getFirstUse(id) == RenderGraph::invalid)
+      continue;
+    t.handle = pool->acquire(t.format, t.width, t.height,
+                             graph.getFirstUse(id), graph.getLastUse(id),
+                             t.unorderedAccess);
+  }
+  pool->compile();
+  // the targets may have moved, what the cached passes wrote is gone
+  cache.invalidate();
+
+  for (ResourceId id = 0; id < graph.resourceCount(); ++id) {
+    if (!graph.isImported(id) && graph.getFirstUse(id) != RenderGraph::invalid)
+      resources[id] = &pool->get(transients[id].handle);
+  }
+}
+
+void FrameGraph::flushBarriers(
+    CommandQueue* queue, CommandList* cmdList,
+    const std::vector<RenderGraph::Barrier>& barriers,
+    std::vector<D3D12_RESOURCE_BARRIER>* batch) {
+  batch->clear();
+  for (const RenderGraph::Barrier& barrier : barriers) {
+    const dxResource* rsc = resources[barrier.resource];
+    rsc->changeResourceState(batch, toResourceState(barrier.after));
+  }
+  if (batch->empty()) return;
+
+  auto* rawList = cmdList->begin();
+  rawList->ResourceBarrier(UINT(batch->size()), batch->data());
+  cmdList->end(queue);
+}
+
+void FrameGraph::record(CommandQueue* queue, CommandList* cmdList,
+                        UINT first, UINT last,
+                        std::vector<D3D12_RESOURCE_BARRIER>* batch) {
+  const std::vector<PassId>& order = graph.getOrder();
+  for (UINT pos = first; pos < last; ++pos) {
+    // only the passes that run activate targets, see updateRuns(); the clear
+    // would wipe what a skipped pass left
+    for (ResourceId id : activations[pos])
+      pool->beginUse(cmdList, transients[id].handle);
+
+    // a skipped pass still moves its resources to the states the graph
+    // planned, the passes after it expect them
+    flushBarriers(queue, cmdList, graph.getBarriers(order[pos]), batch);
+    if (runs[pos]) passFuncs[order[pos]](cmdList);
+  }
+  if (last == order.size())
+    flushBarriers(queue, cmdList, graph.getFinalBarriers(), batch);
+}
+
+void FrameGraph::updateRuns() {
+  hashes.assign(graph.passCount(), 0);
+  for (PassId pass = 0; pass < graph.passCount(); ++pass) {
+    if (passEnabled[pass] && passHashes[pass])
+      hashes[pass] = passHashes[pass]();
+  }
+  // a disabled pass leaves the versions alone, it wrote nothing new
+  cache.update(hashes, passEnabled, &runs);
+  graph.getActivations(runs, &activations);
+}
+
+void FrameGraph::execute(CommandQueue* queue, CommandList* cmdList) {
+  updateRuns();
+  record(queue, cmdList, 0, UINT(graph.getOrder().size()), &batch);
+}
+
+void FrameGraph::execute(ParallelRecorder* recorder) {
+  // runs of the same number of passes, in order, so the lists submitted in
+  // order keep the order of the graph
+  // decided here, the cache is not thread safe
+  updateRuns();
+  UINT numPasses = UINT(graph.getOrder().size());
+  UINT numLists = recorder->getListCount();
+  recorder->record([&](UINT list, CommandList* cmdList) {
+    std::vector<D3D12_RESOURCE_BARRIER> listBatch;
+    record(recorder->getQueue(), cmdList, numPasses * list / numLists,
+           numPasses * (list + 1) / numLists, &listBatch);
+  });
+}
@@ -0,0 +1,121 @@
+#pragma once
+#include <functional>
+
+#include "Helper.h"
+#include "RenderGraph.h"
+#include "RenderTargetPool.h"
+
+D3D12_RESOURCE_STATES toResourceState(ResourceUsage usage);
+
+// Runs a RenderGraph on D3D12.
+// Each pass is a callback that records its work on the list it is given; the
+// graph issues the transitions between passes in batches, so a target written
+// by one pass stays in its state until a later pass needs another one.
+// Transient render targets are taken from a RenderTargetPool with the
+// lifetimes the graph computed. The passes may be recorded on several
+// threads, see execute(ParallelRecorder*). A cached pass is recorded only when
+// its constants or what it reads changed, see setCached().
+class FrameGraph {
+ public:
+  using ResourceId = RenderGraph::ResourceId;
+  using PassId = RenderGraph::PassId;
+  using PassFunc = std::function<void(CommandList*)>;
+  // a hash of what a pass reads from outside the graph, its constants
+  using HashFunc = std::function<uint64_t()>;
+
+ private:
+  struct TransientTarget {
+    DXGI_FORMAT format = DXGI_FORMAT_UNKNOWN;  // unknown for imported ones
+    UINT width = 0;
+    UINT height = 0;
+    bool unorderedAccess = false;
+    RenderTargetPool::Handle handle = 0;
+  };
+
+  RenderGraph graph;
+  RenderTargetPool* pool = nullptr;
+
+  // indexed by ResourceId
+  std::vector<const dxResource*> resources;
+  std::vector<TransientTarget> transients;
+  // indexed by PassId
+  std::vector<PassFunc> passFuncs;
+  std::vector<HashFunc> passHashes;
+  std::vector<uint8_t> passEnabled;
+  PassCache cache{&graph};
+  // whether the pass at each position of the order runs this frame
+  std::vector<bool> runs;
+  std::vector<uint64_t> hashes;  // of the frame, by PassId
+  // transient targets becoming live this frame, by position in the order
+  std::vector<std::vector<ResourceId>> activations;
+  void updateRuns();
+
+  std::vector<D3D12_RESOURCE_BARRIER> batch;
+  void flushBarriers(CommandQueue* queue, CommandList* cmdList,
+                     const std::vector<RenderGraph::Barrier>& barriers,
+                     std::vector<D3D12_RESOURCE_BARRIER>* batch);
+  // the passes at [first, last) of the order
+  void record(CommandQueue* queue, CommandList* cmdList, UINT first,
+              UINT last, std::vector<D3D12_RESOURCE_BARRIER>* batch);
+
+ public:
+  explicit FrameGraph(RenderTargetPool* pool) : pool(pool) {}
+
+  ResourceId importResource(
+      const char* name, const dxResource* resource, ResourceUsage initialUsage,
+      ResourceUsage finalUsage = ResourceUsage::undefined);
+  // imported resources may change every frame, e.g. the back buffer
+  void setImported(ResourceId id, const dxResource* resource) {
+    assert(graph.isImported(id));
+    resources[id] = resource;
+  }
+  ResourceId createRenderTarget(const char* name, DXGI_FORMAT format,
+                                UINT width, UINT height,
+                                bool unorderedAccess = false);
+  PassId addPass(const char* name, PassFunc func, bool sideEffect = false);
+
+  void read(PassId pass, ResourceId id,
+            ResourceUsage usage = ResourceUsage::shaderResource) {
+    graph.read(pass, id, usage);
+  }
+  void write(PassId pass, ResourceId id,
+             ResourceUsage usage = ResourceUsage::renderTarget) {
+    graph.write(pass, id, usage);
+  }
+
+  // the pass runs again only when the hash or a resource it reads changed,
+  // or a pass reading its targets runs; the targets that passes not cached
+  // read keep their content between frames
+  void setCached(PassId pass, HashFunc hash) {
+    graph.setCached(pass);
+    passHashes[pass] = std::move(hash);
+  }
+  // the target keeps its content between frames even when only cached
+  // passes read it, see RenderGraph::setPersistent()
+  void setPersistent(ResourceId id) { graph.setPersistent(id); }
+  // a disabled pass is not recorded, e.g. its object is out of view, nor
+  // activates its targets; its barriers still are. A cached pass picks up where it left when enabled
+  // again. Set before execute(), for the frames after.
+  void setEnabled(PassId pass, bool enabled) { passEnabled[pass] = enabled; }
+  bool isEnabled(PassId pass) const { return passEnabled[pass]; }
+
+  // the resource changed outside of the graph, e.g. an imported texture
+  void touch(ResourceId id) { cache.touch(id); }
+  void invalidate() { cache.invalidate(); }
+  const PassCache& getCache() const { return cache; }
+
+  // compiles the graph and places the transient targets
+  void compile();
+  RenderTarget& getRenderTarget(ResourceId id) const {
+    assert(!graph.isImported(id));
+    return pool->get(transients[id].handle);
+  }
+  const RenderGraph& getGraph() const { return graph; }
+
+  void execute(CommandQueue* queue, CommandList* cmdList);
+  // the order cut in as many runs as the recorder has lists, each recorded
+  // on its own thread and list; the passes must not share objects that
+  // record, e.g. a Pass, with passes of another run. Submitted by the caller
+  // with ParallelRecorder::submit().
+  void execute(ParallelRecorder* recorder);
+};
@@ -0,0 +1,104 @@
+#include "FrustumCull.h"
+
+#include <cmath>
+
+#if defined(__SSE2__) || defined(_M_X64) || defined(_M_AMD64)
+#include <emmintrin.h>
+#define FRUSTUM_CULL_SSE 1
+#endif
+
+void frustumPlanes(const float viewProj[16], float planes[6][4]) {
+  // clip = p * viewProj, so the clip coordinates are dots with the columns
+  auto column = [&](int c, int i) { return viewProj[i * 4 + c]; };
+  for (int i = 0; i < 4; ++i) {
+    planes[0][i] = column(3, i) + column(0, i);  // left
+    planes[1][i] = column(3, i) - column(0, i);  // right
+    planes[2][i] = column(3, i) + column(1, i);  // bottom
+    planes[3][i] = column(3, i) - column(1, i);  // top
+    planes[4][i] = column(2, i);                 // near
+    planes[5][i] = column(3, i) - column(2, i);  // far
+  }
+  for (int p = 0; p < 6; ++p) {
+    float length = std::sqrt(planes[p][0] * planes[p][0] +
+                             planes[p][1] * planes[p][1] +
+                             planes[p][2] * planes[p][2]);
+    for (int i = 0; i < 4; ++i) planes[p][i] /= length;
+  }
+}
+
+void SphereBatch::add(float cx, float cy, float cz, float r) {
+  x.push_back(cx);
+  y.push_back(cy);
+  z.push_back(cz);
+  radius.push_back(r);
+}
+
+void SphereBatch::clear() {
+  x.clear();
+  y.clear();
+  z.clear();
+  radius.clear();
+}
+
+static bool isVisible(const float planes[6][4], float x, float y, float z,
+                      float radius) {
+  for (int p = 0; p < 6; ++p) {
+    if (planes[p][0] * x + planes[p][1] * y + planes[p][2] * z + planes[p][3] <
+        -radius)
+      return false;
+  }
+  return true;
+}
+
+static size_t cullRange(const float planes[6][4], const SphereBatch& spheres,
+                        size_t first, uint8_t* visible) {
+  size_t count = 0;
+  for (size_t i = first; i < spheres.size(); ++i) {
+    visible[i] = isVisible(planes, spheres.getX()[i], spheres.getY()[i],
+                           spheres.getZ()[i], spheres.getRadius()[i]);
+    count += visible[i];
+  }
+  return count;
+}
+
+size_t cullSpheresScalar(const float planes[6][4], const SphereBatch& spheres,
+                         uint8_t* visible) {
+  return cullRange(planes, spheres, 0, visible);
+}
+
+#ifdef FRUSTUM_CULL_SSE
+size_t cullSpheres(const float planes[6][4], const SphereBatch& spheres,
+                   uint8_t* visible) {
+  __m128 n[6][4];
+  for (int p = 0; p < 6; ++p)
+    for (int i = 0; i < 4; ++i) n[p][i] = _mm_set1_ps(planes[p][i]);
+
+  size_t count = 0;
+  size_t i = 0;
+  for (; i + 4 <= spheres.size(); i += 4) {
+    __m128 x = _mm_loadu_ps(spheres.getX() + i);
+    __m128 y = _mm_loadu_ps(spheres.getY() + i);
+    __m128 z = _mm_loadu_ps(spheres.getZ() + i);
+    __m128 negRadius =
+        _mm_sub_ps(_mm_setzero_ps(), _mm_loadu_ps(spheres.getRadius() + i));
+    __m128 inside = _mm_castsi128_ps(_mm_set1_epi32(-1));
+    for (int p = 0; p < 6; ++p) {
+      // summed in the order of isVisible(), both give the same answer
+      __m128 d = _mm_add_ps(_mm_mul_ps(n[p][0], x), _mm_mul_ps(n[p][1], y));
+      d = _mm_add_ps(_mm_add_ps(d, _mm_mul_ps(n[p][2], z)), n[p][3]);
+      inside = _mm_and_ps(inside, _mm_cmpge_ps(d, negRadius));
+    }
+    int bits = _mm_movemask_ps(inside);
+    for (int k = 0; k < 4; ++k) {
+      visible[i + k] = (bits >> k) & 1;
+      count += visible[i + k];
+    }
+  }
+  return count + cullRange(planes, spheres, i, visible);
+}
+#else
+size_t cullSpheres(const float planes[6][4], const SphereBatch& spheres,
+                   uint8_t* visible) {
+  return cullSpheresScalar(planes, spheres, visible);
+}
+#endif
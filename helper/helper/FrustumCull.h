@@ -0,0 +1,38 @@
+#pragma once
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+// Frustum culling of bounding spheres, four at a time with SSE.
+// The planes come from a row major view projection for row vectors, like
+// XMMATRIX, with clip depth in [0, w] as in D3D; their normals point inwards
+// and are normalized, a point p is inside when dot(n, p) + d >= 0.
+
+void frustumPlanes(const float viewProj[16], float planes[6][4]);
+
+// Bounding spheres as a structure of arrays, the layout the test loads.
+class SphereBatch {
+  std::vector<float> x;
+  std::vector<float> y;
+  std::vector<float> z;
+  std::vector<float> radius;
+
+ public:
+  void add(float cx, float cy, float cz, float r);
+  void clear();
+  size_t size() const { return x.size(); }
+
+  const float* getX() const { return x.data(); }
+  const float* getY() const { return y.data(); }
+  const float* getZ() const { return z.data(); }
+  const float* getRadius() const { return radius.data(); }
+};
+
+// visible[i] is 1 when sphere i reaches inside all six planes, else 0; a
+// sphere across a corner of the frustum may be kept. Returns how many are
+// visible.
+size_t cullSpheres(const float planes[6][4], const SphereBatch& spheres,
+                   uint8_t* visible);
+// one sphere at a time, the reference of cullSpheres()
+size_t cullSpheresScalar(const float planes[6][4], const SphereBatch& spheres,
+                         uint8_t* visible);
@@ -0,0 +1,117 @@
+#pragma once
+#include <cmath>
+#include <cstdint>
+
+// CPU reference of the packed texture-space G-buffer.
+// It mirrors data/GBufferPacking.hlsli and the target formats of TextureSpace:
+//   target0 : diffuse   R8G8B8A8_UNORM_SRGB
+//   target1 : position  R16G16B16A16_UNORM, relative to the instance bounds
+//   target2 : normal    R16G16_SNORM, octahedral
+// so the precision loss can be measured without a gpu.
+
+struct GBufferTexel {
+  float diffuse[4]{};
+  float position[3]{};
+  float normal[3]{};
+};
+
+struct PackedGBufferTexel {
+  uint32_t diffuse = 0;
+  uint16_t position[4]{};
+  uint32_t normal = 0;
+};
+
+inline float gbufferSaturate(float v) {
+  return v < 0.0f ? 0.0f : (v > 1.0f ? 1.0f : v);
+}
+
+inline float gbufferSign(float v) { return v >= 0.0f ? 1.0f : -1.0f; }
+
+// float -> UNORM/SNORM conversions follow the D3D rounding rules
+inline uint16_t floatToUnorm16(float v) {
+  return uint16_t(gbufferSaturate(v) * 65535.0f + 0.5f);
+}
+inline float unorm16ToFloat(uint16_t v) { return v / 65535.0f; }
+
+inline int16_t floatToSnorm16(float v) {
+  v = v < -1.0f ? -1.0f : (v > 1.0f ? 1.0f : v);
+  return int16_t(v * 32767.0f + (v >= 0.0f ? 0.5f : -0.5f));
+}
+inline float snorm16ToFloat(int16_t v) {
+  float f = v / 32767.0f;
+  return f < -1.0f ? -1.0f : f;
+}
+
+inline uint8_t linearToSrgb8(float v) {
+  v = gbufferSaturate(v);
+  float s = v <= 0.0031308f ? v * 12.92f
+                            : 1.055f * powf(v, 1.0f / 2.4f) - 0.055f;
+  return uint8_t(s * 255.0f + 0.5f);
+}
+inline float srgb8ToLinear(uint8_t v) {
+  float s = v / 255.0f;
+  return s <= 0.04045f ? s / 12.92f : powf((s + 0.055f) / 1.055f, 2.4f);
+}
+
+// unit normal -> [-1, 1]^2
+inline void octEncode(const float n[3], float e[2]) {
+  float l1 = fabsf(n[0]) + fabsf(n[1]) + fabsf(n[2]);
+  float x = n[0] / l1, y = n[1] / l1, z = n[2] / l1;
+  if (z < 0.0f) {
+    float wx = (1.0f - fabsf(y)) * gbufferSign(x);
+    float wy = (1.0f - fabsf(x)) * gbufferSign(y);
+    x = wx, y = wy;
+  }
+  e[0] = x, e[1] = y;
+}
+
+inline void octDecode(const float e[2], float n[3]) {
+  float x = e[0], y = e[1];
+  float z = 1.0f - fabsf(x) - fabsf(y);
+  float t = gbufferSaturate(-z);
+  x += x >= 0.0f ? -t : t;
+  y += y >= 0.0f ? -t : t;
+  float len = sqrtf(x * x + y * y + z * z);
+  n[0] = x / len, n[1] = y / len, n[2] = z / len;
+}
+
+inline PackedGBufferTexel packGBuffer(const GBufferTexel& texel,
+                                      const float boundsMin[3],
+                                      const float boundsSize[3]) {
+  PackedGBufferTexel packed;
+  for (int i = 0; i < 3; ++i)
+    packed.diffuse |= uint32_t(linearToSrgb8(texel.diffuse[i])) << (8 * i);
+  packed.diffuse |= uint32_t(gbufferSaturate(texel.diffuse[3]) * 255.0f + 0.5f)
+                    << 24;
+
+  for (int i = 0; i < 3; ++i) {
+    packed.position[i] = floatToUnorm16((texel.position[i] - boundsMin[i]) /
+                                        boundsSize[i]);
+  }
+  packed.position[3] = 65535;
+
+  float e[2];
+  octEncode(texel.normal, e);
+  packed.normal = uint32_t(uint16_t(floatToSnorm16(e[0]))) |
+                  (uint32_t(uint16_t(floatToSnorm16(e[1]))) << 16);
+  return packed;
+}
+
+inline GBufferTexel unpackGBuffer(const PackedGBufferTexel& packed,
+                                  const float boundsMin[3],
+                                  const float boundsSize[3]) {
+  GBufferTexel texel;
+  for (int i = 0; i < 3; ++i)
+    texel.diffuse[i] = srgb8ToLinear(uint8_t(packed.diffuse >> (8 * i)));
+  texel.diffuse[3] = uint8_t(packed.diffuse >> 24) / 255.0f;
+
+  for (int i = 0; i < 3; ++i) {
+    texel.position[i] =
+        boundsMin[i] + unorm16ToFloat(packed.position[i]) * boundsSize[i];
+  }
+
+  float e[2] = {snorm16ToFloat(int16_t(packed.normal & 0xffff)),
+                snorm16ToFloat(int16_t(packed.normal >> 16))};
+  octDecode(e, texel.normal);
+  return texel;
+}
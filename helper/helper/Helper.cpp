@@ -1,5 +1,8 @@
 ﻿#include "Helper.h"
 
+#include <filesystem>
+#include <fstream>
+
 #define STB_IMAGE_IMPLEMENTATION
 #include "stb_image.h"
 #define STB_IMAGE_WRITE_IMPLEMENTATION
@@ -188,29 +191,21 @@ void readRegisterInfo(const char* token, DescriptorType* type,
      float black[] = {0.0f, 0.0f, 0.0f, 1.0f};
      std::vector<D3D12_RESOURCE_BARRIER> barriers;
      std::vector<D3D12_RESOURCE_BARRIER> endBarriers;
+     std::vector<D3D12_RESOURCE_STATES> prevStates;
      barriers.reserve(rtvs.size() + dsvs.size());
      endBarriers.reserve(barriers.size());
 
      for (const Descriptor* dscr : rtvs) {
-      const dxResource& rsc = *dscr->getResource();
-      if (rsc.getState() != D3D12_RESOURCE_STATE_RENDER_TARGET) {
-        barriers.push_back(Transition(rsc.get(), rsc.getState(),
-                                      D3D12_RESOURCE_STATE_RENDER_TARGET));
-        endBarriers.push_back(Transition(
-            rsc.get(), D3D12_RESOURCE_STATE_RENDER_TARGET, rsc.getState()));
-      }
+      prevStates.push_back(dscr->getResource()->changeResourceState(
+          &barriers, D3D12_RESOURCE_STATE_RENDER_TARGET));
      }
      for (const Descriptor* dscr : dsvs) {
-      const dxResource& rsc = *dscr->getResource();
-      if (rsc.getState() != D3D12_RESOURCE_STATE_DEPTH_WRITE) {
-        barriers.push_back(Transition(rsc.get(), rsc.getState(),
-                                      D3D12_RESOURCE_STATE_DEPTH_WRITE));
-        endBarriers.push_back(Transition(
-            rsc.get(), D3D12_RESOURCE_STATE_DEPTH_WRITE, rsc.getState()));
-      }
+      prevStates.push_back(dscr->getResource()->changeResourceState(
+          &barriers, D3D12_RESOURCE_STATE_DEPTH_WRITE));
      }
 
-     rawList->ResourceBarrier(barriers.size(), barriers.data());
+     if (!barriers.empty())
+      rawList->ResourceBarrier(UINT(barriers.size()), barriers.data());
      for (const Descriptor* dscr : rtvs) {
       rawList->ClearRenderTargetView(dscr->getCpuHandle(), black, 0, nullptr);
      }
@@ -218,7 +213,15 @@ void readRegisterInfo(const char* token, DescriptorType* type,
       rawList->ClearDepthStencilView(
           dscr->getCpuHandle(), D3D12_CLEAR_FLAG_DEPTH, 1.0f, 0x00, 0, nullptr);
      }
-     rawList->ResourceBarrier(endBarriers.size(), endBarriers.data());
+     for (size_t i = 0; i < rtvs.size(); ++i) {
+      rtvs[i]->getResource()->changeResourceState(&endBarriers, prevStates[i]);
+     }
+     for (size_t i = 0; i < dsvs.size(); ++i) {
+      dsvs[i]->getResource()->changeResourceState(
+          &endBarriers, prevStates[rtvs.size() + i]);
+     }
+     if (!endBarriers.empty())
+      rawList->ResourceBarrier(UINT(endBarriers.size()), endBarriers.data());
    }
    cmdList.end(&cmdqueue);
  }
@@ -239,61 +242,319 @@ UINT64 CommandQueue::excuteCommandList(ID3D12CommandList* rawList) {
   cmdQueue->ExecuteCommandLists(1, &rawList);
   ++fenceValue;
   cmdQueue->Signal(fence, fenceValue); // Signal : Function to be notified when the fence value reaches the desired value
+  collect();
+  return fenceValue;
+}
+
+UINT64 CommandQueue::excuteCommandLists(
+    const std::vector<ID3D12CommandList*>& rawLists) {
+  if (!rawLists.empty())
+    cmdQueue->ExecuteCommandLists(UINT(rawLists.size()), rawLists.data());
+  ++fenceValue;
+  cmdQueue->Signal(fence, fenceValue);
+  collect();
   return fenceValue;
 }
 
 CommandQueue::~CommandQueue() {
+  // deferred work still holds GPU objects
+  if (timeline.pendingCount() > 0) {
+    waitCompletion();
+    collect();
+  }
   SAFE_RELEASE(cmdQueue);
   SAFE_RELEASE(fence);
 }
 
 void CommandQueue::waitCompletion(UINT64 targetValue, HANDLE handle) {
+  assert(targetValue <= fenceValue);  // never submitted, would never return
   //fence->GetCompletedValue() // return fence value
   ThrowFailedHR(fence->SetEventOnCompletion( // Call a handle event when the fence value reaches a specific value
       targetValue ? targetValue : fenceValue, handle)); // If the handle is null, it is not returned until conditional
+  if (!handle) collect();
 }
 
 void CommandQueue::signalForSafety() { cmdQueue->Signal(fence, 1000); }
 
-CommandList::CommandList(D3D12_COMMAND_LIST_TYPE type) {
+void CommandQueue::onCompletion(UINT64 targetValue,
+                                FenceTimeline::Callback func) {
+  timeline.onCompletion(targetValue ? targetValue : fenceValue,
+                        std::move(func));
+}
+
+void CommandQueue::deferRelease(IUnknown* object, UINT64 lastUse) {
+  if (!object) return;
+  onCompletion(lastUse, [object] { object->Release(); });
+}
+
+void CommandQueue::wait(CommandQueue* producer, UINT64 value) {
+  assert(producer != this);
+  if (!value) value = producer->fenceValue;
+  if (producer->isCompleted(value)) return;
+  ThrowFailedHR(cmdQueue->Wait(producer->fence, value));
+}
+
+void CommandQueue::waitFor(const dxResource& rsc) {
+  if (rsc.getCopyQueue() && rsc.getCopyQueue() != this)
+    wait(rsc.getCopyQueue(), rsc.getCopyFenceValue());
+}
+
+// copy queues only know the COMMON and copy states : resources stay in COMMON,
+// get promoted to COPY_DEST by the copy and decay back once it is done
+static bool isCopyQueue(CommandQueue* queue) {
+  return queue && queue->getType() == D3D12_COMMAND_LIST_TYPE_COPY;
+}
+
+bool CommandState::setPipelineState(ID3D12GraphicsCommandList* cmdList,
+                                    ID3D12PipelineState* pso) {
+  bool issue = pipeline != pso;
+  count(issue);
+  if (!issue) return false;
+  cmdList->SetPipelineState(pso);
+  pipeline = pso;
+  return true;
+}
+
+bool CommandState::setDescriptorHeap(ID3D12GraphicsCommandList* cmdList,
+                                     ID3D12DescriptorHeap* descriptorHeap) {
+  bool issue = heap != descriptorHeap;
+  count(issue);
+  if (!issue) return false;
+  cmdList->SetDescriptorHeaps(1, &descriptorHeap);
+  heap = descriptorHeap;
+  // the tables of the bound signatures point into the old heap
+  graphicsRootSig = nullptr;
+  computeRootSig = nullptr;
+  return true;
+}
+
+bool CommandState::setRootSignature(ID3D12GraphicsCommandList* cmdList,
+                                    const RootSignature* rootSig,
+                                    bool compute) {
+  const RootSignature*& bound = compute ? computeRootSig : graphicsRootSig;
+  bool issue = bound != rootSig;
+  count(issue);
+  if (!issue) return false;
+  if (compute)
+    cmdList->SetComputeRootSignature(rootSig->get());
+  else
+    cmdList->SetGraphicsRootSignature(rootSig->get());
+  bound = rootSig;
+  return true;
+}
+
+bool CommandState::setRenderTargets(
+    ID3D12GraphicsCommandList* cmdList, UINT numTargets,
+    const D3D12_CPU_DESCRIPTOR_HANDLE* rtvHandles,
+    const D3D12_CPU_DESCRIPTOR_HANDLE* dsvHandle) {
+  assert(numTargets <= D3D12_SIMULTANEOUS_RENDER_TARGET_COUNT);
+  bool issue = !targetsValid || numRts != numTargets ||
+               dsv.ptr != (dsvHandle ? dsvHandle->ptr : 0);
+  for (UINT i = 0; i < numTargets && !issue; ++i)
+    issue = rtvs[i].ptr != rtvHandles[i].ptr;
+  count(issue);
+  if (!issue) return false;
+  cmdList->OMSetRenderTargets(numTargets, rtvHandles, FALSE, dsvHandle);
+  numRts = numTargets;
+  for (UINT i = 0; i < numTargets; ++i) rtvs[i] = rtvHandles[i];
+  dsv.ptr = dsvHandle ? dsvHandle->ptr : 0;
+  targetsValid = true;
+  return true;
+}
+
+bool CommandState::setViewport(ID3D12GraphicsCommandList* cmdList,
+                               const D3D12_VIEWPORT& vp) {
+  bool issue = !viewportValid || memcmp(&viewport, &vp, sizeof(vp)) != 0;
+  count(issue);
+  if (!issue) return false;
+  cmdList->RSSetViewports(1, &vp);
+  viewport = vp;
+  viewportValid = true;
+  return true;
+}
+
+bool CommandState::setScissorRect(ID3D12GraphicsCommandList* cmdList,
+                                  const D3D12_RECT& rect) {
+  bool issue = !scissorValid || memcmp(&scissorRect, &rect, sizeof(rect)) != 0;
+  count(issue);
+  if (!issue) return false;
+  cmdList->RSSetScissorRects(1, &rect);
+  scissorRect = rect;
+  scissorValid = true;
+  return true;
+}
+
+static thread_local ResourceStateTracker* currentTracker = nullptr;
+
+ResourceStateTracker* ResourceStateTracker::getCurrent() {
+  return currentTracker;
+}
+
+void ResourceStateTracker::setCurrent(ResourceStateTracker* tracker) {
+  currentTracker = tracker;
+}
+
+void ResourceStateTracker::resolve(
+    std::vector<D3D12_RESOURCE_BARRIER>* barriers) {
+  auto toResource = [](StateTracker::Resource resource) {
+    return static_cast<const dxResource*>(resource);
+  };
+  resolved.clear();
+  tracker.resolve(
+      [&](StateTracker::Resource resource) {
+        return StateTracker::State(toResource(resource)->resourceState);
+      },
+      [&](StateTracker::Resource resource, StateTracker::State state) {
+        toResource(resource)->resourceState = D3D12_RESOURCE_STATES(state);
+      },
+      &resolved);
+  for (const StateTracker::Barrier& barrier : resolved) {
+    ID3D12Resource* rsc = toResource(barrier.resource)->get();
+    if (barrier.aliasing) {
+      D3D12_RESOURCE_BARRIER aliasing = {};
+      aliasing.Type = D3D12_RESOURCE_BARRIER_TYPE_ALIASING;
+      aliasing.Aliasing.pResourceAfter = rsc;
+      barriers->push_back(aliasing);
+    } else {
+      barriers->push_back(
+          Transition(rsc, D3D12_RESOURCE_STATES(barrier.before),
+                     D3D12_RESOURCE_STATES(barrier.after)));
+    }
+  }
+}
+
+CommandList::CommandList(D3D12_COMMAND_LIST_TYPE type, UINT numAllocators) {
+  assert(numAllocators > 0);
   this->type = type;
-  ThrowFailedHR(getDevice()->get()->CreateCommandAllocator(
-      type, IID_PPV_ARGS(&cmdAllocator)));
+  allocators.resize(numAllocators);
+  allocatorFences.resize(numAllocators, 0);
+  for (ID3D12CommandAllocator*& allocator : allocators) {
+    ThrowFailedHR(getDevice()->get()->CreateCommandAllocator(
+        type, IID_PPV_ARGS(&allocator)));
+  }
+  cmdAllocator = allocators[0];
   ThrowFailedHR(getDevice()->get()->CreateCommandList(
       0, type, cmdAllocator, nullptr, IID_PPV_ARGS(&cmdList)));
   ThrowFailedHR(cmdList->Close());
 }
 
-void CommandList::reset() { ThrowFailedHR(cmdAllocator->Reset()); }
+void CommandList::reset() {
+  ThrowFailedHR(cmdAllocator->Reset());
+  allocatorFences[allocatorIdx] = 0;
+}
 
 ID3D12GraphicsCommandList* CommandList::begin() {
+  if (frameQueue && recording) return cmdList;
   ThrowFailedHR(cmdList->Reset(cmdAllocator, nullptr));
+  state.invalidate();
+  recording = true;
   return cmdList;
 }
 
 UINT64 CommandList::end(CommandQueue* queue, bool waitFinish) {
+  if (frameQueue) {
+    assert(queue == frameQueue);
+    if (!waitFinish) return queue->getNextFenceValue();
+    // the caller needs the result now : sync point
+    UINT64 fenceValue = split();
+    queue->waitCompletion(fenceValue);
+    return fenceValue;
+  }
+
   ThrowFailedHR(cmdList->Close());
+  recording = false;
 
   UINT64 fenceValue = queue->excuteCommandList(cmdList);
+  allocatorFences[allocatorIdx] = fenceValue;
 
   if (waitFinish) queue->waitCompletion(fenceValue);
 
   return fenceValue;
 }
 
+void CommandList::beginFrame(CommandQueue* queue) {
+  assert(!frameQueue && !recording);
+  frameQueue = queue;
+
+  allocatorIdx = (allocatorIdx + 1) % UINT(allocators.size());
+  cmdAllocator = allocators[allocatorIdx];
+  UINT64 lastUse = allocatorFences[allocatorIdx];
+  if (lastUse == 0) return;
+  if (!queue->isCompleted(lastUse)) queue->waitCompletion(lastUse);
+  ThrowFailedHR(cmdAllocator->Reset());
+  allocatorFences[allocatorIdx] = 0;
+}
+
+UINT64 CommandList::split() {
+  assert(frameQueue);
+  // lists recorded on workers are submitted together, in order
+  assert(!ResourceStateTracker::getCurrent());
+  if (!recording) return frameQueue->getNextFenceValue() - 1;
+
+  // the allocator keeps the recorded commands alive, the list itself can be
+  // reset as soon as it is submitted
+  ThrowFailedHR(cmdList->Close());
+  recording = false;
+  allocatorFences[allocatorIdx] = frameQueue->excuteCommandList(cmdList);
+  return allocatorFences[allocatorIdx];
+}
+
+UINT64 CommandList::endFrame() {
+  UINT64 fenceValue = split();
+  frameQueue = nullptr;
+  return fenceValue;
+}
+
+ID3D12CommandList* CommandList::closeFrame() {
+  assert(frameQueue);
+  if (!recording) return nullptr;
+  ThrowFailedHR(cmdList->Close());
+  recording = false;
+  return cmdList;
+}
+
+void CommandList::endFrame(UINT64 fenceValue) {
+  assert(frameQueue && !recording);
+  allocatorFences[allocatorIdx] = fenceValue;
+  frameQueue = nullptr;
+}
+
 CommandList::~CommandList() {
-  SAFE_RELEASE(cmdAllocator);
+  for (ID3D12CommandAllocator*& allocator : allocators) {
+    SAFE_RELEASE(allocator);
+  }
+  cmdAllocator = nullptr;
   SAFE_RELEASE(cmdList);
 }
 
 D3D12_RESOURCE_STATES dxResource::changeResourceState(
     ID3D12GraphicsCommandList* cmdList, D3D12_RESOURCE_STATES newState) const {
+  D3D12_RESOURCE_STATES prevState = resourceState;
+  if (ResourceStateTracker* tracker = ResourceStateTracker::getCurrent())
+    prevState = tracker->change(this, newState);
+  else
+    resourceState = newState;
+  if (prevState == newState) return prevState;
+
+  auto tras = Transition(resource, prevState, newState);
+  cmdList->ResourceBarrier(1, &tras);
+  return prevState;
+}
+
+D3D12_RESOURCE_STATES dxResource::changeResourceState(
+    std::vector<D3D12_RESOURCE_BARRIER>* batch,
+    D3D12_RESOURCE_STATES newState) const {
+  if (ResourceStateTracker* tracker = ResourceStateTracker::getCurrent()) {
+    D3D12_RESOURCE_STATES prevState = tracker->change(this, newState);
+    if (prevState != newState)
+      batch->push_back(Transition(resource, prevState, newState));
+    return prevState;
+  }
   if (resourceState == newState) return resourceState;
 
   D3D12_RESOURCE_STATES prevState = resourceState;
   resourceState = newState;
-  auto tras = Transition(resource, prevState, newState);
-  cmdList->ResourceBarrier(1, &tras);
+  batch->push_back(Transition(resource, prevState, newState));
   return prevState;
 }
 
@@ -303,7 +564,7 @@ void DxBuffer::create(UINT64 bufferSize, D3D12_HEAP_TYPE heapType,
   if (resource != nullptr)
     Error("destroy() must be called before re-creating.");
   resourceState = rscState;
-  resource = createCommittedBuffer(bufferSize, heapType, rscFlag, rscState);
+  resource = createBuffer(bufferSize, heapType, rscFlag, rscState, category);
   gpuAddress = resource->GetGPUVirtualAddress();
   this->bufferSize = bufferSize;
 }
@@ -316,9 +577,9 @@ void* DxBuffer::map() {
       resource->Map(0, &range, &cpuAddress);
     } else {
       assert(!uploader);
-      uploader = createCommittedBuffer(getBufferSize(), D3D12_HEAP_TYPE_UPLOAD,
-                                       D3D12_RESOURCE_FLAG_NONE,
-                                       D3D12_RESOURCE_STATE_GENERIC_READ);
+      uploader = createBuffer(getBufferSize(), D3D12_HEAP_TYPE_UPLOAD,
+                              D3D12_RESOURCE_FLAG_NONE,
+                              D3D12_RESOURCE_STATE_GENERIC_READ);
       uploader->Map(0, &range, &cpuAddress);
     }
   }
@@ -333,8 +594,12 @@ void DxBuffer::unmap(CommandQueue* cmdQueue, CommandList* cmdList) {
   } else {
     uploader->Unmap(0, nullptr);
 
+    assert(cmdList->getType() == cmdQueue->getType());
     auto* rawList = cmdList->begin();
-    {
+    if (isCopyQueue(cmdQueue)) {
+      assert(resourceState == D3D12_RESOURCE_STATE_COMMON);
+      rawList->CopyBufferRegion(resource, 0, uploader, 0, getBufferSize());
+    } else {
       D3D12_RESOURCE_STATES prevState =
           changeResourceState(rawList, D3D12_RESOURCE_STATE_COPY_DEST);
       rawList->CopyBufferRegion(resource, 0, uploader, 0, getBufferSize());
@@ -342,17 +607,98 @@ void DxBuffer::unmap(CommandQueue* cmdQueue, CommandList* cmdList) {
     }
     UINT64 fenceValue = cmdList->end(cmdQueue);
 
-    cmdQueue->waitCompletion(fenceValue);
-    uploader->Release();
+    cmdQueue->deferRelease(uploader, fenceValue);
     uploader = nullptr;
+    copyQueue = cmdQueue;
+    copyFenceValue = fenceValue;
   }
   cpuAddress = nullptr;
 }
 
-ID3D12Resource* createCommittedBuffer(UINT64 bufferSize,
-                                      D3D12_HEAP_TYPE heapType,
-                                      D3D12_RESOURCE_FLAGS resourceFlags,
-                                      D3D12_RESOURCE_STATES resourceStates) {
+const char* formatName(DXGI_FORMAT format) {
+  switch (format) {
+    case DXGI_FORMAT_R8G8B8A8_UNORM:
+      return "R8G8B8A8_UNORM";
+    case DXGI_FORMAT_R8G8B8A8_UNORM_SRGB:
+      return "R8G8B8A8_UNORM_SRGB";
+    case DXGI_FORMAT_R16G16_SNORM:
+      return "R16G16_SNORM";
+    case DXGI_FORMAT_R16G16B16A16_UNORM:
+      return "R16G16B16A16_UNORM";
+    case DXGI_FORMAT_R32_UINT:
+      return "R32_UINT";
+    case DXGI_FORMAT_R32_FLOAT:
+      return "R32_FLOAT";
+    case DXGI_FORMAT_R32G32_FLOAT:
+      return "R32G32_FLOAT";
+    case DXGI_FORMAT_R32G32B32_FLOAT:
+      return "R32G32B32_FLOAT";
+    case DXGI_FORMAT_R32G32B32A32_UINT:
+      return "R32G32B32A32_UINT";
+    case DXGI_FORMAT_R32G32B32A32_FLOAT:
+      return "R32G32B32A32_FLOAT";
+    case DXGI_FORMAT_D32_FLOAT:
+      return "D32_FLOAT";
+    case DXGI_FORMAT_UNKNOWN:
+      return "unknown";
+    default:
+      return "other";
+  }
+}
+
+// {3e8a41d7-95c2-4f0b-8d6e-1a7c52b9e043}
+static const GUID memoryRecordGuid = {
+    0x3e8a41d7, 0x95c2, 0x4f0b, {0x8d, 0x6e, 0x1a, 0x7c, 0x52, 0xb9, 0xe0, 0x43}};
+
+void trackMemory(ID3D12Object* object, std::string name, std::string format,
+                 MemoryCategory category, UINT64 size,
+                 const std::source_location& creator) {
+  MemoryRegistry::Id id = getMemoryRegistry()->add(
+      std::move(name), std::move(format), category, size,
+      std::string(creator.function_name()) + ":" +
+          std::to_string(creator.line()));
+  onRelease(object, memoryRecordGuid,
+            [id] { getMemoryRegistry()->release(id); });
+}
+
+// names the resource and tracks the memory it takes
+static void trackResource(ID3D12Resource* resource, std::string name,
+                          MemoryCategory category,
+                          const std::source_location& creator) {
+  resource->SetName(std::wstring(name.begin(), name.end()).c_str());
+  D3D12_RESOURCE_DESC desc = resource->GetDesc();
+  UINT64 size =
+      getDevice()->get()->GetResourceAllocationInfo(0, 1, &desc).SizeInBytes;
+  const char* format = desc.Dimension == D3D12_RESOURCE_DIMENSION_BUFFER
+                           ? "buffer"
+                           : formatName(desc.Format);
+  trackMemory(resource, std::move(name), format, category, size, creator);
+}
+
+static MemoryCategory bufferCategory(D3D12_HEAP_TYPE heapType,
+                                     std::optional<MemoryCategory> category) {
+  if (category) return *category;
+  switch (heapType) {
+    case D3D12_HEAP_TYPE_UPLOAD:
+      return MemoryCategory::staging;
+    case D3D12_HEAP_TYPE_READBACK:
+      return MemoryCategory::readback;
+    default:
+      return MemoryCategory::mesh;
+  }
+}
+
+static MemoryCategory textureCategory(D3D12_RESOURCE_FLAGS resourceFlags) {
+  const D3D12_RESOURCE_FLAGS targetFlags =
+      D3D12_RESOURCE_FLAG_ALLOW_RENDER_TARGET |
+      D3D12_RESOURCE_FLAG_ALLOW_DEPTH_STENCIL |
+      D3D12_RESOURCE_FLAG_ALLOW_UNORDERED_ACCESS;
+  return (resourceFlags & targetFlags) ? MemoryCategory::renderTarget
+                                       : MemoryCategory::texture;
+}
+
+static D3D12_RESOURCE_DESC bufferDesc(UINT64 bufferSize,
+                                      D3D12_RESOURCE_FLAGS resourceFlags) {
   D3D12_RESOURCE_DESC desc = {};
   desc.Dimension = D3D12_RESOURCE_DIMENSION_BUFFER;
   desc.Layout = D3D12_TEXTURE_LAYOUT_ROW_MAJOR;
@@ -363,6 +709,35 @@ ID3D12Resource* createCommittedBuffer(UINT64 bufferSize,
   desc.MipLevels = 1;
   desc.SampleDesc.Count = 1;
   desc.Flags = resourceFlags;
+  return desc;
+}
+
+ID3D12Resource* createBuffer(UINT64 bufferSize, D3D12_HEAP_TYPE heapType,
+                             D3D12_RESOURCE_FLAGS resourceFlags,
+                             D3D12_RESOURCE_STATES resourceStates,
+                             std::optional<MemoryCategory> category,
+                             const std::source_location& creator) {
+  GpuMemory::Category heapCategory =
+      heapType == D3D12_HEAP_TYPE_UPLOAD     ? GpuMemory::uploadBuffer
+      : heapType == D3D12_HEAP_TYPE_READBACK ? GpuMemory::readbackBuffer
+                                             : GpuMemory::defaultBuffer;
+  ID3D12Resource* resource = getGpuMemory()->createResource(
+      heapCategory, bufferDesc(bufferSize, resourceFlags), resourceStates);
+
+  static UINT i = 0;
+  trackResource(resource, "buffer" + std::to_string(i++),
+                bufferCategory(heapType, category), creator);
+
+  return resource;
+}
+
+ID3D12Resource* createCommittedBuffer(UINT64 bufferSize,
+                                      D3D12_HEAP_TYPE heapType,
+                                      D3D12_RESOURCE_FLAGS resourceFlags,
+                                      D3D12_RESOURCE_STATES resourceStates,
+                                      std::optional<MemoryCategory> category,
+                                      const std::source_location& creator) {
+  D3D12_RESOURCE_DESC desc = bufferDesc(bufferSize, resourceFlags);
 
   D3D12_HEAP_PROPERTIES prop = {};
   prop.Type = heapType;
@@ -373,64 +748,169 @@ ID3D12Resource* createCommittedBuffer(UINT64 bufferSize,
       IID_PPV_ARGS(&resource)));
 
   static UINT i = 0;
-  resource->SetName((std::wstring(L"buffer") + std::to_wstring(i++)).c_str());
+  trackResource(resource, "committed buffer" + std::to_string(i++),
+                bufferCategory(heapType, category), creator);
 
   return resource;
 }
 
-DescriptorHeap::DescriptorHeap(UINT maxDescriptors,
-                               D3D12_DESCRIPTOR_HEAP_TYPE heapType)
-    : type(heapType) {
-  if (heap != nullptr) Error("destroy() must be called before re-creating.");
+DescriptorHeap::DescriptorHeap(UINT pageSize,
+                               D3D12_DESCRIPTOR_HEAP_TYPE heapType,
+                               bool shaderVisible, UINT ringSize)
+    : type(heapType),
+      shaderVisible(shaderVisible),
+      descriptorSize(
+          getDevice()->get()->GetDescriptorHandleIncrementSize(heapType)),
+      pool(pageSize > 0 ? pageSize : 1, descriptorSize,
+           shaderVisible ? 1 : UINT32_MAX),
+      ring(ringSize > 0 ? ringSize : 1, descriptorSize),
+      pageSize(pageSize > 0 ? pageSize : 1),
+      ringSize(ringSize) {
+  assert(!shaderVisible || type == D3D12_DESCRIPTOR_HEAP_TYPE_CBV_SRV_UAV ||
+         type == D3D12_DESCRIPTOR_HEAP_TYPE_SAMPLER);
+  assert(shaderVisible || ringSize == 0);
+  addPage();
+}
+
+void DescriptorHeap::addPage() {
+  auto page = std::make_unique<Page>();
 
   D3D12_DESCRIPTOR_HEAP_DESC heapDesc = {};
   {
     heapDesc.Type = type;
-    heapDesc.NumDescriptors = maxDescriptors > 0 ? maxDescriptors : 1;
-    heapDesc.Flags = (type == D3D12_DESCRIPTOR_HEAP_TYPE_CBV_SRV_UAV)
-                         ? D3D12_DESCRIPTOR_HEAP_FLAG_SHADER_VISIBLE
-                         : D3D12_DESCRIPTOR_HEAP_FLAG_NONE;
+    // the ring follows the first page
+    heapDesc.NumDescriptors = pageSize + (pages.empty() ? ringSize : 0);
+    heapDesc.Flags = shaderVisible ? D3D12_DESCRIPTOR_HEAP_FLAG_SHADER_VISIBLE
+                                   : D3D12_DESCRIPTOR_HEAP_FLAG_NONE;
   }
-  getDevice()->get()->CreateDescriptorHeap(&heapDesc, IID_PPV_ARGS(&heap));
+  ThrowFailedHR(getDevice()->get()->CreateDescriptorHeap(
+      &heapDesc, IID_PPV_ARGS(&page->heap)));
 
   D3D12_CPU_DESCRIPTOR_HANDLE cpuAddr =
-      heap->GetCPUDescriptorHandleForHeapStart();
-  D3D12_GPU_DESCRIPTOR_HANDLE gpuAddr =
-      heap->GetGPUDescriptorHandleForHeapStart();
-  UINT descriptorSize =
-      getDevice()->get()->GetDescriptorHandleIncrementSize(type);
+      page->heap->GetCPUDescriptorHandleForHeapStart();
+  // no gpu address outside of shader visible heaps
+  D3D12_GPU_DESCRIPTOR_HANDLE gpuAddr = {};
+  if (shaderVisible) gpuAddr = page->heap->GetGPUDescriptorHandleForHeapStart();
 
-  descriptorArr.reserve(maxDescriptors);
+  page->descriptorArr.reserve(pageSize);
 
-  for (UINT i = 0; i < maxDescriptors; ++i) {
-    descriptorArr.push_back(Descriptor(cpuAddr, gpuAddr));
+  for (UINT i = 0; i < pageSize; ++i) {
+    page->descriptorArr.push_back(Descriptor(cpuAddr, gpuAddr));
     cpuAddr.ptr = cpuAddr.ptr + descriptorSize;
-    gpuAddr.ptr = gpuAddr.ptr + descriptorSize;
+    if (shaderVisible) gpuAddr.ptr = gpuAddr.ptr + descriptorSize;
+  }
+  pages.push_back(std::move(page));
+}
+
+const Descriptor* DescriptorHeap::allocate() {
+  DescriptorPool::Slot slot = pool.allocate();
+  if (!slot.valid()) Error("descriptor heap is full");
+  if (slot.page == pages.size()) addPage();
+  return &pages[slot.page]->descriptorArr[slot.index];
+}
+
+void DescriptorHeap::release(const Descriptor* descriptor) {
+  for (UINT p = 0; p < pages.size(); ++p) {
+    const std::vector<Descriptor>& arr = pages[p]->descriptorArr;
+    if (descriptor < arr.data() || descriptor >= arr.data() + arr.size())
+      continue;
+    descriptor->resource = nullptr;
+    pool.free({p, UINT(descriptor - arr.data())});
+    return;
+  }
+  assert(false);  // not from this heap
+}
+
+const Descriptor* DescriptorHeap::copy(const Descriptor& src) {
+  const Descriptor* descriptor = allocate();
+  copy(descriptor, src);
+  return descriptor;
+}
+
+void DescriptorHeap::copy(const Descriptor* dst, const Descriptor& src) const {
+  getDevice()->get()->CopyDescriptorsSimple(1, dst->getCpuHandle(),
+                                            src.getCpuHandle(), type);
+  dst->resource = src.resource;
+}
+
+BindlessTable::~BindlessTable() {
+  for (const Descriptor* entry : entries) {
+    if (entry) heap->release(entry);
   }
 }
 
+UINT BindlessTable::add(const Descriptor& view) {
+  const Descriptor* entry = heap->copy(view);
+  UINT id = heap->getIndex(entry);
+  if (id >= entries.size()) entries.resize(id + 1, nullptr);
+  entries[id] = entry;
+  return id;
+}
+
+void BindlessTable::update(UINT id, const Descriptor& view) {
+  assert(id < entries.size() && entries[id]);
+  heap->copy(entries[id], view);
+}
+
+void BindlessTable::remove(UINT id) {
+  assert(id < entries.size() && entries[id]);
+  heap->release(entries[id]);
+  entries[id] = nullptr;
+}
+
+D3D12_GPU_DESCRIPTOR_HANDLE DescriptorHeap::stage(
+    const D3D12_CPU_DESCRIPTOR_HANDLE* srcStarts, const UINT* srcSizes,
+    UINT numRanges) {
+  assert(shaderVisible);
+  UINT count = 0;
+  for (UINT i = 0; i < numRanges; ++i) count += srcSizes[i];
+
+  UINT index;
+  {
+    std::lock_guard<std::mutex> lock(ringMutex);
+    index = ring.allocate(count);
+  }
+  if (index == DescriptorRing::invalid) Error("descriptor ring is full");
+
+  UINT64 offset = UINT64(pageSize) * descriptorSize + ring.getOffset(index);
+  D3D12_CPU_DESCRIPTOR_HANDLE dstStart =
+      pages[0]->heap->GetCPUDescriptorHandleForHeapStart();
+  D3D12_GPU_DESCRIPTOR_HANDLE gpuStart =
+      pages[0]->heap->GetGPUDescriptorHandleForHeapStart();
+  dstStart.ptr += SIZE_T(offset);
+  gpuStart.ptr += offset;
+
+  getDevice()->get()->CopyDescriptors(1, &dstStart, &count, numRanges,
+                                      srcStarts, srcSizes, type);
+  return gpuStart;
+}
+
 DescriptorHeap::~DescriptorHeap() {
-  SAFE_RELEASE(heap);
-  descriptorArr.clear();
+  for (std::unique_ptr<Page>& page : pages) {
+    SAFE_RELEASE(page->heap);
+  }
+  pages.clear();
 }
 
-void DescriptorHeap::bind(ID3D12GraphicsCommandList* cmdList) const {
-  cmdList->SetDescriptorHeaps(1, &heap);
+bool DescriptorHeap::bind(ID3D12GraphicsCommandList* cmdList,
+                          CommandState* state) const {
+  assert(shaderVisible);
+  return state->setDescriptorHeap(cmdList, pages[0]->heap);
 }
 
 void Texture::allocateResource() {
   D3D12_RESOURCE_FLAGS flag = D3D12_RESOURCE_FLAG_NONE;
-  D3D12_RESOURCE_STATES state = D3D12_RESOURCE_STATE_PIXEL_SHADER_RESOURCE;
-  resource = createCommittedTexture(format, width, height, depth, flag, state,
-                                    nullptr);
+  // read by the graphics queue through implicit promotion
+  D3D12_RESOURCE_STATES state = isCopyQueue(cmdQueue)
+                                    ? D3D12_RESOURCE_STATE_COMMON
+                                    : D3D12_RESOURCE_STATE_PIXEL_SHADER_RESOURCE;
+  resource = createTexture(format, width, height, depth, flag, state, nullptr);
   resourceState = state;
 }
 
-ID3D12Resource* createCommittedTexture(DXGI_FORMAT format, UINT width,
+static D3D12_RESOURCE_DESC textureDesc(DXGI_FORMAT format, UINT width,
                                        UINT height, UINT depth,
-                                       D3D12_RESOURCE_FLAGS resourceFlags,
-                                       D3D12_RESOURCE_STATES resourceStates,
-                                       D3D12_CLEAR_VALUE* pOptClearValue) {
+                                       D3D12_RESOURCE_FLAGS resourceFlags) {
   D3D12_RESOURCE_DESC desc = {};
   desc.Dimension = D3D12_RESOURCE_DIMENSION_TEXTURE2D;
   desc.Layout = D3D12_TEXTURE_LAYOUT_UNKNOWN;
@@ -442,6 +922,43 @@ ID3D12Resource* createCommittedTexture(DXGI_FORMAT format, UINT width,
   desc.SampleDesc.Count = 1;
   desc.SampleDesc.Quality = 0;
   desc.Flags = resourceFlags;
+  return desc;
+}
+
+ID3D12Resource* createTexture(DXGI_FORMAT format, UINT width, UINT height,
+                              UINT depth, D3D12_RESOURCE_FLAGS resourceFlags,
+                              D3D12_RESOURCE_STATES resourceStates,
+                              D3D12_CLEAR_VALUE* pOptClearValue,
+                              const std::source_location& creator) {
+  // a placed target has to be cleared or discarded before its first use,
+  // targets are few and stay committed
+  const D3D12_RESOURCE_FLAGS targetFlags =
+      D3D12_RESOURCE_FLAG_ALLOW_RENDER_TARGET |
+      D3D12_RESOURCE_FLAG_ALLOW_DEPTH_STENCIL;
+  if (resourceFlags & targetFlags)
+    return createCommittedTexture(format, width, height, depth, resourceFlags,
+                                  resourceStates, pOptClearValue, creator);
+
+  ID3D12Resource* resource = getGpuMemory()->createResource(
+      GpuMemory::texture,
+      textureDesc(format, width, height, depth, resourceFlags),
+      resourceStates, pOptClearValue);
+
+  static UINT i = 0;
+  trackResource(resource, "texture" + std::to_string(i++),
+                textureCategory(resourceFlags), creator);
+
+  return resource;
+}
+
+ID3D12Resource* createCommittedTexture(DXGI_FORMAT format, UINT width,
+                                       UINT height, UINT depth,
+                                       D3D12_RESOURCE_FLAGS resourceFlags,
+                                       D3D12_RESOURCE_STATES resourceStates,
+                                       D3D12_CLEAR_VALUE* pOptClearValue,
+                                       const std::source_location& creator) {
+  D3D12_RESOURCE_DESC desc =
+      textureDesc(format, width, height, depth, resourceFlags);
 
   D3D12_HEAP_PROPERTIES prop = {};
   prop.Type = D3D12_HEAP_TYPE_DEFAULT;
@@ -452,11 +969,41 @@ ID3D12Resource* createCommittedTexture(DXGI_FORMAT format, UINT width,
       IID_PPV_ARGS(&resource)));
 
   static UINT i = 0;
-  resource->SetName((std::wstring(L"texture") + std::to_wstring(i++)).c_str());
+  trackResource(resource, "committed texture" + std::to_string(i++),
+                textureCategory(resourceFlags), creator);
+
+  return resource;
+}
+
+ID3D12Resource* createPlacedTexture(ID3D12Heap* heap, UINT64 heapOffset,
+                                    DXGI_FORMAT format, UINT width,
+                                    UINT height, UINT depth,
+                                    D3D12_RESOURCE_FLAGS resourceFlags,
+                                    D3D12_RESOURCE_STATES resourceStates,
+                                    D3D12_CLEAR_VALUE* pOptClearValue) {
+  D3D12_RESOURCE_DESC desc =
+      textureDesc(format, width, height, depth, resourceFlags);
+
+  ID3D12Resource* resource;
+  ThrowFailedHR(getDevice()->get()->CreatePlacedResource(
+      heap, heapOffset, &desc, resourceStates, pOptClearValue,
+      IID_PPV_ARGS(&resource)));
+
+  static UINT i = 0;
+  resource->SetName(
+      (std::wstring(L"placed texture") + std::to_wstring(i++)).c_str());
 
   return resource;
 }
 
+D3D12_RESOURCE_ALLOCATION_INFO getTextureAllocationInfo(
+    DXGI_FORMAT format, UINT width, UINT height, UINT depth,
+    D3D12_RESOURCE_FLAGS resourceFlags) {
+  D3D12_RESOURCE_DESC desc =
+      textureDesc(format, width, height, depth, resourceFlags);
+  return getDevice()->get()->GetResourceAllocationInfo(0, 1, &desc);
+}
+
 void Texture::allocateDescriptor() {
   if (srv) {
     srv->assignSrv(*this);
@@ -489,6 +1036,29 @@ void Texture::resize(UINT newWidth, UINT newHeight, UINT newDepth) {
   allocateDescriptor();
 }
 
+void Texture::copyFromUploader(ID3D12Resource* uploader,
+                               const D3D12_TEXTURE_COPY_LOCATION& dst,
+                               const D3D12_TEXTURE_COPY_LOCATION& src) {
+  CommandList* cmdList = new CommandList(cmdQueue->getType());
+  auto* rawList = cmdList->begin();
+  if (isCopyQueue(cmdQueue)) {
+    assert(resourceState == D3D12_RESOURCE_STATE_COMMON);
+    rawList->CopyTextureRegion(&dst, 0, 0, 0, &src, nullptr);
+  } else {
+    D3D12_RESOURCE_STATES prevState =
+        changeResourceState(rawList, D3D12_RESOURCE_STATE_COPY_DEST);
+    rawList->CopyTextureRegion(&dst, 0, 0, 0, &src, nullptr);
+    changeResourceState(rawList, prevState);
+  }
+  UINT64 fenceValue = cmdList->end(cmdQueue);
+
+  // the staging buffer and the list go away once the copy has run
+  cmdQueue->deferRelease(uploader, fenceValue);
+  cmdQueue->onCompletion(fenceValue, [cmdList] { delete cmdList; });
+  copyQueue = cmdQueue;
+  copyFenceValue = fenceValue;
+}
+
 void Texture::loadData(UINT dataWidth, UINT dataHeight, void* data) {
   if (width < dataWidth || height < dataHeight) {
     resize(dataWidth, dataHeight);
@@ -499,7 +1069,7 @@ void Texture::loadData(UINT dataWidth, UINT dataHeight, void* data) {
       _align(_bpp(format) * width, D3D12_TEXTURE_DATA_PITCH_ALIGNMENT);
   UINT enoughSize = textureRowPitch * height;
 
-  ID3D12Resource* uploader = createCommittedBuffer(
+  ID3D12Resource* uploader = createBuffer(
       enoughSize, D3D12_HEAP_TYPE_UPLOAD, D3D12_RESOURCE_FLAG_NONE,
       D3D12_RESOURCE_STATE_GENERIC_READ);
   void* cpuAddress;
@@ -532,20 +1102,7 @@ void Texture::loadData(UINT dataWidth, UINT dataHeight, void* data) {
   srcDesc.PlacedFootprint.Footprint.Height = dataHeight;
   srcDesc.PlacedFootprint.Footprint.RowPitch = textureRowPitch;
 
-  CommandList* cmdList = new CommandList;
-  auto* rawList = cmdList->begin();
-  {
-    D3D12_RESOURCE_STATES prevState =
-        changeResourceState(rawList, D3D12_RESOURCE_STATE_COPY_DEST);
-    rawList->CopyTextureRegion(&dstDesc, 0, 0, 0, &srcDesc, nullptr);
-    changeResourceState(rawList, prevState);
-  }
-  UINT64 fenceValue = cmdList->end(cmdQueue);
-
-  cmdQueue->waitCompletion(fenceValue);
-  uploader->Release();
-  cmdList->reset();
-  delete cmdList;
+  copyFromUploader(uploader, dstDesc, srcDesc);
   // delete data;
 }
 
@@ -562,7 +1119,7 @@ void Texture::loadData(UINT dataWidth, UINT dataHeight,
 
   for (UINT i = 0; i < length; i++) {
     void* data = getData(filePath[i].c_str(), &dataWidth, &dataHeight);
-    uploader.push_back(createCommittedBuffer(
+    uploader.push_back(createBuffer(
         enoughSize, D3D12_HEAP_TYPE_UPLOAD, D3D12_RESOURCE_FLAG_NONE,
         D3D12_RESOURCE_STATE_GENERIC_READ));
     void* cpuAddress;
@@ -595,20 +1152,7 @@ void Texture::loadData(UINT dataWidth, UINT dataHeight,
     srcDesc.PlacedFootprint.Footprint.Height = height;
     srcDesc.PlacedFootprint.Footprint.RowPitch = textureRowPitch;
 
-    CommandList* cmdList = new CommandList;
-    auto* rawList = cmdList->begin();
-    {
-      D3D12_RESOURCE_STATES prevState =
-          changeResourceState(rawList, D3D12_RESOURCE_STATE_COPY_DEST);
-      rawList->CopyTextureRegion(&dstDesc, 0, 0, 0, &srcDesc, nullptr);
-      changeResourceState(rawList, prevState);
-    }
-    UINT64 fenceValue = cmdList->end(cmdQueue);
-
-    cmdQueue->waitCompletion(fenceValue);
-    uploader[i]->Release();
-    cmdList->reset();
-    delete cmdList;
+    copyFromUploader(uploader[i], dstDesc, srcDesc);
     delete[] data;
   }
 }
@@ -654,7 +1198,7 @@ Texture::Texture(DescriptorHeap* dec, CommandQueue* queue, DXGI_FORMAT format,
 
   for (UINT i = 0; i < length; i++) {
     void* data = dataList[i];
-    uploader.push_back(createCommittedBuffer(
+    uploader.push_back(createBuffer(
         enoughSize, D3D12_HEAP_TYPE_UPLOAD, D3D12_RESOURCE_FLAG_NONE,
         D3D12_RESOURCE_STATE_GENERIC_READ));
     void* cpuAddress;
@@ -687,20 +1231,7 @@ Texture::Texture(DescriptorHeap* dec, CommandQueue* queue, DXGI_FORMAT format,
     srcDesc.PlacedFootprint.Footprint.Height = height;
     srcDesc.PlacedFootprint.Footprint.RowPitch = textureRowPitch;
 
-    CommandList* cmdList = new CommandList;
-    auto* rawList = cmdList->begin();
-    {
-      D3D12_RESOURCE_STATES prevState =
-          changeResourceState(rawList, D3D12_RESOURCE_STATE_COPY_DEST);
-      rawList->CopyTextureRegion(&dstDesc, 0, 0, 0, &srcDesc, nullptr);
-      changeResourceState(rawList, prevState);
-    }
-    UINT64 fenceValue = cmdList->end(cmdQueue);
-
-    cmdQueue->waitCompletion(fenceValue);
-    uploader[i]->Release();
-    cmdList->reset();
-    delete cmdList;
+    copyFromUploader(uploader[i], dstDesc, srcDesc);
     delete[] data;
   }
 }
@@ -735,6 +1266,10 @@ void RootTable::create(const char* code) {
     // rangeArr.push_back(range);
 
     ranges.push_back(range);
+    if (numDescriptors == UINT(-1))
+      unbounded = true;
+    else
+      this->numDescriptors += numDescriptors;
 
     codePos += tokenLengthWithSpace;
   }
@@ -881,40 +1416,206 @@ void RootSignature::build(
   ThrowFailedHR(getDevice()->get()->CreateRootSignature(
       0, blob->GetBufferPointer(), blob->GetBufferSize(),
       IID_PPV_ARGS(&rootSig)));
+  hash = ContentHash()
+             .add(blob->GetBufferPointer(), blob->GetBufferSize())
+             .get();
   blob->Release();
 }
 
-void RootSignature::bindCompute(ID3D12GraphicsCommandList* cmdList,
-                                DescriptorHeap* heap) const {
-  if (includeRootTable()) heap->bind(cmdList);
-
-  cmdList->SetComputeRootSignature(rootSig);
+ID3D12CommandSignature* RootSignature::createDrawSignature(
+    StaticName constants, UINT byteStride) const {
+  UINT paramIdx = find(constants);
+  const RootConstants& param = std::get<RootConstants>(params[paramIdx]);
+
+  D3D12_INDIRECT_ARGUMENT_DESC args[2] = {};
+  args[0].Type = D3D12_INDIRECT_ARGUMENT_TYPE_CONSTANT;
+  args[0].Constant.RootParameterIndex = paramIdx;
+  args[0].Constant.DestOffsetIn32BitValues = 0;
+  args[0].Constant.Num32BitValuesToSet = param.param.Constants.Num32BitValues;
+  args[1].Type = D3D12_INDIRECT_ARGUMENT_TYPE_DRAW_INDEXED;
+
+  D3D12_COMMAND_SIGNATURE_DESC desc = {};
+  desc.ByteStride = byteStride;
+  desc.NumArgumentDescs = _countof(args);
+  desc.pArgumentDescs = args;
+
+  ID3D12CommandSignature* signature;
+  ThrowFailedHR(getDevice()->get()->CreateCommandSignature(
+      &desc, rootSig, IID_PPV_ARGS(&signature)));
+  return signature;
+}
+
+void IndirectCommandBuffer::create(UINT stride, UINT maxCommands) {
+  this->stride = stride;
+  this->maxCommands = maxCommands;
+  commands.create(UINT64(stride) * maxCommands, D3D12_HEAP_TYPE_DEFAULT,
+                  D3D12_RESOURCE_FLAG_ALLOW_UNORDERED_ACCESS,
+                  D3D12_RESOURCE_STATE_COMMON);
+  count.create(sizeof(UINT), D3D12_HEAP_TYPE_DEFAULT,
+               D3D12_RESOURCE_FLAG_ALLOW_UNORDERED_ACCESS,
+               D3D12_RESOURCE_STATE_COMMON);
+  // the source of the reset, stays mapped
+  zero.create(sizeof(UINT));
+  *static_cast<UINT*>(zero.map()) = 0;
+}
+
+void IndirectCommandBuffer::reset(ID3D12GraphicsCommandList* cmdList) {
+  count.changeResourceState(cmdList, D3D12_RESOURCE_STATE_COPY_DEST);
+  cmdList->CopyBufferRegion(count.get(), 0, zero.get(), 0, sizeof(UINT));
+  count.changeResourceState(cmdList, D3D12_RESOURCE_STATE_UNORDERED_ACCESS);
+  commands.changeResourceState(cmdList, D3D12_RESOURCE_STATE_UNORDERED_ACCESS);
+}
+
+void IndirectCommandBuffer::execute(ID3D12GraphicsCommandList* cmdList,
+                                    ID3D12CommandSignature* signature) {
+  // the transitions also wait for the compute pass
+  count.changeResourceState(cmdList, D3D12_RESOURCE_STATE_INDIRECT_ARGUMENT);
+  commands.changeResourceState(cmdList,
+                               D3D12_RESOURCE_STATE_INDIRECT_ARGUMENT);
+  cmdList->ExecuteIndirect(signature, maxCommands, commands.get(), 0,
+                           count.get(), 0);
+}
+
+void VisibleTiles::create(UINT width, UINT height, UINT numMasks) {
+  tilesX = (width + tileSize - 1) / tileSize;
+  tilesY = (height + tileSize - 1) / tileSize;
+  maskWords = (tilesX * tilesY + 31) / 32;
+  masks.create(UINT64(maskWords) * 4 * numMasks, D3D12_HEAP_TYPE_DEFAULT,
+               D3D12_RESOURCE_FLAG_ALLOW_UNORDERED_ACCESS,
+               D3D12_RESOURCE_STATE_COMMON);
+  tiles.create(UINT64(tilesX) * tilesY * 4 * numMasks,
+               D3D12_HEAP_TYPE_DEFAULT,
+               D3D12_RESOURCE_FLAG_ALLOW_UNORDERED_ACCESS,
+               D3D12_RESOURCE_STATE_COMMON);
+  args.create(sizeof(D3D12_DISPATCH_ARGUMENTS) * numMasks,
+              D3D12_HEAP_TYPE_DEFAULT,
+              D3D12_RESOURCE_FLAG_ALLOW_UNORDERED_ACCESS,
+              D3D12_RESOURCE_STATE_COMMON);
+
+  // stays mapped
+  initial.create(UINT64(maskWords) * 4 + sizeof(D3D12_DISPATCH_ARGUMENTS));
+  auto* data = static_cast<UINT*>(initial.map());
+  memset(data, 0, UINT64(maskWords) * 4);
+  D3D12_DISPATCH_ARGUMENTS noGroups = {0, 1, 1};
+  memcpy(data + maskWords, &noGroups, sizeof(noGroups));
+
+  // only the group count changes, no root signature
+  D3D12_INDIRECT_ARGUMENT_DESC arg = {};
+  arg.Type = D3D12_INDIRECT_ARGUMENT_TYPE_DISPATCH;
+  D3D12_COMMAND_SIGNATURE_DESC desc = {};
+  desc.ByteStride = sizeof(D3D12_DISPATCH_ARGUMENTS);
+  desc.NumArgumentDescs = 1;
+  desc.pArgumentDescs = &arg;
+  ThrowFailedHR(getDevice()->get()->CreateCommandSignature(
+      &desc, nullptr, IID_PPV_ARGS(&dispatchSignature)));
+}
+
+void VisibleTiles::beginCompact(ID3D12GraphicsCommandList* cmdList,
+                                UINT mask) {
+  args.changeResourceState(cmdList, D3D12_RESOURCE_STATE_COPY_DEST);
+  cmdList->CopyBufferRegion(args.get(),
+                            mask * sizeof(D3D12_DISPATCH_ARGUMENTS),
+                            initial.get(), UINT64(maskWords) * 4,
+                            sizeof(D3D12_DISPATCH_ARGUMENTS));
+  args.changeResourceState(cmdList, D3D12_RESOURCE_STATE_UNORDERED_ACCESS);
+  tiles.changeResourceState(cmdList, D3D12_RESOURCE_STATE_UNORDERED_ACCESS);
+  // the transition also waits for the draws that marked
+  masks.changeResourceState(cmdList,
+                            D3D12_RESOURCE_STATE_NON_PIXEL_SHADER_RESOURCE);
+}
+
+void VisibleTiles::endCompact(ID3D12GraphicsCommandList* cmdList, UINT mask) {
+  masks.changeResourceState(cmdList, D3D12_RESOURCE_STATE_COPY_DEST);
+  cmdList->CopyBufferRegion(masks.get(), getMaskOffset(mask), initial.get(), 0,
+                            UINT64(maskWords) * 4);
+  masks.changeResourceState(cmdList, D3D12_RESOURCE_STATE_UNORDERED_ACCESS);
+}
+
+void VisibleTiles::dispatch(ID3D12GraphicsCommandList* cmdList, UINT mask) {
+  tiles.changeResourceState(cmdList,
+                            D3D12_RESOURCE_STATE_NON_PIXEL_SHADER_RESOURCE);
+  args.changeResourceState(cmdList, D3D12_RESOURCE_STATE_INDIRECT_ARGUMENT);
+  cmdList->ExecuteIndirect(dispatchSignature, 1, args.get(),
+                           mask * sizeof(D3D12_DISPATCH_ARGUMENTS), nullptr,
+                           0);
+}
+
+void VisibleTiles::setCoverage(CommandQueue* cmdQueue, CommandList* cmdList,
+                               const std::vector<TileMask>& levels) {
+  coverageLevels = UINT(levels.size());
+  coverage.create(UINT64(maskWords) * 4 * coverageLevels);
+  auto* data = static_cast<UINT*>(coverage.map());
+  for (UINT i = 0; i < coverageLevels; ++i) {
+    // the layout of the masks, see TileMask
+    assert(levels[i].getTilesX() == tilesX && levels[i].getTilesY() == tilesY);
+    memcpy(data + UINT64(i) * maskWords, levels[i].getWords().data(),
+           UINT64(maskWords) * 4);
+  }
+  coverage.unmap(cmdQueue, cmdList);
+}
 
+void RootSignature::stageTables(DescriptorHeap* heap, uint32_t mask) const {
+  D3D12_CPU_DESCRIPTOR_HANDLE starts[32];
+  UINT sizes[32];
+  const RootTable* tables[32];
+  UINT numTables = 0;
   for (UINT i = 0; i < params.size(); ++i) {
-    std::visit([cmdList, i](auto&& arg) { arg.bindCompute(cmdList, i); },
-               params[i]);
+    const RootTable* table = std::get_if<RootTable>(&params[i]);
+    if (!table || !table->isStaged() || !(mask & (1u << i))) continue;
+    starts[numTables] = table->stagedStart;
+    sizes[numTables] = table->numDescriptors;
+    tables[numTables++] = table;
+  }
+  if (numTables == 0) return;
+
+  // one copy for all the tables, they sit next to each other in the ring
+  D3D12_GPU_DESCRIPTOR_HANDLE base = heap->stage(starts, sizes, numTables);
+  UINT64 offset = 0;
+  for (UINT i = 0; i < numTables; ++i) {
+    tables[i]->tableStart.ptr = base.ptr + offset;
+    offset += UINT64(sizes[i]) * heap->getDescriptorSize();
   }
 }
 
-void RootSignature::bindGraphics(ID3D12GraphicsCommandList* cmdList,
-                                 DescriptorHeap* heap) const {
-  if (includeRootTable()) heap->bind(cmdList);
+void RootSignature::bind(ID3D12GraphicsCommandList* cmdList,
+                         DescriptorHeap* heap, CommandState* state,
+                         bool compute) const {
+  // another list, heap or signature leaves the parameters undefined
+  bool pushAll = boundState != state;
+  if (includeRootTable()) pushAll |= heap->bind(cmdList, state);
+  pushAll |= state->setRootSignature(cmdList, this, compute);
 
-  cmdList->SetGraphicsRootSignature(rootSig);
+  uint32_t mask = pushAll ? ~0u : dirtyParams;
+  if (includeRootTable()) stageTables(heap, mask);
 
   for (UINT i = 0; i < params.size(); ++i) {
-    std::visit([cmdList, i](auto&& arg) { arg.bindGraphics(cmdList, i); },
-               params[i]);
+    bool push = (mask & (1u << i)) != 0;
+    state->count(push);
+    if (!push) continue;
+    if (compute) {
+      std::visit([cmdList, i](auto&& arg) { arg.bindCompute(cmdList, i); },
+                 params[i]);
+    } else {
+      std::visit([cmdList, i](auto&& arg) { arg.bindGraphics(cmdList, i); },
+                 params[i]);
+    }
   }
+  dirtyParams = 0;
+  boundState = state;
 }
 
 void RenderTarget::allocateResource() {
   D3D12_RESOURCE_FLAGS flag = D3D12_RESOURCE_FLAG_ALLOW_RENDER_TARGET;
+  if (unorderedAccess) flag |= D3D12_RESOURCE_FLAG_ALLOW_UNORDERED_ACCESS;
   D3D12_RESOURCE_STATES state = D3D12_RESOURCE_STATE_PIXEL_SHADER_RESOURCE;
   D3D12_CLEAR_VALUE optClear = {.Format = format,
                                 .Color = {0.f, 0.f, 0.f, 1.f}};
-  resource = createCommittedTexture(format, width, height, depth, flag, state,
-                                    &optClear);
+  if (placedHeap)
+    resource = createPlacedTexture(placedHeap, placedOffset, format, width,
+                                   height, depth, flag, state, &optClear);
+  else
+    resource = createCommittedTexture(format, width, height, depth, flag,
+                                      state, &optClear);
   resourceState = state;
 }
 
@@ -924,6 +1625,12 @@ void RenderTarget::allocateDescriptor() {
     rtv->assignRtv(*this);
   else
     rtv = rtvHeap->assignRtv(*this);
+
+  if (!unorderedAccess) return;
+  if (uav)
+    uav->assignUav(*this);
+  else
+    uav = srvHeap->assignUav(*this);
 }
 
 void RenderTarget::clear(CommandList* cmdList, float* clearValue) {
@@ -940,6 +1647,14 @@ void RenderTarget::clear(CommandList* cmdList, float* clearValue) {
   cmdList->end(cmdQueue);
 }
 
+void RenderTarget::place(ID3D12Heap* heap, UINT64 heapOffset) {
+  SAFE_RELEASE(resource);
+  placedHeap = heap;
+  placedOffset = heapOffset;
+  allocateResource();
+  allocateDescriptor();
+}
+
 RenderTarget::RenderTarget(DescriptorHeap* _srvHeap, DescriptorHeap* _rtvHeap,
                            CommandQueue* queue, DXGI_FORMAT format, UINT width,
                            UINT height)
@@ -950,6 +1665,21 @@ RenderTarget::RenderTarget(DescriptorHeap* _srvHeap, DescriptorHeap* _rtvHeap,
   allocateDescriptor();
 }
 
+RenderTarget::RenderTarget(DescriptorHeap* _srvHeap, DescriptorHeap* _rtvHeap,
+                           CommandQueue* queue, DXGI_FORMAT format, UINT width,
+                           UINT height, ID3D12Heap* heap, UINT64 heapOffset,
+                           bool unorderedAccess)
+    : Texture(_srvHeap, queue, format),
+      rtvHeap(_rtvHeap),
+      unorderedAccess(unorderedAccess),
+      placedHeap(heap),
+      placedOffset(heapOffset) {
+  this->width = width;
+  this->height = height;
+  allocateResource();
+  allocateDescriptor();
+}
+
 void DepthTarget::allocateResource() {
   D3D12_RESOURCE_FLAGS flag = D3D12_RESOURCE_FLAG_ALLOW_DEPTH_STENCIL |
                               D3D12_RESOURCE_FLAG_DENY_SHADER_RESOURCE;
@@ -994,8 +1724,7 @@ void ComputeTarget::allocateResource() {
   D3D12_RESOURCE_FLAGS flag = D3D12_RESOURCE_FLAG_ALLOW_UNORDERED_ACCESS;
   // D3D12_RESOURCE_STATES state = D3D12_RESOURCE_STATE_UNORDERED_ACCESS;
   D3D12_RESOURCE_STATES state = D3D12_RESOURCE_STATE_PIXEL_SHADER_RESOURCE;
-  resource = createCommittedTexture(format, width, height, depth, flag, state,
-                                    nullptr);
+  resource = createTexture(format, width, height, depth, flag, state, nullptr);
   resourceState = state;
 }
 
@@ -1036,7 +1765,7 @@ void ReadbackBuffer::create(UINT64 requiredSize) {
   maxReadbackSize =
       _align(requiredSize, D3D12_DEFAULT_RESOURCE_PLACEMENT_ALIGNMENT);
 
-  readbackBuffer = createCommittedBuffer(
+  readbackBuffer = createBuffer(
       maxReadbackSize, D3D12_HEAP_TYPE_READBACK, D3D12_RESOURCE_FLAG_NONE,
       D3D12_RESOURCE_STATE_COPY_DEST);
 }
@@ -1110,6 +1839,167 @@ void ReadbackBuffer::readback(ID3D12GraphicsCommandList* cmdList,
   }
 }
 
+GpuProfiler::GpuProfiler(CommandQueue* queue, Profiler* profiler,
+                         std::string trackName, UINT framesInFlight,
+                         UINT maxScopes)
+    : queue(queue),
+      profiler(profiler),
+      track(profiler->addTrack(std::move(trackName))),
+      maxScopes(maxScopes),
+      frames(framesInFlight) {
+  // a begin and an end query per scope
+  D3D12_QUERY_HEAP_DESC desc = {};
+  desc.Type = D3D12_QUERY_HEAP_TYPE_TIMESTAMP;
+  desc.Count = framesInFlight * maxScopes * 2;
+  ThrowFailedHR(
+      getDevice()->get()->CreateQueryHeap(&desc, IID_PPV_ARGS(&queryHeap)));
+  readback.create(UINT64(desc.Count) * sizeof(UINT64));
+
+  UINT64 frequency;
+  ThrowFailedHR(queue->get()->GetTimestampFrequency(&frequency));
+  usPerTick = 1e6 / double(frequency);
+  // both clocks read as close together as the API allows
+  UINT64 cpuTick;
+  ThrowFailedHR(queue->get()->GetClockCalibration(&calibrationTick, &cpuTick));
+  calibrationUs = profiler->now();
+}
+
+GpuProfiler::~GpuProfiler() { SAFE_RELEASE(queryHeap); }
+
+void GpuProfiler::collect(UINT slot) {
+  Frame& frame = frames[slot];
+  UINT base = slot * maxScopes * 2;
+  UINT count = UINT(frame.names.size()) * 2;
+  if (count > 0) {
+    D3D12_RANGE range = Range((base + count) * sizeof(UINT64),
+                              base * sizeof(UINT64));
+    void* data;
+    ThrowFailedHR(readback.get()->Map(0, &range, &data));
+    const UINT64* ticks = static_cast<const UINT64*>(data) + base;
+    for (UINT i = 0; i < frame.names.size(); ++i) {
+      UINT64 begin = ticks[2 * i];
+      UINT64 end = ticks[2 * i + 1];
+      // a scope left unclosed resolves to garbage, skip it
+      if (end < begin) continue;
+      double start =
+          calibrationUs + (double(begin) - double(calibrationTick)) * usPerTick;
+      profiler->record(track, frame.names[i], start,
+                       double(end - begin) * usPerTick);
+    }
+    D3D12_RANGE written = Range(0);
+    readback.get()->Unmap(0, &written);
+  }
+  frame.names.clear();
+  frame.fenceValue = 0;
+}
+
+void GpuProfiler::beginFrame() {
+  for (UINT i = 1; i <= frames.size(); ++i) {
+    UINT slot = (frameIdx + i) % UINT(frames.size());
+    if (frames[slot].fenceValue != 0 &&
+        queue->isCompleted(frames[slot].fenceValue))
+      collect(slot);
+  }
+  frameIdx = (frameIdx + 1) % UINT(frames.size());
+  Frame& frame = frames[frameIdx];
+  if (frame.fenceValue != 0) {
+    queue->waitCompletion(frame.fenceValue);
+    collect(frameIdx);
+  }
+  // scopes of a frame that was never ended
+  frame.names.clear();
+}
+
+UINT GpuProfiler::begin(ID3D12GraphicsCommandList* cmdList, std::string name) {
+  std::lock_guard<std::mutex> lock(mutex);
+  Frame& frame = frames[frameIdx];
+  if (frame.names.size() >= maxScopes) return invalid;
+  UINT scope = UINT(frame.names.size());
+  frame.names.push_back(std::move(name));
+  cmdList->EndQuery(queryHeap, D3D12_QUERY_TYPE_TIMESTAMP,
+                    (frameIdx * maxScopes + scope) * 2);
+  return scope;
+}
+
+void GpuProfiler::end(ID3D12GraphicsCommandList* cmdList, UINT scope) {
+  if (scope == invalid) return;
+  cmdList->EndQuery(queryHeap, D3D12_QUERY_TYPE_TIMESTAMP,
+                    (frameIdx * maxScopes + scope) * 2 + 1);
+}
+
+void GpuProfiler::resolve(CommandList* cmdList) {
+  Frame& frame = frames[frameIdx];
+  if (frame.names.empty()) return;
+  UINT base = frameIdx * maxScopes * 2;
+  ID3D12GraphicsCommandList* rawList = cmdList->begin();
+  rawList->ResolveQueryData(queryHeap, D3D12_QUERY_TYPE_TIMESTAMP, base,
+                            UINT(frame.names.size()) * 2, readback.get(),
+                            base * sizeof(UINT64));
+  cmdList->end(queue);
+}
+
+void GpuProfiler::endFrame(UINT64 fenceValue) {
+  Frame& frame = frames[frameIdx];
+  if (!frame.names.empty()) frame.fenceValue = fenceValue;
+}
+
+ParallelRecorder::ParallelRecorder(CommandQueue* queue, UINT numLists,
+                                   UINT framesInFlight)
+    : queue(queue), pool(numLists - 1) {
+  assert(numLists > 0);
+  for (UINT i = 0; i < numLists; ++i) {
+    lists.push_back(
+        std::make_unique<CommandList>(queue->getType(), framesInFlight));
+    fixups.push_back(
+        std::make_unique<CommandList>(queue->getType(), framesInFlight));
+  }
+}
+
+void ParallelRecorder::setProfiler(GpuProfiler* gpuProfiler) {
+  for (auto& list : lists) list->setProfiler(gpuProfiler);
+}
+
+void ParallelRecorder::record(
+    const std::function<void(UINT, CommandList*)>& func) {
+  for (UINT i = 0; i < lists.size(); ++i) {
+    lists[i]->beginFrame(queue);
+    fixups[i]->beginFrame(queue);
+  }
+  pool.run(UINT(lists.size()), [&](uint32_t i) {
+    CommandList* list = lists[i].get();
+    ResourceStateTracker::setCurrent(list->getResourceStates());
+    try {
+      func(i, list);
+    } catch (...) {
+      ResourceStateTracker::setCurrent(nullptr);
+      throw;
+    }
+    ResourceStateTracker::setCurrent(nullptr);
+  });
+}
+
+UINT64 ParallelRecorder::submit() {
+  std::vector<ID3D12CommandList*> rawLists;
+  for (UINT i = 0; i < lists.size(); ++i) {
+    barriers.clear();
+    lists[i]->getResourceStates()->resolve(&barriers);
+    if (!barriers.empty()) {
+      ID3D12GraphicsCommandList* rawList = fixups[i]->begin();
+      rawList->ResourceBarrier(UINT(barriers.size()), barriers.data());
+      rawLists.push_back(fixups[i]->closeFrame());
+    }
+    if (ID3D12CommandList* rawList = lists[i]->closeFrame())
+      rawLists.push_back(rawList);
+  }
+
+  UINT64 fenceValue = queue->excuteCommandLists(rawLists);
+  for (UINT i = 0; i < lists.size(); ++i) {
+    lists[i]->endFrame(fenceValue);
+    fixups[i]->endFrame(fenceValue);
+  }
+  return fenceValue;
+}
+
 void dxShader::load(const char* hlslFile, const char* entryFtn,
                     const char* target) {
   std::string filename(hlslFile);
@@ -1120,9 +2010,21 @@ void dxShader::load(const char* hlslFile, const char* entryFtn,
 #if defined(_DEBUG)
   compileFlags = D3DCOMPILE_DEBUG | D3DCOMPILE_SKIP_OPTIMIZATION;
 #endif
+
+  // a warm start reads the bytecode back instead of compiling
+  ShaderCache* cache = getShaderCache();
+  UINT64 hash = cache->hashSource(
+      {filename, entryFtn, target, compileFlags, D3D_COMPILER_VERSION});
+  std::vector<uint8_t> cached;
+  if (hash != 0 && cache->load(hash, &cached)) {
+    ThrowFailedHR(D3DCreateBlob(cached.size(), &code));
+    memcpy(code->GetBufferPointer(), cached.data(), cached.size());
+    return;
+  }
+
   HRESULT hr = D3DCompileFromFile(wfilename.c_str(),  // filename
                                   nullptr,            // defines
-                                  nullptr,            // includes
+                                  D3D_COMPILE_STANDARD_FILE_INCLUDE,  // includes
                                   entryFtn,           // entry
                                   target,             // targetProfile
                                   compileFlags, 0,    // flag1, flag2
@@ -1135,6 +2037,312 @@ void dxShader::load(const char* hlslFile, const char* entryFtn,
     printf("Can't find the file : %s\n", filename.c_str());
     throw hr;
   }
+  SAFE_RELEASE(error);  // warnings
+
+  cache->store(hash, code->GetBufferPointer(), code->GetBufferSize());
+}
+
+// everything the pipeline library matches on; the descriptions are zero
+// initialized, so their padding hashes the same every time
+static UINT64 hashPipelineDesc(const D3D12_GRAPHICS_PIPELINE_STATE_DESC& desc,
+                               UINT64 rootSigHash) {
+  ContentHash hash;
+  hash.addValue(rootSigHash);
+  for (const D3D12_SHADER_BYTECODE* code :
+       {&desc.VS, &desc.PS, &desc.DS, &desc.HS, &desc.GS}) {
+    hash.addValue(UINT64(code->BytecodeLength));
+    hash.add(code->pShaderBytecode, code->BytecodeLength);
+  }
+  for (UINT i = 0; i < desc.InputLayout.NumElements; ++i) {
+    const D3D12_INPUT_ELEMENT_DESC& element =
+        desc.InputLayout.pInputElementDescs[i];
+    hash.add(element.SemanticName);
+    hash.addValue(element.SemanticIndex).addValue(element.Format);
+    hash.addValue(element.InputSlot).addValue(element.AlignedByteOffset);
+    hash.addValue(element.InputSlotClass);
+    hash.addValue(element.InstanceDataStepRate);
+  }
+  hash.addValue(desc.BlendState).addValue(desc.SampleMask);
+  hash.addValue(desc.RasterizerState).addValue(desc.DepthStencilState);
+  hash.addValue(desc.IBStripCutValue).addValue(desc.PrimitiveTopologyType);
+  hash.addValue(desc.NumRenderTargets).addValue(desc.RTVFormats);
+  hash.addValue(desc.DSVFormat).addValue(desc.SampleDesc);
+  hash.addValue(desc.NodeMask).addValue(desc.Flags);
+  return hash.get();
+}
+
+PipelineLibrary::PipelineLibrary(std::string path) : path(std::move(path)) {
+  // libraries came with ID3D12Device1
+  if (FAILED(getDevice()->get()->QueryInterface(IID_PPV_ARGS(&device))))
+    return;
+
+  std::string data;
+  if (ShaderCache::readFile(this->path, &data))
+    blob.assign(data.begin(), data.end());
+
+  HRESULT hr = device->CreatePipelineLibrary(
+      blob.empty() ? nullptr : blob.data(), blob.size(),
+      IID_PPV_ARGS(&library));
+  if (FAILED(hr) && !blob.empty()) {
+    // another driver or adapter, or a damaged file : start over
+    blob.clear();
+    modified = true;
+    hr = device->CreatePipelineLibrary(nullptr, 0, IID_PPV_ARGS(&library));
+  }
+  if (FAILED(hr)) library = nullptr;
+}
+
+PipelineLibrary::~PipelineLibrary() {
+  SAFE_RELEASE(library);
+  SAFE_RELEASE(device);
+}
+
+ID3D12PipelineState* PipelineLibrary::createGraphics(
+    const D3D12_GRAPHICS_PIPELINE_STATE_DESC& desc, UINT64 hash) {
+  ID3D12PipelineState* pso = nullptr;
+  std::string name = toHex(hash);
+  std::wstring wname(name.begin(), name.end());
+  if (library && SUCCEEDED(library->LoadGraphicsPipeline(
+                     wname.c_str(), &desc, IID_PPV_ARGS(&pso)))) {
+    ++loaded;
+    return pso;
+  }
+
+  ThrowFailedHR(getDevice()->get()->CreateGraphicsPipelineState(
+      &desc, IID_PPV_ARGS(&pso)));
+  ++created;
+  // fails only when the name is taken, the pipeline is fine either way
+  if (library && SUCCEEDED(library->StorePipeline(wname.c_str(), pso)))
+    modified = true;
+  return pso;
+}
+
+ID3D12PipelineState* PipelineLibrary::createCompute(
+    const D3D12_COMPUTE_PIPELINE_STATE_DESC& desc, UINT64 hash) {
+  ID3D12PipelineState* pso = nullptr;
+  std::string name = toHex(hash);
+  std::wstring wname(name.begin(), name.end());
+  if (library && SUCCEEDED(library->LoadComputePipeline(
+                     wname.c_str(), &desc, IID_PPV_ARGS(&pso)))) {
+    ++loaded;
+    return pso;
+  }
+
+  ThrowFailedHR(getDevice()->get()->CreateComputePipelineState(
+      &desc, IID_PPV_ARGS(&pso)));
+  ++created;
+  if (library && SUCCEEDED(library->StorePipeline(wname.c_str(), pso)))
+    modified = true;
+  return pso;
+}
+
+void PipelineLibrary::save() {
+  if (!library || !modified) return;
+
+  std::vector<char> data(library->GetSerializedSize());
+  ThrowFailedHR(library->Serialize(data.data(), data.size()));
+
+  std::error_code ec;
+  std::filesystem::create_directories(
+      std::filesystem::path(path).parent_path(), ec);
+  std::ofstream file(path, std::ios::binary | std::ios::trunc);
+  file.write(data.data(), std::streamsize(data.size()));
+  modified = false;
+}
+
+// Kept in the private data of an object, the last reference goes away with
+// the object and runs the callback.
+class ReleaseCallback : public IUnknown {
+  ULONG refs = 1;
+  std::function<void()> callback;
+
+ public:
+  explicit ReleaseCallback(std::function<void()> callback)
+      : callback(std::move(callback)) {}
+
+  HRESULT STDMETHODCALLTYPE QueryInterface(REFIID riid,
+                                           void** object) override {
+    if (riid != __uuidof(IUnknown)) {
+      *object = nullptr;
+      return E_NOINTERFACE;
+    }
+    *object = this;
+    AddRef();
+    return S_OK;
+  }
+  ULONG STDMETHODCALLTYPE AddRef() override { return ++refs; }
+  ULONG STDMETHODCALLTYPE Release() override {
+    ULONG count = --refs;
+    if (count == 0) {
+      callback();
+      delete this;
+    }
+    return count;
+  }
+};
+
+void onRelease(ID3D12Object* object, const GUID& key,
+               std::function<void()> callback) {
+  ReleaseCallback* token = new ReleaseCallback(std::move(callback));
+  HRESULT hr = object->SetPrivateDataInterface(key, token);
+  token->Release();  // the object holds it now, or it ran on failure
+  ThrowFailedHR(hr);
+}
+
+// {6b1f0c4e-2d7a-4e59-9a31-c8e5f04b7d12}
+static const GUID allocationGuid = {
+    0x6b1f0c4e, 0x2d7a, 0x4e59, {0x9a, 0x31, 0xc8, 0xe5, 0xf0, 0x4b, 0x7d, 0x12}};
+
+static D3D12_HEAP_TYPE heapType(GpuMemory::Category category) {
+  switch (category) {
+    case GpuMemory::uploadBuffer:
+      return D3D12_HEAP_TYPE_UPLOAD;
+    case GpuMemory::readbackBuffer:
+      return D3D12_HEAP_TYPE_READBACK;
+    default:
+      return D3D12_HEAP_TYPE_DEFAULT;
+  }
+}
+
+GpuMemory::GpuMemory(UINT64 heapSize) : heapSize(heapSize) {}
+
+GpuMemory::~GpuMemory() {
+  // placed resources still alive hold their heap
+  for (auto& categoryHeaps : heaps) {
+    for (auto& heap : categoryHeaps) SAFE_RELEASE(heap->heap);
+  }
+}
+
+GpuMemory::Heap* GpuMemory::createHeap(Category category) {
+  D3D12_HEAP_DESC desc = {};
+  desc.SizeInBytes = heapSize;
+  desc.Properties.Type = heapType(category);
+  desc.Alignment = D3D12_DEFAULT_RESOURCE_PLACEMENT_ALIGNMENT;
+  // resource heap tier 1 can't mix buffers and textures in one heap
+  desc.Flags = category == texture
+                   ? D3D12_HEAP_FLAG_ALLOW_ONLY_NON_RT_DS_TEXTURES
+                   : D3D12_HEAP_FLAG_ALLOW_ONLY_BUFFERS;
+
+  ID3D12Heap* heap;
+  ThrowFailedHR(getDevice()->get()->CreateHeap(&desc, IID_PPV_ARGS(&heap)));
+  heaps[category].push_back(std::make_unique<Heap>(
+      Heap{heap,
+           TlsfAllocator(heapSize, D3D12_DEFAULT_RESOURCE_PLACEMENT_ALIGNMENT),
+           {}}));
+  return heaps[category].back().get();
+}
+
+void GpuMemory::attach(ID3D12Resource* resource, Category category,
+                       UINT heapIdx,
+                       const TlsfAllocator::Allocation& allocation) {
+  onRelease(resource, allocationGuid, [=] {
+    free(category, heapIdx, allocation);
+  });
+  heaps[category][heapIdx]->resources[allocation.offset] = {resource,
+                                                            allocation};
+}
+
+void GpuMemory::free(Category category, UINT heapIdx,
+                     const TlsfAllocator::Allocation& allocation) {
+  Heap& heap = *heaps[category][heapIdx];
+  heap.resources.erase(allocation.offset);
+  heap.allocator.free(allocation);
+}
+
+ID3D12Resource* GpuMemory::createResource(
+    Category category, const D3D12_RESOURCE_DESC& desc,
+    D3D12_RESOURCE_STATES resourceStates,
+    const D3D12_CLEAR_VALUE* pOptClearValue) {
+  ID3D12Device* device = getDevice()->get();
+  D3D12_RESOURCE_ALLOCATION_INFO info =
+      device->GetResourceAllocationInfo(0, 1, &desc);
+
+  ID3D12Resource* resource;
+  if (info.SizeInBytes > heapSize) {
+    D3D12_HEAP_PROPERTIES prop = {};
+    prop.Type = heapType(category);
+    ThrowFailedHR(device->CreateCommittedResource(
+        &prop, D3D12_HEAP_FLAG_NONE, &desc, resourceStates, pOptClearValue,
+        IID_PPV_ARGS(&resource)));
+    ++committed[category];
+    return resource;
+  }
+
+  // first fit over the heaps, a new heap when none has room
+  TlsfAllocator::Allocation allocation;
+  UINT heapIdx = 0;
+  for (; heapIdx < heaps[category].size(); ++heapIdx) {
+    allocation = heaps[category][heapIdx]->allocator.allocate(
+        info.SizeInBytes, info.Alignment);
+    if (allocation.valid()) break;
+  }
+  if (!allocation.valid()) {
+    allocation =
+        createHeap(category)->allocator.allocate(info.SizeInBytes,
+                                                 info.Alignment);
+    assert(allocation.valid());
+  }
+
+  Heap& heap = *heaps[category][heapIdx];
+  HRESULT hr = device->CreatePlacedResource(heap.heap, allocation.offset,
+                                            &desc, resourceStates,
+                                            pOptClearValue,
+                                            IID_PPV_ARGS(&resource));
+  if (FAILED(hr)) heap.allocator.free(allocation);
+  ThrowFailedHR(hr);
+  attach(resource, category, heapIdx, allocation);
+  return resource;
+}
+
+UINT GpuMemory::compact(Category category, const RelocateFunc& relocate) {
+  UINT moved = 0;
+  for (UINT heapIdx = 0; heapIdx < heaps[category].size(); ++heapIdx) {
+    Heap& heap = *heaps[category][heapIdx];
+    // the old ranges stay taken until the caller releases the old resources
+    std::vector<Placement> placements;
+    for (const auto& [offset, placement] : heap.resources)
+      placements.push_back(placement);
+
+    for (const Placement& placement : placements) {
+      TlsfAllocator::Allocation target =
+          heap.allocator.allocateBelow(placement.allocation);
+      if (!target.valid()) continue;
+      ID3D12Resource* resource =
+          relocate(placement.resource, heap.heap, target.offset);
+      if (!resource) {
+        heap.allocator.free(target);
+        continue;
+      }
+      attach(resource, category, heapIdx, target);
+      ++moved;
+    }
+  }
+  return moved;
+}
+
+GpuMemory::Stats GpuMemory::getStats(Category category) const {
+  Stats stats;
+  for (const auto& heap : heaps[category]) {
+    stats.reserved += heap->allocator.getSize();
+    stats.used += heap->allocator.getUsedSize();
+    stats.allocations += heap->allocator.getAllocationCount();
+  }
+  stats.heaps = UINT(heaps[category].size());
+  stats.committed = committed[category];
+  return stats;
+}
+
+void GpuMemory::printStats() const {
+  static const char* names[numCategories] = {"default buffer", "upload buffer",
+                                             "readback buffer", "texture"};
+  const double MB = 1024.0 * 1024.0;
+  for (UINT i = 0; i < numCategories; ++i) {
+    Stats stats = getStats(Category(i));
+    printf("gpu memory %s : %u placed in %u heaps, %.1f / %.1f MB, "
+           "%u committed\n",
+           names[i], stats.allocations, stats.heaps, stats.used / MB,
+           stats.reserved / MB, stats.committed);
+  }
 }
 
 void GraphicsPipeline::destroy() {
@@ -1250,11 +2458,12 @@ void GraphicsPipeline::build(
     desc.DepthStencilState = dsDesc;
   }
 
-  ThrowFailedHR(getDevice()->get()->CreateGraphicsPipelineState(
-      &desc, IID_PPV_ARGS(&pipeline)));
+  pipeline = getPipelineLibrary()->createGraphics(
+      desc, hashPipelineDesc(desc, pRootSig->getHash()));
 }
 
-void GraphicsPipeline::begin(ID3D12GraphicsCommandList* cmdList) const {
+void GraphicsPipeline::begin(ID3D12GraphicsCommandList* cmdList,
+                             CommandState* state) const {
 #ifdef _DEBUG
   for (UINT i = 0; i < dscrHandles.size(); ++i) {
     assert(dscrHandles[i] != nullptr);
@@ -1263,7 +2472,7 @@ void GraphicsPipeline::begin(ID3D12GraphicsCommandList* cmdList) const {
   assert(viewport.Width > 0 && viewport.Height > 0);
 #endif
 
-  std::vector<D3D12_CPU_DESCRIPTOR_HANDLE> rtvs(numRts);
+  D3D12_CPU_DESCRIPTOR_HANDLE rtvs[D3D12_SIMULTANEOUS_RENDER_TARGET_COUNT];
   for (UINT i = 0; i < numRts; ++i) {
     rtvs[i] = dscrHandles[i]->getCpuHandle();
   }
@@ -1271,35 +2480,32 @@ void GraphicsPipeline::begin(ID3D12GraphicsCommandList* cmdList) const {
       enableDepth ? &dscrHandles[numRts]->getCpuHandle() : nullptr;
 
   currentCmdList = cmdList;
-  currentCmdList->SetPipelineState(pipeline);
+  state->setPipelineState(currentCmdList, pipeline);
 
-  if (pRootSig) pRootSig->bindGraphics(currentCmdList, decHeap);
+  if (pRootSig) pRootSig->bindGraphics(currentCmdList, decHeap, state);
 
-  currentCmdList->OMSetRenderTargets(numRts, &rtvs[0], FALSE, pDsv);
-  currentCmdList->RSSetViewports(1, &viewport);
-  currentCmdList->RSSetScissorRects(1, &scissorRect);
+  state->setRenderTargets(currentCmdList, numRts, rtvs, pDsv);
+  state->setViewport(currentCmdList, viewport);
+  state->setScissorRect(currentCmdList, scissorRect);
 
   for (UINT i = 0; i < numRts; ++i) {
     const dxResource* rsc = dscrHandles[i]->getResource();
-    if (rsc->getState() != D3D12_RESOURCE_STATE_RENDER_TARGET) {
-      beginBarriers.push_back(Transition(rsc->get(), rsc->getState(),
-                                         D3D12_RESOURCE_STATE_RENDER_TARGET));
-      endBarriers.push_back(Transition(
-          rsc->get(), D3D12_RESOURCE_STATE_RENDER_TARGET, rsc->getState()));
-    }
+    D3D12_RESOURCE_STATES prevState = rsc->changeResourceState(
+        &beginBarriers, D3D12_RESOURCE_STATE_RENDER_TARGET);
+    if (prevState != D3D12_RESOURCE_STATE_RENDER_TARGET)
+      restoreStates.push_back({rsc, prevState});
   }
   if (enableDepth) {
     const dxResource* rsc = dscrHandles[numRts]->getResource();
-    if (rsc->getState() != D3D12_RESOURCE_STATE_DEPTH_WRITE) {
-      beginBarriers.push_back(Transition(rsc->get(), rsc->getState(),
-                                         D3D12_RESOURCE_STATE_DEPTH_WRITE));
-      endBarriers.push_back(Transition(
-          rsc->get(), D3D12_RESOURCE_STATE_DEPTH_WRITE, rsc->getState()));
-    }
+    D3D12_RESOURCE_STATES prevState = rsc->changeResourceState(
+        &beginBarriers, D3D12_RESOURCE_STATE_DEPTH_WRITE);
+    if (prevState != D3D12_RESOURCE_STATE_DEPTH_WRITE)
+      restoreStates.push_back({rsc, prevState});
   }
 
-  currentCmdList->ResourceBarrier(UINT(beginBarriers.size()),
-                                  beginBarriers.data());
+  if (!beginBarriers.empty())
+    currentCmdList->ResourceBarrier(UINT(beginBarriers.size()),
+                                    beginBarriers.data());
   beginBarriers.resize(0);
 
   if (doClear) {
@@ -1314,7 +2520,78 @@ void GraphicsPipeline::begin(ID3D12GraphicsCommandList* cmdList) const {
 }
 
 void GraphicsPipeline::end() const {
-  currentCmdList->ResourceBarrier(UINT(endBarriers.size()), endBarriers.data());
+  for (const auto& [rsc, prevState] : restoreStates)
+    rsc->changeResourceState(&endBarriers, prevState);
+  restoreStates.resize(0);
+  if (!endBarriers.empty())
+    currentCmdList->ResourceBarrier(UINT(endBarriers.size()),
+                                    endBarriers.data());
+  endBarriers.resize(0);
+  currentCmdList = nullptr;
+}
+
+void ComputePipeline::destroy() {
+  SAFE_RELEASE(pipeline);
+  pRootSig = nullptr;
+
+  uavHandles.clear();
+  beginBarriers.clear();
+  endBarriers.clear();
+}
+
+void ComputePipeline::build(const RootSignature* rootSig,
+                            D3D12_SHADER_BYTECODE csCode, UINT numUavs) {
+  assert(pipeline == nullptr);
+  pRootSig = rootSig;
+  uavHandles.resize(numUavs, nullptr);
+  beginBarriers.reserve(numUavs);
+  endBarriers.reserve(numUavs);
+
+  D3D12_COMPUTE_PIPELINE_STATE_DESC desc{};
+  desc.pRootSignature = pRootSig->get();
+  desc.CS = csCode;
+
+  ContentHash hash;
+  hash.addValue(pRootSig->getHash());
+  hash.add(csCode.pShaderBytecode, csCode.BytecodeLength);
+  pipeline = getPipelineLibrary()->createCompute(desc, hash.get());
+}
+
+void ComputePipeline::begin(ID3D12GraphicsCommandList* cmdList,
+                            CommandState* state) const {
+#ifdef _DEBUG
+  for (UINT i = 0; i < uavHandles.size(); ++i) {
+    assert(uavHandles[i] != nullptr);
+    assert(uavHandles[i]->getResource() != nullptr);
+  }
+#endif
+
+  currentCmdList = cmdList;
+  state->setPipelineState(currentCmdList, pipeline);
+
+  if (pRootSig) pRootSig->bindCompute(currentCmdList, decHeap, state);
+
+  for (UINT i = 0; i < uavHandles.size(); ++i) {
+    const dxResource* rsc = uavHandles[i]->getResource();
+    D3D12_RESOURCE_STATES prevState = rsc->changeResourceState(
+        &beginBarriers, D3D12_RESOURCE_STATE_UNORDERED_ACCESS);
+    if (prevState != D3D12_RESOURCE_STATE_UNORDERED_ACCESS)
+      restoreStates.push_back({rsc, prevState});
+  }
+
+  if (!beginBarriers.empty())
+    currentCmdList->ResourceBarrier(UINT(beginBarriers.size()),
+                                    beginBarriers.data());
+  beginBarriers.resize(0);
+}
+
+void ComputePipeline::end() const {
+  for (const auto& [rsc, prevState] : restoreStates)
+    rsc->changeResourceState(&endBarriers, prevState);
+  restoreStates.resize(0);
+  if (!endBarriers.empty())
+    currentCmdList->ResourceBarrier(UINT(endBarriers.size()),
+                                    endBarriers.data());
   endBarriers.resize(0);
   currentCmdList = nullptr;
 }
@@ -1405,8 +2682,6 @@ MeshData::MeshData(CommandQueue* cmdQueue, CommandList* cmdList,
   void loadOBJFile(const char* filename, std::vector<float>* vertices,
                    std::vector<UINT>* indices, bool* writeNormal,
                    bool* writeTexcoord);
-  std::vector<float> vertices;  // x, y, z, nx, ny, nz, u, v
-  std::vector<UINT> indices;    // i, j, k
   bool writeNormal;
   bool writeTexcoord;
 
@@ -1466,6 +2741,24 @@ MeshData::MeshData(CommandQueue* cmdQueue, CommandList* cmdList,
     }
   }
 
+  boundsMin = float3(HUGE_VALF);
+  boundsMax = float3(-HUGE_VALF);
+  for (UINT i = 0; i < vertices.size(); i += 8) {
+    for (UINT j = 0; j < 3; ++j) {
+      boundsMin[j] = fminf(boundsMin[j], vertices[i + j]);
+      boundsMax[j] = fmaxf(boundsMax[j], vertices[i + j]);
+    }
+  }
+  // centered on the bounds, tighter than their half diagonal
+  float3 center = (boundsMin + boundsMax) * 0.5f;
+  float radius = 0.0f;
+  for (UINT i = 0; i < vertices.size(); i += 8) {
+    float3 d(vertices[i] - center.x, vertices[i + 1] - center.y,
+             vertices[i + 2] - center.z);
+    radius = fmaxf(radius, d.x * d.x + d.y * d.y + d.z * d.z);
+  }
+  boundingSphere = float4(center, sqrtf(radius));
+
   vtxBuff.create(sizeof(float) * vertices.size());
   idxBuff.create(sizeof(UINT) * indices.size());
 
@@ -1518,4 +2811,17 @@ MeshData::MeshData(CommandQueue* cmdQueue, CommandList* cmdList,
                                   (UINT)wireIdxBuffer.getBufferSize(),
                                   DXGI_FORMAT_R32_UINT};
   }
+}
+
+TileMask MeshData::uvCoverage(UINT width, UINT height, UINT tileSize,
+                              float uvScale, float dilation) const {
+  TileMask mask(width, height, tileSize);
+  markUvTiles(vertices.data(), 8, 6, indices.data(), indices.size(), uvScale,
+              dilation, &mask);
+  return mask;
+}
+
+OccluderMesh MeshData::occluder(UINT gridCells) const {
+  return simplifyOccluder(vertices.data(), 8, indices.data(), indices.size(),
+                          gridCells);
 }
\ No newline at end of file
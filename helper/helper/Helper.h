@@ -9,10 +9,26 @@
 #include <variant>
 #include <typeindex>
 #include <map>
-#include <any>
+#include <mutex>
+#include <unordered_map>
 #include <set>
+#include <algorithm>
+#include <source_location>
+#include <optional>
 
 #include "basic_types.h"
+#include "FenceTimeline.h"
+#include "MemoryRegistry.h"
+#include "DescriptorAllocator.h"
+#include "FrustumCull.h"
+#include "NameHash.h"
+#include "OcclusionCuller.h"
+#include "Profiler.h"
+#include "ShaderCache.h"
+#include "StateTracker.h"
+#include "TaskPool.h"
+#include "TileMask.h"
+#include "TlsfAllocator.h"
 
 
 
@@ -28,6 +44,9 @@ using namespace DirectX;
 
 class CommandQueue;
 class CommandList;
+class RootSignature;
+class GpuProfiler;
+class dxResource;
 
 enum class DescriptorType { SRV, UAV, CBV, RTV, DSV, Sampler };
 enum DepthMode { depth_disable, depth_readOnly, depth_enable };
@@ -66,6 +85,7 @@ inline constexpr UINT _bpp(DXGI_FORMAT format) {  // bytes per pixel
   switch (format) {
     case DXGI_FORMAT_R8G8B8A8_UNORM:
     case DXGI_FORMAT_R8G8B8A8_UNORM_SRGB:
+    case DXGI_FORMAT_R16G16_SNORM:
     case DXGI_FORMAT_R32_UINT:
     case DXGI_FORMAT_R32_FLOAT:
       return 4;
@@ -98,6 +118,9 @@ inline constexpr UINT _channels(DXGI_FORMAT format) {
     case DXGI_FORMAT_R32G32B32_FLOAT:
       return 3;
 
+    case DXGI_FORMAT_R16G16_SNORM:
+      return 2;
+
     case DXGI_FORMAT_R32_UINT:
     case DXGI_FORMAT_R32_FLOAT:
       return 1;
@@ -114,16 +137,57 @@ inline constexpr UnsignedType _align(UnsignedType val, PowerOfTwo base) {
   return (val + (UnsignedType)base - 1) & ~((UnsignedType)base - 1);
 }
 
+// registers the memory of object in getMemoryRegistry(), the record is
+// released with the object
+void trackMemory(
+    ID3D12Object* object, std::string name, std::string format,
+    MemoryCategory category, UINT64 size,
+    const std::source_location& creator = std::source_location::current());
+const char* formatName(DXGI_FORMAT format);
+
+// the resources below are tracked, creator names the calling function
+
+// placed in GpuMemory, render and depth targets stay committed
+ID3D12Resource* createTexture(
+    DXGI_FORMAT format, UINT width, UINT height, UINT depth = 1,
+    D3D12_RESOURCE_FLAGS resourceFlags = D3D12_RESOURCE_FLAG_NONE,
+    D3D12_RESOURCE_STATES resourceStates = D3D12_RESOURCE_STATE_COMMON,
+    D3D12_CLEAR_VALUE* pOptClearValue = nullptr,
+    const std::source_location& creator = std::source_location::current());
+
 ID3D12Resource* createCommittedTexture(
     DXGI_FORMAT format, UINT width, UINT height, UINT depth = 1,
     D3D12_RESOURCE_FLAGS resourceFlags = D3D12_RESOURCE_FLAG_NONE,
     D3D12_RESOURCE_STATES resourceStates = D3D12_RESOURCE_STATE_COMMON,
+    D3D12_CLEAR_VALUE* pOptClearValue = nullptr,
+    const std::source_location& creator = std::source_location::current());
+
+ID3D12Resource* createPlacedTexture(
+    ID3D12Heap* heap, UINT64 heapOffset, DXGI_FORMAT format, UINT width,
+    UINT height, UINT depth = 1,
+    D3D12_RESOURCE_FLAGS resourceFlags = D3D12_RESOURCE_FLAG_NONE,
+    D3D12_RESOURCE_STATES resourceStates = D3D12_RESOURCE_STATE_COMMON,
     D3D12_CLEAR_VALUE* pOptClearValue = nullptr);
 
+D3D12_RESOURCE_ALLOCATION_INFO getTextureAllocationInfo(
+    DXGI_FORMAT format, UINT width, UINT height, UINT depth = 1,
+    D3D12_RESOURCE_FLAGS resourceFlags = D3D12_RESOURCE_FLAG_NONE);
+
+// placed in GpuMemory. category is what the buffer holds; without it the
+// heap type tells : staging, readback, or mesh for the default heap
+ID3D12Resource* createBuffer(
+    UINT64 bufferSize, D3D12_HEAP_TYPE heapType = D3D12_HEAP_TYPE_UPLOAD,
+    D3D12_RESOURCE_FLAGS resourceFlags = D3D12_RESOURCE_FLAG_NONE,
+    D3D12_RESOURCE_STATES resourceStates = D3D12_RESOURCE_STATE_GENERIC_READ,
+    std::optional<MemoryCategory> category = std::nullopt,
+    const std::source_location& creator = std::source_location::current());
+
 ID3D12Resource* createCommittedBuffer(
     UINT64 bufferSize, D3D12_HEAP_TYPE heapType = D3D12_HEAP_TYPE_UPLOAD,
     D3D12_RESOURCE_FLAGS resourceFlags = D3D12_RESOURCE_FLAG_NONE,
-    D3D12_RESOURCE_STATES resourceStates = D3D12_RESOURCE_STATE_GENERIC_READ);
+    D3D12_RESOURCE_STATES resourceStates = D3D12_RESOURCE_STATE_GENERIC_READ,
+    std::optional<MemoryCategory> category = std::nullopt,
+    const std::source_location& creator = std::source_location::current());
 
 void clearTargets(CommandQueue& cmdqueue, CommandList& cmdList,
                   const std::vector<const class Descriptor*>& rtvs,
@@ -244,21 +308,271 @@ inline Device* getDevice() {
   return singleton.get();
 }
 
+// compiled shaders, see dxShader::load()
+inline ShaderCache* getShaderCache() {
+  static std::unique_ptr<ShaderCache> singleton = nullptr;
+  if (!singleton) {
+    singleton = std::make_unique<ShaderCache>("./shader_cache");
+  }
+  return singleton.get();
+}
+
+// every buffer and texture, see trackMemory()
+inline MemoryRegistry* getMemoryRegistry() {
+  static std::unique_ptr<MemoryRegistry> singleton = nullptr;
+  if (!singleton) {
+    singleton = std::make_unique<MemoryRegistry>();
+  }
+  return singleton.get();
+}
+
+// cpu scopes and the gpu timestamps, see GpuProfiler
+inline Profiler* getProfiler() {
+  static std::unique_ptr<Profiler> singleton = nullptr;
+  if (!singleton) {
+    singleton = std::make_unique<Profiler>();
+  }
+  return singleton.get();
+}
+
+// Pipeline states kept on disk between runs.
+// Each pipeline is stored under a hash of its description. A library written
+// by another driver or adapter is dropped and rebuilt; without library support
+// the pipelines are simply created.
+class PipelineLibrary {
+  ID3D12Device1* device = nullptr;
+  ID3D12PipelineLibrary* library = nullptr;
+  std::vector<char> blob;  // backs the library, kept while it lives
+  std::string path;
+  bool modified = false;
+  UINT loaded = 0;
+  UINT created = 0;
+
+ public:
+  explicit PipelineLibrary(std::string path);
+  ~PipelineLibrary();
+
+  ID3D12PipelineState* createGraphics(
+      const D3D12_GRAPHICS_PIPELINE_STATE_DESC& desc, UINT64 hash);
+  ID3D12PipelineState* createCompute(
+      const D3D12_COMPUTE_PIPELINE_STATE_DESC& desc, UINT64 hash);
+  // writes the library back when pipelines were added
+  void save();
+
+  UINT getLoadedCount() const { return loaded; }
+  UINT getCreatedCount() const { return created; }
+};
+
+inline PipelineLibrary* getPipelineLibrary() {
+  static std::unique_ptr<PipelineLibrary> singleton = nullptr;
+  if (!singleton) {
+    singleton = std::make_unique<PipelineLibrary>(
+        getShaderCache()->getDir() + "/pipelines.bin");
+  }
+  return singleton.get();
+}
+
+// runs callback when the object is destroyed : it rides in the private data
+// of the object under key, one callback per key
+void onRelease(ID3D12Object* object, const GUID& key,
+               std::function<void()> callback);
+
+// Placed resources sub-allocated from large heaps.
+// Each category has its own heaps (resource heap tier 1 keeps buffers and
+// textures apart, upload and readback memory are heap types of their own),
+// each range handed out by a TlsfAllocator. The range is tied to the resource
+// through onRelease(), so releasing the resource, directly or through
+// CommandQueue::deferRelease(), gives it back. Resources larger than a heap
+// are committed.
+class GpuMemory {
+ public:
+  enum Category {
+    defaultBuffer,
+    uploadBuffer,
+    readbackBuffer,
+    texture,
+    numCategories
+  };
+
+  struct Stats {
+    UINT64 reserved = 0;
+    UINT64 used = 0;
+    UINT allocations = 0;
+    UINT heaps = 0;
+    UINT committed = 0;  // too large for a heap
+  };
+
+  // creates the resource at its new place and copies the data, nullptr to
+  // leave it where it is. The old resource is released by the caller.
+  using RelocateFunc = std::function<ID3D12Resource*(
+      ID3D12Resource* resource, ID3D12Heap* heap, UINT64 heapOffset)>;
+
+ private:
+  struct Placement {
+    ID3D12Resource* resource;  // not owned
+    TlsfAllocator::Allocation allocation;
+  };
+  struct Heap {
+    ID3D12Heap* heap;
+    TlsfAllocator allocator;
+    std::map<UINT64, Placement> resources;  // by offset
+  };
+
+  UINT64 heapSize;
+  std::vector<std::unique_ptr<Heap>> heaps[numCategories];
+  UINT committed[numCategories] = {};
+
+  Heap* createHeap(Category category);
+  void attach(ID3D12Resource* resource, Category category, UINT heapIdx,
+              const TlsfAllocator::Allocation& allocation);
+  void free(Category category, UINT heapIdx,
+            const TlsfAllocator::Allocation& allocation);
+
+ public:
+  explicit GpuMemory(UINT64 heapSize = 64 * 1024 * 1024);
+  ~GpuMemory();
+
+  ID3D12Resource* createResource(
+      Category category, const D3D12_RESOURCE_DESC& desc,
+      D3D12_RESOURCE_STATES resourceStates,
+      const D3D12_CLEAR_VALUE* pOptClearValue = nullptr);
+
+  // defragmentation hook : moves each resource of the category that fits
+  // lower in its heap, returns how many moved
+  UINT compact(Category category, const RelocateFunc& relocate);
+
+  Stats getStats(Category category) const;
+  void printStats() const;
+};
+
+inline GpuMemory* getGpuMemory() {
+  static std::unique_ptr<GpuMemory> singleton = nullptr;
+  if (!singleton) {
+    singleton = std::make_unique<GpuMemory>();
+  }
+  return singleton.get();
+}
+
 class CommandQueue {
   D3D12_COMMAND_LIST_TYPE type = D3D12_COMMAND_LIST_TYPE_DIRECT;
   ID3D12CommandQueue* cmdQueue = nullptr;
   ID3D12Fence* fence = nullptr;
   UINT64 fenceValue = 0;
+  FenceTimeline timeline;
 
  public:
   ID3D12CommandQueue* get() { return cmdQueue; }
   D3D12_COMMAND_LIST_TYPE getType() { return type; }
   UINT64 excuteCommandList(ID3D12CommandList* rawList);
+  // in order, one signal for all
+  UINT64 excuteCommandLists(const std::vector<ID3D12CommandList*>& rawLists);
+  // the value the next submission will signal
+  UINT64 getNextFenceValue() const { return fenceValue + 1; }
+  UINT64 getLastSubmittedValue() const { return fenceValue; }
+  UINT64 getCompletedValue() const { return fence->GetCompletedValue(); }
+  bool isCompleted(UINT64 value) const {
+    return getCompletedValue() >= value;
+  }
   ~CommandQueue();
   explicit CommandQueue(
       D3D12_COMMAND_LIST_TYPE type = D3D12_COMMAND_LIST_TYPE_DIRECT);
   void waitCompletion(UINT64 targetValue = 0, HANDLE handle = nullptr);
   void signalForSafety();
+
+  // runs func once the GPU passed targetValue (0 : the last submission)
+  void onCompletion(UINT64 targetValue, FenceTimeline::Callback func);
+  // releases the object once the GPU no longer uses it
+  void deferRelease(IUnknown* object, UINT64 lastUse = 0);
+  // polls the fence and runs what retired, never blocks
+  void collect() { timeline.retire(getCompletedValue()); }
+
+  // makes this queue wait on the GPU until producer reaches value
+  // (0 : its last submission), skipped when it already has
+  void wait(CommandQueue* producer, UINT64 value = 0);
+  // waits for a copy still writing the resource on another queue
+  void waitFor(const class dxResource& rsc);
+};
+
+// What a command list has bound since its last Reset().
+// Pipelines set their state through it, so what is already bound is not set
+// again; the counters tell how many commands went to the list and how many
+// were skipped.
+class CommandState {
+  ID3D12PipelineState* pipeline = nullptr;
+  ID3D12DescriptorHeap* heap = nullptr;
+  const RootSignature* graphicsRootSig = nullptr;
+  const RootSignature* computeRootSig = nullptr;
+
+  UINT numRts = 0;
+  D3D12_CPU_DESCRIPTOR_HANDLE rtvs[D3D12_SIMULTANEOUS_RENDER_TARGET_COUNT]{};
+  D3D12_CPU_DESCRIPTOR_HANDLE dsv{};
+  bool targetsValid = false;
+  D3D12_VIEWPORT viewport{};
+  bool viewportValid = false;
+  D3D12_RECT scissorRect{};
+  bool scissorValid = false;
+
+ public:
+  struct Stats {
+    UINT64 issued = 0;
+    UINT64 skipped = 0;
+  };
+  Stats stats;
+
+  // nothing is known about a list that was just reset
+  void invalidate() {
+    Stats kept = stats;
+    *this = CommandState();
+    stats = kept;
+  }
+  void count(bool issued) { ++(issued ? stats.issued : stats.skipped); }
+
+  // each returns true when the command was issued
+  bool setPipelineState(ID3D12GraphicsCommandList* cmdList,
+                        ID3D12PipelineState* pso);
+  bool setDescriptorHeap(ID3D12GraphicsCommandList* cmdList,
+                         ID3D12DescriptorHeap* descriptorHeap);
+  bool setRootSignature(ID3D12GraphicsCommandList* cmdList,
+                        const RootSignature* rootSig, bool compute);
+  bool setRenderTargets(ID3D12GraphicsCommandList* cmdList, UINT numTargets,
+                        const D3D12_CPU_DESCRIPTOR_HANDLE* rtvHandles,
+                        const D3D12_CPU_DESCRIPTOR_HANDLE* dsvHandle);
+  bool setViewport(ID3D12GraphicsCommandList* cmdList,
+                   const D3D12_VIEWPORT& vp);
+  bool setScissorRect(ID3D12GraphicsCommandList* cmdList,
+                      const D3D12_RECT& rect);
+};
+
+// The resource states of one list recorded on a worker thread.
+// The shared state of a resource is what the lists submitted so far left it
+// in; a list recorded next to others cannot read it. The first transition of
+// a resource on the list only notes the state the list expects it in, the
+// later ones are recorded against the state the list left it in. resolve()
+// runs at submit, in submission order : it returns the barriers to put
+// before the list and moves the shared states to where the list leaves them.
+// The bookkeeping is StateTracker's.
+class ResourceStateTracker {
+  StateTracker tracker;
+  std::vector<StateTracker::Barrier> resolved;
+
+ public:
+  // the state before, newState itself on the first use
+  D3D12_RESOURCE_STATES change(const dxResource* resource,
+                               D3D12_RESOURCE_STATES newState) {
+    return D3D12_RESOURCE_STATES(tracker.change(resource, newState));
+  }
+  // the aliasing barrier of a placed resource the list uses first, put
+  // before the list ahead of its transition; see StateTracker::activate()
+  void activate(const dxResource* resource) { tracker.activate(resource); }
+  bool isTracked(const dxResource* resource) const {
+    return tracker.isTracked(resource);
+  }
+  void resolve(std::vector<D3D12_RESOURCE_BARRIER>* barriers);
+  void clear() { tracker.clear(); }
+
+  // the tracker transitions go to on this thread, null : the shared states
+  static ResourceStateTracker* getCurrent();
+  static void setCurrent(ResourceStateTracker* tracker);
 };
 
 class CommandList {
@@ -266,19 +580,59 @@ class CommandList {
   ID3D12GraphicsCommandList* cmdList = nullptr;
   ID3D12CommandAllocator* cmdAllocator = nullptr;
 
+  // one allocator per frame in flight, each with the fence value of the last
+  // submission recorded from it
+  std::vector<ID3D12CommandAllocator*> allocators;
+  std::vector<UINT64> allocatorFences;
+  UINT allocatorIdx = 0;
+
+  // frame recording : between beginFrame() and endFrame(), begin()/end() pairs
+  // append to one open list which is submitted once
+  CommandQueue* frameQueue = nullptr;
+  bool recording = false;
+
+  CommandState state;
+  ResourceStateTracker resourceStates;
+  GpuProfiler* profiler = nullptr;
+
  public:
   ID3D12GraphicsCommandList* get() { return cmdList; }
+  CommandState* getState() { return &state; }
+  // used while the list is recorded on a worker, see ParallelRecorder
+  ResourceStateTracker* getResourceStates() { return &resourceStates; }
+  // the timestamps of the scopes recorded on this list, may be null
+  void setProfiler(GpuProfiler* gpuProfiler) { profiler = gpuProfiler; }
+  GpuProfiler* getProfiler() { return profiler; }
   ID3D12CommandAllocator* getAllocator() { return cmdAllocator; }
   D3D12_COMMAND_LIST_TYPE getType() { return type; }
   ~CommandList();
   explicit CommandList(
-      D3D12_COMMAND_LIST_TYPE type = D3D12_COMMAND_LIST_TYPE_DIRECT);
+      D3D12_COMMAND_LIST_TYPE type = D3D12_COMMAND_LIST_TYPE_DIRECT,
+      UINT numAllocators = 1);
+  UINT getAllocatorCount() const { return UINT(allocators.size()); }
   void reset();
   ID3D12GraphicsCommandList* begin();
+  // in a frame, returns the value the frame submission will signal, waiting
+  // for it needs split() or endFrame() first
   UINT64 end(CommandQueue* queue, bool waitFinish = false);
+
+  // moves to the next allocator, blocks only when it is still in use by the
+  // frame submitted getAllocatorCount() frames ago
+  void beginFrame(CommandQueue* queue);
+  bool isFrameOpen() const { return frameQueue != nullptr; }
+  // submits what was recorded so far and keeps the frame open
+  UINT64 split();
+  UINT64 endFrame();
+  // for lists submitted together by someone else : closes the frame list,
+  // null when nothing was recorded, then endFrame() with the fence value of
+  // the submission
+  ID3D12CommandList* closeFrame();
+  void endFrame(UINT64 fenceValue);
 };
 
 class dxResource {
+  friend class ResourceStateTracker;
+
  protected:
   ID3D12Resource* resource = nullptr;
   mutable D3D12_RESOURCE_STATES resourceState = D3D12_RESOURCE_STATE_COMMON;
@@ -286,6 +640,10 @@ class dxResource {
   UINT64 bufferSize = 0;
   D3D12_GPU_VIRTUAL_ADDRESS gpuAddress = 0;
 
+  // last upload, it may run on a copy queue
+  CommandQueue* copyQueue = nullptr;
+  UINT64 copyFenceValue = 0;
+
  public:
   virtual ~dxResource() {
     partialDestroy();
@@ -301,8 +659,15 @@ class dxResource {
   }
   ID3D12Resource* get() const { return resource; }
   D3D12_RESOURCE_STATES getState() const { return resourceState; }
+  CommandQueue* getCopyQueue() const { return copyQueue; }
+  UINT64 getCopyFenceValue() const { return copyFenceValue; }
+  // on a worker, the state on the list of ResourceStateTracker::getCurrent()
   D3D12_RESOURCE_STATES changeResourceState(
       ID3D12GraphicsCommandList* cmdList, D3D12_RESOURCE_STATES newState) const;
+  // same as changeResourceState() but appends the barrier to a batch
+  D3D12_RESOURCE_STATES changeResourceState(
+      std::vector<D3D12_RESOURCE_BARRIER>* batch,
+      D3D12_RESOURCE_STATES newState) const;
 };
 
 class DxBuffer : public dxResource {
@@ -316,6 +681,8 @@ class DxBuffer : public dxResource {
   D3D12_GPU_VIRTUAL_ADDRESS gpuAddress = 0;
 
   const StorageType type;
+  // tracked as, see createBuffer()
+  const std::optional<MemoryCategory> category;
   ID3D12Resource* uploader = nullptr;
   void* cpuAddress = nullptr;
 
@@ -331,7 +698,10 @@ class DxBuffer : public dxResource {
     cpuAddress = nullptr;
   }
 
-  explicit DxBuffer(StorageType type = StorageType::cpu) : type(type) {}
+  explicit DxBuffer(
+      StorageType type = StorageType::cpu,
+      std::optional<MemoryCategory> category = std::nullopt)
+      : type(type), category(category) {}
   explicit DxBuffer(UINT64 bufferSize, StorageType type = StorageType::cpu)
       : type(type) {
     create(bufferSize);
@@ -414,52 +784,126 @@ class DescriptorHeap {
   //  create a descriptor storage space
   //  free up resource memory space in cpu and gpu
   D3D12_DESCRIPTOR_HEAP_TYPE type;
-  ID3D12DescriptorHeap* heap = nullptr;
-  std::vector<Descriptor> descriptorArr;
-  UINT numAssigned = 0;
+  bool shaderVisible = false;
+  UINT descriptorSize = 0;
+
+  // persistent descriptors, one heap per page. A shader visible heap is a
+  // single page since only one can be bound; its transient ring follows the
+  // page in the same heap.
+  struct Page {
+    ID3D12DescriptorHeap* heap = nullptr;
+    std::vector<Descriptor> descriptorArr;
+  };
+  std::vector<std::unique_ptr<Page>> pages;
+  DescriptorPool pool;
+  DescriptorRing ring;
+  std::mutex ringMutex;  // lists recorded in parallel stage their tables
+  UINT pageSize = 0;
+  UINT ringSize = 0;
+
+  void addPage();
+  const Descriptor* allocate();
 
  public:
   ~DescriptorHeap();
   DescriptorHeap() = delete;
-  DescriptorHeap(UINT maxDescriptors, D3D12_DESCRIPTOR_HEAP_TYPE heapType);
-
-  ID3D12DescriptorHeap* get() const { return heap; }
-  void bind(ID3D12GraphicsCommandList* cmdList) const;
+  // only CBV_SRV_UAV heaps are shader visible
+  DescriptorHeap(UINT maxDescriptors, D3D12_DESCRIPTOR_HEAP_TYPE heapType)
+      : DescriptorHeap(maxDescriptors, heapType,
+                       heapType == D3D12_DESCRIPTOR_HEAP_TYPE_CBV_SRV_UAV) {}
+  // non shader visible heaps grow by pageSize, shader visible ones keep
+  // ringSize more slots for the tables copied in each frame
+  DescriptorHeap(UINT pageSize, D3D12_DESCRIPTOR_HEAP_TYPE heapType,
+                 bool shaderVisible, UINT ringSize = 0);
+
+  ID3D12DescriptorHeap* get() const { return pages[0]->heap; }
+  UINT getDescriptorSize() const { return descriptorSize; }
+  UINT getUsedCount() const { return pool.getUsedCount(); }
+  // returns true when the heap was not bound on the list yet
+  bool bind(ID3D12GraphicsCommandList* cmdList, CommandState* state) const;
 
   const Descriptor* assignRtv(
       const dxResource& resource,
       const D3D12_RENDER_TARGET_VIEW_DESC* desc = nullptr) {
     assert(type == D3D12_DESCRIPTOR_HEAP_TYPE_RTV);
-    descriptorArr[numAssigned].assignRtv(resource, desc);
-    return &descriptorArr[numAssigned++];
+    const Descriptor* descriptor = allocate();
+    descriptor->assignRtv(resource, desc);
+    return descriptor;
   }
   const Descriptor* assignDsv(
       const dxResource& resource,
       const D3D12_DEPTH_STENCIL_VIEW_DESC* desc = nullptr) {
     assert(type == D3D12_DESCRIPTOR_HEAP_TYPE_DSV);
-    descriptorArr[numAssigned].assignDsv(resource, desc);
-    return &descriptorArr[numAssigned++];
+    const Descriptor* descriptor = allocate();
+    descriptor->assignDsv(resource, desc);
+    return descriptor;
   }
   const Descriptor* assignSrv(
       const dxResource& resource,
       const D3D12_SHADER_RESOURCE_VIEW_DESC* desc = nullptr) {
     assert(type == D3D12_DESCRIPTOR_HEAP_TYPE_CBV_SRV_UAV);
-    descriptorArr[numAssigned].assignSrv(resource, desc);
-    return &descriptorArr[numAssigned++];
+    const Descriptor* descriptor = allocate();
+    descriptor->assignSrv(resource, desc);
+    return descriptor;
   }
   const Descriptor* assignUav(
       const dxResource& resource,
       const D3D12_UNORDERED_ACCESS_VIEW_DESC* desc = nullptr,
       ID3D12Resource* counter = nullptr) {
     assert(type == D3D12_DESCRIPTOR_HEAP_TYPE_CBV_SRV_UAV);
-    descriptorArr[numAssigned].assignUav(resource, desc, counter);
-    return &descriptorArr[numAssigned++];
+    const Descriptor* descriptor = allocate();
+    descriptor->assignUav(resource, desc, counter);
+    return descriptor;
   }
   const Descriptor* assignCbv(const D3D12_CONSTANT_BUFFER_VIEW_DESC* desc) {
     assert(type == D3D12_DESCRIPTOR_HEAP_TYPE_CBV_SRV_UAV);
-    descriptorArr[numAssigned].assignCbv(desc);
-    return &descriptorArr[numAssigned++];
+    const Descriptor* descriptor = allocate();
+    descriptor->assignCbv(desc);
+    return descriptor;
   }
+  // the slot is reused by the next assign
+  void release(const Descriptor* descriptor);
+
+  // a new slot holding a copy of src, e.g. a staging view made persistent
+  const Descriptor* copy(const Descriptor& src);
+  void copy(const Descriptor* dst, const Descriptor& src) const;
+  // bindless tables start at the first slot and index the first page
+  const Descriptor& getStart() const { return pages[0]->descriptorArr[0]; }
+  UINT getIndex(const Descriptor* descriptor) const {
+    assert(descriptor >= pages[0]->descriptorArr.data() &&
+           descriptor < pages[0]->descriptorArr.data() + pageSize);
+    return UINT(descriptor - pages[0]->descriptorArr.data());
+  }
+
+  // copies the source ranges into contiguous ring slots with one
+  // CopyDescriptors, returns the gpu handle of the first
+  D3D12_GPU_DESCRIPTOR_HANDLE stage(
+      const D3D12_CPU_DESCRIPTOR_HANDLE* srcStarts, const UINT* srcSizes,
+      UINT numRanges);
+  // ring slots staged until now are in use until fenceValue retires
+  void endFrame(UINT64 fenceValue) { ring.endFrame(fenceValue); }
+  void retire(UINT64 completedValue) { ring.retire(completedValue); }
+};
+
+// Shader resources read through one unbounded table.
+// Views are copied into persistent slots of the shader visible heap and
+// shaders index the table with the id add() returned, so a pass binds the
+// table once instead of re-pointing a table per texture and per draw. Bind
+// getTable() to an unbounded range, e.g. RootTable("(1)t0-").
+class BindlessTable {
+  DescriptorHeap* heap = nullptr;
+  std::vector<const Descriptor*> entries;  // by id, null when removed
+
+ public:
+  explicit BindlessTable(DescriptorHeap* shaderVisibleHeap)
+      : heap(shaderVisibleHeap) {}
+  ~BindlessTable();
+
+  UINT add(const Descriptor& view);
+  // the gpu must be done with the old view, e.g. between frames
+  void update(UINT id, const Descriptor& view);
+  void remove(UINT id);
+  const Descriptor& getTable() const { return heap->getStart(); }
 };
 
 class Texture : public dxResource {
@@ -477,6 +921,9 @@ class Texture : public dxResource {
   virtual void allocateDescriptor();
 
   void* getData(const char* filePath, UINT* width, UINT* height);
+  void copyFromUploader(ID3D12Resource* uploader,
+                        const D3D12_TEXTURE_COPY_LOCATION& dst,
+                        const D3D12_TEXTURE_COPY_LOCATION& src);
 
  public:
   DXGI_FORMAT getFormat() const { return format; }
@@ -485,6 +932,11 @@ class Texture : public dxResource {
   UINT getDepth() const { return depth; }
   const Descriptor& getSrv() const { return *srv; }
 
+  // the heaps outlive the textures, their slots are given back
+  ~Texture() override {
+    if (srv) srvHeap->release(srv);
+  }
+
   virtual void clear(CommandList* cmdList, float* clearValue = nullptr) {
     assert(false);
   }
@@ -525,9 +977,17 @@ class RootParameter {
 };
 
 class RootTable : public RootParameter {
-  D3D12_GPU_DESCRIPTOR_HANDLE tableStart;
+  // resolved at bind time when the table is staged
+  mutable D3D12_GPU_DESCRIPTOR_HANDLE tableStart{};
+  // descriptors of a non shader-visible heap, copied into the ring on bind
+  D3D12_CPU_DESCRIPTOR_HANDLE stagedStart{};
+  UINT numDescriptors = 0;
+  // an unbounded range reads the heap in place, it can't be staged
+  bool unbounded = false;
   std::vector<D3D12_DESCRIPTOR_RANGE> ranges = {};
 
+  friend class RootSignature;
+
  public:
   RootTable() = delete;
   explicit RootTable(const char* code) { create(code); }
@@ -539,7 +999,19 @@ class RootTable : public RootParameter {
 
   void setTableStart(D3D12_GPU_DESCRIPTOR_HANDLE handle) {
     tableStart = handle;
+    stagedStart = {};
   }
+  // a descriptor of a staging heap has no gpu address
+  void setTable(const Descriptor& start) {
+    if (start.getGpuHandle().ptr != 0) {
+      setTableStart(start.getGpuHandle());
+    } else {
+      assert(!unbounded);
+      stagedStart = start.getCpuHandle();
+    }
+  }
+  bool isStaged() const { return stagedStart.ptr != 0; }
+  UINT getNumDescriptors() const { return numDescriptors; }
 
   void create(const char* code);
   bool isRootTable() const override { return true; }
@@ -617,64 +1089,232 @@ class RootSignature {
   ID3D12RootSignature* rootSig = nullptr;
   bool bIncludeRootTable = false;
   std::vector<VarRootParam> params;
-  std::map<std::string_view, UINT> indices;
+  // hashName() of the parameter names, in parameter order
+  std::vector<uint32_t> nameHashes;
+  // of the serialized description, set in build()
+  UINT64 hash = 0;
+
+  // one bit per parameter set since the last bind, and the list it went to :
+  // on that list only the dirty ones are pushed again
+  mutable uint32_t dirtyParams = ~0u;
+  mutable const CommandState* boundState = nullptr;
+
+  // copies the tables of staging heaps into the ring of the bound heap
+  void stageTables(DescriptorHeap* heap, uint32_t mask) const;
+  void bind(ID3D12GraphicsCommandList* cmdList, DescriptorHeap* heap,
+            CommandState* state, bool compute) const;
 
  public:
   ~RootSignature();
   RootSignature() {}
   ID3D12RootSignature* get() const { return rootSig; }
+  UINT64 getHash() const { return hash; }
   bool includeRootTable() const { return bIncludeRootTable; }
 
   void build(D3D12_ROOT_SIGNATURE_FLAGS flags = D3D12_ROOT_SIGNATURE_FLAG_NONE);
   void build(const std::vector<D3D12_STATIC_SAMPLER_DESC>& samplerArr,
              D3D12_ROOT_SIGNATURE_FLAGS flags = D3D12_ROOT_SIGNATURE_FLAG_NONE);
-  void bindCompute(ID3D12GraphicsCommandList* cmdList,
-                   DescriptorHeap* heap) const;
-  void bindGraphics(ID3D12GraphicsCommandList* cmdList,
-                    DescriptorHeap* heap) const;
+  void bindCompute(ID3D12GraphicsCommandList* cmdList, DescriptorHeap* heap,
+                   CommandState* state) const {
+    bind(cmdList, heap, state, true);
+  }
+  void bindGraphics(ID3D12GraphicsCommandList* cmdList, DescriptorHeap* heap,
+                    CommandState* state) const {
+    bind(cmdList, heap, state, false);
+  }
 
   RootSignature(
       std::initializer_list<std::pair<std::string_view, VarRootParam>> list) {
     for (auto& [str, var] : list) {
       params.push_back(std::move(*const_cast<VarRootParam*>(&var)));
-      indices.emplace(str, params.size() - 1);
+      // find() tells the parameters apart by their hash alone, checked here
+      // on the names the signature declares
+      assert(std::find(nameHashes.begin(), nameHashes.end(), hashName(str)) ==
+             nameHashes.end());
+      nameHashes.push_back(hashName(str));
+    }
+    assert(params.size() <= 32);
+  }
+
+  // a few parameters per signature, scanning the hashes beats any lookup
+  UINT find(StaticName name) const {
+    for (UINT i = 0; i < nameHashes.size(); ++i) {
+      if (nameHashes[i] == name.hash) return i;
     }
+    assert(false);  // no parameter of that name
+    return 0;
   }
 
   template <typename T>
-  void set(std::string_view name, const T& data) {
-    std::any any_data = data;
-
-    if (params[indices[name]].index() == 0) {
-      std::get<RootConstants>(params[indices[name]]).setConstants(data);
-    } else if (params[indices[name]].index() == 1) {
-      std::get<RootPointer>(params[indices[name]])
-          .setResourceAddress(
-              std::any_cast<D3D12_GPU_VIRTUAL_ADDRESS>(any_data));
+  void set(StaticName name, const T& data) {
+    set(find(name), data);
+  }
+
+  // for ExecuteIndirect : each command sets the named root constants, then
+  // draws; the commands are laid out as IndirectDraw<the constants type>
+  ID3D12CommandSignature* createDrawSignature(StaticName constants,
+                                              UINT byteStride) const;
+  // the root arguments ExecuteIndirect wrote are undefined after it
+  void invalidate(StaticName name) const { dirtyParams |= 1u << find(name); }
+
+  // the parameter kind follows from the type, the data is copied in place
+  template <typename T>
+  void set(UINT paramIdx, const T& data) {
+    VarRootParam& param = params[paramIdx];
+    dirtyParams |= 1u << paramIdx;
+    if constexpr (std::is_same_v<T, Descriptor>) {
+      std::get<RootTable>(param).setTable(data);
+    } else if constexpr (std::is_same_v<T, D3D12_GPU_VIRTUAL_ADDRESS>) {
+      std::get<RootPointer>(param).setResourceAddress(data);
     } else {
-      std::get<RootTable>(params[indices[name]])
-          .setTableStart(std::any_cast<Descriptor>(any_data).getGpuHandle());
+      std::get<RootConstants>(param).setConstants(data);
     }
   }
 };
 
+// one command of a draw signature, see RootSignature::createDrawSignature()
+template <typename Constants>
+struct IndirectDraw {
+  Constants constants;
+  D3D12_DRAW_INDEXED_ARGUMENTS draw;
+};
+
+// Commands for ExecuteIndirect written on the GPU.
+// A compute pass writes the commands and counts them in a second buffer,
+// both through root UAVs; ExecuteIndirect reads the count there, so the CPU
+// never learns how many draws were kept.
+class IndirectCommandBuffer {
+  DxBuffer commands{DxBuffer::StorageType::gpu, MemoryCategory::indirect};
+  DxBuffer count{DxBuffer::StorageType::gpu, MemoryCategory::indirect};
+  DxBuffer zero{DxBuffer::StorageType::cpu};
+  UINT stride = 0;
+  UINT maxCommands = 0;
+
+ public:
+  IndirectCommandBuffer() {}
+  IndirectCommandBuffer(UINT stride, UINT maxCommands) {
+    create(stride, maxCommands);
+  }
+  void create(UINT stride, UINT maxCommands);
+
+  UINT getStride() const { return stride; }
+  UINT getMaxCommands() const { return maxCommands; }
+  D3D12_GPU_VIRTUAL_ADDRESS getCommandAddress() const {
+    return commands.getGpuAddress();
+  }
+  D3D12_GPU_VIRTUAL_ADDRESS getCountAddress() const {
+    return count.getGpuAddress();
+  }
+
+  // zeroes the count, before the compute pass writes
+  void reset(ID3D12GraphicsCommandList* cmdList);
+  void execute(ID3D12GraphicsCommandList* cmdList,
+               ID3D12CommandSignature* signature);
+};
+
+// Texture space tiles seen on screen, for shading only those.
+// Each mask has a bit per tile of tileSize x tileSize texels, set by the
+// pixel shaders of the draws sampling the texture space (VisibleTiles.hlsli).
+// A TileCompact pass turns a mask into the list of its tiles and the group
+// count of an indirect dispatch over them, then the mask is cleared for the
+// next marks; so the tiles shaded in a frame are the ones seen in the frame
+// before. A mask holds garbage until its first compaction, which has to list
+// every tile. TileMask is the cpu reference.
+class VisibleTiles {
+  DxBuffer masks{DxBuffer::StorageType::gpu, MemoryCategory::tileMask};
+  DxBuffer tiles{DxBuffer::StorageType::gpu, MemoryCategory::tileMask};
+  DxBuffer args{DxBuffer::StorageType::gpu, MemoryCategory::indirect};
+  // the source of the resets : a zero mask, then D3D12_DISPATCH_ARGUMENTS
+  DxBuffer initial{DxBuffer::StorageType::cpu};
+  DxBuffer coverage{DxBuffer::StorageType::gpu, MemoryCategory::tileMask};
+  UINT coverageLevels = 0;
+  ID3D12CommandSignature* dispatchSignature = nullptr;
+  UINT tilesX = 0;
+  UINT tilesY = 0;
+  UINT maskWords = 0;
+
+ public:
+  static const UINT tileSize = 8;
+
+  VisibleTiles() {}
+  ~VisibleTiles() { SAFE_RELEASE(dispatchSignature); }
+  // numMasks masks of the tiles of width x height texels
+  void create(UINT width, UINT height, UINT numMasks);
+
+  UINT getTilesX() const { return tilesX; }
+  UINT getTilesY() const { return tilesY; }
+  // the masks are in one buffer, the draws offset into it
+  UINT getMaskOffset(UINT mask) const { return mask * maskWords * 4; }
+  D3D12_GPU_VIRTUAL_ADDRESS getMasksAddress() const {
+    return masks.getGpuAddress();
+  }
+  D3D12_GPU_VIRTUAL_ADDRESS getMaskAddress(UINT mask) const {
+    return masks.getGpuAddress() + getMaskOffset(mask);
+  }
+  D3D12_GPU_VIRTUAL_ADDRESS getTileAddress(UINT mask) const {
+    return tiles.getGpuAddress() + UINT64(mask) * tilesX * tilesY * 4;
+  }
+  D3D12_GPU_VIRTUAL_ADDRESS getArgsAddress(UINT mask) const {
+    return args.getGpuAddress() + mask * sizeof(D3D12_DISPATCH_ARGUMENTS);
+  }
+
+  // before the compaction of a mask : its marks readable, its count zeroed
+  void beginCompact(ID3D12GraphicsCommandList* cmdList, UINT mask);
+  // after it : the mask cleared and writable by the draws again
+  void endCompact(ID3D12GraphicsCommandList* cmdList, UINT mask);
+  // one group per listed tile, the pass reads the list in its shader
+  void dispatch(ID3D12GraphicsCommandList* cmdList, UINT mask);
+
+  // the tiles the texture space holds anything in, shared by the masks; a
+  // level per shaded size, level l for width >> l
+  void setCoverage(CommandQueue* cmdQueue, CommandList* cmdList,
+                   const std::vector<TileMask>& levels);
+  UINT getCoverageLevels() const { return coverageLevels; }
+  const DxBuffer& getCoverage() const { return coverage; }
+  D3D12_GPU_VIRTUAL_ADDRESS getCoverageAddress(UINT level) const {
+    assert(level < coverageLevels);
+    return coverage.getGpuAddress() + UINT64(level) * maskWords * 4;
+  }
+};
+
 class RenderTarget : public Texture {
   const Descriptor* rtv = nullptr;
   DescriptorHeap* rtvHeap = nullptr;
+  // also written by compute passes, the uav lives in the srv heap
+  const Descriptor* uav = nullptr;
+  bool unorderedAccess = false;
+
+  // placed in a shared heap instead of a committed resource when set
+  ID3D12Heap* placedHeap = nullptr;
+  UINT64 placedOffset = 0;
 
   void allocateResource() override;
   void allocateDescriptor() override;
 
  public:
   const Descriptor& getRtv() const { return *rtv; }
+  const Descriptor& getUav() const {
+    assert(unorderedAccess);
+    return *uav;
+  }
   void clear(CommandList* cmdList, float* clearValue = nullptr) override;
+  // re-creates the resource at the given heap offset, descriptors are kept
+  void place(ID3D12Heap* heap, UINT64 heapOffset);
 
+  ~RenderTarget() override {
+    if (rtv) rtvHeap->release(rtv);
+    if (uav) srvHeap->release(uav);
+  }
   RenderTarget(DescriptorHeap* srvHeap, DescriptorHeap* _rtvHeap,
                CommandQueue* queue, DXGI_FORMAT format)
       : Texture(srvHeap, queue, format), rtvHeap(_rtvHeap) {}
   RenderTarget(DescriptorHeap* srvHeap, DescriptorHeap* _rtvHeap,
                CommandQueue* queue, DXGI_FORMAT format, UINT width,
                UINT height);
+  RenderTarget(DescriptorHeap* srvHeap, DescriptorHeap* _rtvHeap,
+               CommandQueue* queue, DXGI_FORMAT format, UINT width,
+               UINT height, ID3D12Heap* heap, UINT64 heapOffset,
+               bool unorderedAccess = false);
 };
 
 class DepthTarget : public Texture {
@@ -687,6 +1327,9 @@ class DepthTarget : public Texture {
   const Descriptor& getDsv() const { return *dsv; }
   void clear(CommandList* cmdList, float* clearValue = nullptr) override;
 
+  ~DepthTarget() override {
+    if (dsv) dsvHeap->release(dsv);
+  }
   DepthTarget(DescriptorHeap* dec, DescriptorHeap* _dsvHeap,
               CommandQueue* queue, DXGI_FORMAT format)
       : Texture(dec, queue, format), dsvHeap(_dsvHeap) {}
@@ -704,6 +1347,9 @@ class ComputeTarget : public Texture {
   const Descriptor& getUav() const { return *uav; }
   void clear(CommandList* cmdList, float* clearValue = nullptr) override;
 
+  ~ComputeTarget() override {
+    if (uav) uavHeap->release(uav);
+  }
   ComputeTarget(DescriptorHeap* dec, DescriptorHeap* _uavHeap,
                 CommandQueue* queue, DXGI_FORMAT format)
       : Texture(dec, queue, format), uavHeap(_uavHeap) {}
@@ -731,6 +1377,101 @@ class ReadbackBuffer {
   void readback(ID3D12GraphicsCommandList* cmdList, const dxResource& source);
 };
 
+// GPU timestamps around scopes, fed to a Profiler on a track of their own.
+// The queries of a frame are resolved at its end and read back once its fence
+// has passed, one slot per frame in flight. GPU ticks are put on the profiler
+// clock through a calibration taken at creation.
+class GpuProfiler {
+ public:
+  static const UINT invalid = UINT_MAX;
+
+ private:
+  struct Frame {
+    UINT64 fenceValue = 0;  // 0 once read
+    std::vector<std::string> names;
+  };
+
+  CommandQueue* queue;
+  Profiler* profiler;
+  uint32_t track;
+  UINT maxScopes;
+  ID3D12QueryHeap* queryHeap = nullptr;
+  ReadbackBuffer readback;
+  std::vector<Frame> frames;
+  UINT frameIdx = 0;
+  std::mutex mutex;  // lists recorded in parallel open scopes
+
+  double usPerTick;
+  UINT64 calibrationTick;
+  double calibrationUs;
+
+  void collect(UINT slot);
+
+ public:
+  GpuProfiler(CommandQueue* queue, Profiler* profiler, std::string trackName,
+              UINT framesInFlight, UINT maxScopes = 64);
+  ~GpuProfiler();
+
+  // reads what finished, the next frame records into a free slot
+  void beginFrame();
+  // invalid when the frame has no query left
+  UINT begin(ID3D12GraphicsCommandList* cmdList, std::string name);
+  void end(ID3D12GraphicsCommandList* cmdList, UINT scope);
+  // the last thing recorded in the frame, then endFrame() with the fence the
+  // frame submission signals
+  void resolve(CommandList* cmdList);
+  void endFrame(UINT64 fenceValue);
+};
+
+// A timestamp pair around the commands recorded in its lifetime, nothing
+// when the list has no profiler.
+class GpuScope {
+  GpuProfiler* profiler;
+  ID3D12GraphicsCommandList* cmdList;
+  UINT scope = GpuProfiler::invalid;
+
+ public:
+  GpuScope(CommandList* cmdList, std::string name)
+      : profiler(cmdList->getProfiler()), cmdList(cmdList->get()) {
+    if (profiler) scope = profiler->begin(this->cmdList, std::move(name));
+  }
+  ~GpuScope() {
+    if (profiler) profiler->end(cmdList, scope);
+  }
+  GpuScope(const GpuScope&) = delete;
+  GpuScope& operator=(const GpuScope&) = delete;
+};
+
+// Records a frame on several threads.
+// Each of the lists has its own allocators and is recorded by one task of a
+// TaskPool, the resource transitions it records are tracked on the list
+// (see ResourceStateTracker). submit() resolves the lists in their order,
+// puts the barriers a list expects in a small list before it, and submits
+// all of them at once; the result does not depend on which thread recorded
+// which list or when it finished.
+class ParallelRecorder {
+  CommandQueue* queue;
+  std::vector<std::unique_ptr<CommandList>> lists;
+  std::vector<std::unique_ptr<CommandList>> fixups;  // the barriers before
+  TaskPool pool;
+  std::vector<D3D12_RESOURCE_BARRIER> barriers;
+
+ public:
+  // numLists lists recorded by numLists - 1 workers and the caller
+  ParallelRecorder(CommandQueue* queue, UINT numLists, UINT framesInFlight);
+
+  CommandQueue* getQueue() { return queue; }
+  UINT getListCount() const { return UINT(lists.size()); }
+  CommandList* getList(UINT idx) { return lists[idx].get(); }
+  void setProfiler(GpuProfiler* gpuProfiler);
+
+  // func(i, list i) for every list, on the workers; returns when all are
+  // recorded. A list may not be submitted by func.
+  void record(const std::function<void(UINT, CommandList*)>& func);
+  // the lists in order, returns the fence value of the submission
+  UINT64 submit();
+};
+
 class dxShader {
   ID3DBlob* code{};
 
@@ -772,6 +1513,9 @@ class GraphicsPipeline {
   mutable ID3D12GraphicsCommandList* currentCmdList = nullptr;
   mutable std::vector<D3D12_RESOURCE_BARRIER> beginBarriers;
   mutable std::vector<D3D12_RESOURCE_BARRIER> endBarriers;
+  // the targets end() moves back, with their states before begin()
+  mutable std::vector<std::pair<const dxResource*, D3D12_RESOURCE_STATES>>
+      restoreStates;
   mutable bool doClear = false;
 
  public:
@@ -800,7 +1544,46 @@ class GraphicsPipeline {
   }
   void setScissorRect(const D3D12_RECT& rect) { scissorRect = rect; }
   void clearTargetsBeforeNextRender() const { doClear = true; }
-  void begin(ID3D12GraphicsCommandList* cmdList) const;
+  // state : cache of the list, skips what is already bound
+  void begin(ID3D12GraphicsCommandList* cmdList, CommandState* state) const;
+  void end() const;
+
+  void SetName(const wchar_t* name) {
+    pipeline->SetName((std::wstring(L"[PSO: ") + name + L"]").c_str());
+  }
+};
+
+class ComputePipeline {
+  // set in build()
+  ID3D12PipelineState* pipeline = nullptr;
+  const RootSignature* pRootSig = nullptr;
+
+  // sized in & set after build(), the uavs the dispatch writes
+  std::vector<const Descriptor*> uavHandles;
+  DescriptorHeap* decHeap = nullptr;
+
+  mutable ID3D12GraphicsCommandList* currentCmdList = nullptr;
+  mutable std::vector<D3D12_RESOURCE_BARRIER> beginBarriers;
+  mutable std::vector<D3D12_RESOURCE_BARRIER> endBarriers;
+  // the targets end() moves back, with their states before begin()
+  mutable std::vector<std::pair<const dxResource*, D3D12_RESOURCE_STATES>>
+      restoreStates;
+
+ public:
+  explicit ComputePipeline(DescriptorHeap* heap) : decHeap(heap) {}
+  ~ComputePipeline() { destroy(); }
+  void destroy();
+
+  void build(const RootSignature* rootSig, D3D12_SHADER_BYTECODE csCode,
+             UINT numUavs);
+
+  void setUavHandle(UINT uavIdx, const Descriptor& uav) {
+    assert(uavIdx < uavHandles.size());
+    uavHandles[uavIdx] = &uav;
+  }
+
+  // state : cache of the list, skips what is already bound
+  void begin(ID3D12GraphicsCommandList* cmdList, CommandState* state) const;
   void end() const;
 
   void SetName(const wchar_t* name) {
@@ -848,6 +1631,14 @@ class MeshData {
   DxBuffer idxBuff = DxBuffer(DxBuffer::StorageType::gpu);
   DxBuffer wireIdxBuffer = DxBuffer(DxBuffer::StorageType::gpu);
   XMMATRIX modelMat = XMMatrixIdentity();
+  // object space bounds of the loaded vertices
+  float3 boundsMin;
+  float3 boundsMax;
+  // around the loaded vertices, center and radius
+  float4 boundingSphere;
+  // as loaded, kept for cpu work on the mesh
+  std::vector<float> vertices;  // x, y, z, nx, ny, nz, u, v
+  std::vector<UINT> indices;    // i, j, k
   ID3D12Resource* blas = nullptr;
   ID3D12Resource* tlas = nullptr;
 
@@ -857,6 +1648,14 @@ class MeshData {
                     bool flipTexV = false, bool centering = true,
                     bool buildAS = false, bool needWire = false);
   MeshData() {}
+
+  // the tiles of a width x height texture space the uv layout covers when
+  // sampled at texcoord * uvScale, grown by dilation texels
+  TileMask uvCoverage(UINT width, UINT height, UINT tileSize, float uvScale,
+                      float dilation) const;
+  // a low poly version for occlusion culling, gridCells per side of the bounds
+  OccluderMesh occluder(UINT gridCells) const;
+
   ~MeshData() {
     SAFE_RELEASE(blas);
     SAFE_RELEASE(tlas);
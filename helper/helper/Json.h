@@ -0,0 +1,26 @@
+#pragma once
+#include <cstdint>
+#include <cstdio>
+#include <string>
+
+// text as the inside of a JSON string : quotes, backslashes and control
+// characters escaped
+inline std::string escapeJson(const std::string& text) {
+  std::string escaped;
+  escaped.reserve(text.size());
+  for (char c : text) {
+    if (c == '"' || c == '\\') {
+      escaped += '\\';
+      escaped += c;
+    } else if (c == '\n') {
+      escaped += "\\n";
+    } else if (uint8_t(c) < 0x20) {
+      char code[8];
+      snprintf(code, sizeof(code), "\\u%04x", c);
+      escaped += code;
+    } else {
+      escaped += c;
+    }
+  }
+  return escaped;
+}
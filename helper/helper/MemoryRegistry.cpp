@@ -0,0 +1,221 @@
+#include "MemoryRegistry.h"
+
+#include <algorithm>
+#include <cassert>
+#include <cstdio>
+#include <fstream>
+#include <sstream>
+
+#include "Json.h"
+
+static const double MB = 1024.0 * 1024.0;
+
+const char* memoryCategoryName(MemoryCategory category) {
+  switch (category) {
+    case MemoryCategory::mesh:
+      return "mesh";
+    case MemoryCategory::texture:
+      return "texture";
+    case MemoryCategory::renderTarget:
+      return "render target";
+    case MemoryCategory::staging:
+      return "staging";
+    case MemoryCategory::readback:
+      return "readback";
+    case MemoryCategory::indirect:
+      return "indirect";
+    case MemoryCategory::tileMask:
+      return "tile mask";
+    default:
+      assert(false);
+      return "";
+  }
+}
+
+MemoryRegistry::MemoryRegistry(size_t maxReleased)
+    : maxReleased(maxReleased) {}
+
+MemoryRegistry::Id MemoryRegistry::add(std::string name, std::string format,
+                                       MemoryCategory category, uint64_t size,
+                                       std::string creator) {
+  assert(category < MemoryCategory::count);
+  std::lock_guard<std::mutex> lock(mutex);
+  Record record;
+  record.id = nextId++;
+  record.name = std::move(name);
+  record.format = std::move(format);
+  record.category = category;
+  record.size = size;
+  record.creator = std::move(creator);
+  record.createdFrame = frame;
+
+  size_t c = size_t(category);
+  totals.live[c] += size;
+  totals.peak[c] = std::max(totals.peak[c], totals.live[c]);
+  ++totals.liveCount[c];
+  totals.liveTotal += size;
+  totals.peakTotal = std::max(totals.peakTotal, totals.liveTotal);
+
+  Id id = record.id;
+  live.emplace(id, std::move(record));
+  return id;
+}
+
+void MemoryRegistry::release(Id id) {
+  std::lock_guard<std::mutex> lock(mutex);
+  auto it = live.find(id);
+  assert(it != live.end());
+  if (it == live.end()) return;
+
+  Record& record = it->second;
+  size_t c = size_t(record.category);
+  totals.live[c] -= record.size;
+  --totals.liveCount[c];
+  totals.liveTotal -= record.size;
+
+  record.releasedFrame = frame;
+  released.push_back(std::move(record));
+  if (released.size() > maxReleased) released.pop_front();
+  live.erase(it);
+}
+
+void MemoryRegistry::beginFrame() {
+  std::lock_guard<std::mutex> lock(mutex);
+  ++frame;
+}
+
+uint64_t MemoryRegistry::getFrame() const {
+  std::lock_guard<std::mutex> lock(mutex);
+  return frame;
+}
+
+MemoryRegistry::Totals MemoryRegistry::getTotals() const {
+  std::lock_guard<std::mutex> lock(mutex);
+  return totals;
+}
+
+bool MemoryRegistry::find(Id id, Record* record) const {
+  std::lock_guard<std::mutex> lock(mutex);
+  auto it = live.find(id);
+  if (it == live.end()) return false;
+  *record = it->second;
+  return true;
+}
+
+MemoryRegistry::Snapshot MemoryRegistry::snapshot() const {
+  std::lock_guard<std::mutex> lock(mutex);
+  return {frame, live};
+}
+
+MemoryRegistry::Diff MemoryRegistry::diff(const Snapshot& before,
+                                          const Snapshot& after) {
+  Diff result;
+  // both maps are ordered by id, walk them side by side
+  auto a = before.records.begin();
+  auto b = after.records.begin();
+  while (a != before.records.end() || b != after.records.end()) {
+    if (b == after.records.end() ||
+        (a != before.records.end() && a->first < b->first)) {
+      result.removed.push_back(a->second);
+      result.delta[size_t(a->second.category)] -= int64_t(a->second.size);
+      result.deltaTotal -= int64_t(a->second.size);
+      ++a;
+    } else if (a == before.records.end() || b->first < a->first) {
+      result.added.push_back(b->second);
+      result.delta[size_t(b->second.category)] += int64_t(b->second.size);
+      result.deltaTotal += int64_t(b->second.size);
+      ++b;
+    } else {
+      ++a;
+      ++b;
+    }
+  }
+  return result;
+}
+
+static void writeRecord(std::ostringstream& ss,
+                        const MemoryRegistry::Record& record, bool live) {
+  ss << "{\"id\":" << record.id << ",\"name\":\"" << escapeJson(record.name)
+     << "\",\"format\":\"" << escapeJson(record.format)
+     << "\",\"category\":\"" << memoryCategoryName(record.category)
+     << "\",\"size\":" << record.size << ",\"creator\":\""
+     << escapeJson(record.creator)
+     << "\",\"createdFrame\":" << record.createdFrame;
+  if (!live) ss << ",\"releasedFrame\":" << record.releasedFrame;
+  ss << "}";
+}
+
+std::string MemoryRegistry::reportJson() const {
+  std::lock_guard<std::mutex> lock(mutex);
+  std::ostringstream ss;
+  ss << "{\"frame\":" << frame << ",\"liveTotal\":" << totals.liveTotal
+     << ",\"peakTotal\":" << totals.peakTotal << ",\"categories\":{";
+  for (size_t c = 0; c < size_t(MemoryCategory::count); ++c) {
+    ss << (c ? "," : "") << "\n\"" << memoryCategoryName(MemoryCategory(c))
+       << "\":{\"live\":" << totals.live[c] << ",\"peak\":" << totals.peak[c]
+       << ",\"count\":" << totals.liveCount[c] << "}";
+  }
+
+  // the largest first, that is what the report is read for
+  std::vector<const Record*> sorted;
+  for (const auto& [id, record] : live) sorted.push_back(&record);
+  std::stable_sort(sorted.begin(), sorted.end(),
+                   [](const Record* a, const Record* b) {
+                     return a->size > b->size;
+                   });
+  ss << "},\"live\":[";
+  for (size_t i = 0; i < sorted.size(); ++i) {
+    ss << (i ? "," : "") << "\n";
+    writeRecord(ss, *sorted[i], true);
+  }
+  ss << "],\"released\":[";
+  for (size_t i = 0; i < released.size(); ++i) {
+    ss << (i ? "," : "") << "\n";
+    writeRecord(ss, released[i], false);
+  }
+  ss << "]}\n";
+  return ss.str();
+}
+
+bool MemoryRegistry::writeReport(const std::string& path) const {
+  std::ofstream file(path, std::ios::binary | std::ios::trunc);
+  if (!file) return false;
+  file << reportJson();
+  return bool(file);
+}
+
+std::string MemoryRegistry::describe() const {
+  Totals t = getTotals();
+  std::ostringstream ss;
+  char line[128];
+  for (size_t c = 0; c < size_t(MemoryCategory::count); ++c) {
+    snprintf(line, sizeof(line), "%-14s %4u live %9.1f MB, peak %9.1f MB\n",
+             memoryCategoryName(MemoryCategory(c)), t.liveCount[c],
+             t.live[c] / MB, t.peak[c] / MB);
+    ss << line;
+  }
+  snprintf(line, sizeof(line), "%-14s      live %9.1f MB, peak %9.1f MB\n",
+           "total", t.liveTotal / MB, t.peakTotal / MB);
+  ss << line;
+  return ss.str();
+}
+
+std::string MemoryRegistry::describe(const Diff& diff) {
+  std::ostringstream ss;
+  char line[256];
+  for (const Record& record : diff.added) {
+    snprintf(line, sizeof(line), "+ %-24s %-14s %9.1f MB\n",
+             record.name.c_str(), memoryCategoryName(record.category),
+             record.size / MB);
+    ss << line;
+  }
+  for (const Record& record : diff.removed) {
+    snprintf(line, sizeof(line), "- %-24s %-14s %9.1f MB\n",
+             record.name.c_str(), memoryCategoryName(record.category),
+             record.size / MB);
+    ss << line;
+  }
+  snprintf(line, sizeof(line), "total %+.1f MB\n", diff.deltaTotal / MB);
+  ss << line;
+  return ss.str();
+}
@@ -0,0 +1,94 @@
+#pragma once
+#include <cstdint>
+#include <deque>
+#include <map>
+#include <mutex>
+#include <string>
+#include <vector>
+
+enum class MemoryCategory : uint8_t {
+  mesh,          // vertex and index buffers, default heap buffers
+  texture,       // sampled textures
+  renderTarget,  // render, depth and unordered access targets
+  staging,       // upload heap
+  readback,      // readback heap
+  indirect,      // indirect commands and arguments, the draws culled into them
+  tileMask,      // tile masks, tile lists and coverage of the texture space
+  count
+};
+
+const char* memoryCategoryName(MemoryCategory category);
+
+// Every GPU allocation with its size, kind and lifetime.
+// Allocations are registered when created and released when freed; the
+// registry keeps live and peak totals per category, snapshots to diff two
+// frames, and writes everything as JSON. Frames are counted by the caller
+// through beginFrame(). It knows nothing about the graphics API. Thread safe.
+class MemoryRegistry {
+ public:
+  using Id = uint64_t;
+  static const Id invalid = 0;
+
+  struct Record {
+    Id id = invalid;
+    std::string name;
+    std::string format;
+    MemoryCategory category = MemoryCategory::mesh;
+    uint64_t size = 0;
+    std::string creator;
+    uint64_t createdFrame = 0;
+    uint64_t releasedFrame = 0;  // valid once released
+  };
+
+  struct Totals {
+    uint64_t live[size_t(MemoryCategory::count)] = {};
+    uint64_t peak[size_t(MemoryCategory::count)] = {};
+    uint32_t liveCount[size_t(MemoryCategory::count)] = {};
+    uint64_t liveTotal = 0;
+    uint64_t peakTotal = 0;
+  };
+
+  // the live allocations at one frame
+  struct Snapshot {
+    uint64_t frame = 0;
+    std::map<Id, Record> records;
+  };
+
+  struct Diff {
+    std::vector<Record> added;
+    std::vector<Record> removed;
+    int64_t delta[size_t(MemoryCategory::count)] = {};
+    int64_t deltaTotal = 0;
+  };
+
+ private:
+  mutable std::mutex mutex;
+  Id nextId = 1;
+  uint64_t frame = 0;
+  std::map<Id, Record> live;
+  std::deque<Record> released;  // the last maxReleased, oldest first
+  size_t maxReleased;
+  Totals totals;
+
+ public:
+  explicit MemoryRegistry(size_t maxReleased = 256);
+
+  Id add(std::string name, std::string format, MemoryCategory category,
+         uint64_t size, std::string creator);
+  void release(Id id);
+
+  void beginFrame();
+  uint64_t getFrame() const;
+
+  Totals getTotals() const;
+  bool find(Id id, Record* record) const;
+  Snapshot snapshot() const;
+  static Diff diff(const Snapshot& before, const Snapshot& after);
+
+  // totals, live allocations by size and the recently released ones
+  std::string reportJson() const;
+  bool writeReport(const std::string& path) const;
+  // one line per category
+  std::string describe() const;
+  static std::string describe(const Diff& diff);
+};
@@ -0,0 +1,33 @@
+#pragma once
+#include <cstdint>
+#include <initializer_list>
+#include <string_view>
+
+// FNV-1a over the characters of a name.
+// constexpr so names written in the code are hashed by the compiler.
+constexpr uint32_t hashName(std::string_view name) {
+  uint32_t hash = 2166136261u;
+  for (char c : name) {
+    hash ^= uint8_t(c);
+    hash *= 16777619u;
+  }
+  return hash;
+}
+
+// true when no two different names share a hash, for a set of names fixed at
+// compile time
+constexpr bool distinctHashes(std::initializer_list<std::string_view> names) {
+  for (const std::string_view* a = names.begin(); a != names.end(); ++a) {
+    for (const std::string_view* b = a + 1; b != names.end(); ++b)
+      if (*a != *b && hashName(*a) == hashName(*b)) return false;
+  }
+  return true;
+}
+
+// A name known at compile time, only its hash is kept.
+// The constructor is consteval : a literal converts without any work at run
+// time, a name built at run time does not compile.
+struct StaticName {
+  uint32_t hash;
+  consteval StaticName(const char* name) : hash(hashName(name)) {}
+};
@@ -0,0 +1,447 @@
+#include "OcclusionCuller.h"
+
+#include <algorithm>
+#include <cassert>
+#include <cmath>
+#include <unordered_map>
+
+#if defined(__SSE2__) || defined(_M_X64) || defined(_M_AMD64)
+#include <emmintrin.h>
+#define OCCLUSION_CULLER_SSE 1
+#endif
+
+// whether the triangle overlaps the cube of half size half around center :
+// no separating axis among the cube normals, the triangle normal and the
+// cross products of their edges
+static bool overlapsCube(const double tri[3][3], const double center[3],
+                         double half) {
+  double v[3][3], e[3][3];
+  for (int i = 0; i < 3; ++i)
+    for (int j = 0; j < 3; ++j) v[i][j] = tri[i][j] - center[j];
+  for (int i = 0; i < 3; ++i)
+    for (int j = 0; j < 3; ++j) e[i][j] = v[(i + 1) % 3][j] - v[i][j];
+  auto separates = [&](const double a[3]) {
+    double lo = HUGE_VAL, hi = -HUGE_VAL;
+    for (int i = 0; i < 3; ++i) {
+      double p = v[i][0] * a[0] + v[i][1] * a[1] + v[i][2] * a[2];
+      lo = std::min(lo, p);
+      hi = std::max(hi, p);
+    }
+    double r = half * (std::fabs(a[0]) + std::fabs(a[1]) + std::fabs(a[2]));
+    return lo > r || hi < -r;
+  };
+  auto cross = [](const double a[3], const double b[3], double out[3]) {
+    out[0] = a[1] * b[2] - a[2] * b[1];
+    out[1] = a[2] * b[0] - a[0] * b[2];
+    out[2] = a[0] * b[1] - a[1] * b[0];
+  };
+  double axis[3];
+  for (int j = 0; j < 3; ++j) {
+    const double unit[3] = {double(j == 0), double(j == 1), double(j == 2)};
+    if (separates(unit)) return false;
+    for (int i = 0; i < 3; ++i) {
+      cross(e[i], unit, axis);
+      if (separates(axis)) return false;
+    }
+  }
+  cross(e[0], e[1], axis);
+  return !separates(axis);
+}
+
+OccluderMesh simplifyOccluder(const float* vertices, uint32_t stride,
+                              const uint32_t* indices, size_t numIndices,
+                              uint32_t gridCells) {
+  assert(gridCells > 0 && numIndices % 3 == 0);
+  OccluderMesh mesh;
+  if (numIndices == 0) return mesh;
+
+  uint32_t numVertices = 0;
+  for (size_t i = 0; i < numIndices; ++i)
+    numVertices = std::max(numVertices, indices[i] + 1);
+  double lo[3] = {HUGE_VAL, HUGE_VAL, HUGE_VAL};
+  double hi[3] = {-HUGE_VAL, -HUGE_VAL, -HUGE_VAL};
+  for (uint32_t v = 0; v < numVertices; ++v) {
+    for (int j = 0; j < 3; ++j) {
+      lo[j] = std::min(lo[j], double(vertices[size_t(v) * stride + j]));
+      hi[j] = std::max(hi[j], double(vertices[size_t(v) * stride + j]));
+    }
+  }
+  // cubes, gridCells along the longest side
+  double size = std::max({hi[0] - lo[0], hi[1] - lo[1], hi[2] - lo[2]}) /
+                gridCells;
+  if (size <= 0.0) return mesh;
+  int n[3];
+  for (int j = 0; j < 3; ++j)
+    n[j] = std::max(int(std::ceil((hi[j] - lo[j]) / size)), 1);
+  auto cellOf = [&](const int c[3]) {
+    return (size_t(c[2]) * n[1] + c[1]) * n[0] + c[0];
+  };
+  auto triangle = [&](size_t t, double tri[3][3]) {
+    for (int i = 0; i < 3; ++i)
+      for (int j = 0; j < 3; ++j)
+        tri[i][j] = vertices[size_t(indices[t + i]) * stride + j];
+  };
+
+  // the cells the surface goes through, a little grown for the rounding
+  std::vector<uint8_t> surface(size_t(n[0]) * n[1] * n[2], 0);
+  for (size_t t = 0; t < numIndices; t += 3) {
+    double tri[3][3];
+    triangle(t, tri);
+    int c0[3], c1[3];
+    for (int j = 0; j < 3; ++j) {
+      double tmin = std::min({tri[0][j], tri[1][j], tri[2][j]});
+      double tmax = std::max({tri[0][j], tri[1][j], tri[2][j]});
+      c0[j] = std::clamp(int(std::floor((tmin - lo[j]) / size)) - 1, 0,
+                         n[j] - 1);
+      c1[j] = std::clamp(int(std::floor((tmax - lo[j]) / size)) + 1, 0,
+                         n[j] - 1);
+    }
+    int c[3];
+    for (c[2] = c0[2]; c[2] <= c1[2]; ++c[2]) {
+      for (c[1] = c0[1]; c[1] <= c1[1]; ++c[1]) {
+        for (c[0] = c0[0]; c[0] <= c1[0]; ++c[0]) {
+          double center[3];
+          for (int j = 0; j < 3; ++j) center[j] = lo[j] + (c[j] + 0.5) * size;
+          if (overlapsCube(tri, center, 0.5 * size * (1.0 + 1e-6)))
+            surface[cellOf(c)] = 1;
+        }
+      }
+    }
+  }
+
+  // a cell the surface misses is wholly inside or outside, as its center :
+  // inside when the row of centers along x crosses the surface an odd number
+  // of times on either side of it. The row is moved off the centers a little
+  // so it misses the edges of a mesh laid on the grid.
+  std::vector<uint8_t> inside(surface.size(), 0);
+  std::vector<double> crossings;
+  for (int z = 0; z < n[2]; ++z) {
+    for (int y = 0; y < n[1]; ++y) {
+      double py = lo[1] + (y + 0.5 + 0.73e-4) * size;
+      double pz = lo[2] + (z + 0.5 + 0.41e-4) * size;
+      crossings.clear();
+      for (size_t t = 0; t < numIndices; t += 3) {
+        double tri[3][3];
+        triangle(t, tri);
+        double w[3];
+        for (int i = 0; i < 3; ++i) {
+          const double* p = tri[(i + 1) % 3];
+          const double* q = tri[(i + 2) % 3];
+          w[i] = (q[1] - p[1]) * (pz - p[2]) - (q[2] - p[2]) * (py - p[1]);
+        }
+        double area = w[0] + w[1] + w[2];
+        if (area == 0.0) continue;
+        bool hit = true;
+        for (int i = 0; i < 3; ++i) hit &= w[i] / area >= 0.0;
+        if (!hit) continue;
+        crossings.push_back(
+            (w[0] * tri[0][0] + w[1] * tri[1][0] + w[2] * tri[2][0]) / area);
+      }
+      std::sort(crossings.begin(), crossings.end());
+      for (int x = 0; x < n[0]; ++x) {
+        const int c[3] = {x, y, z};
+        if (surface[cellOf(c)]) continue;
+        double px = lo[0] + (x + 0.5) * size;
+        size_t before = size_t(
+            std::lower_bound(crossings.begin(), crossings.end(), px) -
+            crossings.begin());
+        size_t after = crossings.size() - before;
+        inside[cellOf(c)] = (before & 1) && (after & 1);
+      }
+    }
+  }
+
+  // the faces between a cell inside and one that is not, merged into
+  // rectangles slice by slice; the corners are shared
+  std::unordered_map<uint64_t, uint32_t> corners;
+  auto corner = [&](const int c[3]) {
+    uint64_t key =
+        (uint64_t(c[2]) * (n[1] + 1) + uint64_t(c[1])) * (n[0] + 1) + c[0];
+    auto [it, added] =
+        corners.try_emplace(key, uint32_t(mesh.positions.size() / 3));
+    if (added) {
+      for (int j = 0; j < 3; ++j)
+        mesh.positions.push_back(float(lo[j] + c[j] * size));
+    }
+    return it->second;
+  };
+  auto isInside = [&](const int c[3]) {
+    for (int j = 0; j < 3; ++j)
+      if (c[j] < 0 || c[j] >= n[j]) return false;
+    return inside[cellOf(c)] != 0;
+  };
+  for (int d = 0; d < 3; ++d) {
+    int u = (d + 1) % 3, v = (d + 2) % 3;
+    std::vector<uint8_t> faces(size_t(n[u]) * n[v]);
+    auto face = [&](int a, int b) -> uint8_t& {
+      return faces[size_t(b) * n[u] + a];
+    };
+    for (int side : {-1, 1}) {
+      for (int k = 0; k < n[d]; ++k) {
+        for (int b = 0; b < n[v]; ++b) {
+          for (int a = 0; a < n[u]; ++a) {
+            int c[3], next[3];
+            c[d] = k, c[u] = a, c[v] = b;
+            std::copy(c, c + 3, next);
+            next[d] += side;
+            face(a, b) = isInside(c) && !isInside(next);
+          }
+        }
+        for (int b = 0; b < n[v]; ++b) {
+          for (int a = 0; a < n[u]; ++a) {
+            if (!face(a, b)) continue;
+            int w = 1, h = 1;
+            while (a + w < n[u] && face(a + w, b)) ++w;
+            auto rowFull = [&](int row) {
+              for (int i = 0; i < w; ++i)
+                if (!face(a + i, row)) return false;
+              return true;
+            };
+            while (b + h < n[v] && rowFull(b + h)) ++h;
+            for (int j = 0; j < h; ++j)
+              for (int i = 0; i < w; ++i) face(a + i, b + j) = 0;
+
+            int p[4][3];
+            for (int i = 0; i < 4; ++i) {
+              p[i][d] = k + (side > 0);
+              p[i][u] = a + (i == 1 || i == 2 ? w : 0);
+              p[i][v] = b + (i >= 2 ? h : 0);
+            }
+            uint32_t q[4] = {corner(p[0]), corner(p[1]), corner(p[2]),
+                             corner(p[3])};
+            if (side > 0)
+              mesh.indices.insert(mesh.indices.end(),
+                                  {q[0], q[1], q[2], q[0], q[2], q[3]});
+            else
+              mesh.indices.insert(mesh.indices.end(),
+                                  {q[0], q[2], q[1], q[0], q[3], q[2]});
+          }
+        }
+      }
+    }
+  }
+  return mesh;
+}
+
+OcclusionCuller::OcclusionCuller(uint32_t width, uint32_t height)
+    : width(width),
+      height(height),
+      tilesX(width / tileSize),
+      tilesY(height / tileSize),
+      depth(size_t(width) * height, 1.0f),
+      tileMax(size_t(tilesX) * tilesY, 1.0f) {
+  // whole tiles in every band, whole sse groups in every row
+  assert(width % bandRows == 0 && height % bandRows == 0);
+  static_assert(bandRows % tileSize == 0);
+}
+
+void OcclusionCuller::clear() {
+  std::fill(depth.begin(), depth.end(), 1.0f);
+  std::fill(tileMax.begin(), tileMax.end(), 1.0f);
+  triangles.clear();
+  stats = {};
+}
+
+// clip = p * m for a row vector p
+static void transform(const float p[3], const float m[16], float clip[4]) {
+  for (int j = 0; j < 4; ++j)
+    clip[j] = p[0] * m[j] + p[1] * m[4 + j] + p[2] * m[8 + j] + m[12 + j];
+}
+
+void OcclusionCuller::addOccluder(const float* positions, uint32_t stride,
+                                  const uint32_t* indices, size_t numIndices,
+                                  const float mvp[16]) {
+  assert(numIndices % 3 == 0);
+  uint32_t numVertices = 0;
+  for (size_t i = 0; i < numIndices; ++i)
+    numVertices = std::max(numVertices, indices[i] + 1);
+  // x, y in pixels and z, w negative in front of the near plane
+  screen.resize(size_t(numVertices) * 4);
+  for (uint32_t v = 0; v < numVertices; ++v) {
+    float clip[4];
+    transform(positions + size_t(v) * stride, mvp, clip);
+    float* s = screen.data() + size_t(v) * 4;
+    s[3] = clip[2] < 0.0f || clip[3] <= 0.0f ? -1.0f : 1.0f;
+    if (s[3] < 0.0f) continue;
+    s[0] = (clip[0] / clip[3] * 0.5f + 0.5f) * width;
+    s[1] = (0.5f - clip[1] / clip[3] * 0.5f) * height;
+    s[2] = clip[2] / clip[3];
+  }
+
+  for (size_t t = 0; t < numIndices; t += 3) {
+    ++stats.occluderTriangles;
+    float x[3], y[3], z[3];
+    bool nearClipped = false;
+    for (int v = 0; v < 3; ++v) {
+      const float* s = screen.data() + size_t(indices[t + v]) * 4;
+      // clipping would add triangles, an occluder may as well drop them
+      if (s[3] < 0.0f) nearClipped = true;
+      x[v] = s[0];
+      y[v] = s[1];
+      z[v] = s[2];
+    }
+    if (nearClipped) continue;
+
+    float area = (x[1] - x[0]) * (y[2] - y[0]) - (x[2] - x[0]) * (y[1] - y[0]);
+    if (std::fabs(area) < 1e-8f) continue;
+    // either winding, the edge functions are made positive inside
+    if (area < 0.0f) {
+      std::swap(x[1], x[2]);
+      std::swap(y[1], y[2]);
+      std::swap(z[1], z[2]);
+      area = -area;
+    }
+
+    // the pixels whose centers are in the bounds
+    Triangle tri;
+    tri.minX = std::max(
+        int(std::ceil(std::min({x[0], x[1], x[2]}) - 0.5f)), 0);
+    tri.minY = std::max(
+        int(std::ceil(std::min({y[0], y[1], y[2]}) - 0.5f)), 0);
+    tri.maxX = std::min(int(std::floor(std::max({x[0], x[1], x[2]}) - 0.5f)),
+                        int(width) - 1);
+    tri.maxY = std::min(int(std::floor(std::max({y[0], y[1], y[2]}) - 0.5f)),
+                        int(height) - 1);
+    if (tri.minX > tri.maxX || tri.minY > tri.maxY) continue;
+
+    for (int e = 0; e < 3; ++e) {
+      int n = (e + 1) % 3;
+      tri.edgeA[e] = y[e] - y[n];
+      tri.edgeB[e] = x[n] - x[e];
+      tri.edgeC[e] = (y[n] - y[e]) * x[e] - (x[n] - x[e]) * y[e];
+    }
+    // z / w is linear in screen space
+    tri.depthA =
+        ((z[1] - z[0]) * (y[2] - y[0]) - (z[2] - z[0]) * (y[1] - y[0])) / area;
+    tri.depthB =
+        ((z[2] - z[0]) * (x[1] - x[0]) - (z[1] - z[0]) * (x[2] - x[0])) / area;
+    tri.depthC = z[0] - tri.depthA * x[0] - tri.depthB * y[0];
+    triangles.push_back(tri);
+  }
+}
+
+void OcclusionCuller::rasterizeBand(uint32_t band) {
+  int firstRow = int(band * bandRows);
+  int lastRow = firstRow + int(bandRows) - 1;
+  for (uint32_t t : bins[band]) {
+    const Triangle& tri = triangles[t];
+    int y0 = std::max(tri.minY, firstRow);
+    int y1 = std::min(tri.maxY, lastRow);
+    if (y0 > y1) continue;
+    // from a multiple of 4, the edge functions reject the pixels before
+    // minX and past maxX within the group
+    int x0 = tri.minX & ~3;
+    for (int y = y0; y <= y1; ++y) {
+      float py = y + 0.5f;
+      float* row = depth.data() + size_t(y) * width;
+#ifdef OCCLUSION_CULLER_SSE
+      __m128 rowEdge[3];
+      __m128 edgeA[3];
+      for (int e = 0; e < 3; ++e) {
+        rowEdge[e] = _mm_set1_ps(tri.edgeB[e] * py + tri.edgeC[e]);
+        edgeA[e] = _mm_set1_ps(tri.edgeA[e]);
+      }
+      __m128 rowDepth = _mm_set1_ps(tri.depthB * py + tri.depthC);
+      __m128 depthA = _mm_set1_ps(tri.depthA);
+      __m128 zero = _mm_setzero_ps();
+      for (int x = x0; x <= tri.maxX; x += 4) {
+        __m128 px = _mm_add_ps(_mm_set1_ps(x + 0.5f),
+                               _mm_set_ps(3.0f, 2.0f, 1.0f, 0.0f));
+        __m128 inside = _mm_cmpge_ps(
+            _mm_add_ps(_mm_mul_ps(edgeA[0], px), rowEdge[0]), zero);
+        for (int e = 1; e < 3; ++e) {
+          inside = _mm_and_ps(
+              inside, _mm_cmpge_ps(
+                          _mm_add_ps(_mm_mul_ps(edgeA[e], px), rowEdge[e]),
+                          zero));
+        }
+        if (_mm_movemask_ps(inside) == 0) continue;
+        __m128 z = _mm_add_ps(_mm_mul_ps(depthA, px), rowDepth);
+        __m128 old = _mm_loadu_ps(row + x);
+        __m128 nearest = _mm_min_ps(old, z);
+        _mm_storeu_ps(row + x, _mm_or_ps(_mm_and_ps(inside, nearest),
+                                         _mm_andnot_ps(inside, old)));
+      }
+#else
+      for (int x = x0; x <= tri.maxX; ++x) {
+        float px = x + 0.5f;
+        bool inside = true;
+        for (int e = 0; e < 3; ++e)
+          inside &= tri.edgeA[e] * px + (tri.edgeB[e] * py + tri.edgeC[e]) >= 0;
+        // summed in the order of the sse path, to match it bit for bit
+        if (inside)
+          row[x] = std::min(row[x], tri.depthA * px +
+                                        (tri.depthB * py + tri.depthC));
+      }
+#endif
+    }
+  }
+
+  // the tiles of the band
+  for (uint32_t ty = firstRow / tileSize; ty <= uint32_t(lastRow) / tileSize;
+       ++ty) {
+    for (uint32_t tx = 0; tx < tilesX; ++tx) {
+      float farthest = 0.0f;
+      for (uint32_t y = ty * tileSize; y < (ty + 1) * tileSize; ++y) {
+        const float* row = depth.data() + size_t(y) * width + tx * tileSize;
+        for (uint32_t x = 0; x < tileSize; ++x)
+          farthest = std::max(farthest, row[x]);
+      }
+      tileMax[ty * tilesX + tx] = farthest;
+    }
+  }
+}
+
+void OcclusionCuller::rasterize(TaskPool* pool) {
+  stats.rasterizedTriangles = uint32_t(triangles.size());
+  uint32_t numBands = height / bandRows;
+  bins.resize(numBands);
+  for (auto& bin : bins) bin.clear();
+  for (uint32_t t = 0; t < triangles.size(); ++t) {
+    for (uint32_t band = triangles[t].minY / bandRows;
+         band <= triangles[t].maxY / bandRows; ++band)
+      bins[band].push_back(t);
+  }
+  if (pool) {
+    pool->run(numBands, [&](uint32_t band) { rasterizeBand(band); });
+  } else {
+    for (uint32_t band = 0; band < numBands; ++band) rasterizeBand(band);
+  }
+}
+
+bool OcclusionCuller::testBox(const float boxMin[3], const float boxMax[3],
+                              const float viewProj[16]) {
+  ++stats.testedBoxes;
+  float minX = HUGE_VALF, minY = HUGE_VALF, nearest = HUGE_VALF;
+  float maxX = -HUGE_VALF, maxY = -HUGE_VALF;
+  for (int i = 0; i < 8; ++i) {
+    float corner[3] = {(i & 1) ? boxMax[0] : boxMin[0],
+                       (i & 2) ? boxMax[1] : boxMin[1],
+                       (i & 4) ? boxMax[2] : boxMin[2]};
+    float clip[4];
+    transform(corner, viewProj, clip);
+    if (clip[2] < 0.0f || clip[3] <= 0.0f) return true;
+    float x = (clip[0] / clip[3] * 0.5f + 0.5f) * width;
+    float y = (0.5f - clip[1] / clip[3] * 0.5f) * height;
+    minX = std::min(minX, x);
+    maxX = std::max(maxX, x);
+    minY = std::min(minY, y);
+    maxY = std::max(maxY, y);
+    nearest = std::min(nearest, clip[2] / clip[3]);
+  }
+  // off screen is the business of the frustum test
+  if (maxX < 0.0f || maxY < 0.0f || minX >= width || minY >= height)
+    return true;
+
+  uint32_t tx0 = uint32_t(std::max(minX, 0.0f)) / tileSize;
+  uint32_t ty0 = uint32_t(std::max(minY, 0.0f)) / tileSize;
+  uint32_t tx1 = std::min(uint32_t(maxX), width - 1) / tileSize;
+  uint32_t ty1 = std::min(uint32_t(maxY), height - 1) / tileSize;
+  for (uint32_t ty = ty0; ty <= ty1; ++ty) {
+    for (uint32_t tx = tx0; tx <= tx1; ++tx) {
+      if (nearest <= tileMax[ty * tilesX + tx]) return true;
+    }
+  }
+  ++stats.occludedBoxes;
+  return false;
+}
@@ -0,0 +1,98 @@
+#pragma once
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+#include "TaskPool.h"
+
+// A low poly stand-in of a mesh for OcclusionCuller, positions only.
+struct OccluderMesh {
+  std::vector<float> positions;  // x, y, z
+  std::vector<uint32_t> indices;
+};
+
+// Simplifies a closed mesh into the cells of a grid that lie wholly inside
+// it, gridCells along the longest side of the bounds, as the faces between
+// them and the cells outside merged into rectangles. What is inside a mesh is
+// behind its surface from any point of view outside it, so the occluder never
+// hides what the mesh does not, however concave; the silhouette shrinks by up
+// to two cells. A cell is inside when a line along x through it crosses the
+// surface an odd number of times on both sides, an open mesh keeps only what
+// it closes that way. vertices : stride floats each, the position first.
+OccluderMesh simplifyOccluder(const float* vertices, uint32_t stride,
+                              const uint32_t* indices, size_t numIndices,
+                              uint32_t gridCells);
+
+// Occlusion culling on the cpu.
+// Occluder triangles are rasterized into a small depth buffer, 4 pixels at a
+// time with SSE, in bands of rows run in parallel on a TaskPool; then each
+// tileSize x tileSize tile keeps its farthest depth. A box is occluded when
+// its nearest depth is behind the farthest depth of every tile its screen
+// rectangle touches. Depth is z / w of a row major view projection for row
+// vectors, 0 near and 1 far as in D3D. Triangles crossing the near plane are
+// not rasterized and boxes crossing it are visible, so an error only keeps a
+// box; the pixels are sampled at their centers, though, a box seen through
+// less than a pixel may be culled.
+class OcclusionCuller {
+ public:
+  static const uint32_t tileSize = 8;
+  static const uint32_t bandRows = 16;
+
+  struct Stats {
+    uint32_t occluderTriangles = 0;  // added since clear()
+    uint32_t rasterizedTriangles = 0;
+    uint32_t testedBoxes = 0;
+    uint32_t occludedBoxes = 0;
+  };
+
+ private:
+  // in pixels, edges and depth as planes a * x + b * y + c
+  struct Triangle {
+    float edgeA[3];
+    float edgeB[3];
+    float edgeC[3];
+    float depthA;
+    float depthB;
+    float depthC;
+    int minX;
+    int minY;
+    int maxX;
+    int maxY;
+  };
+
+  uint32_t width;
+  uint32_t height;
+  uint32_t tilesX;
+  uint32_t tilesY;
+  std::vector<float> depth;    // a row after the other, 1 : nothing drawn
+  std::vector<float> tileMax;  // the farthest depth of each tile
+  std::vector<Triangle> triangles;
+  std::vector<std::vector<uint32_t>> bins;  // the triangles of each band
+  std::vector<float> screen;                // the vertices of an occluder
+  Stats stats;
+
+  void rasterizeBand(uint32_t band);
+
+ public:
+  // multiples of bandRows
+  OcclusionCuller(uint32_t width, uint32_t height);
+
+  uint32_t getWidth() const { return width; }
+  uint32_t getHeight() const { return height; }
+  float getDepth(uint32_t x, uint32_t y) const { return depth[y * width + x]; }
+  float getTileMax(uint32_t x, uint32_t y) const {
+    return tileMax[y * tilesX + x];
+  }
+  const Stats& getStats() const { return stats; }
+
+  void clear();
+  // positions : stride floats per vertex, xyz first; mvp : row major
+  void addOccluder(const float* positions, uint32_t stride,
+                   const uint32_t* indices, size_t numIndices,
+                   const float mvp[16]);
+  // the occluders added since clear(), in place without a pool
+  void rasterize(TaskPool* pool = nullptr);
+  // after rasterize(), false when the box is hidden
+  bool testBox(const float boxMin[3], const float boxMax[3],
+               const float viewProj[16]);
+};
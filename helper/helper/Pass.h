@@ -1,6 +1,18 @@
 #include "Helper.h"
 
+// the shader file without its directory and extension, names the pass in the
+// profiler
+inline std::string passName(const char* hlslName) {
+  std::string name = hlslName;
+  size_t slash = name.find_last_of("/\\");
+  if (slash != std::string::npos) name = name.substr(slash + 1);
+  return name.substr(0, name.find_last_of('.'));
+}
+
 struct PassLayout {
+  // 5_1 for unbounded descriptor arrays
+  inline static const char* vsTarget = "vs_5_0";
+  inline static const char* psTarget = "ps_5_0";
   struct Layout {
     inline static const D3D12_INPUT_LAYOUT_DESC inputLayout = {};
   };
@@ -27,10 +39,13 @@ template <typename PassDesc>
 class Pass {
   std::string vsEntry = "VSMain";
   std::string psEntry = "PSMain";
+  std::string name = passName(PassDesc::hlslName);
 
   DescriptorHeap* srvHeap;
   GraphicsPipeline pipeline{srvHeap};
   RootSignature* rootSigature = PassDesc::createRootSignature();
+  // created on the first renderIndirect()
+  ID3D12CommandSignature* drawSignature = nullptr;
 
  public:
   explicit Pass(DescriptorHeap* _srvHeap) : srvHeap(_srvHeap) {
@@ -44,8 +59,10 @@ class Pass {
 
     pipeline.build(
         rootSigature, PassDesc::Layout::inputLayout,
-        dxShader(srcPath.c_str(), vsEntry.c_str(), "vs_5_0").getCode(),
-        dxShader(srcPath.c_str(), psEntry.c_str(), "ps_5_0").getCode(),
+        dxShader(srcPath.c_str(), vsEntry.c_str(), PassDesc::vsTarget)
+            .getCode(),
+        dxShader(srcPath.c_str(), psEntry.c_str(), PassDesc::psTarget)
+            .getCode(),
         PassDesc::RenderTarget::count, PassDesc::RenderTarget::blendMode,
         PassDesc::DepthTarget::depthMode, PassDesc::RenderTarget::format,
         PassDesc::DepthTarget::format, D3D12_CULL_MODE_NONE);
@@ -58,15 +75,18 @@ class Pass {
 #endif
   }
 
-  ~Pass() { delete rootSigature; }
+  ~Pass() {
+    SAFE_RELEASE(drawSignature);
+    delete rootSigature;
+  }
 
-  void bind(std::string_view name,
-            const typename PassDesc::ConstantData& data) {
+  // names are hashed at compile time, see StaticName
+  void bind(StaticName name, const typename PassDesc::ConstantData& data) {
     rootSigature->set(name, data);
   }
 
   template <typename T>
-  void bind(std::string_view name, const T& data) {
+  void bind(StaticName name, const T& data) {
     rootSigature->set(name, data);
   }
 
@@ -94,14 +114,146 @@ class Pass {
 
   template <typename... Params>
   void render(CommandQueue* queue, CommandList* cmdList, Params... params) {
+    CpuScope cpuScope(getProfiler(), name);
     ID3D12GraphicsCommandList* rawList = cmdList->begin();
     {
-      pipeline.begin(rawList);
+      GpuScope gpuScope(cmdList, name);
+      pipeline.begin(rawList, cmdList->getState());
       PassDesc::Draw::draw(rawList, params...);
       pipeline.end();
     }
     cmdList->end(queue);
   }
+
+  // draws what a compute pass wrote into commands : each command sets the
+  // root constants PassDesc::indirectConstants and draws from the input
+  // PassDesc::Draw::bindInput() sets. The cpu cost does not depend on the
+  // number of draws.
+  template <typename... Params>
+  void renderIndirect(CommandQueue* queue, CommandList* cmdList,
+                      IndirectCommandBuffer* commands, Params... params) {
+    using Command = IndirectDraw<typename PassDesc::ConstantData>;
+    assert(commands->getStride() == sizeof(Command));
+    if (!drawSignature)
+      drawSignature = rootSigature->createDrawSignature(
+          PassDesc::indirectConstants, sizeof(Command));
+
+    CpuScope cpuScope(getProfiler(), name);
+    ID3D12GraphicsCommandList* rawList = cmdList->begin();
+    {
+      GpuScope gpuScope(cmdList, name);
+      pipeline.begin(rawList, cmdList->getState());
+      PassDesc::Draw::bindInput(rawList, params...);
+      commands->execute(rawList, drawSignature);
+      rootSigature->invalidate(PassDesc::indirectConstants);
+      pipeline.end();
+    }
+    cmdList->end(queue);
+  }
+};
+
+struct ComputePassLayout {
+  // 5_1 for unbounded descriptor arrays
+  inline static const char* csTarget = "cs_5_0";
+  struct Sampler {
+    inline static const std::vector<D3D12_STATIC_SAMPLER_DESC> descArr = {};
+  };
+  // threads per group, must match numthreads in the shader
+  struct GroupSize {
+    static const UINT x = 8;
+    static const UINT y = 8;
+  };
+  struct Target {
+    static const UINT count = 1;
+  };
+};
+
+template <typename PassDesc>
+class ComputePass {
+  std::string csEntry = "CSMain";
+  std::string name = passName(PassDesc::hlslName);
+
+  DescriptorHeap* srvHeap;
+  ComputePipeline pipeline{srvHeap};
+  RootSignature* rootSigature = PassDesc::createRootSignature();
+
+  // one thread per texel
+  UINT dispatchW = 0;
+  UINT dispatchH = 0;
+  // or a group per listed tile, see setDispatchTiles()
+  VisibleTiles* tiles = nullptr;
+  UINT tileMask = 0;
+
+ public:
+  explicit ComputePass(DescriptorHeap* _srvHeap) : srvHeap(_srvHeap) {
+    rootSigature->build(PassDesc::Sampler::descArr);
+
+    std::string srcPath = PassDesc::hlslName;
+
+    pipeline.build(
+        rootSigature,
+        dxShader(srcPath.c_str(), csEntry.c_str(), PassDesc::csTarget)
+            .getCode(),
+        PassDesc::Target::count);
+
+#ifdef _DEBUG
+    wchar_t* wname = new wchar_t[strlen(srcPath.c_str()) + 1];
+    mbstowcs(wname, srcPath.c_str(), strlen(srcPath.c_str()) + 1);
+    pipeline.SetName(wname);
+    delete[] wname;
+#endif
+  }
+
+  ~ComputePass() { delete rootSigature; }
+
+  // names are hashed at compile time, see StaticName
+  void bind(StaticName name, const typename PassDesc::ConstantData& data) {
+    rootSigature->set(name, data);
+  }
+
+  template <typename T>
+  void bind(StaticName name, const T& data) {
+    rootSigature->set(name, data);
+  }
+
+  // binds the uav table and lets the pipeline track the target state
+  void bindTarget(StaticName name, const Descriptor& uav, UINT uavIdx = 0) {
+    rootSigature->set(name, uav);
+    pipeline.setUavHandle(uavIdx, uav);
+  }
+
+  void setDispatchSize(UINT width, UINT height) {
+    dispatchW = width;
+    dispatchH = height;
+    tiles = nullptr;
+  }
+
+  // the group count comes from the gpu : a group per tile of the list of a
+  // mask, the shader reads the list
+  void setDispatchTiles(VisibleTiles* tiles, UINT mask) {
+    this->tiles = tiles;
+    tileMask = mask;
+  }
+
+  void render(CommandQueue* queue, CommandList* cmdList) {
+    assert(tiles || (dispatchW > 0 && dispatchH > 0));
+    const UINT groupX = PassDesc::GroupSize::x;
+    const UINT groupY = PassDesc::GroupSize::y;
+
+    CpuScope cpuScope(getProfiler(), name);
+    ID3D12GraphicsCommandList* rawList = cmdList->begin();
+    {
+      GpuScope gpuScope(cmdList, name);
+      pipeline.begin(rawList, cmdList->getState());
+      if (tiles)
+        tiles->dispatch(rawList, tileMask);
+      else
+        rawList->Dispatch((dispatchW + groupX - 1) / groupX,
+                          (dispatchH + groupY - 1) / groupY, 1);
+      pipeline.end();
+    }
+    cmdList->end(queue);
+  }
 };
 
 
@@ -135,10 +287,12 @@ struct TextureSpace : PassLayout {
             .ShaderVisibility = D3D12_SHADER_VISIBILITY_PIXEL}};
   };
 
+  // diffuse, position relative to the bounds, octahedral normal
+  // (see GBufferPacking.h)
   struct RenderTarget {
     inline static const std::vector<DXGI_FORMAT> format = {
-        DXGI_FORMAT_R32G32B32A32_FLOAT, DXGI_FORMAT_R32G32B32A32_FLOAT,
-        DXGI_FORMAT_R32G32B32A32_FLOAT};
+        DXGI_FORMAT_R8G8B8A8_UNORM_SRGB, DXGI_FORMAT_R16G16B16A16_UNORM,
+        DXGI_FORMAT_R16G16_SNORM};
 
     inline static const std::vector<BlendMode> blendMode = {
         BlendMode::blend_opaque, BlendMode::blend_opaque,
@@ -170,6 +324,8 @@ struct TextureSpace : PassLayout {
 
   struct ConstantData {
     XMMATRIX VP;
+    float4 boundsMin;
+    float4 boundsSize;
   };
 
   static RootSignature* createRootSignature() {
@@ -235,11 +391,47 @@ struct MeshDraw : PassLayout {
   };
   struct ConstantData {
     XMMATRIX VP;
+    float uvScale = 1.0f;  // of the texture space part that was shaded
+    UINT maskOffset = 0;   // VisibleTiles::getMaskOffset()
   };
 
+  // the pixels mark the tiles they sample in the masks of a VisibleTiles
   static RootSignature* createRootSignature() {
     return new RootSignature{{"modelMat", RootConstants("b0", ConstantData{})},
-                             {"shadedColor", RootTable("t0")}};
+                             {"shadedColor", RootTable("t0")},
+                             {"tileMasks", RootPointer("u0")}};
+  }
+};
+
+// MeshDraw with the commands written by DrawCull : the shaded color comes
+// from the bindless table by an id in the root constants, so a draw only
+// changes constants
+struct MeshDrawIndirect : MeshDraw {
+  inline static const char* hlslName = "./data/MeshDrawIndirect.hlsl";
+  inline static const char* vsTarget = "vs_5_1";
+  inline static const char* psTarget = "ps_5_1";
+  static constexpr StaticName indirectConstants = "drawData";
+
+  struct Draw {
+    static void bindInput(ID3D12GraphicsCommandList* cmdList,
+                          const RenderInfo& info) {
+      cmdList->IASetPrimitiveTopology(D3D_PRIMITIVE_TOPOLOGY_TRIANGLELIST);
+      cmdList->IASetVertexBuffers(0, 1, &info.vtxBuffView);
+      cmdList->IASetIndexBuffer(&info.idxBuffView);
+    }
+  };
+
+  struct ConstantData {
+    XMMATRIX MVP;
+    UINT colorId;
+    float uvScale;
+    UINT maskOffset;
+  };
+
+  static RootSignature* createRootSignature() {
+    return new RootSignature{{"drawData", RootConstants("b0", ConstantData{})},
+                             {"textures", RootTable("(1)t0-")},
+                             {"tileMasks", RootPointer("u0")}};
   }
 };
 
@@ -309,6 +501,8 @@ struct LightSpace : PassLayout {
     float4 normal;
     float3 cameraPos;
     float intensity;
+    float4 boundsMin;
+    float4 boundsSize;
   };
 
   static RootSignature* createRootSignature() {
@@ -318,3 +512,126 @@ struct LightSpace : PassLayout {
                              {"normal", RootTable("t2")}};
   }
 };
+
+// LightSpace as a compute pass : one thread per texel writes the light
+// target through a uav, no full-screen quad
+struct LightSpaceCompute : ComputePassLayout {
+  inline static const char* hlslName = "./data/LightSpaceCompute.hlsl";
+
+  using ConstantData = LightSpace::ConstantData;
+
+  static RootSignature* createRootSignature() {
+    return new RootSignature{{"data", RootConstants("b0", ConstantData{})},
+                             {"diffuse", RootTable("t0")},
+                             {"position", RootTable("t1")},
+                             {"normal", RootTable("t2")},
+                             {"light", RootTable("u0")}};
+  }
+};
+
+// Frustum culling of draw candidates into an IndirectCommandBuffer, the
+// kept ones are compacted to the front of it.
+struct DrawCull : ComputePassLayout {
+  inline static const char* hlslName = "./data/DrawCull.hlsl";
+  struct GroupSize {
+    static const UINT x = 64;
+    static const UINT y = 1;
+  };
+  // root uavs, IndirectCommandBuffer changes their states
+  struct Target {
+    static const UINT count = 0;
+  };
+
+  // one instance of a mesh, the commands are
+  // IndirectDraw<MeshDrawIndirect::ConstantData>
+  struct Candidate {
+    XMMATRIX modelMat;
+    float4 sphere;  // world space center and radius
+    UINT colorId;
+    UINT indexCount;
+    UINT startIndex;
+    INT baseVertex;
+    float uvScale;
+    UINT maskOffset;
+  };
+
+  struct ConstantData {
+    XMMATRIX VP;
+    float4 planes[6];  // xyz inwards, a point is inside when dot + w >= 0
+    UINT numCandidates;
+  };
+
+  static RootSignature* createRootSignature() {
+    return new RootSignature{{"data", RootConstants("b0", ConstantData{})},
+                             {"candidates", RootPointer("t0")},
+                             {"commands", RootPointer("u0")},
+                             {"count", RootPointer("u1")}};
+  }
+};
+
+// LightSpaceCompute reading the G-buffer through the bindless table : the
+// textures are picked by the ids in the constants, the pass binds its tables
+// once
+struct LightSpaceBindless : ComputePassLayout {
+  inline static const char* hlslName = "./data/LightSpaceBindless.hlsl";
+  inline static const char* csTarget = "cs_5_1";
+
+  struct ConstantData {
+    LightSpace::ConstantData light;
+    UINT diffuseId;
+    UINT positionId;
+    UINT normalId;
+  };
+
+  static RootSignature* createRootSignature() {
+    return new RootSignature{{"data", RootConstants("b0", ConstantData{})},
+                             {"textures", RootTable("(1)t0-")},
+                             {"light", RootTable("u0")}};
+  }
+};
+
+// LightSpaceBindless over the tiles a TileCompact pass listed, a group per
+// tile; dispatched with setDispatchTiles()
+struct LightSpaceTiled : ComputePassLayout {
+  inline static const char* hlslName = "./data/LightSpaceTiled.hlsl";
+  inline static const char* csTarget = "cs_5_1";
+  struct GroupSize {
+    static const UINT x = VisibleTiles::tileSize;
+    static const UINT y = VisibleTiles::tileSize;
+  };
+
+  using ConstantData = LightSpaceBindless::ConstantData;
+
+  static RootSignature* createRootSignature() {
+    return new RootSignature{{"data", RootConstants("b0", ConstantData{})},
+                             {"textures", RootTable("(1)t0-")},
+                             {"light", RootTable("u0")},
+                             {"tiles", RootPointer("t0")}};
+  }
+};
+
+// Lists the tiles of one mask of a VisibleTiles, between its beginCompact()
+// and endCompact()
+struct TileCompact : ComputePassLayout {
+  inline static const char* hlslName = "./data/TileCompact.hlsl";
+  // root uavs, VisibleTiles changes their states
+  struct Target {
+    static const UINT count = 0;
+  };
+
+  struct ConstantData {
+    UINT tilesX;
+    UINT usedX;  // tiles of the shaded part of the texture space
+    UINT usedY;
+    UINT allTiles;
+    UINT useCoverage;
+  };
+
+  static RootSignature* createRootSignature() {
+    return new RootSignature{{"data", RootConstants("b0", ConstantData{})},
+                             {"mask", RootPointer("t0")},
+                             {"coverage", RootPointer("t1")},
+                             {"tiles", RootPointer("u0")},
+                             {"args", RootPointer("u1")}};
+  }
+};
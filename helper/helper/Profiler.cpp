@@ -0,0 +1,158 @@
+#include "Profiler.h"
+
+#include <algorithm>
+#include <cassert>
+#include <cstdio>
+#include <fstream>
+#include <sstream>
+
+#include "Json.h"
+
+// nearest rank of the sorted samples
+static double percentile(const std::vector<double>& sorted, double p) {
+  size_t rank = size_t(p * sorted.size() + 0.999999);
+  rank = std::clamp<size_t>(rank, 1, sorted.size());
+  return sorted[rank - 1];
+}
+
+Profiler::Profiler(uint32_t windowSize, size_t maxEvents)
+    : windowSize(windowSize), maxEvents(maxEvents) {
+  assert(windowSize > 0);
+}
+
+double Profiler::now() const {
+  return std::chrono::duration<double, std::micro>(Clock::now() - origin)
+      .count();
+}
+
+uint32_t Profiler::addTrack(std::string name) {
+  std::lock_guard<std::mutex> lock(mutex);
+  trackNames.push_back(std::move(name));
+  return uint32_t(trackNames.size() - 1);
+}
+
+uint32_t Profiler::threadTrack() {
+  auto [it, added] =
+      threadTracks.try_emplace(std::this_thread::get_id(), 0);
+  if (added) {
+    it->second = uint32_t(trackNames.size());
+    trackNames.push_back(threadTracks.size() == 1
+                             ? std::string("main")
+                             : "thread " + std::to_string(threadTracks.size()));
+  }
+  return it->second;
+}
+
+uint32_t Profiler::getThreadTrack() {
+  std::lock_guard<std::mutex> lock(mutex);
+  return threadTrack();
+}
+
+void Profiler::record(uint32_t track, std::string name, double start,
+                      double duration) {
+  std::lock_guard<std::mutex> lock(mutex);
+  assert(track < trackNames.size());
+  Window& window = windows[{track, name}];
+  double ms = duration / 1000.0;
+  if (window.samples.size() < windowSize) {
+    window.samples.push_back(ms);
+  } else {
+    window.samples[window.next] = ms;
+    window.next = (window.next + 1) % windowSize;
+  }
+  window.last = ms;
+
+  events.push_back({std::move(name), track, start, duration});
+  if (events.size() > maxEvents) events.pop_front();
+}
+
+void Profiler::record(std::string name, double start, double duration) {
+  uint32_t track;
+  {
+    std::lock_guard<std::mutex> lock(mutex);
+    track = threadTrack();
+  }
+  record(track, std::move(name), start, duration);
+}
+
+ScopeStats Profiler::getStats(uint32_t track, const std::string& name) const {
+  std::lock_guard<std::mutex> lock(mutex);
+  ScopeStats stats;
+  auto it = windows.find({track, name});
+  if (it == windows.end()) return stats;
+
+  std::vector<double> sorted = it->second.samples;
+  std::sort(sorted.begin(), sorted.end());
+  stats.count = uint32_t(sorted.size());
+  stats.last = it->second.last;
+  for (double sample : sorted) stats.mean += sample;
+  stats.mean /= sorted.size();
+  stats.p50 = percentile(sorted, 0.5);
+  stats.p99 = percentile(sorted, 0.99);
+  return stats;
+}
+
+std::string Profiler::getTrackName(uint32_t track) const {
+  std::lock_guard<std::mutex> lock(mutex);
+  return trackNames[track];
+}
+
+std::vector<Profiler::Event> Profiler::getEvents() const {
+  std::lock_guard<std::mutex> lock(mutex);
+  return std::vector<Event>(events.begin(), events.end());
+}
+
+void Profiler::clear() {
+  std::lock_guard<std::mutex> lock(mutex);
+  windows.clear();
+  events.clear();
+}
+
+std::string Profiler::describe() const {
+  std::vector<std::pair<uint32_t, std::string>> keys;
+  {
+    std::lock_guard<std::mutex> lock(mutex);
+    for (const auto& [key, window] : windows) keys.push_back(key);
+  }
+  std::ostringstream ss;
+  for (const auto& [track, name] : keys) {
+    ScopeStats stats = getStats(track, name);
+    char line[256];
+    snprintf(line, sizeof(line),
+             "%-8s %-24s mean %7.3f ms  p50 %7.3f ms  p99 %7.3f ms  (%u)\n",
+             getTrackName(track).c_str(), name.c_str(), stats.mean,
+             stats.p50, stats.p99, stats.count);
+    ss << line;
+  }
+  return ss.str();
+}
+
+std::string Profiler::exportChromeTrace() const {
+  std::lock_guard<std::mutex> lock(mutex);
+  std::ostringstream ss;
+  ss.precision(3);
+  ss << std::fixed << "{\"traceEvents\":[";
+  bool first = true;
+  // the track names as thread names
+  for (uint32_t track = 0; track < trackNames.size(); ++track) {
+    ss << (first ? "" : ",") << "\n{\"name\":\"thread_name\",\"ph\":\"M\","
+       << "\"pid\":1,\"tid\":" << track << ",\"args\":{\"name\":\""
+       << escapeJson(trackNames[track]) << "\"}}";
+    first = false;
+  }
+  for (const Event& event : events) {
+    ss << (first ? "" : ",") << "\n{\"name\":\"" << escapeJson(event.name)
+       << "\",\"ph\":\"X\",\"pid\":1,\"tid\":" << event.track
+       << ",\"ts\":" << event.start << ",\"dur\":" << event.duration << "}";
+    first = false;
+  }
+  ss << "\n],\"displayTimeUnit\":\"ms\"}\n";
+  return ss.str();
+}
+
+bool Profiler::writeChromeTrace(const std::string& path) const {
+  std::ofstream file(path, std::ios::binary | std::ios::trunc);
+  if (!file) return false;
+  file << exportChromeTrace();
+  return bool(file);
+}
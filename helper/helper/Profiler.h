@@ -0,0 +1,99 @@
+#pragma once
+#include <chrono>
+#include <cstdint>
+#include <deque>
+#include <map>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <utility>
+#include <vector>
+
+// Timings of the last samples of a scope, in milliseconds.
+struct ScopeStats {
+  uint32_t count = 0;  // samples in the window
+  double last = 0.0;
+  double mean = 0.0;
+  double p50 = 0.0;
+  double p99 = 0.0;
+};
+
+// Named scopes on tracks, kept as rolling statistics and as trace events.
+// A track is a CPU thread, it gets one the first time it records, or a
+// timeline named by the caller, like the GPU queue of GpuProfiler. Times are
+// microseconds since the profiler was created. Scopes nest by time, a scope
+// recorded inside another on the same track is drawn below it in the trace.
+// Thread safe.
+class Profiler {
+ public:
+  using Clock = std::chrono::steady_clock;
+
+  struct Event {
+    std::string name;
+    uint32_t track;
+    double start;     // us
+    double duration;  // us
+  };
+
+ private:
+  struct Window {
+    std::vector<double> samples;  // ms, a ring of windowSize
+    uint32_t next = 0;
+    double last = 0.0;
+  };
+
+  Clock::time_point origin = Clock::now();
+  uint32_t windowSize;
+  size_t maxEvents;
+
+  mutable std::mutex mutex;
+  std::vector<std::string> trackNames;
+  std::map<std::thread::id, uint32_t> threadTracks;
+  std::map<std::pair<uint32_t, std::string>, Window> windows;
+  std::deque<Event> events;  // the last maxEvents, in recording order
+
+  uint32_t threadTrack();  // mutex held
+
+ public:
+  // windowSize samples per scope for the statistics, maxEvents for the trace
+  explicit Profiler(uint32_t windowSize = 256, size_t maxEvents = 1 << 16);
+
+  double now() const;
+  uint32_t addTrack(std::string name);
+  uint32_t getThreadTrack();
+  void record(uint32_t track, std::string name, double start,
+              double duration);
+  // on the track of the calling thread
+  void record(std::string name, double start, double duration);
+
+  ScopeStats getStats(uint32_t track, const std::string& name) const;
+  std::string getTrackName(uint32_t track) const;
+  std::vector<Event> getEvents() const;
+  void clear();
+
+  // one line per scope and track
+  std::string describe() const;
+  // the Chrome trace event format, Perfetto reads it too
+  std::string exportChromeTrace() const;
+  bool writeChromeTrace(const std::string& path) const;
+};
+
+// Records the time between its construction and destruction.
+class CpuScope {
+  Profiler* profiler;
+  std::string name;
+  double start;
+
+ public:
+  // a null profiler records nothing
+  CpuScope(Profiler* profiler, std::string name)
+      : profiler(profiler),
+        name(std::move(name)),
+        start(profiler ? profiler->now() : 0.0) {}
+  ~CpuScope() {
+    if (profiler)
+      profiler->record(std::move(name), start, profiler->now() - start);
+  }
+  CpuScope(const CpuScope&) = delete;
+  CpuScope& operator=(const CpuScope&) = delete;
+};
@@ -1,9 +1,38 @@
 #include "Render.h"
 #include <thread>
 
+#include "stb_image.h"
+
 LRESULT CALLBACK msgProc(HWND hWnd, UINT message, WPARAM wParam, LPARAM lParam);
 HWND createWindow(const char* winTitle, UINT width, UINT height);
 
+// world space bounds of the mesh placed by modelMat, the packed G-buffer
+// stores positions relative to them
+static void worldBounds(const MeshData& mesh, const XMMATRIX& modelMat,
+                        float4* boundsMin, float4* boundsSize) {
+  XMVECTOR lo = XMVectorReplicate(HUGE_VALF);
+  XMVECTOR hi = XMVectorReplicate(-HUGE_VALF);
+  for (UINT i = 0; i < 8; ++i) {
+    XMVECTOR corner =
+        XMVectorSet((i & 1) ? mesh.boundsMax.x : mesh.boundsMin.x,
+                    (i & 2) ? mesh.boundsMax.y : mesh.boundsMin.y,
+                    (i & 4) ? mesh.boundsMax.z : mesh.boundsMin.z, 1.0f);
+    corner = XMVector3TransformCoord(corner, modelMat);
+    lo = XMVectorMin(lo, corner);
+    hi = XMVectorMax(hi, corner);
+  }
+  XMVECTOR size = XMVectorMax(hi - lo, XMVectorReplicate(1e-6f));
+  XMStoreFloat4(reinterpret_cast<XMFLOAT4*>(boundsMin), lo);
+  XMStoreFloat4(reinterpret_cast<XMFLOAT4*>(boundsSize), size);
+}
+
+// the planes of the frustum of vp, normals inwards and normalized
+static void frustumPlanes(const XMMATRIX& vp, float4 planes[6]) {
+  XMFLOAT4X4 m;
+  XMStoreFloat4x4(&m, vp);
+  frustumPlanes(&m.m[0][0], reinterpret_cast<float(*)[4]>(planes));
+}
+
 void Render::cameraUpdate(InputEngine input) {
   camera.update(input);
 
@@ -36,17 +65,18 @@ void Render::init() {
   camera.setScreenSize((float)renderWidth, (float)renderHeight);
   camera.initOrbit(float3(0.0f, 160.0f, 0.0f), 100.0f, 0.0f, 0.0f);
 
-  MeshData mesh{&cmdqueue, &cmdlist, "./data/mesh.obj", 0, 0, 0, true,
-                false,     false};
-  DepthTarget depth{&srvHeap,    &dsvHeap,    &cmdqueue, DXGI_FORMAT_D32_FLOAT,
+  MeshData mesh{&copyqueue, &copylist, "./data/mesh.obj", 0, 0, 0, true,
+                false,      false};
+  OccluderMesh occluder = mesh.occluder(occluderGrid);
+  DepthTarget depth{&viewHeap,   &dsvHeap,    &cmdqueue, DXGI_FORMAT_D32_FLOAT,
                     renderWidth, renderHeight};
-  Texture skin{&srvHeap, &cmdqueue, DXGI_FORMAT_R8G8B8A8_UNORM,
+  Texture skin{&viewHeap, &copyqueue, DXGI_FORMAT_R8G8B8A8_UNORM,
                "./data/FaceColor.png"};
 
 
-  mdPass.setTargetSize(renderWidth, renderHeight);
-  mdPass.bindRenderTarget(swapChain.getRtv());
-  mdPass.bindDepthTarget(depth);
+  mdIndirectPass.setTargetSize(renderWidth, renderHeight);
+  mdIndirectPass.bindRenderTarget(swapChain.getRtv());
+  mdIndirectPass.bindDepthTarget(depth);
 
   rectlight.setTargetSize(renderWidth, renderHeight);
   rectlight.bindRenderTarget(swapChain.getRtv());
@@ -61,75 +91,476 @@ void Render::init() {
   XMMATRIX translate2 = XMMatrixTranslation(10, 0, 20);
   XMMATRIX translate3 = XMMatrixTranslation(0, 0, 0);
 
+  instances.resize(2);
+  instances[0].modelMat = translate3;
+  instances[1].modelMat = translate2;
+  for (Instance& inst : instances) {
+    worldBounds(mesh, inst.modelMat, &inst.boundsMin, &inst.boundsSize);
+    // the radius grows with the largest scale of the model matrix
+    const float4& s = mesh.boundingSphere;
+    XMVECTOR center = XMVector3TransformCoord(XMVectorSet(s.x, s.y, s.z, 1.0f),
+                                              inst.modelMat);
+    float scale = 0.0f;
+    for (UINT i = 0; i < 3; ++i)
+      scale = fmaxf(scale, XMVectorGetX(XMVector3Length(inst.modelMat.r[i])));
+    XMStoreFloat4(reinterpret_cast<XMFLOAT4*>(&inst.sphere),
+                  XMVectorSetW(center, s.w * scale));
+    instanceSpheres.add(inst.sphere.x, inst.sphere.y, inst.sphere.z,
+                        inst.sphere.w);
+    inst.texSize = imageW;
+    inst.passes = std::make_unique<InstancePasses>(&srvHeap);
+    Pass<MeshDraw>& mdPass = inst.passes->mdPass;
+    mdPass.setTargetSize(renderWidth, renderHeight);
+    mdPass.bindRenderTarget(swapChain.getRtv());
+    mdPass.bindDepthTarget(depth);
+  }
 
-  tsPass.bind("diffuseColor", skin.getSrv());
-  tsPass.bindRenderTarget(target[0], 0);
-  tsPass.bindRenderTarget(target[1], 1);
-  tsPass.bindRenderTarget(target[2], 2);
-  tsPass.setTargetSize(imageW, imageH);
-  tsPass.render(&cmdqueue, &cmdlist,
-                TextureSpace::RenderInfo{mesh.renderInfo.vtxBuffView,
-                                         mesh.renderInfo.idxBuffView,
-                                         mesh.renderInfo.numTriangles});
-
-
-  lightPass.bind("diffuse", target[0].getSrv());
-  lightPass.bind("position", target[1].getSrv());
-  lightPass.bind("normal", target[2].getSrv());
-  lightPass.bindRenderTarget(lightTarget);
-  lightPass.setTargetSize(imageW, imageH);
-
-  mdPass.bind("shadedColor", lightTarget.getSrv());
-  
   float intensity = 2000;
 
-  while (IsWindow(hwnd)) {
-    input.update();
+  // each instance is shaded in texture space, lit, then drawn on screen
+  using Usage = ResourceUsage;
+  FrameGraph& fg = frameGraph;
+  FrameGraph::ResourceId backBuffer = fg.importResource(
+      "back buffer", swapChain.getRtv().getResource(), Usage::present,
+      Usage::present);
+  FrameGraph::ResourceId depthBuffer =
+      fg.importResource("depth", &depth, Usage::depthWrite);
+  const char* gbufferNames[3] = {"diffuse", "position", "normal"};
+
+  FrameGraph::PassId clearPass = fg.addPass("clear", [&](CommandList* list) {
+    clearTargets(cmdqueue, *list, {&swapChain.getRtv()}, {&depth.getDsv()});
+  });
+  fg.write(clearPass, backBuffer);
+  fg.write(clearPass, depthBuffer, Usage::depthWrite);
+
+  for (Instance& inst : instances) {
+    for (UINT i = 0; i < 3; ++i) {
+      inst.target[i] = fg.createRenderTarget(
+          gbufferNames[i], TextureSpace::RenderTarget::format[i], imageW,
+          imageH);
+    }
+    inst.lightTarget = fg.createRenderTarget(
+        "light", LightSpace::RenderTarget::format[0], imageW, imageH, true);
+  }
 
-    cameraUpdate(input);
+  // the light pass on the graphics queue, or next to it on the compute queue
+  auto renderLight = [&](auto& pass, CommandList* list) {
+    if (!asyncLight) {
+      pass.render(&cmdqueue, list);
+      return;
+    }
+    // the graph barriers were recorded on the graphics list, submit them
+    // before the compute queue reads the targets
+    list->split();
+    computequeue.wait(&cmdqueue);
+    pass.render(&computequeue, &computelist);
+    computelist.split();
+    cmdqueue.wait(&computequeue);
+  };
+
+  auto lightData = [&](const Instance& inst) {
+    return LightSpace::ConstantData{float4(light_position, 1.0),
+                                    float4(0, 0, -1, 1), camera.getCameraPos(),
+                                    intensity, inst.boundsMin, inst.boundsSize};
+  };
+
+  for (Instance& inst : instances) {
+    FrameGraph::PassId ts = fg.addPass("texture space", [&](CommandList* list) {
+      Pass<TextureSpace>& tsPass = inst.passes->tsPass;
+      tsPass.setTargetSize(inst.texSize, inst.texSize * imageH / imageW);
+      for (UINT i = 0; i < 3; ++i)
+        tsPass.bindRenderTarget(fg.getRenderTarget(inst.target[i]), i);
+      tsPass.bind("modelMat", {inst.modelMat, inst.boundsMin, inst.boundsSize});
+      tsPass.render(&cmdqueue, list,
+                    TextureSpace::RenderInfo{mesh.renderInfo.vtxBuffView,
+                                             mesh.renderInfo.idxBuffView,
+                                             mesh.renderInfo.numTriangles});
+    });
+    for (UINT i = 0; i < 3; ++i) fg.write(ts, inst.target[i]);
+
+    FrameGraph::PassId light =
+        fg.addPass("light space", [&](CommandList* list) {
+      const Descriptor& lightUav =
+          fg.getRenderTarget(inst.lightTarget).getUav();
+      LightSpace::ConstantData data = lightData(inst);
+      UINT texH = inst.texSize * imageH / imageW;
+      if (bindlessLight && (visibleTilesOnly || uvCoverage)) {
+        InstancePasses& passes = *inst.passes;
+        const UINT tile = VisibleTiles::tileSize;
+        UINT usedX = (inst.texSize + tile - 1) / tile;
+        UINT usedY = (texH + tile - 1) / tile;
+        UINT level = 0;
+        for (UINT size = imageW; size > inst.texSize; size /= 2) ++level;
+        visibleTiles.beginCompact(list->begin(), inst.tileMask);
+        list->end(&cmdqueue);
+        passes.compactPass.bind("data", {visibleTiles.getTilesX(), usedX,
+                                         usedY,
+                                         inst.allTiles || !visibleTilesOnly,
+                                         uvCoverage});
+        passes.compactPass.bind("coverage",
+                                visibleTiles.getCoverageAddress(level));
+        passes.compactPass.setDispatchSize(usedX, usedY);
+        passes.compactPass.render(&cmdqueue, list);
+        visibleTiles.endCompact(list->begin(), inst.tileMask);
+        list->end(&cmdqueue);
+
+        passes.tiledLightPass.setDispatchTiles(&visibleTiles, inst.tileMask);
+        passes.tiledLightPass.bindTarget("light", lightUav);
+        passes.tiledLightPass.bind("data", {data, inst.gbufferIds[0],
+                                            inst.gbufferIds[1],
+                                            inst.gbufferIds[2]});
+        renderLight(passes.tiledLightPass, list);
+        return;
+      }
+      if (bindlessLight) {
+        auto& bindlessLightPass = inst.passes->bindlessLightPass;
+        bindlessLightPass.setDispatchSize(inst.texSize, texH);
+        bindlessLightPass.bindTarget("light", lightUav);
+        bindlessLightPass.bind("data", {data, inst.gbufferIds[0],
+                                        inst.gbufferIds[1],
+                                        inst.gbufferIds[2]});
+        renderLight(bindlessLightPass, list);
+        return;
+      }
+      auto& lightPass = inst.passes->lightPass;
+      lightPass.setDispatchSize(inst.texSize, texH);
+      lightPass.bind("diffuse", fg.getRenderTarget(inst.target[0]).getSrv());
+      lightPass.bind("position", fg.getRenderTarget(inst.target[1]).getSrv());
+      lightPass.bind("normal", fg.getRenderTarget(inst.target[2]).getSrv());
+      lightPass.bindTarget("light", lightUav);
+      lightPass.bind("data", data);
+      renderLight(lightPass, list);
+    });
+    for (UINT i = 0; i < 3; ++i) fg.read(light, inst.target[i]);
+    fg.write(light, inst.lightTarget, Usage::unorderedAccess);
+    inst.graphPasses = {ts, light};
+
+    // the camera position is in the light constants, the specular follows it
+    if (cacheTextureSpace) {
+      fg.setCached(ts, [&] {
+        return ContentHash()
+            .addValue(inst.modelMat)
+            .addValue(inst.boundsMin)
+            .addValue(inst.boundsSize)
+            .addValue(inst.texSize)
+            .get();
+      });
+      // the light pass reruns as the camera moves, the G-buffer is kept so
+      // that texture space does not run with it; it no longer shares memory
+      for (UINT i = 0; i < 3; ++i) fg.setPersistent(inst.target[i]);
+      // the tiles come from the draws with the camera of the frame before
+      fg.setCached(light, [&] {
+        return ContentHash()
+            .addValue(lightData(inst))
+            .addValue(inst.texSize)
+            .addValue(bindlessLight)
+            .addValue(visibleTilesOnly ? lastCameraPos : float3())
+            .addValue(inst.allTiles)
+            .get();
+      });
+    }
+    if (indirectDraw) continue;
+
+    FrameGraph::PassId md = fg.addPass("mesh draw", [&](CommandList* list) {
+      Pass<MeshDraw>& mdPass = inst.passes->mdPass;
+      mdPass.bind("shadedColor", fg.getRenderTarget(inst.lightTarget).getSrv());
+      mdPass.bind("modelMat",
+                  {inst.modelMat * vp_matrix, float(inst.texSize) / imageW,
+                   visibleTiles.getMaskOffset(inst.tileMask)});
+      mdPass.render(&cmdqueue, list,
+                    MeshDraw::RenderInfo{mesh.renderInfo.vtxBuffView,
+                                         mesh.renderInfo.idxBuffView,
+                                         mesh.renderInfo.numTriangles});
+    });
+    fg.read(md, inst.lightTarget);
+    fg.write(md, backBuffer);
+    fg.write(md, depthBuffer, Usage::depthWrite);
+    inst.graphPasses.push_back(md);
+  }
 
-    clearTargets(cmdqueue, cmdlist, {&swapChain.getRtv()}, {&depth.getDsv()});
+  // the cull writes the commands of the instances in view, the draw reads
+  // them; neither depends on the number of instances on the cpu
+  if (indirectDraw) {
+    FrameGraph::PassId md =
+        fg.addPass("indirect mesh draw", [&](CommandList* list) {
+      drawCommands.reset(list->begin());
+      list->end(&cmdqueue);
+
+      DrawCull::ConstantData data{vp_matrix};
+      frustumPlanes(vp_matrix, data.planes);
+      data.numCandidates = numCandidates;
+      cullPass.bind("data", data);
+      cullPass.bind("candidates",
+                    drawCandidates.getGpuAddress() +
+                        candidateSlot * instances.size() *
+                            sizeof(DrawCull::Candidate));
+      cullPass.setDispatchSize(data.numCandidates, 1);
+      cullPass.render(&cmdqueue, list);
+
+      mdIndirectPass.renderIndirect(
+          &cmdqueue, list, &drawCommands,
+          MeshDrawIndirect::RenderInfo{mesh.renderInfo.vtxBuffView,
+                                       mesh.renderInfo.idxBuffView,
+                                       mesh.renderInfo.numTriangles});
+    });
+    for (const Instance& inst : instances) fg.read(md, inst.lightTarget);
+    fg.write(md, backBuffer);
+    fg.write(md, depthBuffer, Usage::depthWrite);
+  }
 
-    tsPass.bind("modelMat", {translate3});
-    tsPass.render(&cmdqueue, &cmdlist,
-                  TextureSpace::RenderInfo{mesh.renderInfo.vtxBuffView,
-                                           mesh.renderInfo.idxBuffView,
-                                           mesh.renderInfo.numTriangles});
+  FrameGraph::PassId rect = fg.addPass("light rect", [&](CommandList* list) {
+    rectlight.bind("viewData",
+                   {rect_matrix * vp_matrix, float4(1.0f, 1.0f, 1.0f, 1.0f)});
+    rectlight.render(&cmdqueue, list);
+  });
+  fg.write(rect, backBuffer);
+  fg.write(rect, depthBuffer, Usage::depthWrite);
+
+  fg.compile();
+  printf("%s", fg.getGraph().describe().c_str());
+  rtPool.printStats();
+  // without the cache the targets of the instances share memory; with it
+  // they are all kept between frames
+  if (!cacheTextureSpace && instances.size() > 1 &&
+      rtPool.getAliasedCount() == 0)
+    printf("render target pool : warning, no target aliased\n");
+  printf("shader cache : %u loaded, %u compiled; pipelines : %u loaded, "
+         "%u created\n",
+         getShaderCache()->getHitCount(), getShaderCache()->getMissCount(),
+         getPipelineLibrary()->getLoadedCount(),
+         getPipelineLibrary()->getCreatedCount());
+
+  // the G-buffer views exist once the targets are placed
+  for (Instance& inst : instances) {
+    for (UINT i = 0; i < 3; ++i)
+      inst.gbufferIds[i] =
+          bindless.add(fg.getRenderTarget(inst.target[i]).getSrv());
+  }
 
-    lightPass.bind("data", {float4(light_position, 1.0), float4(0, 0, -1, 1),
-                            camera.getCameraPos(), intensity});
-    lightPass.render(&cmdqueue, &cmdlist);
+  // a mask per instance, the draws mark them whether the light passes use
+  // them or not
+  visibleTiles.create(imageW, imageH, UINT(instances.size()));
+  {
+    // the uv layout is the same at every shaded size, only scaled
+    std::vector<TileMask> coverage;
+    for (UINT size = imageW; size >= texSizes.getMinSize(); size /= 2) {
+      coverage.push_back(mesh.uvCoverage(imageW, imageH,
+                                         VisibleTiles::tileSize,
+                                         float(size) / imageW, seamTexels));
+    }
+    visibleTiles.setCoverage(&copyqueue, &copylist, coverage);
+
+    // the texel ratio at a quarter of the size is close enough
+    TileMask texels = mesh.uvCoverage(imageW / 4, imageH / 4, 1, 1.0f, 0.0f);
+    float texelRatio = float(texels.count()) /
+                       (texels.getTilesX() * texels.getTilesY());
+    float tileRatio = float(coverage[0].count()) /
+                      (coverage[0].getTilesX() * coverage[0].getTilesY());
+    printf("uv coverage : %.1f%% of the texels, %.1f%% of the tiles with a "
+           "%.0f texel band; the light passes skip %.1f%% of the texels\n",
+           100.0f * texelRatio, 100.0f * tileRatio, seamTexels,
+           uvCoverage ? 100.0f * (1.0f - tileRatio) : 0.0f);
+  }
+  for (UINT i = 0; i < instances.size(); ++i) {
+    Instance& inst = instances[i];
+    InstancePasses& passes = *inst.passes;
+    inst.tileMask = i;
+    passes.mdPass.bind("tileMasks", visibleTiles.getMasksAddress());
+    passes.compactPass.bind("mask", visibleTiles.getMaskAddress(i));
+    passes.compactPass.bind("tiles", visibleTiles.getTileAddress(i));
+    passes.compactPass.bind("args", visibleTiles.getArgsAddress(i));
+    passes.tiledLightPass.bind("tiles", visibleTiles.getTileAddress(i));
+  }
 
-    mdPass.bind("viewData", {translate3 * vp_matrix});
-    mdPass.render(&cmdqueue, &cmdlist,
-                  MeshDraw::RenderInfo{mesh.renderInfo.vtxBuffView,
-                                       mesh.renderInfo.idxBuffView,
-                                       mesh.renderInfo.numTriangles});
+  // the texture sizes change, the candidates are written for each frame in
+  // the copy the frame framesInFlight ago has finished reading
+  DrawCull::Candidate* candidates = nullptr;
+  if (indirectDraw) {
+    drawCandidates.create(sizeof(DrawCull::Candidate) * instances.size() *
+                          framesInFlight);
+    candidates = static_cast<DrawCull::Candidate*>(drawCandidates.map());
+    for (Instance& inst : instances)
+      inst.lightId =
+          bindless.add(fg.getRenderTarget(inst.lightTarget).getSrv());
+    drawCommands.create(sizeof(IndirectDraw<MeshDrawIndirect::ConstantData>),
+                        UINT(instances.size()));
+    cullPass.bind("commands", drawCommands.getCommandAddress());
+    cullPass.bind("count", drawCommands.getCountAddress());
+    mdIndirectPass.bind("textures", bindless.getTable());
+    mdIndirectPass.bind("tileMasks", visibleTiles.getMasksAddress());
+  }
 
-    tsPass.bind("modelMat", {translate2});
-    tsPass.render(&cmdqueue, &cmdlist,
-                  TextureSpace::RenderInfo{mesh.renderInfo.vtxBuffView,
-                                           mesh.renderInfo.idxBuffView,
-                                           mesh.renderInfo.numTriangles});
+  for (Instance& inst : instances) {
+    InstancePasses& passes = *inst.passes;
+    passes.tsPass.bind("diffuseColor", skin.getSrv());
+    passes.bindlessLightPass.bind("textures", bindless.getTable());
+    passes.tiledLightPass.bind("textures", bindless.getTable());
+  }
 
-    lightPass.bind("data", {float4(light_position, 1.0), float4(0, 0, -1, 1),
-                            camera.getCameraPos(), intensity});
-    lightPass.render(&cmdqueue, &cmdlist);
+  cmdlist.setProfiler(&gpuProfiler);
+  recorder.setProfiler(&gpuProfiler);
+  computelist.setProfiler(&computeProfiler);
 
-    mdPass.bind("viewData", {translate2 * vp_matrix});
-    mdPass.render(&cmdqueue, &cmdlist,
-                  MeshDraw::RenderInfo{mesh.renderInfo.vtxBuffView,
-                                       mesh.renderInfo.idxBuffView,
-                                       mesh.renderInfo.numTriangles});
+  // what the frames allocate on top of the set up
+  MemoryRegistry* memory = getMemoryRegistry();
+  printf("%s", memory->describe().c_str());
+  MemoryRegistry::Snapshot setupMemory = memory->snapshot();
 
+  while (IsWindow(hwnd)) {
+    CpuScope frameScope(getProfiler(), "frame");
+    memory->beginFrame();
+    input.update();
 
-    rectlight.bind("viewData",
-                   {rect_matrix * vp_matrix, float4(1.0f, 1.0f, 1.0f, 1.0f)});
-    rectlight.render(&cmdqueue, &cmdlist);
+    cameraUpdate(input);
+    // every tile of the compared light target is shaded
+    bool softCapture =
+        softCompareFrame != 0 && memory->getFrame() == softCompareFrame;
+    if (softCapture) instances[0].allTiles = true;
+
+    if (adaptiveTextureSpace) {
+      float3 eye = camera.getCameraPos();
+      for (UINT i = 0; i < instances.size(); ++i) {
+        Instance& inst = instances[i];
+        float distance = XMVectorGetX(XMVector3Length(
+            XMVectorSet(inst.sphere.x - eye.x, inst.sphere.y - eye.y,
+                        inst.sphere.z - eye.z, 0.0f)));
+        float required =
+            texelsPerPixel * projectedDiameter(inst.sphere.w, distance,
+                                               fovy * DEG2RAD,
+                                               float(renderHeight));
+        UINT texSize = texSizes.update(inst.texSize, required);
+        if (texSize != inst.texSize) {
+          ++texSizeChanges;
+          inst.allTiles = true;
+        }
+        inst.texSize = texSize;
+      }
+    }
 
-    swapChain.present();
-    cmdqueue.waitCompletion();
-    cmdlist.reset();
+    // the indirect draw culls again on the gpu, the texture space work of
+    // the instances out of view or hidden is skipped here
+    if (frustumCull || occlusionCull) {
+      instanceVisible.assign(instances.size(), 1);
+      if (frustumCull) {
+        float4 planes[6];
+        frustumPlanes(vp_matrix, planes);
+        size_t numVisible =
+            cullSpheres(reinterpret_cast<float(*)[4]>(planes),
+                        instanceSpheres, instanceVisible.data());
+        culledInstances += instances.size() - numVisible;
+        testedInstances += instances.size();
+      }
+      if (occlusionCull) {
+        CpuScope scope(getProfiler(), "occlusion cull");
+        occlusion.clear();
+        for (UINT i = 0; i < instances.size(); ++i) {
+          if (!instanceVisible[i]) continue;
+          XMFLOAT4X4 mvp;
+          XMStoreFloat4x4(&mvp, instances[i].modelMat * vp_matrix);
+          occlusion.addOccluder(occluder.positions.data(), 3,
+                                occluder.indices.data(),
+                                occluder.indices.size(), &mvp.m[0][0]);
+        }
+        occlusion.rasterize(&occlusionPool);
+        // an occluder lies in the bounds of its instance, never hides it
+        XMFLOAT4X4 viewProj;
+        XMStoreFloat4x4(&viewProj, vp_matrix);
+        for (UINT i = 0; i < instances.size(); ++i) {
+          if (!instanceVisible[i]) continue;
+          const Instance& inst = instances[i];
+          float boxMin[3] = {inst.boundsMin.x, inst.boundsMin.y,
+                             inst.boundsMin.z};
+          float boxMax[3] = {inst.boundsMin.x + inst.boundsSize.x,
+                             inst.boundsMin.y + inst.boundsSize.y,
+                             inst.boundsMin.z + inst.boundsSize.z};
+          if (!occlusion.testBox(boxMin, boxMax, &viewProj.m[0][0])) {
+            instanceVisible[i] = 0;
+            ++occludedInstances;
+          }
+        }
+      }
+      for (UINT i = 0; i < instances.size(); ++i) {
+        Instance& inst = instances[i];
+        bool visible = instanceVisible[i];
+        // the tiles it marked are from before it left the view
+        if (visible && !inst.visible) inst.allTiles = true;
+        inst.visible = visible;
+        for (FrameGraph::PassId pass : inst.graphPasses)
+          fg.setEnabled(pass, visible);
+      }
+    }
+
+    // the frame may only read the assets once their copies are done
+    cmdqueue.waitFor(skin);
+    cmdqueue.waitFor(mesh.vtxBuff);
+    cmdqueue.waitFor(mesh.idxBuff);
+    cmdqueue.waitFor(visibleTiles.getCoverage());
+    copyqueue.collect();
+
+    // ring slots of the frames the gpu finished can be staged again
+    srvHeap.retire(cmdqueue.getCompletedValue());
+
+    // the whole frame goes in one submission
+    gpuProfiler.beginFrame();
+    cmdlist.beginFrame(&cmdqueue);
+    if (indirectDraw) {
+      candidateSlot = (candidateSlot + 1) % framesInFlight;
+      // the hidden ones would draw a light target their passes did not shade
+      numCandidates = 0;
+      for (const Instance& inst : instances) {
+        if (!inst.visible) continue;
+        DrawCull::Candidate& candidate =
+            candidates[candidateSlot * instances.size() + numCandidates++];
+        candidate.modelMat = inst.modelMat;
+        candidate.sphere = inst.sphere;
+        candidate.colorId = inst.lightId;
+        candidate.indexCount = 3 * mesh.renderInfo.numTriangles;
+        candidate.startIndex = 0;
+        candidate.baseVertex = 0;
+        candidate.uvScale = float(inst.texSize) / imageW;
+        candidate.maskOffset = visibleTiles.getMaskOffset(inst.tileMask);
+      }
+    }
+    if (asyncLight) {
+      computeProfiler.beginFrame();
+      computelist.beginFrame(&computequeue);
+    }
+    fg.setImported(backBuffer, swapChain.getRtv().getResource());
+    if (parallelRecording && !asyncLight) {
+      // the passes go in the worker lists, submitted before the frame list
+      // which only resolves the timestamps
+      fg.execute(&recorder);
+      recorder.submit();
+    } else {
+      fg.execute(&cmdqueue, &cmdlist);
+    }
+    if (softCapture && instances[0].visible) {
+      softReadback.readback(cmdlist.begin(),
+                            fg.getRenderTarget(instances[0].lightTarget));
+      cmdlist.end(&cmdqueue);
+      softTexSize = instances[0].texSize;
+      softCameraPos = camera.getCameraPos();
+    }
+    // allTiles is in the light hashes, the passes in view ran and listed
+    // every tile
+    for (Instance& inst : instances) {
+      if (inst.visible) inst.allTiles = false;
+    }
+    lastCameraPos = camera.getCameraPos();
+    if (asyncLight) {
+      computeProfiler.resolve(&computelist);
+      computeProfiler.endFrame(computelist.endFrame());
+    }
+    gpuProfiler.resolve(&cmdlist);
+    UINT64 frameFence = cmdlist.endFrame();
+    gpuProfiler.endFrame(frameFence);
+    // the graphics queue waits for the compute work, its fence covers both
+    srvHeap.endFrame(frameFence);
+
+    {
+      CpuScope presentScope(getProfiler(), "present");
+      swapChain.present();
+    }
 
     MSG msg;
     while (PeekMessage(&msg, nullptr, 0, 0, PM_REMOVE)) {
@@ -138,8 +569,87 @@ void Render::init() {
     }
   }
 
+  copyqueue.waitCompletion();
+  computequeue.waitCompletion();
   cmdqueue.waitCompletion();
   cmdqueue.signalForSafety();
+
+  getPipelineLibrary()->save();
+
+  CommandState::Stats stats = cmdlist.getState()->stats;
+  for (UINT i = 0; i < recorder.getListCount(); ++i) {
+    stats.issued += recorder.getList(i)->getState()->stats.issued;
+    stats.skipped += recorder.getList(i)->getState()->stats.skipped;
+  }
+  printf("state cache : %llu commands issued, %llu skipped\n", stats.issued,
+         stats.skipped);
+  printf("frame graph : %u passes run, %u skipped\n",
+         fg.getCache().getRunCount(), fg.getCache().getSkipCount());
+  printf("frustum cull : %llu of %llu instances culled\n", culledInstances,
+         testedInstances);
+  printf("occlusion cull : %llu instances hidden\n", occludedInstances);
+  printf("texture space : %llu size changes\n", texSizeChanges);
+
+  // the first instance through texture space and light on the cpu, against
+  // the light the gpu shaded; only the texels the uv layout covers count
+  if (softTexSize) {
+    int skinW, skinH, channels;
+    UINT8* pixels =
+        stbi_load("./data/FaceColor.png", &skinW, &skinH, &channels, 4);
+    if (!pixels) Error(stbi_failure_reason());
+    SoftTexture skinTexels =
+        SoftTexture::fromRgba8(pixels, skinW, skinH, size_t(skinW) * 4);
+    stbi_image_free(pixels);
+
+    const Instance& inst = instances[0];
+    UINT texW = softTexSize;
+    UINT texH = texW * imageH / imageW;
+    SoftRasterizer raster(&occlusionPool);
+    SoftMesh softMesh{mesh.vertices.data(), 8, UINT(mesh.vertices.size() / 8),
+                      mesh.indices.data(), mesh.indices.size()};
+    SoftTexture gbuffer[3] = {{texW, texH}, {texW, texH}, {texW, texH}};
+    SoftTexture* targets[3] = {&gbuffer[0], &gbuffer[1], &gbuffer[2]};
+    SoftTextureSpace::ConstantData tsData;
+    XMStoreFloat4x4(reinterpret_cast<XMFLOAT4X4*>(tsData.M), inst.modelMat);
+    memcpy(tsData.boundsMin, &inst.boundsMin, sizeof(tsData.boundsMin));
+    memcpy(tsData.boundsSize, &inst.boundsSize, sizeof(tsData.boundsSize));
+    raster.setViewport(texW, texH);
+    SoftTextureSpace::render(&raster, softMesh, tsData, skinTexels, targets);
+
+    LightSpace::ConstantData data{float4(light_position, 1.0),
+                                  float4(0, 0, -1, 1), softCameraPos,
+                                  intensity, inst.boundsMin, inst.boundsSize};
+    SoftLightSpace::ConstantData lightConstants;
+    static_assert(sizeof(lightConstants) == sizeof(data));
+    memcpy(&lightConstants, &data, sizeof(data));
+    SoftTexture light(texW, texH);
+    const SoftTexture* gbufferTexels[3] = {&gbuffer[0], &gbuffer[1],
+                                           &gbuffer[2]};
+    SoftLightSpace::render(&occlusionPool, lightConstants, gbufferTexels, texW,
+                           texH, &light);
+
+    size_t rowPitch = _align(_bpp(LightSpace::RenderTarget::format[0]) * imageW,
+                             D3D12_TEXTURE_DATA_PITCH_ALIGNMENT);
+    SoftTexture gpuLight = SoftTexture::fromFloat4(
+        static_cast<const float*>(softReadback.map()), texW, texH, rowPitch);
+    softReadback.unmap();
+    SoftDiff diff =
+        compareTextures(light, gpuLight, texW, texH, 0.01f, &gbuffer[1]);
+    printf("soft light : %llu of %llu texels off by more than 1%%, max %.4f, "
+           "mean %.6f\n",
+           diff.overTolerance, diff.compared, diff.maxError, diff.meanError);
+  }
+
+  getGpuMemory()->printStats();
+
+  printf("%s", getProfiler()->describe().c_str());
+  getProfiler()->writeChromeTrace("profile.json");
+
+  printf("%s", memory->describe().c_str());
+  printf("%s", MemoryRegistry::describe(
+                   MemoryRegistry::diff(setupMemory, memory->snapshot()))
+                   .c_str());
+  memory->writeReport("memory.json");
 }
 
 LRESULT CALLBACK msgProc(HWND hWnd, UINT message, WPARAM wParam,
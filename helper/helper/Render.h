@@ -3,22 +3,66 @@
 #include "Input.h"
 #include "Camera.h"
 #include "Pass.h"
+#include "RenderTargetPool.h"
+#include "SoftRender.h"
+#include "FrameGraph.h"
+#include "TexelDensity.h"
 
 
 
 class Render {
  private:
+  // cpu heaps grow by a page when full
   DescriptorHeap rtvHeap{128, D3D12_DESCRIPTOR_HEAP_TYPE_RTV};
-  DescriptorHeap srvHeap{256, D3D12_DESCRIPTOR_HEAP_TYPE_CBV_SRV_UAV};  
   DescriptorHeap dsvHeap{32, D3D12_DESCRIPTOR_HEAP_TYPE_DSV};
+  // the views of the textures, copied to srvHeap when a pass binds them
+  DescriptorHeap viewHeap{256, D3D12_DESCRIPTOR_HEAP_TYPE_CBV_SRV_UAV, false};
+  // the one shader-visible heap : the bindless slots and a per-frame ring
+  DescriptorHeap srvHeap{4096, D3D12_DESCRIPTOR_HEAP_TYPE_CBV_SRV_UAV, true,
+                         1024};
+  BindlessTable bindless{&srvHeap};
   CommandQueue cmdqueue{D3D12_COMMAND_LIST_TYPE_DIRECT};
-  CommandList cmdlist{D3D12_COMMAND_LIST_TYPE_DIRECT};
+  // the CPU records up to this many frames ahead of the GPU
+  static const UINT framesInFlight = 2;
+  CommandList cmdlist{D3D12_COMMAND_LIST_TYPE_DIRECT, framesInFlight};
+  // the graph passes recorded on several threads, see FrameGraph::execute()
+  bool parallelRecording = true;
+  ParallelRecorder recorder{&cmdqueue, 4, framesInFlight};
+  // asset uploads, they overlap the frames
+  CommandQueue copyqueue{D3D12_COMMAND_LIST_TYPE_COPY};
+  CommandList copylist{D3D12_COMMAND_LIST_TYPE_COPY};
+  // the light passes may run on a compute queue next to the graphics work
+  bool asyncLight = false;
+  CommandQueue computequeue{D3D12_COMMAND_LIST_TYPE_COMPUTE};
+  CommandList computelist{D3D12_COMMAND_LIST_TYPE_COMPUTE, framesInFlight};
+  // timestamps of the passes on each queue, see getProfiler()
+  GpuProfiler gpuProfiler{&cmdqueue, getProfiler(), "gpu", framesInFlight};
+  GpuProfiler computeProfiler{&computequeue, getProfiler(), "gpu compute",
+                              framesInFlight};
 
   HWND hwnd = nullptr;
   UINT renderWidth = 1200;
   UINT renderHeight = 900;
   UINT imageW = 4096;
   UINT imageH = 4096;
+  // each instance shades the part of its texture space its size on screen
+  // needs, the targets keep the full size
+  bool adaptiveTextureSpace = true;
+  float texelsPerPixel = 2.0f;  // across the bounds on screen
+  ResolutionSelector texSizes{128, imageW};
+  UINT64 texSizeChanges = 0;
+  // the texture space and light passes run only when their inputs changed;
+  // their targets are kept per instance instead of sharing memory
+  bool cacheTextureSpace = true;
+  // the bindless light pass shades only the tiles the draws of the frame
+  // before sampled, and their neighbours
+  bool visibleTilesOnly = true;
+  // nor the tiles the uv layout of the mesh leaves empty, grown by
+  // seamTexels for the bilinear reads across the seams
+  bool uvCoverage = true;
+  float seamTexels = 2.0f;
+  VisibleTiles visibleTiles;
+  float3 lastCameraPos;  // the tiles follow the camera a frame late
 
   SwapChain swapChain;
   OrbitCamera camera;
@@ -28,20 +72,88 @@ class Render {
   XMMATRIX vp_matrix;
   XMMATRIX rect_matrix;
 
-  Pass<MeshDraw> mdPass{&srvHeap};
   Pass<RectDraw> rectlight{&srvHeap};
-  Pass<TextureSpace> tsPass{&srvHeap};
-  Pass<LightSpace> lightPass{&srvHeap};
-
-  RenderTarget target[3]{{&srvHeap, &rtvHeap, &cmdqueue,
-                            DXGI_FORMAT_R32G32B32A32_FLOAT, imageW, imageH},
-                             {&srvHeap, &rtvHeap, &cmdqueue,
-                              DXGI_FORMAT_R32G32B32A32_FLOAT, imageW, imageH},
-                             {&srvHeap, &rtvHeap, &cmdqueue,
-                              DXGI_FORMAT_R32G32B32A32_FLOAT, imageW, imageH}};
-  RenderTarget lightTarget{&srvHeap,  &rtvHeap,
-                           &cmdqueue, DXGI_FORMAT_R32G32B32A32_FLOAT,
-                           imageW,    imageH};
+  // the light pass reads the G-buffer by ids instead of per-instance tables
+  bool bindlessLight = true;
+  // the instances are culled and drawn by the gpu in one ExecuteIndirect
+  bool indirectDraw = true;
+  Pass<MeshDrawIndirect> mdIndirectPass{&srvHeap};
+  ComputePass<DrawCull> cullPass{&srvHeap};
+  // DrawCull::Candidate per instance, a copy per frame in flight
+  DxBuffer drawCandidates{DxBuffer::StorageType::cpu,
+                          MemoryCategory::indirect};
+  UINT candidateSlot = 0;  // the copy of the current frame
+  UINT numCandidates = 0;  // the instances in view, first in the copy
+  IndirectCommandBuffer drawCommands;
+
+  // the instances out of view skip their graph passes, tested on the cpu
+  bool frustumCull = true;
+  SphereBatch instanceSpheres;
+  std::vector<uint8_t> instanceVisible;
+  UINT64 culledInstances = 0;
+  UINT64 testedInstances = 0;
+  // and the ones hidden behind others, their bounds are tested against the
+  // low poly versions of the instances in view rasterized on the cpu
+  bool occlusionCull = true;
+  UINT occluderGrid = 12;  // cells along the longest side of the mesh bounds
+  OcclusionCuller occlusion{256, 192};
+  TaskPool occlusionPool{3};
+  UINT64 occludedInstances = 0;
+
+  // the light target of the first instance is read back at softCompareFrame
+  // and, after the loop, compared with SoftRender shading it on the cpu.
+  // 0 : off
+  UINT64 softCompareFrame = 0;
+  ReadbackBuffer softReadback;
+  UINT softTexSize = 0;  // its shaded size at that frame, 0 : not read back
+  float3 softCameraPos;
+
+  // the passes keep what is bound to them, each instance has its own so
+  // instances can be recorded on different threads
+  struct InstancePasses {
+    explicit InstancePasses(DescriptorHeap* srvHeap)
+        : mdPass(srvHeap),
+          tsPass(srvHeap),
+          lightPass(srvHeap),
+          bindlessLightPass(srvHeap),
+          tiledLightPass(srvHeap),
+          compactPass(srvHeap) {}
+    Pass<MeshDraw> mdPass;
+    Pass<TextureSpace> tsPass;
+    ComputePass<LightSpaceCompute> lightPass;
+    ComputePass<LightSpaceBindless> bindlessLightPass;
+    ComputePass<LightSpaceTiled> tiledLightPass;
+    ComputePass<TileCompact> compactPass;
+  };
+
+  struct Instance {
+    std::unique_ptr<InstancePasses> passes;
+    XMMATRIX modelMat;
+    // world space bounds, the packed G-buffer positions are relative to them
+    float4 boundsMin;
+    float4 boundsSize;
+    float4 sphere;  // MeshData::boundingSphere in world space
+    // shaded width of the texture space, the height follows imageH / imageW
+    UINT texSize = 0;
+    // transient targets, instances shaded one after the other share memory
+    FrameGraph::ResourceId target[3]{};
+    FrameGraph::ResourceId lightTarget{};
+    // of the G-buffer targets in the bindless table
+    UINT gbufferIds[3]{};
+    // of the light target, the color of the indirect draw
+    UINT lightId = 0;
+    // of visibleTiles; the marks do not match the texture space after its
+    // size changed, every tile is shaded once then
+    UINT tileMask = 0;
+    bool allTiles = true;
+    // texture space, light and draw, disabled while out of view
+    std::vector<FrameGraph::PassId> graphPasses;
+    bool visible = true;
+  };
+  std::vector<Instance> instances;
+
+  RenderTargetPool rtPool{&viewHeap, &rtvHeap, &cmdqueue};
+  FrameGraph frameGraph{&rtPool};
 
  public:
   void init();
@@ -0,0 +1,406 @@
+#include "RenderGraph.h"
+
+#include <algorithm>
+#include <cassert>
+#include <functional>
+#include <queue>
+
+const char* usageName(ResourceUsage usage) {
+  switch (usage) {
+    case ResourceUsage::undefined:
+      return "undefined";
+    case ResourceUsage::renderTarget:
+      return "renderTarget";
+    case ResourceUsage::depthWrite:
+      return "depthWrite";
+    case ResourceUsage::depthRead:
+      return "depthRead";
+    case ResourceUsage::shaderResource:
+      return "shaderResource";
+    case ResourceUsage::unorderedAccess:
+      return "unorderedAccess";
+    case ResourceUsage::copySource:
+      return "copySource";
+    case ResourceUsage::copyDest:
+      return "copyDest";
+    case ResourceUsage::present:
+      return "present";
+  }
+  return "?";
+}
+
+RenderGraph::ResourceId RenderGraph::importResource(const char* name,
+                                                    ResourceUsage initialUsage,
+                                                    ResourceUsage finalUsage) {
+  ResourceNode node;
+  node.name = name;
+  node.imported = true;
+  node.initialUsage = initialUsage;
+  node.finalUsage = finalUsage;
+  resources.push_back(node);
+  compiled = false;
+  return ResourceId(resources.size() - 1);
+}
+
+RenderGraph::ResourceId RenderGraph::createTransient(const char* name) {
+  ResourceNode node;
+  node.name = name;
+  resources.push_back(node);
+  compiled = false;
+  return ResourceId(resources.size() - 1);
+}
+
+RenderGraph::PassId RenderGraph::addPass(const char* name, bool sideEffect) {
+  PassNode node;
+  node.name = name;
+  node.sideEffect = sideEffect;
+  passes.push_back(node);
+  compiled = false;
+  return PassId(passes.size() - 1);
+}
+
+void RenderGraph::setCached(PassId pass, bool cached) {
+  assert(pass < passes.size());
+  passes[pass].cached = cached;
+  compiled = false;
+}
+
+void RenderGraph::setPersistent(ResourceId resource, bool persistent) {
+  assert(resource < resources.size() && !resources[resource].imported);
+  resources[resource].kept = persistent;
+  compiled = false;
+}
+
+void RenderGraph::addAccess(PassId pass, ResourceId resource,
+                            ResourceUsage usage) {
+  assert(pass < passes.size() && resource < resources.size());
+  for (const Access& access : passes[pass].accesses) {
+    // one resource can only be in one state during a pass
+    assert(access.resource != resource || access.usage == usage);
+    if (access.resource == resource) return;
+  }
+  passes[pass].accesses.push_back({resource, usage});
+  compiled = false;
+}
+
+void RenderGraph::read(PassId pass, ResourceId resource, ResourceUsage usage) {
+  assert(!isWriteUsage(usage));
+  addAccess(pass, resource, usage);
+}
+
+void RenderGraph::write(PassId pass, ResourceId resource,
+                        ResourceUsage usage) {
+  assert(isWriteUsage(usage));
+  addAccess(pass, resource, usage);
+}
+
+void RenderGraph::clear() {
+  passes.clear();
+  resources.clear();
+  order.clear();
+  finalBarriers.clear();
+  error.clear();
+  compiled = false;
+}
+
+bool RenderGraph::compile() {
+  compiled = false;
+  error.clear();
+
+  // dependencies : a read follows the write declared last before it, a write
+  // follows the previous write and its readers. A transient read before any
+  // write of it is declared reads the first write declared after it.
+  std::vector<std::vector<PassId>> next(passes.size());
+  std::vector<uint32_t> numDeps(passes.size(), 0);
+  auto depend = [&](PassId before, PassId after) {
+    if (before == after) return;
+    next[before].push_back(after);
+    ++numDeps[after];
+  };
+
+  struct Contents {
+    PassId writer = invalid;
+    std::vector<PassId> readers;
+    std::vector<PassId> early;  // readers of the next write
+  };
+  std::vector<Contents> contents(resources.size());
+  for (PassId p = 0; p < passes.size(); ++p) {
+    for (const Access& access : passes[p].accesses) {
+      Contents& c = contents[access.resource];
+      if (!isWriteUsage(access.usage)) {
+        if (c.writer != invalid) depend(c.writer, p);
+        if (c.writer == invalid && !resources[access.resource].imported)
+          c.early.push_back(p);
+        else
+          c.readers.push_back(p);
+        continue;
+      }
+      if (c.writer != invalid) depend(c.writer, p);
+      for (PassId reader : c.readers) depend(reader, p);
+      for (PassId reader : c.early) depend(p, reader);
+      c.writer = p;
+      c.readers = std::move(c.early);
+      c.early.clear();
+    }
+  }
+  for (ResourceId r = 0; r < resources.size(); ++r) {
+    for (PassId reader : contents[r].early) {
+      error += "pass " + passes[reader].name + " reads " + resources[r].name +
+               " that no pass writes\n";
+    }
+  }
+
+  // topological sort, among the passes that are ready the one declared
+  // first runs first so that a graph declared in order keeps it
+  std::vector<PassId> sorted;
+  std::priority_queue<PassId, std::vector<PassId>, std::greater<PassId>> ready;
+  for (PassId p = 0; p < passes.size(); ++p)
+    if (numDeps[p] == 0) ready.push(p);
+  std::vector<uint32_t> remaining = numDeps;
+  while (!ready.empty()) {
+    PassId p = ready.top();
+    ready.pop();
+    sorted.push_back(p);
+    for (PassId after : next[p])
+      if (--remaining[after] == 0) ready.push(after);
+  }
+
+  if (sorted.size() < passes.size()) {
+    // every pass left waits on another one left, walking back through them
+    // has to close a cycle
+    std::vector<uint32_t> visit(passes.size(), invalid);
+    PassId p = 0;
+    while (remaining[p] == 0) ++p;
+    std::vector<PassId> path;
+    while (visit[p] == invalid) {
+      visit[p] = uint32_t(path.size());
+      path.push_back(p);
+      for (PassId before = 0; before < passes.size(); ++before) {
+        bool waited = remaining[before] > 0 &&
+                      std::find(next[before].begin(), next[before].end(),
+                                p) != next[before].end();
+        if (waited) {
+          p = before;
+          break;
+        }
+      }
+    }
+    error += "cycle : " + passes[p].name;
+    for (size_t i = path.size() - 1; i > visit[p]; --i)
+      error += " -> " + passes[path[i]].name;
+    error += " -> " + passes[p].name + "\n";
+  }
+  if (!error.empty()) return false;
+
+  // culling : walking backwards, a pass is kept when it writes something that
+  // is imported or read by a kept pass
+  std::vector<bool> needed(resources.size(), false);
+  for (ResourceId r = 0; r < resources.size(); ++r)
+    needed[r] = resources[r].imported;
+
+  for (size_t i = sorted.size(); i-- > 0;) {
+    PassNode& pass = passes[sorted[i]];
+    bool keep = pass.sideEffect;
+    for (const Access& access : pass.accesses)
+      keep |= isWriteUsage(access.usage) && needed[access.resource];
+    pass.culled = !keep;
+    if (!keep) continue;
+    for (const Access& access : pass.accesses) needed[access.resource] = true;
+  }
+
+  order.clear();
+  for (PassId p : sorted)
+    if (!passes[p].culled) order.push_back(p);
+
+  std::vector<ResourceUsage> current(resources.size());
+  for (ResourceId r = 0; r < resources.size(); ++r) {
+    current[r] = resources[r].initialUsage;
+    resources[r].firstUse = resources[r].lastUse = invalid;
+    resources[r].persistent = false;
+  }
+
+  for (PassId p = 0; p < passes.size(); ++p) passes[p].barriers.clear();
+
+  for (uint32_t pos = 0; pos < order.size(); ++pos) {
+    PassNode& pass = passes[order[pos]];
+    for (const Access& access : pass.accesses) {
+      ResourceNode& rsc = resources[access.resource];
+      if (rsc.firstUse == invalid) rsc.firstUse = pos;
+      rsc.lastUse = pos;
+
+      // consecutive uses in the same state share the transition
+      if (current[access.resource] != access.usage) {
+        pass.barriers.push_back(
+            {access.resource, current[access.resource], access.usage});
+        current[access.resource] = access.usage;
+      }
+    }
+  }
+
+  // what a cached pass wrote is read again in later frames by the passes
+  // that are not cached, they run every frame; cached readers run the writer
+  // again instead, see PassCache
+  std::vector<bool> cachedWrite(resources.size(), false);
+  for (PassId p : order) {
+    for (const Access& access : passes[p].accesses) {
+      if (isWriteUsage(access.usage)) {
+        cachedWrite[access.resource] = passes[p].cached;
+      } else if (cachedWrite[access.resource] && !passes[p].cached &&
+                 !resources[access.resource].imported) {
+        resources[access.resource].persistent = true;
+      }
+    }
+  }
+  for (ResourceNode& rsc : resources) {
+    rsc.persistent |= rsc.kept && rsc.firstUse != invalid;
+    if (!rsc.persistent) continue;
+    rsc.firstUse = 0;
+    rsc.lastUse = uint32_t(order.size() - 1);
+  }
+
+  finalBarriers.clear();
+  for (ResourceId r = 0; r < resources.size(); ++r) {
+    const ResourceNode& rsc = resources[r];
+    if (rsc.imported && rsc.finalUsage != ResourceUsage::undefined &&
+        current[r] != rsc.finalUsage) {
+      finalBarriers.push_back({r, current[r], rsc.finalUsage});
+    }
+  }
+
+  compiled = true;
+  return true;
+}
+
+void RenderGraph::getActivations(
+    const std::vector<bool>& runs,
+    std::vector<std::vector<ResourceId>>* activations) const {
+  assert(compiled && runs.size() == order.size());
+  activations->assign(order.size(), {});
+  std::vector<bool> active(resources.size(), false);
+  for (uint32_t pos = 0; pos < order.size(); ++pos) {
+    if (!runs[pos]) continue;
+    for (const Access& access : passes[order[pos]].accesses) {
+      const ResourceNode& rsc = resources[access.resource];
+      if (rsc.imported || rsc.persistent || active[access.resource]) continue;
+      active[access.resource] = true;
+      (*activations)[pos].push_back(access.resource);
+    }
+  }
+}
+
+uint32_t RenderGraph::getBarrierCount() const {
+  uint32_t count = uint32_t(finalBarriers.size());
+  for (PassId p : order) count += uint32_t(passes[p].barriers.size());
+  return count;
+}
+
+std::string RenderGraph::describe() const {
+  assert(compiled);
+  std::string text;
+  auto appendBarriers = [&](const std::vector<Barrier>& barriers) {
+    for (const Barrier& b : barriers) {
+      text += "    " + resources[b.resource].name + " : " +
+              usageName(b.before) + " -> " + usageName(b.after) + "\n";
+    }
+  };
+
+  for (uint32_t pos = 0; pos < order.size(); ++pos) {
+    const PassNode& pass = passes[order[pos]];
+    text += std::to_string(pos) + " " + pass.name +
+            (pass.cached ? " (cached)\n" : "\n");
+    appendBarriers(pass.barriers);
+  }
+  if (!finalBarriers.empty()) {
+    text += "end\n";
+    appendBarriers(finalBarriers);
+  }
+  for (PassId p = 0; p < passes.size(); ++p)
+    if (passes[p].culled) text += "culled " + passes[p].name + "\n";
+  text += std::to_string(getBarrierCount()) + " barriers\n";
+  return text;
+}
+
+// splitmix64 finalizer over the running value
+static uint64_t mix(uint64_t hash, uint64_t value) {
+  uint64_t z = hash ^ (value + 0x9e3779b97f4a7c15ull + (hash << 6));
+  z = (z ^ (z >> 30)) * 0xbf58476d1ce4e5b9ull;
+  z = (z ^ (z >> 27)) * 0x94d049bb133111ebull;
+  return z ^ (z >> 31);
+}
+
+void PassCache::update(const std::vector<uint64_t>& inputHashes,
+                       const std::vector<uint8_t>& enabled,
+                       std::vector<bool>* runs) {
+  using ResourceId = RenderGraph::ResourceId;
+  if (versions.size() < graph->resourceCount())
+    versions.resize(graph->resourceCount(), 1);
+  if (keys.size() < graph->passCount()) keys.resize(graph->passCount(), 0);
+
+  const std::vector<RenderGraph::PassId>& order = graph->getOrder();
+  std::vector<bool> forced(order.size(), false);
+  std::vector<uint64_t> newKeys(order.size(), 0);
+  std::vector<uint64_t> newVersions;
+  std::vector<uint32_t> writerPos;
+  // played forward on copies of the versions, then again with the writers
+  // that a reader which runs needs, until none is added
+  for (bool again = true; again;) {
+    again = false;
+    newVersions = versions;
+    writerPos.assign(versions.size(), RenderGraph::invalid);
+    runs->assign(order.size(), false);
+    for (uint32_t pos = 0; pos < order.size(); ++pos) {
+      RenderGraph::PassId pass = order[pos];
+      if (!enabled[pass]) continue;
+      const std::vector<RenderGraph::Access>& accesses =
+          graph->getAccesses(pass);
+      bool run = !graph->isCached(pass) || forced[pos];
+      if (graph->isCached(pass)) {
+        uint64_t key = mix(0, inputHashes[pass]);
+        for (const RenderGraph::Access& access : accesses) {
+          if (isWriteUsage(access.usage)) continue;
+          key = mix(key, access.resource);
+          key = mix(key, newVersions[access.resource]);
+        }
+        newKeys[pos] = key == 0 ? 1 : key;
+        run |= newKeys[pos] != keys[pass];
+      }
+
+      for (const RenderGraph::Access& access : accesses) {
+        ResourceId resource = access.resource;
+        if (isWriteUsage(access.usage)) {
+          writerPos[resource] = pos;
+          if (run) ++newVersions[resource];
+          continue;
+        }
+        uint32_t writer = writerPos[resource];
+        if (run && writer != RenderGraph::invalid && !(*runs)[writer] &&
+            !graph->isImported(resource) && !graph->isPersistent(resource) &&
+            enabled[order[writer]]) {
+          forced[writer] = true;
+          again = true;
+        }
+      }
+      (*runs)[pos] = run;
+    }
+  }
+
+  versions = std::move(newVersions);
+  for (uint32_t pos = 0; pos < order.size(); ++pos) {
+    RenderGraph::PassId pass = order[pos];
+    if (!enabled[pass]) continue;
+    if ((*runs)[pos]) {
+      ++runCount;
+      if (graph->isCached(pass)) keys[pass] = newKeys[pos];
+    } else {
+      ++skipCount;
+    }
+  }
+}
+
+void PassCache::touch(RenderGraph::ResourceId resource) {
+  if (versions.size() < graph->resourceCount())
+    versions.resize(graph->resourceCount(), 1);
+  ++versions[resource];
+}
+
+void PassCache::invalidate() { keys.assign(keys.size(), 0); }
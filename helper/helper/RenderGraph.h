@@ -0,0 +1,191 @@
+#pragma once
+#include <cstdint>
+#include <string>
+#include <vector>
+
+// Frame graph compiler.
+// Passes declare which resources they read and write and how. compile()
+// sorts the passes by their dependencies, drops the passes that do not
+// contribute to an imported resource, computes resource lifetimes and
+// schedules the state transitions as one batch in front of each pass. It
+// knows nothing about the graphics API; FrameGraph maps the result onto
+// D3D12. Passes marked cached may be skipped, see PassCache.
+enum class ResourceUsage : uint8_t {
+  undefined,
+  renderTarget,
+  depthWrite,
+  depthRead,
+  shaderResource,
+  unorderedAccess,
+  copySource,
+  copyDest,
+  present,
+};
+
+inline bool isWriteUsage(ResourceUsage usage) {
+  return usage == ResourceUsage::renderTarget ||
+         usage == ResourceUsage::depthWrite ||
+         usage == ResourceUsage::unorderedAccess ||
+         usage == ResourceUsage::copyDest;
+}
+
+const char* usageName(ResourceUsage usage);
+
+class RenderGraph {
+ public:
+  using ResourceId = uint32_t;
+  using PassId = uint32_t;
+  static const uint32_t invalid = UINT32_MAX;
+
+  struct Barrier {
+    ResourceId resource;
+    ResourceUsage before;
+    ResourceUsage after;
+  };
+
+  struct Access {
+    ResourceId resource;
+    ResourceUsage usage;
+  };
+
+ private:
+  struct PassNode {
+    std::string name;
+    bool sideEffect = false;  // never culled
+    bool cached = false;
+    std::vector<Access> accesses;
+
+    // set in compile()
+    bool culled = false;
+    std::vector<Barrier> barriers;
+  };
+
+  struct ResourceNode {
+    std::string name;
+    bool imported = false;
+    ResourceUsage initialUsage = ResourceUsage::undefined;
+    ResourceUsage finalUsage = ResourceUsage::undefined;
+
+    // positions in the execution order, set in compile()
+    uint32_t firstUse = invalid;
+    uint32_t lastUse = invalid;
+    bool persistent = false;
+    bool kept = false;  // by setPersistent()
+  };
+
+  std::vector<PassNode> passes;
+  std::vector<ResourceNode> resources;
+  std::vector<PassId> order;
+  std::vector<Barrier> finalBarriers;
+  std::string error;
+  bool compiled = false;
+
+  void addAccess(PassId pass, ResourceId resource, ResourceUsage usage);
+
+ public:
+  // resources living outside of the frame: their state on entry is
+  // initialUsage and they are left in finalUsage (undefined: as is)
+  ResourceId importResource(const char* name, ResourceUsage initialUsage,
+                            ResourceUsage finalUsage = ResourceUsage::undefined);
+  // resources owned by the frame, only their lifetime is meaningful
+  ResourceId createTransient(const char* name);
+  PassId addPass(const char* name, bool sideEffect = false);
+
+  // what the pass writes stays valid while what it reads does not change.
+  // The transients it writes that a pass not cached reads are kept between
+  // frames, they live through the whole frame and never share memory; the
+  // others are written again whenever a pass reading them runs. Only the
+  // pass may write them.
+  void setCached(PassId pass, bool cached = true);
+  // the transient is kept between frames whatever reads it, e.g. what a
+  // cached pass wrote for a cached pass that runs more often : the reader
+  // runs again without its writer. It never shares memory.
+  void setPersistent(ResourceId resource, bool persistent = true);
+
+  void read(PassId pass, ResourceId resource,
+            ResourceUsage usage = ResourceUsage::shaderResource);
+  void write(PassId pass, ResourceId resource,
+             ResourceUsage usage = ResourceUsage::renderTarget);
+
+  void clear();
+  // false when a transient is read but never written or the dependencies
+  // form a cycle, getError() then tells which
+  bool compile();
+  const std::string& getError() const { return error; }
+
+  uint32_t passCount() const { return uint32_t(passes.size()); }
+  uint32_t resourceCount() const { return uint32_t(resources.size()); }
+  const std::string& getPassName(PassId pass) const { return passes[pass].name; }
+  const std::string& getResourceName(ResourceId resource) const {
+    return resources[resource].name;
+  }
+  bool isImported(ResourceId resource) const {
+    return resources[resource].imported;
+  }
+
+  const std::vector<PassId>& getOrder() const { return order; }
+  bool isCulled(PassId pass) const { return passes[pass].culled; }
+  bool isCached(PassId pass) const { return passes[pass].cached; }
+  const std::vector<Access>& getAccesses(PassId pass) const {
+    return passes[pass].accesses;
+  }
+  // transitions to issue right before the pass
+  const std::vector<Barrier>& getBarriers(PassId pass) const {
+    return passes[pass].barriers;
+  }
+  // transitions to issue after the last pass
+  const std::vector<Barrier>& getFinalBarriers() const { return finalBarriers; }
+  uint32_t getBarrierCount() const;
+
+  // lifetime of the resource as positions in getOrder(), invalid if unused
+  uint32_t getFirstUse(ResourceId resource) const {
+    return resources[resource].firstUse;
+  }
+  uint32_t getLastUse(ResourceId resource) const {
+    return resources[resource].lastUse;
+  }
+  // written by a cached pass and read in the frames it is skipped, or set
+  bool isPersistent(ResourceId resource) const {
+    return resources[resource].persistent;
+  }
+  // the transients that take over their memory at each position of the order
+  // in a frame, runs as given by PassCache::update() : each at the first
+  // pass that runs and uses it, so a skipped or disabled pass activates
+  // nothing. Persistent ones never share memory and are left out.
+  void getActivations(const std::vector<bool>& runs,
+                      std::vector<std::vector<ResourceId>>* activations) const;
+
+  std::string describe() const;
+};
+
+// Which passes of a compiled RenderGraph have to run this frame.
+// Each resource has a version, bumped whenever a pass writing it runs. A
+// cached pass runs when the hash of its inputs from outside the graph (its
+// constants, say) or the version of a resource it reads changed since it last
+// ran, so a change reaches everything downstream of it; other passes always
+// run. A pass that runs reading a transient that does not persist runs its
+// writer again, the content did not survive the frames the writer skipped.
+class PassCache {
+  const RenderGraph* graph;
+  std::vector<uint64_t> versions;  // per resource
+  std::vector<uint64_t> keys;      // per pass, of its last run, 0 : never ran
+  uint32_t runCount = 0;
+  uint32_t skipCount = 0;
+
+ public:
+  explicit PassCache(const RenderGraph* graph) : graph(graph) {}
+
+  // once per frame : the hash of each pass and whether it is enabled, by
+  // PassId; runs gets whether the pass at each position of the order runs.
+  // The writes of the passes that run get new versions, a disabled pass
+  // neither runs nor counts.
+  void update(const std::vector<uint64_t>& inputHashes,
+              const std::vector<uint8_t>& enabled, std::vector<bool>* runs);
+  // the resource changed outside of the graph, its readers run again
+  void touch(RenderGraph::ResourceId resource);
+  // every pass runs once more
+  void invalidate();
+
+  uint32_t getRunCount() const { return runCount; }
+  uint32_t getSkipCount() const { return skipCount; }
+};
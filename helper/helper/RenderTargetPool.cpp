@@ -0,0 +1,147 @@
+#include "RenderTargetPool.h"
+
+void RenderTargetPool::destroy() {
+  entries.clear();
+  planner.clear();
+  SAFE_RELEASE(heap);
+  dirty = false;
+}
+
+void RenderTargetPool::beginFrame() {
+  for (Entry& entry : entries) entry.acquired = false;
+}
+
+RenderTargetPool::Handle RenderTargetPool::acquire(DXGI_FORMAT format,
+                                                   UINT width, UINT height,
+                                                   UINT firstPass,
+                                                   UINT lastPass,
+                                                   bool unorderedAccess) {
+  UINT freeSlot = UINT(entries.size());
+  for (UINT i = 0; i < entries.size(); ++i) {
+    Entry& entry = entries[i];
+    if (!entry.live) {
+      freeSlot = std::min(freeSlot, i);
+      continue;
+    }
+    if (!entry.acquired && entry.format == format && entry.width == width &&
+        entry.height == height && entry.firstPass == firstPass &&
+        entry.lastPass == lastPass &&
+        entry.unorderedAccess == unorderedAccess) {
+      entry.acquired = true;
+      return i;
+    }
+  }
+
+  Entry entry{format,   width,           height, firstPass,
+              lastPass, unorderedAccess, true,   true};
+  if (freeSlot == entries.size()) entries.emplace_back();
+  entries[freeSlot] = std::move(entry);
+  dirty = true;
+  return freeSlot;
+}
+
+void RenderTargetPool::compile() {
+  for (Entry& entry : entries) {
+    if (!entry.live || entry.acquired) continue;
+    // e.g. a target of another size now, its memory goes back to the heap
+    if (RenderTarget* target = entry.target.release())
+      cmdQueue->onCompletion(0, [target] { delete target; });
+    entry.live = false;
+    dirty = true;
+  }
+  if (!dirty) return;
+
+  // the old heap and targets may still be referenced by commands in flight,
+  // the new ones are placed next to them instead of waiting
+  planner.clear();
+  for (Entry& entry : entries) {
+    if (!entry.live) continue;
+    D3D12_RESOURCE_FLAGS flags = D3D12_RESOURCE_FLAG_ALLOW_RENDER_TARGET;
+    if (entry.unorderedAccess)
+      flags |= D3D12_RESOURCE_FLAG_ALLOW_UNORDERED_ACCESS;
+    D3D12_RESOURCE_ALLOCATION_INFO info = getTextureAllocationInfo(
+        entry.format, entry.width, entry.height, 1, flags);
+    entry.planned = planner.add({info.SizeInBytes, info.Alignment,
+                                 entry.firstPass, entry.lastPass});
+    if (ID3D12Resource* old = entry.target ? entry.target->get() : nullptr) {
+      // place() releases its reference, the queue keeps this one
+      old->AddRef();
+      cmdQueue->deferRelease(old);
+    }
+  }
+  planner.plan();
+  if (heap) cmdQueue->deferRelease(heap);
+  heap = nullptr;
+  dirty = false;
+  if (planner.count() == 0) return;
+
+  D3D12_HEAP_DESC heapDesc = {};
+  heapDesc.SizeInBytes = planner.getHeapSize();
+  heapDesc.Properties.Type = D3D12_HEAP_TYPE_DEFAULT;
+  heapDesc.Alignment = _max(planner.getHeapAlignment(),
+                            (UINT64)D3D12_DEFAULT_RESOURCE_PLACEMENT_ALIGNMENT);
+  heapDesc.Flags = D3D12_HEAP_FLAG_ALLOW_ONLY_RT_DS_TEXTURES;
+  ThrowFailedHR(
+      getDevice()->get()->CreateHeap(&heapDesc, IID_PPV_ARGS(&heap)));
+  heap->SetName(L"render target pool");
+  // the targets placed in it alias, the heap is what takes memory
+  trackMemory(heap, "render target pool", "heap", MemoryCategory::renderTarget,
+              heapDesc.SizeInBytes);
+
+  for (Entry& entry : entries) {
+    if (!entry.live) continue;
+    UINT64 offset = planner.getPlacement(entry.planned).offset;
+    if (entry.target) {
+      entry.target->place(heap, offset);
+    } else {
+      entry.target = std::make_unique<RenderTarget>(
+          srvHeap, rtvHeap, cmdQueue, entry.format, entry.width, entry.height,
+          heap, offset, entry.unorderedAccess);
+    }
+  }
+}
+
+void RenderTargetPool::beginUse(CommandList* cmdList, Handle handle) {
+  if (!isAliased(handle)) return;
+
+  RenderTarget& rt = get(handle);
+  float black[] = {0.0f, 0.0f, 0.0f, 1.0f};
+
+  auto* rawList = cmdList->begin();
+  {
+    // on a worker the transition to the first state of the target goes in
+    // front of the list at submit, the aliasing barrier must come before it
+    ResourceStateTracker* tracker = ResourceStateTracker::getCurrent();
+    if (tracker && !tracker->isTracked(&rt)) {
+      tracker->activate(&rt);
+    } else {
+      D3D12_RESOURCE_BARRIER barrier = {};
+      barrier.Type = D3D12_RESOURCE_BARRIER_TYPE_ALIASING;
+      barrier.Aliasing.pResourceBefore = nullptr;
+      barrier.Aliasing.pResourceAfter = rt.get();
+      rawList->ResourceBarrier(1, &barrier);
+    }
+
+    // an activated aliased target must be cleared before it is used
+    D3D12_RESOURCE_STATES prevState =
+        rt.changeResourceState(rawList, D3D12_RESOURCE_STATE_RENDER_TARGET);
+    rawList->ClearRenderTargetView(rt.getRtv(), black, 0, nullptr);
+    rt.changeResourceState(rawList, prevState);
+  }
+  cmdList->end(cmdQueue);
+}
+
+UINT RenderTargetPool::getAliasedCount() const {
+  UINT count = 0;
+  for (UINT i = 0; i < planner.count(); ++i)
+    count += planner.getPlacement(i).aliased;
+  return count;
+}
+
+void RenderTargetPool::printStats() const {
+  const double MB = 1024.0 * 1024.0;
+  printf("render target pool : %u targets, %u aliased, heap %.1f MB (naive "
+         "%.1f MB, live peak %.1f MB)\n",
+         planner.count(), getAliasedCount(), planner.getHeapSize() / MB,
+         planner.getNaiveSize() / MB, planner.getPeakLiveSize() / MB);
+}
@@ -0,0 +1,70 @@
+#pragma once
+#include "Helper.h"
+#include "AliasingPlanner.h"
+
+// Hands out render targets by (format, size, lifetime).
+// All targets are placed in one heap; targets whose pass intervals do not
+// overlap share memory. Requests that match a previous frame reuse the
+// same target, so the heap is only re-planned when the request set changes;
+// the targets no request matched are dropped then. What the commands in
+// flight still use is released once the queue is past them.
+class RenderTargetPool {
+ public:
+  using Handle = UINT;
+
+ private:
+  struct Entry {
+    DXGI_FORMAT format;
+    UINT width;
+    UINT height;
+    UINT firstPass;
+    UINT lastPass;
+    bool unorderedAccess;
+    bool acquired = false;  // acquired since the last beginFrame()
+    bool live = false;      // false : a free slot, handles stay stable
+    UINT planned = 0;       // index in the planner
+    std::unique_ptr<RenderTarget> target;
+  };
+
+  DescriptorHeap* srvHeap = nullptr;
+  DescriptorHeap* rtvHeap = nullptr;
+  CommandQueue* cmdQueue = nullptr;
+
+  std::vector<Entry> entries;
+  AliasingPlanner planner;
+  ID3D12Heap* heap = nullptr;
+  bool dirty = false;
+
+ public:
+  RenderTargetPool(DescriptorHeap* srvHeap, DescriptorHeap* rtvHeap,
+                   CommandQueue* queue)
+      : srvHeap(srvHeap), rtvHeap(rtvHeap), cmdQueue(queue) {}
+  ~RenderTargetPool() { destroy(); }
+  void destroy();
+
+  void beginFrame();
+  // passes are numbered in execution order, the target is live in
+  // [firstPass, lastPass]. unorderedAccess targets also get a uav.
+  Handle acquire(DXGI_FORMAT format, UINT width, UINT height, UINT firstPass,
+                 UINT lastPass, bool unorderedAccess = false);
+  // drops the targets not acquired since beginFrame() and places the
+  // others, never waits for the gpu
+  void compile();
+
+  RenderTarget& get(Handle handle) const {
+    assert(handle < entries.size() && entries[handle].target);
+    return *entries[handle].target;
+  }
+  bool isAliased(Handle handle) const {
+    return planner.getPlacement(entries[handle].planned).aliased;
+  }
+  // must be called before the first pass that writes the target in a frame,
+  // the memory may hold another target's data
+  void beginUse(CommandList* cmdList, Handle handle);
+
+  UINT64 getHeapSize() const { return planner.getHeapSize(); }
+  UINT64 getNaiveSize() const { return planner.getNaiveSize(); }
+  // the targets sharing memory with another one
+  UINT getAliasedCount() const;
+  void printStats() const;
+};
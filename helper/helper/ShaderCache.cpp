@@ -0,0 +1,163 @@
+#include "ShaderCache.h"
+
+#include <algorithm>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <sstream>
+
+namespace {
+const uint32_t entryMagic = 0x31484353;  // "SCH1"
+
+struct EntryHeader {
+  uint32_t magic;
+  uint32_t reserved;
+  uint64_t hash;
+  uint64_t size;
+  uint64_t codeHash;
+};
+}  // namespace
+
+ContentHash& ContentHash::add(const void* data, size_t size) {
+  const uint8_t* bytes = static_cast<const uint8_t*>(data);
+  for (size_t i = 0; i < size; ++i) {
+    value ^= bytes[i];
+    value *= 1099511628211ull;
+  }
+  return *this;
+}
+
+ContentHash& ContentHash::add(std::string_view text) {
+  addValue(uint64_t(text.size()));
+  return add(text.data(), text.size());
+}
+
+std::string toHex(uint64_t value) {
+  static const char digits[] = "0123456789abcdef";
+  std::string hex(16, '0');
+  for (int i = 15; i >= 0; --i, value >>= 4) hex[i] = digits[value & 0xf];
+  return hex;
+}
+
+bool ShaderCache::readFile(const std::string& path, std::string* text) {
+  std::ifstream file(path, std::ios::binary);
+  if (!file) return false;
+  std::ostringstream ss;
+  ss << file.rdbuf();
+  *text = ss.str();
+  return true;
+}
+
+ShaderCache::ShaderCache(std::string dir, ReadFunc read)
+    : dir(std::move(dir)), read(std::move(read)) {}
+
+std::vector<std::string> ShaderCache::findIncludes(std::string_view text) {
+  std::vector<std::string> names;
+  size_t pos = 0;
+  while (pos < text.size()) {
+    size_t end = text.find('\n', pos);
+    if (end == std::string_view::npos) end = text.size();
+    std::string_view line = text.substr(pos, end - pos);
+    pos = end + 1;
+
+    size_t i = line.find_first_not_of(" \t");
+    if (i == std::string_view::npos || line[i] != '#') continue;
+    i = line.find_first_not_of(" \t", i + 1);
+    if (i == std::string_view::npos || line.substr(i, 7) != "include")
+      continue;
+    i = line.find_first_not_of(" \t", i + 7);
+    if (i == std::string_view::npos) continue;
+
+    char close = line[i] == '"' ? '"' : line[i] == '<' ? '>' : 0;
+    if (!close) continue;
+    size_t last = line.find(close, i + 1);
+    if (last == std::string_view::npos) continue;
+    names.emplace_back(line.substr(i + 1, last - i - 1));
+  }
+  return names;
+}
+
+std::string ShaderCache::resolveInclude(const std::string& includer,
+                                        const std::string& name) {
+  size_t slash = includer.find_last_of("/\\");
+  if (slash == std::string::npos) return name;
+  return includer.substr(0, slash + 1) + name;
+}
+
+void ShaderCache::hashFile(const std::string& path, ContentHash* hash,
+                           std::vector<std::string>* visited) const {
+  // an include guarded by #pragma once may come back, hash it once
+  if (std::find(visited->begin(), visited->end(), path) != visited->end())
+    return;
+  visited->push_back(path);
+
+  std::string text;
+  hash->add(path);
+  if (!read(path, &text)) {
+    // a missing include is part of the key too, creating it changes the hash
+    hash->addValue(uint8_t(0));
+    return;
+  }
+  hash->addValue(uint8_t(1)).add(text);
+
+  for (const std::string& name : findIncludes(text))
+    hashFile(resolveInclude(path, name), hash, visited);
+}
+
+uint64_t ShaderCache::hashSource(const ShaderKey& key) const {
+  std::string text;
+  if (!read(key.path, &text)) return 0;
+
+  ContentHash hash;
+  hash.add(key.entry).add(key.target);
+  hash.addValue(key.flags).addValue(key.compilerVersion);
+  std::vector<std::string> visited;
+  hashFile(key.path, &hash, &visited);
+  // 0 means unreadable
+  return hash.get() != 0 ? hash.get() : 1;
+}
+
+std::string ShaderCache::getPath(uint64_t hash) const {
+  return dir + "/" + toHex(hash) + ".cso";
+}
+
+bool ShaderCache::load(uint64_t hash, std::vector<uint8_t>* code) const {
+  ++misses;  // until the entry checks out
+  std::ifstream file(getPath(hash), std::ios::binary);
+  if (!file) return false;
+
+  EntryHeader header;
+  if (!file.read(reinterpret_cast<char*>(&header), sizeof(header)))
+    return false;
+  if (header.magic != entryMagic || header.hash != hash) return false;
+
+  code->resize(size_t(header.size));
+  if (!file.read(reinterpret_cast<char*>(code->data()), code->size()))
+    return false;
+  // a write cut short leaves a file that reads fine but hashes wrong
+  if (ContentHash().add(code->data(), code->size()).get() != header.codeHash)
+    return false;
+  --misses;
+  ++hits;
+  return true;
+}
+
+bool ShaderCache::store(uint64_t hash, const void* code, size_t size) const {
+  std::error_code ec;
+  std::filesystem::create_directories(dir, ec);
+
+  EntryHeader header{entryMagic, 0, hash, size,
+                     ContentHash().add(code, size).get()};
+  // written aside then renamed, a reader never sees half an entry
+  std::string path = getPath(hash);
+  std::string tmpPath = path + ".tmp";
+  {
+    std::ofstream file(tmpPath, std::ios::binary | std::ios::trunc);
+    if (!file) return false;
+    file.write(reinterpret_cast<const char*>(&header), sizeof(header));
+    file.write(static_cast<const char*>(code), std::streamsize(size));
+    if (!file) return false;
+  }
+  std::filesystem::rename(tmpPath, path, ec);
+  return !ec;
+}
@@ -0,0 +1,74 @@
+#pragma once
+#include <cstdint>
+#include <functional>
+#include <string>
+#include <string_view>
+#include <vector>
+
+// 64-bit FNV-1a, fed piece by piece.
+class ContentHash {
+  uint64_t value = 14695981039346656037ull;
+
+ public:
+  ContentHash& add(const void* data, size_t size);
+  // the length goes in too, so "ab" + "c" differs from "a" + "bc"
+  ContentHash& add(std::string_view text);
+  template <typename T>
+  ContentHash& addValue(const T& data) {
+    return add(&data, sizeof(T));
+  }
+  uint64_t get() const { return value; }
+};
+
+std::string toHex(uint64_t value);
+
+// What a compiled shader depends on besides its text.
+struct ShaderKey {
+  std::string path;
+  std::string entry;
+  std::string target;
+  uint32_t flags = 0;
+  uint32_t compilerVersion = 0;
+};
+
+// Compiled shaders on disk, named by a hash of everything they were built
+// from : the key, the source and every file it includes. Editing any of them
+// changes the hash, so stale entries are never found again; nothing has to
+// be invalidated by hand.
+class ShaderCache {
+ public:
+  // reads a whole file, false when it does not exist
+  using ReadFunc = std::function<bool(const std::string& path,
+                                      std::string* text)>;
+  static bool readFile(const std::string& path, std::string* text);
+
+ private:
+  std::string dir;
+  ReadFunc read;
+  mutable uint32_t hits = 0;
+  mutable uint32_t misses = 0;
+
+  void hashFile(const std::string& path, ContentHash* hash,
+                std::vector<std::string>* visited) const;
+
+ public:
+  explicit ShaderCache(std::string dir, ReadFunc read = readFile);
+
+  // 0 when the source itself can't be read
+  uint64_t hashSource(const ShaderKey& key) const;
+
+  // the quoted or angled names of the #include lines, in order
+  static std::vector<std::string> findIncludes(std::string_view text);
+  // an include is looked up next to the file including it
+  static std::string resolveInclude(const std::string& includer,
+                                    const std::string& name);
+
+  std::string getPath(uint64_t hash) const;
+  // false on a miss or a damaged entry
+  bool load(uint64_t hash, std::vector<uint8_t>* code) const;
+  bool store(uint64_t hash, const void* code, size_t size) const;
+
+  const std::string& getDir() const { return dir; }
+  uint32_t getHitCount() const { return hits; }
+  uint32_t getMissCount() const { return misses; }
+};
@@ -0,0 +1,542 @@
+#include "SoftRender.h"
+
+#include <algorithm>
+#include <cassert>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstring>
+
+#include "GBufferPacking.h"
+
+#if defined(__SSE2__) || defined(_M_X64) || defined(_M_AMD64)
+#include <emmintrin.h>
+#define SOFT_RENDER_SSE 1
+#endif
+
+SoftTexture::SoftTexture(uint32_t width, uint32_t height)
+    : width(width), height(height), texels(size_t(width) * height * 4, 0.0f) {}
+
+SoftTexture SoftTexture::fromRgba8(const uint8_t* data, uint32_t width,
+                                   uint32_t height, size_t rowPitch) {
+  SoftTexture texture(width, height);
+  for (uint32_t y = 0; y < height; ++y) {
+    const uint8_t* row = data + y * rowPitch;
+    float* dst = texture.texel(0, y);
+    for (uint32_t i = 0; i < width * 4; ++i) dst[i] = row[i] / 255.0f;
+  }
+  return texture;
+}
+
+SoftTexture SoftTexture::fromFloat4(const float* data, uint32_t width,
+                                    uint32_t height, size_t rowPitch) {
+  SoftTexture texture(width, height);
+  for (uint32_t y = 0; y < height; ++y) {
+    memcpy(texture.texel(0, y),
+           reinterpret_cast<const uint8_t*>(data) + y * rowPitch,
+           sizeof(float) * 4 * width);
+  }
+  return texture;
+}
+
+void SoftTexture::fill(const float value[4]) {
+  for (size_t i = 0; i < texels.size(); i += 4)
+    memcpy(texels.data() + i, value, sizeof(float) * 4);
+}
+
+static uint32_t wrap(int i, uint32_t size) {
+  int m = i % int(size);
+  return uint32_t(m < 0 ? m + int(size) : m);
+}
+
+void SoftTexture::sample(float u, float v, float out[4]) const {
+  // texel centers at half integers
+  float x = u * width - 0.5f;
+  float y = v * height - 0.5f;
+  float fx = floorf(x);
+  float fy = floorf(y);
+  float tx = x - fx;
+  float ty = y - fy;
+  uint32_t x0 = wrap(int(fx), width);
+  uint32_t x1 = wrap(int(fx) + 1, width);
+  uint32_t y0 = wrap(int(fy), height);
+  uint32_t y1 = wrap(int(fy) + 1, height);
+  const float* a = texel(x0, y0);
+  const float* b = texel(x1, y0);
+  const float* c = texel(x0, y1);
+  const float* d = texel(x1, y1);
+  for (int i = 0; i < 4; ++i) {
+    float top = a[i] + (b[i] - a[i]) * tx;
+    float bottom = c[i] + (d[i] - c[i]) * tx;
+    out[i] = top + (bottom - top) * ty;
+  }
+}
+
+static uint8_t toUnorm8(float v) {
+  return uint8_t(gbufferSaturate(v) * 255.0f + 0.5f);
+}
+
+std::vector<uint8_t> SoftTexture::toRgba8() const {
+  std::vector<uint8_t> data(texels.size());
+  for (size_t i = 0; i < texels.size(); ++i) data[i] = toUnorm8(texels[i]);
+  return data;
+}
+
+SoftDepth::SoftDepth(uint32_t width, uint32_t height)
+    : width(width), height(height), values(size_t(width) * height, 1.0f) {}
+
+SoftRasterizer::SoftRasterizer(TaskPool* pool) : pool(pool) {}
+
+void SoftRasterizer::setViewport(uint32_t width, uint32_t height) {
+  this->width = width;
+  this->height = height;
+  tilesX = (width + tileSize - 1) / tileSize;
+  tilesY = (height + tileSize - 1) / tileSize;
+  bins.resize(size_t(tilesX) * tilesY);
+  tilePixels.resize(bins.size());
+}
+
+void SoftRasterizer::shadeVertices(
+    uint32_t numVertices,
+    const std::function<void(uint32_t, SoftVertex*)>& vertex,
+    std::vector<SoftVertex>* out) {
+  out->resize(numVertices);
+  const uint32_t chunk = 1024;
+  uint32_t numChunks = (numVertices + chunk - 1) / chunk;
+  auto shade = [&](uint32_t c) {
+    uint32_t end = std::min(numVertices, (c + 1) * chunk);
+    for (uint32_t i = c * chunk; i < end; ++i) vertex(i, &(*out)[i]);
+  };
+  if (pool) {
+    pool->run(numChunks, shade);
+  } else {
+    for (uint32_t c = 0; c < numChunks; ++c) shade(c);
+  }
+}
+
+void SoftRasterizer::setup(const SoftVertex* v0, const SoftVertex* v1,
+                           const SoftVertex* v2, uint32_t numVaryings) {
+  const SoftVertex* v[3] = {v0, v1, v2};
+  float x[3], y[3], z[3], invW[3];
+  for (int i = 0; i < 3; ++i) {
+    invW[i] = 1.0f / v[i]->clip[3];
+    x[i] = (v[i]->clip[0] * invW[i] * 0.5f + 0.5f) * width;
+    y[i] = (0.5f - v[i]->clip[1] * invW[i] * 0.5f) * height;
+    z[i] = v[i]->clip[2] * invW[i];
+  }
+  float area = (x[1] - x[0]) * (y[2] - y[0]) - (x[2] - x[0]) * (y[1] - y[0]);
+  if (area == 0.0f) return;
+  // either winding, the edge functions are made positive inside
+  int order[3] = {0, 1, 2};
+  if (area < 0.0f) {
+    std::swap(order[1], order[2]);
+    area = -area;
+  }
+  float px[3], py[3];
+  for (int i = 0; i < 3; ++i) {
+    px[i] = x[order[i]];
+    py[i] = y[order[i]];
+  }
+
+  Triangle tri;
+  tri.minX = std::max(int(ceilf(std::min({px[0], px[1], px[2]}) - 0.5f)), 0);
+  tri.minY = std::max(int(ceilf(std::min({py[0], py[1], py[2]}) - 0.5f)), 0);
+  tri.maxX = std::min(int(floorf(std::max({px[0], px[1], px[2]}) - 0.5f)),
+                      int(width) - 1);
+  tri.maxY = std::min(int(floorf(std::max({py[0], py[1], py[2]}) - 0.5f)),
+                      int(height) - 1);
+  if (tri.minX > tri.maxX || tri.minY > tri.maxY) return;
+
+  for (int e = 0; e < 3; ++e) {
+    // from the same end for both triangles of a shared edge, their values
+    // are then exactly opposite and a pixel center is in one of them; exactly
+    // 0 at both ends, the rule also settles a center on a vertex
+    int p = e;
+    int q = (e + 1) % 3;
+    bool flip = py[q] < py[p] || (py[q] == py[p] && px[q] < px[p]);
+    if (flip) std::swap(p, q);
+    float sign = flip ? -1.0f : 1.0f;
+    tri.edge[e][0] = (py[p] - py[q]) * sign;
+    tri.edge[e][1] = (px[q] - px[p]) * sign;
+    tri.edge[e][2] = px[p];
+    tri.edge[e][3] = py[p];
+    // the gradient points inside : right of a left edge, below a top one
+    tri.topLeft[e] = tri.edge[e][0] > 0.0f ||
+                     (tri.edge[e][0] == 0.0f && tri.edge[e][1] > 0.0f);
+  }
+
+  // a value at the vertices as a plane over the screen
+  auto plane = [&](const float value[3], float out[3]) {
+    float f[3] = {value[order[0]], value[order[1]], value[order[2]]};
+    out[0] = ((f[1] - f[0]) * (py[2] - py[0]) -
+              (f[2] - f[0]) * (py[1] - py[0])) / area;
+    out[1] = ((f[2] - f[0]) * (px[1] - px[0]) -
+              (f[1] - f[0]) * (px[2] - px[0])) / area;
+    out[2] = f[0] - out[0] * px[0] - out[1] * py[0];
+  };
+  plane(z, tri.depth);
+  plane(invW, tri.invW);
+  for (uint32_t i = 0; i < numVaryings; ++i) {
+    float value[3];
+    for (int j = 0; j < 3; ++j) value[j] = v[j]->varyings[i] * invW[j];
+    plane(value, tri.varyings[i]);
+  }
+
+  uint32_t index = uint32_t(triangles.size());
+  triangles.push_back(tri);
+  ++stats.triangles;
+  for (uint32_t ty = tri.minY / tileSize; ty <= tri.maxY / tileSize; ++ty) {
+    for (uint32_t tx = tri.minX / tileSize; tx <= tri.maxX / tileSize; ++tx)
+      bins[ty * tilesX + tx].push_back(index);
+  }
+}
+
+// the polygon of a triangle where z >= 0, 3 or 4 vertices
+static uint32_t clipNear(const SoftVertex* in[3], uint32_t numVaryings,
+                         SoftVertex out[4]) {
+  uint32_t count = 0;
+  for (int i = 0; i < 3; ++i) {
+    const SoftVertex& a = *in[i];
+    const SoftVertex& b = *in[(i + 1) % 3];
+    bool aInside = a.clip[2] >= 0.0f;
+    bool bInside = b.clip[2] >= 0.0f;
+    if (aInside) out[count++] = a;
+    if (aInside == bInside) continue;
+    float t = a.clip[2] / (a.clip[2] - b.clip[2]);
+    SoftVertex& v = out[count++];
+    for (int j = 0; j < 4; ++j)
+      v.clip[j] = a.clip[j] + (b.clip[j] - a.clip[j]) * t;
+    v.clip[2] = 0.0f;
+    for (uint32_t j = 0; j < numVaryings; ++j)
+      v.varyings[j] = a.varyings[j] + (b.varyings[j] - a.varyings[j]) * t;
+  }
+  return count;
+}
+
+void SoftRasterizer::draw(const SoftVertex* vertices, const uint32_t* indices,
+                          size_t numIndices, uint32_t numVaryings,
+                          SoftDepth* depth, const PixelFunc& pixel) {
+  assert(numIndices % 3 == 0 && numVaryings <= SoftVertex::maxVaryings);
+  assert(!depth || (depth->getWidth() >= width &&
+                    depth->getHeight() >= height));
+  triangles.clear();
+  for (auto& bin : bins) bin.clear();
+  for (size_t i = 0; i < numIndices; i += 3) {
+    const SoftVertex* v[3] = {&vertices[indices[i]], &vertices[indices[i + 1]],
+                              &vertices[indices[i + 2]]};
+    if (v[0]->clip[2] >= 0.0f && v[1]->clip[2] >= 0.0f &&
+        v[2]->clip[2] >= 0.0f) {
+      setup(v[0], v[1], v[2], numVaryings);
+      continue;
+    }
+    SoftVertex clipped[4];
+    uint32_t count = clipNear(v, numVaryings, clipped);
+    for (uint32_t j = 2; j < count; ++j)
+      setup(&clipped[0], &clipped[j - 1], &clipped[j], numVaryings);
+  }
+
+  std::fill(tilePixels.begin(), tilePixels.end(), 0);
+  auto rasterize = [&](uint32_t tile) {
+    rasterizeTile(tile, numVaryings, depth, pixel);
+  };
+  if (pool) {
+    pool->run(uint32_t(bins.size()), rasterize);
+  } else {
+    for (uint32_t tile = 0; tile < bins.size(); ++tile) rasterize(tile);
+  }
+  for (uint64_t count : tilePixels) stats.pixels += count;
+}
+
+void SoftRasterizer::rasterizeTile(uint32_t tile, uint32_t numVaryings,
+                                   SoftDepth* depth, const PixelFunc& pixel) {
+  int tileX0 = int(tile % tilesX * tileSize);
+  int tileY0 = int(tile / tilesX * tileSize);
+  int tileX1 = std::min(tileX0 + int(tileSize), int(width)) - 1;
+  int tileY1 = std::min(tileY0 + int(tileSize), int(height)) - 1;
+  uint64_t shaded = 0;
+  float varyings[SoftVertex::maxVaryings];
+
+  for (uint32_t t : bins[tile]) {
+    const Triangle& tri = triangles[t];
+    int x0 = std::max(tri.minX, tileX0) & ~3;
+    int x1 = std::min(tri.maxX, tileX1);
+    int y0 = std::max(tri.minY, tileY0);
+    int y1 = std::min(tri.maxY, tileY1);
+    for (int y = y0; y <= y1; ++y) {
+      float py = y + 0.5f;
+      for (int x = x0; x <= x1; x += 4) {
+        // the lanes inside the triangle, the depth clip range and x1
+        int mask = 0;
+        float z[4];
+#ifdef SOFT_RENDER_SSE
+        __m128 px = _mm_add_ps(_mm_set1_ps(x + 0.5f),
+                               _mm_set_ps(3.0f, 2.0f, 1.0f, 0.0f));
+        __m128 inside = _mm_cmple_ps(px, _mm_set1_ps(x1 + 0.5f));
+        for (int e = 0; e < 3; ++e) {
+          __m128 value = _mm_add_ps(
+              _mm_mul_ps(_mm_set1_ps(tri.edge[e][0]),
+                         _mm_sub_ps(px, _mm_set1_ps(tri.edge[e][2]))),
+              _mm_set1_ps(tri.edge[e][1] * (py - tri.edge[e][3])));
+          inside = _mm_and_ps(
+              inside, tri.topLeft[e] ? _mm_cmpge_ps(value, _mm_setzero_ps())
+                                     : _mm_cmpgt_ps(value, _mm_setzero_ps()));
+        }
+        __m128 depthValue =
+            _mm_add_ps(_mm_mul_ps(_mm_set1_ps(tri.depth[0]), px),
+                       _mm_set1_ps(tri.depth[1] * py + tri.depth[2]));
+        inside = _mm_and_ps(
+            inside, _mm_and_ps(_mm_cmpge_ps(depthValue, _mm_setzero_ps()),
+                               _mm_cmple_ps(depthValue, _mm_set1_ps(1.0f))));
+        mask = _mm_movemask_ps(inside);
+        _mm_storeu_ps(z, depthValue);
+#else
+        for (int k = 0; k < 4; ++k) {
+          float px = x + k + 0.5f;
+          bool inside = x + k <= x1;
+          for (int e = 0; e < 3; ++e) {
+            float value = tri.edge[e][0] * (px - tri.edge[e][2]) +
+                          tri.edge[e][1] * (py - tri.edge[e][3]);
+            inside &= tri.topLeft[e] ? value >= 0.0f : value > 0.0f;
+          }
+          z[k] = tri.depth[0] * px + (tri.depth[1] * py + tri.depth[2]);
+          inside &= z[k] >= 0.0f && z[k] <= 1.0f;
+          mask |= int(inside) << k;
+        }
+#endif
+        for (int k = 0; mask; ++k, mask >>= 1) {
+          if (!(mask & 1)) continue;
+          uint32_t sx = uint32_t(x + k);
+          if (depth) {
+            float& stored = depth->at(sx, uint32_t(y));
+            if (!(z[k] < stored)) continue;
+            stored = z[k];
+          }
+          float px = x + k + 0.5f;
+          float w = 1.0f / (tri.invW[0] * px + tri.invW[1] * py + tri.invW[2]);
+          for (uint32_t i = 0; i < numVaryings; ++i) {
+            varyings[i] = (tri.varyings[i][0] * px + tri.varyings[i][1] * py +
+                           tri.varyings[i][2]) * w;
+          }
+          pixel(sx, uint32_t(y), varyings);
+          ++shaded;
+        }
+      }
+    }
+  }
+  tilePixels[tile] = shaded;
+}
+
+std::string SoftPassStats::describe(const char* name) const {
+  char line[160];
+  snprintf(line, sizeof(line),
+           "%-20s %8llu triangles %10llu pixels %8.2f ms %8.1f Mpixels/s\n",
+           name, (unsigned long long)triangles, (unsigned long long)pixels, ms,
+           ms > 0.0 ? pixels / ms / 1000.0 : 0.0);
+  return line;
+}
+
+namespace {
+
+using Clock = std::chrono::steady_clock;
+
+double msSince(Clock::time_point start) {
+  return std::chrono::duration<double, std::milli>(Clock::now() - start)
+      .count();
+}
+
+// p * m for a row vector p, w given
+void transform(const float p[3], float w, const float m[16], float out[4]) {
+  for (int j = 0; j < 4; ++j)
+    out[j] = p[0] * m[j] + p[1] * m[4 + j] + p[2] * m[8 + j] + w * m[12 + j];
+}
+
+float dot3(const float a[3], const float b[3]) {
+  return a[0] * b[0] + a[1] * b[1] + a[2] * b[2];
+}
+
+void normalize3(float v[3]) {
+  float length = sqrtf(dot3(v, v));
+  for (int i = 0; i < 3; ++i) v[i] /= length;
+}
+
+}  // namespace
+
+SoftPassStats SoftTextureSpace::render(SoftRasterizer* raster,
+                                       const SoftMesh& mesh,
+                                       const ConstantData& data,
+                                       const SoftTexture& diffuseColor,
+                                       SoftTexture* const targets[3]) {
+  Clock::time_point start = Clock::now();
+  raster->resetStats();
+  std::vector<SoftVertex> vertices;
+  // VSMain : placed by the texcoord, world position and normal
+  raster->shadeVertices(mesh.numVertices, [&](uint32_t i, SoftVertex* out) {
+    const float* in = mesh.vertices + size_t(i) * mesh.stride;
+    out->clip[0] = in[6] * 2.0f - 1.0f;
+    out->clip[1] = in[7] * -2.0f + 1.0f;
+    out->clip[2] = 0.0f;
+    out->clip[3] = 1.0f;
+    float position[4], normal[4];
+    transform(in, 1.0f, data.M, position);
+    transform(in + 3, 0.0f, data.M, normal);
+    memcpy(out->varyings, position, sizeof(float) * 3);
+    memcpy(out->varyings + 3, normal, sizeof(float) * 3);
+    memcpy(out->varyings + 6, in + 6, sizeof(float) * 2);
+  }, &vertices);
+
+  // PSMain : written through the target formats
+  raster->draw(vertices.data(), mesh.indices, mesh.numIndices, 8, nullptr,
+               [&](uint32_t x, uint32_t y, const float* in) {
+    float* diffuse = targets[0]->texel(x, y);
+    diffuseColor.sample(in[6], in[7], diffuse);
+    for (int i = 0; i < 3; ++i)
+      diffuse[i] = srgb8ToLinear(linearToSrgb8(diffuse[i]));
+    diffuse[3] = toUnorm8(diffuse[3]) / 255.0f;
+
+    float* position = targets[1]->texel(x, y);
+    for (int i = 0; i < 3; ++i) {
+      position[i] = unorm16ToFloat(floatToUnorm16(
+          (in[i] - data.boundsMin[i]) / data.boundsSize[i]));
+    }
+    position[3] = 1.0f;
+
+    float n[3] = {in[3], in[4], in[5]};
+    normalize3(n);
+    float e[2];
+    octEncode(n, e);
+    float* normal = targets[2]->texel(x, y);
+    normal[0] = snorm16ToFloat(floatToSnorm16(e[0]));
+    normal[1] = snorm16ToFloat(floatToSnorm16(e[1]));
+    normal[2] = 0.0f;
+    normal[3] = 1.0f;
+  });
+  return {raster->getStats().triangles, raster->getStats().pixels,
+          msSince(start)};
+}
+
+SoftPassStats SoftLightSpace::render(TaskPool* pool, const ConstantData& data,
+                                     const SoftTexture* const gbuffer[3],
+                                     uint32_t width, uint32_t height,
+                                     SoftTexture* light) {
+  Clock::time_point start = Clock::now();
+  auto shadeRow = [&](uint32_t y) {
+    for (uint32_t x = 0; x < width; ++x) {
+      const float* diffuseColor = gbuffer[0]->texel(x, y);
+      const float* packed = gbuffer[1]->texel(x, y);
+      float N[3];
+      octDecode(gbuffer[2]->texel(x, y), N);
+      float P[3], L[3], v[3];
+      for (int i = 0; i < 3; ++i) {
+        P[i] = data.boundsMin[i] + packed[i] * data.boundsSize[i];
+        L[i] = data.position[i] - P[i];
+        v[i] = P[i] - data.cameraPos[i];
+      }
+      float dist = sqrtf(dot3(L, L));
+      normalize3(L);
+      normalize3(v);
+      float cos_i = gbufferSaturate(dot3(N, L));
+      float cos_j = gbufferSaturate(-dot3(data.normal, L));
+      // reflect(L, N)
+      float r[3];
+      float d = 2.0f * dot3(L, N);
+      for (int i = 0; i < 3; ++i) r[i] = L[i] - d * N[i];
+      float cosAlpha = gbufferSaturate(dot3(v, r));
+
+      float falloff = data.intensity / (dist * dist);
+      float specular = powf(cosAlpha, 5.0f) * falloff;
+      float* out = light->texel(x, y);
+      for (int i = 0; i < 3; ++i) {
+        out[i] = cos_i * cos_j * diffuseColor[i] * falloff + specular +
+                 0.2f * diffuseColor[i];
+      }
+      out[3] = 1.0f;
+    }
+  };
+  if (pool) {
+    pool->run(height, shadeRow);
+  } else {
+    for (uint32_t y = 0; y < height; ++y) shadeRow(y);
+  }
+  return {0, uint64_t(width) * height, msSince(start)};
+}
+
+SoftPassStats SoftMeshDraw::render(SoftRasterizer* raster, const SoftMesh& mesh,
+                                   const ConstantData& data,
+                                   const SoftTexture& shadedColor,
+                                   SoftTexture* target, SoftDepth* depth) {
+  Clock::time_point start = Clock::now();
+  raster->resetStats();
+  std::vector<SoftVertex> vertices;
+  raster->shadeVertices(mesh.numVertices, [&](uint32_t i, SoftVertex* out) {
+    const float* in = mesh.vertices + size_t(i) * mesh.stride;
+    transform(in, 1.0f, data.MVP, out->clip);
+    memcpy(out->varyings, in + 6, sizeof(float) * 2);
+  }, &vertices);
+
+  raster->draw(vertices.data(), mesh.indices, mesh.numIndices, 2, depth,
+               [&](uint32_t x, uint32_t y, const float* in) {
+    float color[4];
+    shadedColor.sample(in[0] * data.uvScale, in[1] * data.uvScale, color);
+    float* out = target->texel(x, y);
+    for (int i = 0; i < 4; ++i) out[i] = toUnorm8(color[i]) / 255.0f;
+  });
+  return {raster->getStats().triangles, raster->getStats().pixels,
+          msSince(start)};
+}
+
+SoftPassStats SoftRectDraw::render(SoftRasterizer* raster,
+                                   const ConstantData& data,
+                                   SoftTexture* target, SoftDepth* depth) {
+  static const float uniformRect[4][3] = {
+      {-0.5f, -0.5f, 0.0f}, {0.5f, -0.5f, 0.0f}, {-0.5f, 0.5f, 0.0f},
+      {0.5f, 0.5f, 0.0f}};
+  // the triangle strip as a list
+  static const uint32_t indices[6] = {0, 1, 2, 2, 1, 3};
+
+  Clock::time_point start = Clock::now();
+  raster->resetStats();
+  SoftVertex vertices[4];
+  for (int i = 0; i < 4; ++i)
+    transform(uniformRect[i], 1.0f, data.MVP, vertices[i].clip);
+
+  // blend_translucent : SRC_ALPHA, INV_SRC_ALPHA on rgb, alpha replaced
+  const float* color = data.color;
+  raster->draw(vertices, indices, 6, 0, depth,
+               [&](uint32_t x, uint32_t y, const float*) {
+    float* out = target->texel(x, y);
+    for (int i = 0; i < 3; ++i) {
+      float blended = color[i] * color[3] + out[i] * (1.0f - color[3]);
+      out[i] = toUnorm8(blended) / 255.0f;
+    }
+    out[3] = toUnorm8(color[3]) / 255.0f;
+  });
+  return {raster->getStats().triangles, raster->getStats().pixels,
+          msSince(start)};
+}
+
+SoftDiff compareTextures(const SoftTexture& a, const SoftTexture& b,
+                         uint32_t width, uint32_t height, float tolerance,
+                         const SoftTexture* coverage) {
+  assert(a.getWidth() >= width && a.getHeight() >= height);
+  assert(b.getWidth() >= width && b.getHeight() >= height);
+  SoftDiff diff;
+  double sum = 0.0;
+  for (uint32_t y = 0; y < height; ++y) {
+    for (uint32_t x = 0; x < width; ++x) {
+      if (coverage && coverage->texel(x, y)[3] == 0.0f) continue;
+      const float* p = a.texel(x, y);
+      const float* q = b.texel(x, y);
+      float error = 0.0f;
+      for (int i = 0; i < 3; ++i) {
+        float scale = std::max({1.0f, fabsf(p[i]), fabsf(q[i])});
+        error = std::max(error, fabsf(p[i] - q[i]) / scale);
+      }
+      ++diff.compared;
+      if (error > tolerance) ++diff.overTolerance;
+      diff.maxError = std::max(diff.maxError, error);
+      sum += error;
+    }
+  }
+  if (diff.compared) diff.meanError = float(sum / diff.compared);
+  return diff;
+}
@@ -0,0 +1,234 @@
+#pragma once
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <string>
+#include <vector>
+
+#include "TaskPool.h"
+
+// A cpu backend of the passes of Pass.h, to render, test and time them
+// without a device. Matrices are row major for row vectors like XMMATRIX,
+// clip depth is in [0, w] and the viewport maps y down, as in D3D.
+
+// RGBA floats, a row after the other; what the target formats hold is
+// quantized by the kernels that write them.
+class SoftTexture {
+  uint32_t width = 0;
+  uint32_t height = 0;
+  std::vector<float> texels;
+
+ public:
+  SoftTexture() {}
+  SoftTexture(uint32_t width, uint32_t height);
+  // R8G8B8A8_UNORM and R32G32B32A32_FLOAT rows rowPitch bytes apart, like
+  // an image file or a readback
+  static SoftTexture fromRgba8(const uint8_t* data, uint32_t width,
+                               uint32_t height, size_t rowPitch);
+  static SoftTexture fromFloat4(const float* data, uint32_t width,
+                                uint32_t height, size_t rowPitch);
+
+  uint32_t getWidth() const { return width; }
+  uint32_t getHeight() const { return height; }
+  const float* getData() const { return texels.data(); }
+
+  void fill(const float value[4]);
+  float* texel(uint32_t x, uint32_t y) {
+    return texels.data() + (size_t(y) * width + x) * 4;
+  }
+  const float* texel(uint32_t x, uint32_t y) const {
+    return texels.data() + (size_t(y) * width + x) * 4;
+  }
+  // bilinear with wrap addressing, the static samplers of Pass.h
+  void sample(float u, float v, float out[4]) const;
+  // R8G8B8A8 rows, for stbi_write_png
+  std::vector<uint8_t> toRgba8() const;
+};
+
+// D32_FLOAT, cleared to 1; the test is LESS as in Helper.cpp.
+class SoftDepth {
+  uint32_t width = 0;
+  uint32_t height = 0;
+  std::vector<float> values;
+
+ public:
+  SoftDepth() {}
+  SoftDepth(uint32_t width, uint32_t height);
+
+  uint32_t getWidth() const { return width; }
+  uint32_t getHeight() const { return height; }
+  void clear() { values.assign(values.size(), 1.0f); }
+  float& at(uint32_t x, uint32_t y) { return values[size_t(y) * width + x]; }
+};
+
+// What a vertex kernel outputs, SV_POSITION and the interpolated values.
+struct SoftVertex {
+  static const uint32_t maxVaryings = 12;
+  float clip[4];
+  float varyings[maxVaryings];
+};
+
+// Vertices of stride floats, the layout of MeshData::vertices.
+struct SoftMesh {
+  const float* vertices = nullptr;
+  uint32_t stride = 8;  // position, normal, texcoord
+  uint32_t numVertices = 0;
+  const uint32_t* indices = nullptr;
+  size_t numIndices = 0;
+};
+
+// Rasterizes triangle lists for the pixel kernels of the passes.
+// Triangles are clipped at the near plane, both windings are drawn as with
+// D3D12_CULL_MODE_NONE, and pixel centers on an edge follow the top left
+// rule. The viewport is cut in tileSize x tileSize tiles, each takes the
+// triangles over it in draw order and runs on a TaskPool; coverage and depth
+// are computed for 4 pixels at a time with SSE. The varyings are
+// interpolated perspective correct. The pixel kernel is called for the
+// pixels that pass the depth test, like [earlydepthstencil], from several
+// threads but never twice at once for a pixel.
+class SoftRasterizer {
+ public:
+  static const uint32_t tileSize = 32;
+
+  using PixelFunc =
+      std::function<void(uint32_t x, uint32_t y, const float* varyings)>;
+
+  struct Stats {
+    uint64_t triangles = 0;  // set up, after clipping
+    uint64_t pixels = 0;     // passed to the pixel kernel
+  };
+
+ private:
+  // in pixels, each a plane a * x + b * y + c; the edges as
+  // a * (x - x0) + b * (y - y0) through their end x0, y0
+  struct Triangle {
+    float edge[3][4];
+    bool topLeft[3];
+    float depth[3];
+    float invW[3];
+    float varyings[SoftVertex::maxVaryings][3];  // divided by w
+    int minX;
+    int minY;
+    int maxX;
+    int maxY;
+  };
+
+  TaskPool* pool;
+  uint32_t width = 0;
+  uint32_t height = 0;
+  uint32_t tilesX = 0;
+  uint32_t tilesY = 0;
+  std::vector<Triangle> triangles;
+  std::vector<std::vector<uint32_t>> bins;  // the triangles of each tile
+  std::vector<uint64_t> tilePixels;
+  Stats stats;
+
+  void setup(const SoftVertex* v0, const SoftVertex* v1, const SoftVertex* v2,
+             uint32_t numVaryings);
+  void rasterizeTile(uint32_t tile, uint32_t numVaryings, SoftDepth* depth,
+                     const PixelFunc& pixel);
+
+ public:
+  // a null pool runs in place
+  explicit SoftRasterizer(TaskPool* pool = nullptr);
+
+  // the top left width x height pixels of the targets
+  void setViewport(uint32_t width, uint32_t height);
+  uint32_t getWidth() const { return width; }
+  uint32_t getHeight() const { return height; }
+  TaskPool* getPool() const { return pool; }
+
+  // indexed triangle list; depth is tested and written when not null
+  void draw(const SoftVertex* vertices, const uint32_t* indices,
+            size_t numIndices, uint32_t numVaryings, SoftDepth* depth,
+            const PixelFunc& pixel);
+  // vertex(i, out) for each vertex, on the pool
+  void shadeVertices(uint32_t numVertices,
+                     const std::function<void(uint32_t, SoftVertex*)>& vertex,
+                     std::vector<SoftVertex>* out);
+
+  const Stats& getStats() const { return stats; }
+  void resetStats() { stats = {}; }
+};
+
+// Work and time of one pass, for the throughput report.
+struct SoftPassStats {
+  uint64_t triangles = 0;
+  uint64_t pixels = 0;  // pixels or texels shaded
+  double ms = 0.0;
+
+  // "name  triangles  pixels  ms  Mpixels/s"
+  std::string describe(const char* name) const;
+};
+
+// The passes as c++ kernels, each mirrors its data/*.hlsl. The constants
+// are those of the layouts in Pass.h as floats.
+
+// TextureSpacePass.hlsl : the mesh unwrapped by its texcoords into
+// diffuse, position and normal, quantized to TextureSpace::RenderTarget
+// (see GBufferPacking.h). The viewport of raster is the shaded part.
+struct SoftTextureSpace {
+  struct ConstantData {
+    float M[16];
+    float boundsMin[4];
+    float boundsSize[4];
+  };
+  static SoftPassStats render(SoftRasterizer* raster, const SoftMesh& mesh,
+                              const ConstantData& data,
+                              const SoftTexture& diffuseColor,
+                              SoftTexture* const targets[3]);
+};
+
+// LightSpaceCompute.hlsl : a texel of the light target from the texels of
+// the G-buffer, width x height of them from the top left.
+struct SoftLightSpace {
+  struct ConstantData {
+    float position[4];
+    float normal[4];
+    float cameraPos[3];
+    float intensity;
+    float boundsMin[4];
+    float boundsSize[4];
+  };
+  static SoftPassStats render(TaskPool* pool, const ConstantData& data,
+                              const SoftTexture* const gbuffer[3],
+                              uint32_t width, uint32_t height,
+                              SoftTexture* light);
+};
+
+// MeshDrawPass.hlsl : the mesh on screen with the light target, into
+// R8G8B8A8_UNORM.
+struct SoftMeshDraw {
+  struct ConstantData {
+    float MVP[16];
+    float uvScale = 1.0f;
+  };
+  static SoftPassStats render(SoftRasterizer* raster, const SoftMesh& mesh,
+                              const ConstantData& data,
+                              const SoftTexture& shadedColor,
+                              SoftTexture* target, SoftDepth* depth);
+};
+
+// RectDrawPass.hlsl : the light rectangle, blended by its alpha.
+struct SoftRectDraw {
+  struct ConstantData {
+    float MVP[16];
+    float color[4];
+  };
+  static SoftPassStats render(SoftRasterizer* raster, const ConstantData& data,
+                              SoftTexture* target, SoftDepth* depth);
+};
+
+// How far two results are apart in rgb, over the top left width x height
+// texels; only where the alpha of coverage is not 0 when it is given. The
+// light is not bound to 1, above 1 the error is relative.
+struct SoftDiff {
+  uint64_t compared = 0;
+  uint64_t overTolerance = 0;
+  float maxError = 0.0f;
+  float meanError = 0.0f;
+};
+
+SoftDiff compareTextures(const SoftTexture& a, const SoftTexture& b,
+                         uint32_t width, uint32_t height, float tolerance,
+                         const SoftTexture* coverage = nullptr);
@@ -0,0 +1,42 @@
+#include "StateTracker.h"
+
+#include <cassert>
+
+StateTracker::State StateTracker::change(Resource resource, State newState) {
+  auto [it, added] = index.try_emplace(resource, uint32_t(entries.size()));
+  if (added) {
+    entries.push_back({resource, newState, newState, false, true});
+    return newState;
+  }
+  Entry& entry = entries[it->second];
+  if (!entry.changed) {
+    entry.first = entry.last = newState;
+    entry.changed = true;
+    return newState;
+  }
+  State prevState = entry.last;
+  entry.last = newState;
+  return prevState;
+}
+
+void StateTracker::activate(Resource resource) {
+  auto [it, added] = index.try_emplace(resource, uint32_t(entries.size()));
+  assert(added);
+  (void)it;
+  if (added) entries.push_back({resource, 0, 0, true, false});
+}
+
+void StateTracker::resolve(
+    const std::function<State(Resource)>& getState,
+    const std::function<void(Resource, State)>& setState,
+    std::vector<Barrier>* barriers) {
+  for (const Entry& entry : entries) {
+    if (entry.activated) barriers->push_back({entry.resource, true, 0, 0});
+    if (!entry.changed) continue;
+    State state = getState(entry.resource);
+    if (state != entry.first)
+      barriers->push_back({entry.resource, false, state, entry.first});
+    setState(entry.resource, entry.last);
+  }
+  clear();
+}
@@ -0,0 +1,54 @@
+#pragma once
+#include <cstdint>
+#include <functional>
+#include <unordered_map>
+#include <vector>
+
+// The state changes of a command list recorded before the state it starts
+// in is known, e.g. on a worker thread. Each resource keeps the state it is
+// first used in and the one it is left in; resolve() then gives the barriers
+// to submit in front of the list. No graphics API is referenced here,
+// ResourceStateTracker maps it onto D3D12.
+class StateTracker {
+ public:
+  using Resource = const void*;
+  using State = uint32_t;
+
+  struct Barrier {
+    Resource resource;
+    bool aliasing;  // the resource becomes the one its memory holds
+    State before;   // of a transition
+    State after;
+  };
+
+ private:
+  struct Entry {
+    Resource resource;
+    State first;
+    State last;
+    bool activated;
+    bool changed;  // a state was set on the list
+  };
+  std::vector<Entry> entries;  // in first use order
+  std::unordered_map<Resource, uint32_t> index;
+
+ public:
+  // the state before, newState itself on the first use
+  State change(Resource resource, State newState);
+  // the list starts using a placed resource whose memory another one held :
+  // its aliasing barrier goes in front of the list, right ahead of the
+  // transition to its first state. Before any change() of the resource.
+  void activate(Resource resource);
+  bool isTracked(Resource resource) const { return index.count(resource) != 0; }
+
+  // appends the barriers to submit in front of the list, in first use order,
+  // from the states the resources are in before it (getState), and leaves
+  // them in the states the list ends with (setState)
+  void resolve(const std::function<State(Resource)>& getState,
+               const std::function<void(Resource, State)>& setState,
+               std::vector<Barrier>* barriers);
+  void clear() {
+    entries.clear();
+    index.clear();
+  }
+};
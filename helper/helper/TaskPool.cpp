@@ -0,0 +1,74 @@
+#include "TaskPool.h"
+
+TaskPool::TaskPool(uint32_t numThreads) {
+  workers.reserve(numThreads);
+  for (uint32_t i = 0; i < numThreads; ++i)
+    workers.emplace_back([this] { work(); });
+}
+
+TaskPool::~TaskPool() {
+  {
+    std::lock_guard<std::mutex> lock(mutex);
+    stopping = true;
+  }
+  wake.notify_all();
+  for (std::thread& worker : workers) worker.join();
+}
+
+void TaskPool::drain() {
+  for (uint32_t i = next++; i < count; i = next++) {
+    try {
+      func(i);
+    } catch (...) {
+      std::lock_guard<std::mutex> lock(mutex);
+      if (!error) error = std::current_exception();
+    }
+    if (++finished == count) {
+      std::lock_guard<std::mutex> lock(mutex);
+      idle.notify_all();
+    }
+  }
+}
+
+void TaskPool::work() {
+  uint64_t seen = 0;
+  for (;;) {
+    {
+      std::unique_lock<std::mutex> lock(mutex);
+      wake.wait(lock, [&] { return stopping || generation != seen; });
+      if (stopping) return;
+      seen = generation;
+      ++running;
+    }
+    drain();
+    {
+      std::lock_guard<std::mutex> lock(mutex);
+      if (--running == 0) idle.notify_all();
+    }
+  }
+}
+
+void TaskPool::run(uint32_t count, std::function<void(uint32_t)> func) {
+  if (count == 0) return;
+  {
+    // a worker late for the last run may still be reading it
+    std::unique_lock<std::mutex> lock(mutex);
+    idle.wait(lock, [&] { return running == 0; });
+    this->func = std::move(func);
+    this->count = count;
+    next = 0;
+    finished = 0;
+    error = nullptr;
+    ++generation;
+  }
+  wake.notify_all();
+  drain();
+
+  std::exception_ptr thrown;
+  {
+    std::unique_lock<std::mutex> lock(mutex);
+    idle.wait(lock, [&] { return finished == this->count; });
+    thrown = error;
+  }
+  if (thrown) std::rethrow_exception(thrown);
+}
@@ -0,0 +1,45 @@
+#pragma once
+#include <atomic>
+#include <condition_variable>
+#include <cstdint>
+#include <exception>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+// Runs the iterations of a loop on worker threads.
+// The workers live as long as the pool and sleep between runs. run() hands
+// out the indices one at a time and the calling thread takes its share too,
+// so a pool of n threads keeps n + 1 cores busy and a pool of 0 runs the
+// loop in place. Which thread runs an index is not fixed, what an index
+// writes should only depend on the index. One run() at a time.
+class TaskPool {
+  std::vector<std::thread> workers;
+
+  std::mutex mutex;
+  std::condition_variable wake;  // a run started or the pool is stopping
+  std::condition_variable idle;  // a run finished or a worker left it
+  std::function<void(uint32_t)> func;
+  uint32_t count = 0;
+  std::atomic<uint32_t> next{0};
+  std::atomic<uint32_t> finished{0};
+  uint32_t running = 0;  // workers inside the current run
+  uint64_t generation = 0;
+  bool stopping = false;
+  std::exception_ptr error;  // the first one thrown in the run
+
+  void work();
+  void drain();
+
+ public:
+  explicit TaskPool(uint32_t numThreads);
+  ~TaskPool();
+  TaskPool(const TaskPool&) = delete;
+  TaskPool& operator=(const TaskPool&) = delete;
+
+  uint32_t getThreadCount() const { return uint32_t(workers.size()); }
+  // func(i) for i in [0, count), returns when all are done; rethrows the
+  // first exception of a func
+  void run(uint32_t count, std::function<void(uint32_t)> func);
+};
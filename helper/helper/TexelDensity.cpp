@@ -0,0 +1,38 @@
+#include "TexelDensity.h"
+
+#include <cassert>
+#include <cmath>
+#include <limits>
+
+float projectedDiameter(float radius, float distance, float fovY,
+                        float screenHeight) {
+  assert(radius >= 0.0f && fovY > 0.0f);
+  if (distance <= radius) return std::numeric_limits<float>::infinity();
+  // the half angle of the cone around the sphere is asin(radius / distance)
+  float halfExtent = radius / std::sqrt(distance * distance - radius * radius);
+  return screenHeight * halfExtent / std::tan(0.5f * fovY);
+}
+
+static bool isPowerOfTwo(uint32_t x) { return x && !(x & (x - 1)); }
+
+ResolutionSelector::ResolutionSelector(uint32_t minSize, uint32_t maxSize,
+                                       float hysteresis)
+    : minSize(minSize), maxSize(maxSize), hysteresis(hysteresis) {
+  assert(isPowerOfTwo(minSize) && isPowerOfTwo(maxSize) && minSize <= maxSize);
+  assert(hysteresis >= 0.0f && hysteresis < 1.0f);
+}
+
+uint32_t ResolutionSelector::pick(float required) const {
+  uint32_t size = minSize;
+  while (size < maxSize && float(size) < required) size *= 2;
+  return size;
+}
+
+uint32_t ResolutionSelector::update(uint32_t current, float required) const {
+  if (current < minSize || current > maxSize || !isPowerOfTwo(current))
+    return pick(required);
+  bool grow = current < maxSize && required > current * (1.0f + hysteresis);
+  bool shrink =
+      current > minSize && required < current * 0.5f * (1.0f - hysteresis);
+  return grow || shrink ? pick(required) : current;
+}
@@ -0,0 +1,37 @@
+#pragma once
+#include <cstdint>
+
+// Texture space resolutions picked from how large an object is on screen.
+// A texture space shaded at a fixed size wastes most of its texels on an
+// object far away; the size it needs follows from the screen height its
+// bounding sphere covers and the texels wanted per screen pixel.
+
+// screen pixels covered by the diameter of a sphere, for a perspective
+// projection of vertical field of view fovY (radians) onto screenHeight
+// pixels; a camera inside the sphere gets infinity
+float projectedDiameter(float radius, float distance, float fovY,
+                        float screenHeight);
+
+// Power of two sizes between minSize and maxSize.
+// The size is only changed once the required size left a band around the
+// current one, so an object moving about a threshold keeps its size.
+class ResolutionSelector {
+  uint32_t minSize;
+  uint32_t maxSize;
+  float hysteresis;
+
+ public:
+  // hysteresis : how far past the band of a size, relatively, the required
+  // size has to go before the size changes
+  ResolutionSelector(uint32_t minSize, uint32_t maxSize,
+                     float hysteresis = 0.25f);
+
+  // the smallest size at least required, clamped
+  uint32_t pick(float required) const;
+  // current while required stays within
+  // [current / 2 * (1 - hysteresis), current * (1 + hysteresis)], else pick()
+  uint32_t update(uint32_t current, float required) const;
+
+  uint32_t getMinSize() const { return minSize; }
+  uint32_t getMaxSize() const { return maxSize; }
+};
@@ -0,0 +1,175 @@
+#include "TileMask.h"
+
+#include <algorithm>
+#include <bit>
+#include <cassert>
+#include <cmath>
+
+TileMask::TileMask(uint32_t width, uint32_t height, uint32_t tileSize)
+    : width(width),
+      height(height),
+      tileSize(tileSize),
+      tilesX((width + tileSize - 1) / tileSize),
+      tilesY((height + tileSize - 1) / tileSize),
+      words((size_t(tilesX) * tilesY + 31) / 32, 0) {
+  assert(tileSize > 0);
+}
+
+void TileMask::clear() { std::fill(words.begin(), words.end(), 0); }
+
+void TileMask::mark(uint32_t x, uint32_t y) {
+  assert(x < tilesX && y < tilesY);
+  size_t bit = size_t(y) * tilesX + x;
+  words[bit >> 5] |= 1u << (bit & 31);
+}
+
+bool TileMask::isMarked(uint32_t x, uint32_t y) const {
+  size_t bit = size_t(y) * tilesX + x;
+  return (words[bit >> 5] >> (bit & 31)) & 1;
+}
+
+uint32_t TileMask::count() const {
+  uint32_t total = 0;
+  for (uint32_t word : words) total += uint32_t(std::popcount(word));
+  return total;
+}
+
+std::vector<uint32_t> TileMask::compact(uint32_t usedX, uint32_t usedY) const {
+  usedX = std::min(usedX, tilesX);
+  usedY = std::min(usedY, tilesY);
+  std::vector<uint32_t> tiles;
+  for (uint32_t y = 0; y < usedY; ++y) {
+    for (uint32_t x = 0; x < usedX; ++x) {
+      bool visible = false;
+      uint32_t y1 = std::min(y + 1, tilesY - 1);
+      uint32_t x1 = std::min(x + 1, tilesX - 1);
+      for (uint32_t ny = y ? y - 1 : 0; ny <= y1 && !visible; ++ny)
+        for (uint32_t nx = x ? x - 1 : 0; nx <= x1 && !visible; ++nx)
+          visible = isMarked(nx, ny);
+      if (visible) tiles.push_back(x | (y << 16));
+    }
+  }
+  return tiles;
+}
+
+// a triangle is out of view when its three corners are outside the same
+// plane of the clip volume, 0 <= z <= w as in D3D
+static bool outsideView(const float clip[3][4]) {
+  auto allOutside = [&](auto outside) {
+    return outside(clip[0]) && outside(clip[1]) && outside(clip[2]);
+  };
+  return allOutside([](const float* c) { return c[0] < -c[3]; }) ||
+         allOutside([](const float* c) { return c[0] > c[3]; }) ||
+         allOutside([](const float* c) { return c[1] < -c[3]; }) ||
+         allOutside([](const float* c) { return c[1] > c[3]; }) ||
+         allOutside([](const float* c) { return c[2] < 0.0f; }) ||
+         allOutside([](const float* c) { return c[2] > c[3]; });
+}
+
+// the tiles grown by grow texels a texel space triangle overlaps : the
+// bounding box of the triangle, and for each edge the tiles with a corner on
+// its inner side
+static void markTriangle(const float uv[3][2], float grow, TileMask* mask) {
+  float size = float(mask->getTileSize());
+  float minX = std::min({uv[0][0], uv[1][0], uv[2][0]}) - grow;
+  float maxX = std::max({uv[0][0], uv[1][0], uv[2][0]}) + grow;
+  float minY = std::min({uv[0][1], uv[1][1], uv[2][1]}) - grow;
+  float maxY = std::max({uv[0][1], uv[1][1], uv[2][1]}) + grow;
+  int x0 = std::max(int(std::floor(minX / size)), 0);
+  int y0 = std::max(int(std::floor(minY / size)), 0);
+  int x1 = std::min(int(std::floor(maxX / size)), int(mask->getTilesX()) - 1);
+  int y1 = std::min(int(std::floor(maxY / size)), int(mask->getTilesY()) - 1);
+
+  // edge functions, positive inside whatever the winding
+  float area = (uv[1][0] - uv[0][0]) * (uv[2][1] - uv[0][1]) -
+               (uv[2][0] - uv[0][0]) * (uv[1][1] - uv[0][1]);
+  float sign = area < 0.0f ? -1.0f : 1.0f;
+  float a[3], b[3], c[3];
+  for (int e = 0; e < 3; ++e) {
+    const float* p = uv[e];
+    const float* q = uv[(e + 1) % 3];
+    a[e] = sign * (p[1] - q[1]);
+    b[e] = sign * (q[0] - p[0]);
+    c[e] = sign * (p[0] * q[1] - p[1] * q[0]);
+  }
+
+  for (int y = y0; y <= y1; ++y) {
+    for (int x = x0; x <= x1; ++x) {
+      bool overlaps = true;
+      for (int e = 0; e < 3 && overlaps; ++e) {
+        // the corner of the tile furthest along the edge normal
+        float cx = a[e] > 0.0f ? (x + 1) * size + grow : x * size - grow;
+        float cy = b[e] > 0.0f ? (y + 1) * size + grow : y * size - grow;
+        overlaps = a[e] * cx + b[e] * cy + c[e] >= 0.0f;
+      }
+      if (overlaps) mask->mark(uint32_t(x), uint32_t(y));
+    }
+  }
+}
+
+// the texcoord of a vertex in texels, not wrapped yet
+static void texelOf(const float* vertex, uint32_t uvOffset, float uvScale,
+                    const TileMask& mask, float texel[2]) {
+  texel[0] = vertex[uvOffset] * uvScale * float(mask.getWidth());
+  texel[1] = vertex[uvOffset + 1] * uvScale * float(mask.getHeight());
+}
+
+// the sampler wraps the texcoords, as do the marks of the pixel shader : the
+// triangle is marked moved by each whole number of texture sizes that brings
+// a part of it into the texture space
+static void markWrapped(const float uv[3][2], float grow, TileMask* mask) {
+  float width = float(mask->getWidth());
+  float height = float(mask->getHeight());
+  float minX = std::min({uv[0][0], uv[1][0], uv[2][0]}) - grow;
+  float maxX = std::max({uv[0][0], uv[1][0], uv[2][0]}) + grow;
+  float minY = std::min({uv[0][1], uv[1][1], uv[2][1]}) - grow;
+  float maxY = std::max({uv[0][1], uv[1][1], uv[2][1]}) + grow;
+  int x0 = int(std::floor(minX / width));
+  int x1 = int(std::floor(maxX / width));
+  int y0 = int(std::floor(minY / height));
+  int y1 = int(std::floor(maxY / height));
+  for (int y = y0; y <= y1; ++y) {
+    for (int x = x0; x <= x1; ++x) {
+      float moved[3][2];
+      for (int v = 0; v < 3; ++v) {
+        moved[v][0] = uv[v][0] - float(x) * width;
+        moved[v][1] = uv[v][1] - float(y) * height;
+      }
+      markTriangle(moved, grow, mask);
+    }
+  }
+}
+
+void markVisibleTiles(const float* vertices, uint32_t stride,
+                      uint32_t uvOffset, const uint32_t* indices,
+                      size_t numIndices, const float mvp[16], float uvScale,
+                      TileMask* mask) {
+  assert(numIndices % 3 == 0);
+  for (size_t t = 0; t < numIndices; t += 3) {
+    float clip[3][4];
+    float uv[3][2];
+    for (int v = 0; v < 3; ++v) {
+      const float* vertex = vertices + size_t(indices[t + v]) * stride;
+      for (int j = 0; j < 4; ++j) {
+        clip[v][j] = vertex[0] * mvp[j] + vertex[1] * mvp[4 + j] +
+                     vertex[2] * mvp[8 + j] + mvp[12 + j];
+      }
+      texelOf(vertex, uvOffset, uvScale, *mask, uv[v]);
+    }
+    if (!outsideView(clip)) markWrapped(uv, 0.0f, mask);
+  }
+}
+
+void markUvTiles(const float* vertices, uint32_t stride, uint32_t uvOffset,
+                 const uint32_t* indices, size_t numIndices, float uvScale,
+                 float dilation, TileMask* mask) {
+  assert(numIndices % 3 == 0 && dilation >= 0.0f);
+  for (size_t t = 0; t < numIndices; t += 3) {
+    float uv[3][2];
+    for (int v = 0; v < 3; ++v) {
+      texelOf(vertices + size_t(indices[t + v]) * stride, uvOffset, uvScale,
+              *mask, uv[v]);
+    }
+    markWrapped(uv, dilation, mask);
+  }
+}
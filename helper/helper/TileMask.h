@@ -0,0 +1,59 @@
+#pragma once
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+// The texture space tiles a frame needs shaded, a bit per tile.
+// Same layout as the masks of VisibleTiles on the gpu : tiles of
+// tileSize x tileSize texels, row after row, 32 to a word. The cpu version
+// is the reference the gpu marks and lists are checked against.
+class TileMask {
+  uint32_t width;
+  uint32_t height;
+  uint32_t tileSize;
+  uint32_t tilesX;
+  uint32_t tilesY;
+  std::vector<uint32_t> words;
+
+ public:
+  // width and height of the texture space in texels
+  TileMask(uint32_t width, uint32_t height, uint32_t tileSize = 8);
+
+  uint32_t getWidth() const { return width; }
+  uint32_t getHeight() const { return height; }
+  uint32_t getTileSize() const { return tileSize; }
+  uint32_t getTilesX() const { return tilesX; }
+  uint32_t getTilesY() const { return tilesY; }
+  const std::vector<uint32_t>& getWords() const { return words; }
+
+  void clear();
+  void mark(uint32_t x, uint32_t y);
+  bool isMarked(uint32_t x, uint32_t y) const;
+  uint32_t count() const;
+
+  // the tiles of the used columns and rows that are marked or next to a
+  // marked one, as x | y << 16 in row order; the order of TileCompact.hlsl
+  // is not defined, its set is the same
+  std::vector<uint32_t> compact(uint32_t usedX, uint32_t usedY) const;
+};
+
+// Marks the tiles under the triangles of a mesh that are inside the view.
+// vertices : stride floats per vertex, the position at 0 and the texcoord at
+// uvOffset; mvp : row major, for row vectors like XMMATRIX; uvScale : the
+// part of the texture space that is shaded, see MeshDrawPass.hlsl.
+// There is no depth test and every tile a texcoord triangle overlaps is
+// marked, so the result holds what the draw marks on the gpu. Texcoords wrap
+// like the sampler of the draw : a triangle across an edge of the texture
+// space marks the tiles on both sides.
+void markVisibleTiles(const float* vertices, uint32_t stride,
+                      uint32_t uvOffset, const uint32_t* indices,
+                      size_t numIndices, const float mvp[16], float uvScale,
+                      TileMask* mask);
+
+// Marks the tiles the texcoord triangles of a mesh cover in any view, grown
+// by dilation texels : the texture space pass fills the texels around the
+// seams a little and bilinear sampling reads past them. With a tile size of
+// 1 and no dilation, the texels the triangles cover.
+void markUvTiles(const float* vertices, uint32_t stride, uint32_t uvOffset,
+                 const uint32_t* indices, size_t numIndices, float uvScale,
+                 float dilation, TileMask* mask);
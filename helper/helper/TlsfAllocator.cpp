@@ -0,0 +1,265 @@
+#include "TlsfAllocator.h"
+
+#include <algorithm>
+#include <bit>
+#include <cassert>
+
+static uint64_t alignUp(uint64_t value, uint64_t alignment) {
+  return (value + alignment - 1) & ~(alignment - 1);
+}
+
+TlsfAllocator::TlsfAllocator(uint64_t size, uint64_t granularity)
+    : size(size & ~(granularity - 1)), granularity(granularity) {
+  assert(std::has_single_bit(granularity));
+  assert(this->size > 0);
+  for (uint32_t fl = 0; fl < flCount; ++fl)
+    std::fill(heads[fl], heads[fl] + slCount, uint32_t(invalid));
+
+  uint32_t first = newBlock();
+  blocks[first].size = this->size;
+  blocks[first].free = true;
+  insertFree(first);
+}
+
+void TlsfAllocator::mapping(uint64_t size, uint32_t* fl, uint32_t* sl) {
+  if (size < slCount) {
+    *fl = 0;
+    *sl = uint32_t(size);
+    return;
+  }
+  uint32_t msb = uint32_t(std::bit_width(size)) - 1;
+  *sl = uint32_t(size >> (msb - slLog2)) - slCount;
+  *fl = msb - slLog2 + 1;
+}
+
+uint32_t TlsfAllocator::findFree(uint64_t size) const {
+  // round up to the next list, any block found there is large enough
+  if (size >= slCount) {
+    uint32_t msb = uint32_t(std::bit_width(size)) - 1;
+    size += (uint64_t(1) << (msb - slLog2)) - 1;
+  }
+  uint32_t fl, sl;
+  mapping(size, &fl, &sl);
+  if (fl >= flCount) return invalid;
+
+  uint32_t slMap = slBitmap[fl] & (~0u << sl);
+  if (!slMap) {
+    uint64_t flMap = flBitmap & (~uint64_t(0) << (fl + 1));
+    if (!flMap) return invalid;
+    fl = uint32_t(std::countr_zero(flMap));
+    slMap = slBitmap[fl];
+  }
+  sl = uint32_t(std::countr_zero(slMap));
+  return heads[fl][sl];
+}
+
+uint32_t TlsfAllocator::newBlock() {
+  if (!unusedBlocks.empty()) {
+    uint32_t idx = unusedBlocks.back();
+    unusedBlocks.pop_back();
+    blocks[idx] = Block{};
+    return idx;
+  }
+  blocks.emplace_back();
+  return uint32_t(blocks.size() - 1);
+}
+
+void TlsfAllocator::insertFree(uint32_t idx) {
+  uint32_t fl, sl;
+  mapping(blocks[idx].size, &fl, &sl);
+  Block& block = blocks[idx];
+  block.prevFree = invalid;
+  block.nextFree = heads[fl][sl];
+  if (block.nextFree != invalid) blocks[block.nextFree].prevFree = idx;
+  heads[fl][sl] = idx;
+  flBitmap |= uint64_t(1) << fl;
+  slBitmap[fl] |= 1u << sl;
+}
+
+void TlsfAllocator::removeFree(uint32_t idx) {
+  uint32_t fl, sl;
+  mapping(blocks[idx].size, &fl, &sl);
+  Block& block = blocks[idx];
+  if (block.prevFree != invalid)
+    blocks[block.prevFree].nextFree = block.nextFree;
+  else
+    heads[fl][sl] = block.nextFree;
+  if (block.nextFree != invalid)
+    blocks[block.nextFree].prevFree = block.prevFree;
+  block.prevFree = block.nextFree = invalid;
+
+  if (heads[fl][sl] == invalid) {
+    slBitmap[fl] &= ~(1u << sl);
+    if (!slBitmap[fl]) flBitmap &= ~(uint64_t(1) << fl);
+  }
+}
+
+void TlsfAllocator::split(uint32_t idx, uint64_t firstSize) {
+  assert(firstSize < blocks[idx].size);
+  uint32_t rest = newBlock();  // may move the blocks
+  Block& block = blocks[idx];
+  Block& restBlock = blocks[rest];
+  restBlock.offset = block.offset + firstSize;
+  restBlock.size = block.size - firstSize;
+  restBlock.free = true;
+  restBlock.prevPhys = idx;
+  restBlock.nextPhys = block.nextPhys;
+  if (block.nextPhys != invalid) blocks[block.nextPhys].prevPhys = rest;
+  block.nextPhys = rest;
+  block.size = firstSize;
+}
+
+TlsfAllocator::Allocation TlsfAllocator::carve(uint32_t idx, uint64_t size,
+                                               uint64_t alignment) {
+  removeFree(idx);
+
+  uint64_t offset = blocks[idx].offset;
+  uint64_t padding = alignUp(offset, alignment) - offset;
+  if (padding > 0) {
+    // the padding stays a free block of its own
+    split(idx, padding);
+    uint32_t rest = blocks[idx].nextPhys;
+    insertFree(idx);
+    idx = rest;
+  }
+  assert(blocks[idx].size >= size);
+  if (blocks[idx].size > size) {
+    split(idx, size);
+    insertFree(blocks[idx].nextPhys);
+  }
+
+  Block& block = blocks[idx];
+  block.free = false;
+  block.alignment = alignment;
+  used += size;
+  ++numAllocations;
+  return {block.offset, block.size, idx};
+}
+
+TlsfAllocator::Allocation TlsfAllocator::allocate(uint64_t size,
+                                                  uint64_t alignment) {
+  assert(std::has_single_bit(alignment));
+  size = alignUp(std::max<uint64_t>(size, 1), granularity);
+  alignment = std::max(alignment, granularity);
+  // enough for the worst padding, offsets are multiples of granularity
+  uint64_t searchSize = size + alignment - granularity;
+  if (searchSize > this->size) return {};
+
+  uint32_t idx = findFree(searchSize);
+  if (idx == invalid) return {};
+  return carve(idx, size, alignment);
+}
+
+void TlsfAllocator::free(const Allocation& allocation) {
+  assert(allocation.valid() && allocation.block < blocks.size());
+  uint32_t idx = allocation.block;
+  assert(!blocks[idx].free && blocks[idx].offset == allocation.offset);
+  used -= blocks[idx].size;
+  --numAllocations;
+  blocks[idx].free = true;
+
+  uint32_t next = blocks[idx].nextPhys;
+  if (next != invalid && blocks[next].free) {
+    removeFree(next);
+    blocks[idx].size += blocks[next].size;
+    blocks[idx].nextPhys = blocks[next].nextPhys;
+    if (blocks[next].nextPhys != invalid)
+      blocks[blocks[next].nextPhys].prevPhys = idx;
+    unusedBlocks.push_back(next);
+  }
+  uint32_t prev = blocks[idx].prevPhys;
+  if (prev != invalid && blocks[prev].free) {
+    removeFree(prev);
+    blocks[prev].size += blocks[idx].size;
+    blocks[prev].nextPhys = blocks[idx].nextPhys;
+    if (blocks[idx].nextPhys != invalid)
+      blocks[blocks[idx].nextPhys].prevPhys = prev;
+    unusedBlocks.push_back(idx);
+    idx = prev;
+  }
+  insertFree(idx);
+}
+
+TlsfAllocator::Allocation TlsfAllocator::allocateBelow(
+    const Allocation& allocation) {
+  assert(allocation.valid() && !blocks[allocation.block].free);
+  uint64_t size = blocks[allocation.block].size;
+  uint64_t alignment = blocks[allocation.block].alignment;
+
+  // the block at offset 0 keeps index 0 : splits keep the front part and
+  // merges keep the lower block
+  for (uint32_t idx = 0; blocks[idx].offset < allocation.offset;
+       idx = blocks[idx].nextPhys) {
+    const Block& block = blocks[idx];
+    if (!block.free) continue;
+    if (alignUp(block.offset, alignment) + size <= block.offset + block.size)
+      return carve(idx, size, alignment);
+  }
+  return {};
+}
+
+void TlsfAllocator::forEachAllocation(
+    const std::function<void(const Allocation&)>& func) const {
+  for (uint32_t idx = 0; idx != invalid; idx = blocks[idx].nextPhys) {
+    const Block& block = blocks[idx];
+    if (!block.free) func({block.offset, block.size, idx});
+  }
+}
+
+uint64_t TlsfAllocator::getLargestFreeSize() const {
+  if (!flBitmap) return 0;
+  uint32_t fl = uint32_t(std::bit_width(flBitmap)) - 1;
+  uint32_t sl = uint32_t(std::bit_width(slBitmap[fl])) - 1;
+  // the sizes of one list only share a range, look at each
+  uint64_t largest = 0;
+  for (uint32_t idx = heads[fl][sl]; idx != invalid;
+       idx = blocks[idx].nextFree)
+    largest = std::max(largest, blocks[idx].size);
+  return largest;
+}
+
+bool TlsfAllocator::validate() const {
+  uint64_t offset = 0;
+  uint64_t usedSize = 0;
+  uint32_t numFree = 0;
+  uint32_t numUsed = 0;
+  uint32_t prev = invalid;
+  for (uint32_t idx = 0; idx != invalid; idx = blocks[idx].nextPhys) {
+    const Block& block = blocks[idx];
+    if (block.offset != offset || block.prevPhys != prev) return false;
+    if (block.size == 0 || block.size % granularity) return false;
+    if (block.free) {
+      // free neighbours are always merged
+      if (prev != invalid && blocks[prev].free) return false;
+      ++numFree;
+    } else {
+      if (block.offset % block.alignment) return false;
+      usedSize += block.size;
+      ++numUsed;
+    }
+    offset += block.size;
+    prev = idx;
+  }
+  if (offset != size || usedSize != used || numUsed != numAllocations)
+    return false;
+
+  uint32_t numListed = 0;
+  for (uint32_t fl = 0; fl < flCount; ++fl) {
+    for (uint32_t sl = 0; sl < slCount; ++sl) {
+      bool listed = heads[fl][sl] != invalid;
+      if (listed != bool(slBitmap[fl] & (1u << sl))) return false;
+      if (listed && !(flBitmap & (uint64_t(1) << fl))) return false;
+      uint32_t prevFree = invalid;
+      for (uint32_t idx = heads[fl][sl]; idx != invalid;
+           idx = blocks[idx].nextFree) {
+        uint32_t blockFl, blockSl;
+        mapping(blocks[idx].size, &blockFl, &blockSl);
+        if (!blocks[idx].free || blockFl != fl || blockSl != sl) return false;
+        if (blocks[idx].prevFree != prevFree) return false;
+        prevFree = idx;
+        ++numListed;
+      }
+    }
+  }
+  return numListed == numFree;
+}
@@ -0,0 +1,83 @@
+#pragma once
+#include <cstdint>
+#include <functional>
+#include <vector>
+
+// Two-level segregated fit allocator over an address range.
+// Free blocks are kept in lists bucketed by a coarse power of two and a fine
+// linear split of it, with a bitmap per level, so allocate() and free() take
+// constant time whatever the number of blocks. Neighbouring free blocks are
+// merged on free. Only offsets are handed out, the memory itself (a D3D12
+// heap for GpuMemory) lives outside.
+class TlsfAllocator {
+ public:
+  static const uint32_t invalid = UINT32_MAX;
+
+  struct Allocation {
+    uint64_t offset = 0;
+    uint64_t size = 0;
+    uint32_t block = invalid;
+    bool valid() const { return block != invalid; }
+  };
+
+ private:
+  static const uint32_t slLog2 = 5;  // 32 second level lists per first level
+  static const uint32_t slCount = 1u << slLog2;
+  static const uint32_t flCount = 64 - slLog2 + 1;
+
+  struct Block {
+    uint64_t offset = 0;
+    uint64_t size = 0;
+    uint64_t alignment = 1;  // of the allocation, for allocateBelow()
+    uint32_t prevPhys = invalid;
+    uint32_t nextPhys = invalid;
+    uint32_t prevFree = invalid;
+    uint32_t nextFree = invalid;
+    bool free = false;
+  };
+
+  uint64_t size;
+  uint64_t granularity;
+  std::vector<Block> blocks;
+  std::vector<uint32_t> unusedBlocks;  // indices of blocks to recycle
+
+  uint64_t flBitmap = 0;
+  uint32_t slBitmap[flCount]{};
+  uint32_t heads[flCount][slCount];
+
+  uint64_t used = 0;
+  uint32_t numAllocations = 0;
+
+  static void mapping(uint64_t size, uint32_t* fl, uint32_t* sl);
+  uint32_t findFree(uint64_t size) const;
+  uint32_t newBlock();
+  void insertFree(uint32_t idx);
+  void removeFree(uint32_t idx);
+  // keeps the first size bytes in idx, the rest goes to a new free block
+  void split(uint32_t idx, uint64_t firstSize);
+  Allocation carve(uint32_t idx, uint64_t size, uint64_t alignment);
+
+ public:
+  // offsets and sizes are multiples of granularity, a power of two
+  explicit TlsfAllocator(uint64_t size, uint64_t granularity = 256);
+
+  // alignment is a power of two, invalid when no free block fits
+  Allocation allocate(uint64_t size, uint64_t alignment = 1);
+  void free(const Allocation& allocation);
+
+  // defragmentation hook : a new allocation of the same size and alignment
+  // in the lowest free block that fits below the given one, invalid when
+  // there is none. The caller moves the data, then frees the old allocation.
+  Allocation allocateBelow(const Allocation& allocation);
+  // live allocations in address order
+  void forEachAllocation(
+      const std::function<void(const Allocation&)>& func) const;
+
+  uint64_t getSize() const { return size; }
+  uint64_t getUsedSize() const { return used; }
+  uint64_t getFreeSize() const { return size - used; }
+  uint32_t getAllocationCount() const { return numAllocations; }
+  uint64_t getLargestFreeSize() const;
+  // walks the blocks, checks links, merging and the free lists
+  bool validate() const;
+};
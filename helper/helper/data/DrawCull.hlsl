@@ -0,0 +1,78 @@
+// Frustum culling of the draw candidates.
+// The candidates inside the frustum get a draw command each, packed at the
+// front of the command buffer; the count buffer holds how many for
+// ExecuteIndirect.
+
+// DrawCull::Candidate
+struct Candidate
+{
+    row_major float4x4 model;
+    float4 sphere;
+    uint colorId;
+    uint indexCount;
+    uint startIndex;
+    int baseVertex;
+    float uvScale;
+    uint maskOffset;
+    uint2 padding;
+};
+
+// IndirectDraw<MeshDrawIndirect::ConstantData>, 112 bytes
+struct Command
+{
+    row_major float4x4 MVP;
+    uint colorId;
+    float uvScale;
+    uint maskOffset;
+    uint padding0;
+    uint indexCount;
+    uint instanceCount;
+    uint startIndex;
+    int baseVertex;
+    uint startInstance;
+    uint3 padding1;
+};
+
+cbuffer cb0 : register(b0)
+{
+    row_major float4x4 VP;
+    float4 planes[6];
+    uint numCandidates;
+};
+
+StructuredBuffer<Candidate> candidates : register(t0);
+RWStructuredBuffer<Command> commands : register(u0);
+RWByteAddressBuffer count : register(u1);
+
+[numthreads(64, 1, 1)]
+void CSMain(uint3 id : SV_DispatchThreadID)
+{
+    if (id.x >= numCandidates)
+        return;
+
+    Candidate candidate = candidates[id.x];
+    [unroll]
+    for (uint i = 0; i < 6; ++i)
+    {
+        if (dot(planes[i].xyz, candidate.sphere.xyz) + planes[i].w <
+            -candidate.sphere.w)
+            return;
+    }
+
+    uint slot;
+    count.InterlockedAdd(0, 1, slot);
+
+    Command command;
+    command.MVP = mul(candidate.model, VP);
+    command.colorId = candidate.colorId;
+    command.uvScale = candidate.uvScale;
+    command.maskOffset = candidate.maskOffset;
+    command.padding0 = 0;
+    command.indexCount = candidate.indexCount;
+    command.instanceCount = 1;
+    command.startIndex = candidate.startIndex;
+    command.baseVertex = candidate.baseVertex;
+    command.startInstance = 0;
+    command.padding1 = 0;
+    commands[slot] = command;
+}
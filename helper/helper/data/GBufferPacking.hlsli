@@ -0,0 +1,34 @@
+// Packed texture-space G-buffer, see GBufferPacking.h for the CPU reference.
+//   target0 : diffuse   R8G8B8A8_UNORM_SRGB (conversion done by the format)
+//   target1 : position  R16G16B16A16_UNORM, relative to the instance bounds
+//   target2 : normal    R16G16_SNORM, octahedral
+
+float2 octWrap(float2 v)
+{
+    return (1.0 - abs(v.yx)) * (v.xy >= 0.0 ? 1.0 : -1.0);
+}
+
+float2 packNormal(float3 n)
+{
+    n /= abs(n.x) + abs(n.y) + abs(n.z);
+    n.xy = n.z >= 0.0 ? n.xy : octWrap(n.xy);
+    return n.xy;
+}
+
+float3 unpackNormal(float2 e)
+{
+    float3 n = float3(e.xy, 1.0 - abs(e.x) - abs(e.y));
+    float t = saturate(-n.z);
+    n.xy += n.xy >= 0.0 ? -t : t;
+    return normalize(n);
+}
+
+float4 packPosition(float3 p, float3 boundsMin, float3 boundsSize)
+{
+    return float4(saturate((p - boundsMin) / boundsSize), 1.0);
+}
+
+float3 unpackPosition(float3 e, float3 boundsMin, float3 boundsSize)
+{
+    return boundsMin + e * boundsSize;
+}
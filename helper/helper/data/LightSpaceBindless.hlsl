@@ -0,0 +1,59 @@
+#include "GBufferPacking.hlsli"
+
+// LightSpaceCompute.hlsl with the G-buffer read from the bindless table
+
+cbuffer cb0 : register(b0)
+{
+    float4 position;
+    float4 normal;
+    float3 cameraPos;
+    float intensity;
+    float4 boundsMin;
+    float4 boundsSize;
+    uint diffuseId;
+    uint positionId;
+    uint normalId;
+};
+
+// every texture of the shader visible heap, see BindlessTable
+Texture2D textures[] : register(t0, space1);
+RWTexture2D<float4> lightTarget : register(u0);
+
+void shadeTexel(uint2 texel)
+{
+    uint width, height;
+    lightTarget.GetDimensions(width, height);
+    if (texel.x >= width || texel.y >= height)
+        return;
+
+    uint3 coord = uint3(texel, 0);
+    // the ids are the same for the whole dispatch, no NonUniformResourceIndex
+    float3 diffuseColor = textures[diffuseId].Load(coord).rgb;
+    float3 N = unpackNormal(textures[normalId].Load(coord).xy);
+    float3 P = unpackPosition(textures[positionId].Load(coord).xyz,
+                              boundsMin.xyz, boundsSize.xyz);
+    float3 L = normalize(position.xyz - P);
+
+    float dist = length(position.xyz - P);
+    float cos_i = saturate(dot(N, L));
+    float cos_j = saturate(dot(normal.xyz, -L));
+
+    float3 v = normalize(P - cameraPos);
+    float3 r = reflect(L, N);
+    float cosAlpha = saturate(dot(v, r));
+
+    float3 _diffuse = cos_i * cos_j * diffuseColor * intensity / (dist * dist);
+    float3 _speuclar = pow(cosAlpha, 5) * float3(1, 1, 1) * intensity / (dist * dist);
+    float3 _ambient = 0.2 * diffuseColor;
+
+    lightTarget[texel] = float4(_diffuse + _speuclar + _ambient, 1);
+}
+
+// LightSpaceTiled.hlsl has its own entry
+#ifndef LIGHT_SPACE_TILED
+[numthreads(8, 8, 1)]
+void CSMain(uint3 texel : SV_DispatchThreadID)
+{
+    shadeTexel(texel.xy);
+}
+#endif
@@ -0,0 +1,48 @@
+#include "GBufferPacking.hlsli"
+
+// same lighting as LightSpacePass.hlsl, one thread per texel
+
+cbuffer cb0 : register(b0)
+{
+    float4 position;
+    float4 normal;
+    float3 cameraPos;
+    float intensity;
+    float4 boundsMin;
+    float4 boundsSize;
+};
+
+Texture2D diffuseMap : register(t0);
+Texture2D positionMap : register(t1);
+Texture2D normalMap : register(t2);
+RWTexture2D<float4> lightTarget : register(u0);
+
+[numthreads(8, 8, 1)]
+void CSMain(uint3 texel : SV_DispatchThreadID)
+{
+    uint width, height;
+    lightTarget.GetDimensions(width, height);
+    if (texel.x >= width || texel.y >= height)
+        return;
+
+    uint3 coord = uint3(texel.xy, 0);
+    float3 diffuseColor = diffuseMap.Load(coord).rgb;
+    float3 N = unpackNormal(normalMap.Load(coord).xy);
+    float3 P = unpackPosition(positionMap.Load(coord).xyz,
+                              boundsMin.xyz, boundsSize.xyz);
+    float3 L = normalize(position.xyz - P);
+
+    float dist = length(position.xyz - P);
+    float cos_i = saturate(dot(N, L));
+    float cos_j = saturate(dot(normal.xyz, -L));
+
+    float3 v = normalize(P - cameraPos);
+    float3 r = reflect(L, N);
+    float cosAlpha = saturate(dot(v, r));
+
+    float3 _diffuse = cos_i * cos_j * diffuseColor * intensity / (dist * dist);
+    float3 _speuclar = pow(cosAlpha, 5) * float3(1, 1, 1) * intensity / (dist * dist);
+    float3 _ambient = 0.2 * diffuseColor;
+
+    lightTarget[texel.xy] = float4(_diffuse + _speuclar + _ambient, 1);
+}
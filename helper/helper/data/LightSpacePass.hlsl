@@ -1,3 +1,5 @@
+#include "GBufferPacking.hlsli"
+
 static const float4 QuadNDCoords[4] = {
         float4(-1, -1, 0, 1),
         float4(-1,  1, 0, 1),
@@ -30,6 +32,8 @@ cbuffer cb0 : register(b0)
     float4 normal;
     float3 cameraPos;
     float intensity;
+    float4 boundsMin;
+    float4 boundsSize;
 };
 
 Texture2D diffuseMap : register(t0);
@@ -53,8 +57,9 @@ void PSMain(
 
     
     float3 diffuseColor = diffuseMap.Load(uint3(input.ndc.x, input.ndc.y, 0)).rgb;
-    float3 N = normalize(normalMap.Load(uint3(input.ndc.x, input.ndc.y, 0))).xyz;
-    float3 P = positionMap.Load(uint3(input.ndc.x, input.ndc.y, 0)).xyz;
+    float3 N = unpackNormal(normalMap.Load(uint3(input.ndc.x, input.ndc.y, 0)).xy);
+    float3 P = unpackPosition(positionMap.Load(uint3(input.ndc.x, input.ndc.y, 0)).xyz,
+                              boundsMin.xyz, boundsSize.xyz);
     //float3 V = normalize(cameraPos - P);
     float3 L = normalize(position - P);
 
@@ -0,0 +1,16 @@
+// LightSpaceBindless.hlsl over the tiles TileCompact.hlsl listed, a group
+// per tile
+
+#define LIGHT_SPACE_TILED
+#include "LightSpaceBindless.hlsl"
+#include "VisibleTiles.hlsli"
+
+ByteAddressBuffer tiles : register(t0);  // x | y << 16
+
+// tileSize x tileSize
+[numthreads(8, 8, 1)]
+void CSMain(uint3 group : SV_GroupID, uint3 thread : SV_GroupThreadID)
+{
+    uint tile = tiles.Load(group.x * 4);
+    shadeTexel(uint2(tile & 0xffff, tile >> 16) * tileSize + thread.xy);
+}
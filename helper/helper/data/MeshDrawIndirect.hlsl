@@ -0,0 +1,53 @@
+// MeshDrawPass.hlsl drawn by ExecuteIndirect, see DrawCull.hlsl
+
+#include "VisibleTiles.hlsli"
+
+struct VSInput
+{
+    float3 position : POSITION;
+    float3 normal   : NORMAL;
+    float2 texcoord : TEXCOORD;
+};
+
+struct PSInput
+{
+    float4 positionClip : SV_POSITION;
+    float2 texcoord     : TEXCOORD;
+};
+
+// set by each command
+cbuffer cb0 : register(b0)
+{
+    row_major float4x4 MVP;
+    uint colorId;
+    float uvScale;
+    uint maskOffset;
+};
+
+// every texture of the shader visible heap, see BindlessTable
+Texture2D textures[] : register(t0, space1);
+SamplerState sampler0 : register(s0);
+RWByteAddressBuffer tileMasks : register(u0);
+
+
+PSInput VSMain(VSInput input)
+{
+    PSInput result;
+    result.positionClip = mul(float4(input.position, 1.0), MVP);
+    result.texcoord = input.texcoord;
+    return result;
+}
+
+[earlydepthstencil]
+void PSMain(
+    PSInput input,
+    out float4 outTarget0 : SV_TARGET0
+)
+{
+    float2 uv = input.texcoord * uvScale;
+    outTarget0 = textures[colorId].Sample(sampler0, uv);
+
+    uint2 size;
+    textures[colorId].GetDimensions(size.x, size.y);
+    markTile(tileMasks, maskOffset, uv, size);
+}
@@ -1,4 +1,6 @@
 
+#include "VisibleTiles.hlsli"
+
 struct VSInput
 {
     float3 position : POSITION;
@@ -15,10 +17,13 @@ struct PSInput
 cbuffer cb0 : register(b0)
 {
     row_major float4x4 MVP;
-    row_major float4x4 MVP2;
+    // the texture space may be shaded in its top left part only
+    float uvScale;
+    uint maskOffset;
 };
 Texture2D shadedColor : register(t0);
 SamplerState sampler0 : register(s0);
+RWByteAddressBuffer tileMasks : register(u0);
 
 
 PSInput VSMain(VSInput input)
@@ -29,10 +34,17 @@ PSInput VSMain(VSInput input)
     return result;
 }
 
+// only the pixels that pass the depth test mark their tile
+[earlydepthstencil]
 void PSMain(
     PSInput input,
     out float4 outTarget0 : SV_TARGET0
 )
 {
-    outTarget0 = shadedColor.Sample(sampler0, input.texcoord);
+    float2 uv = input.texcoord * uvScale;
+    outTarget0 = shadedColor.Sample(sampler0, uv);
+
+    uint2 size;
+    shadedColor.GetDimensions(size.x, size.y);
+    markTile(tileMasks, maskOffset, uv, size);
 }
@@ -1,3 +1,5 @@
+#include "GBufferPacking.hlsli"
+
 
 struct VSInput
 {
@@ -17,6 +19,8 @@ struct PSInput
 cbuffer cb0 : register(b0)
 {
     row_major float4x4 M;
+    float4 boundsMin;
+    float4 boundsSize;
 };
 
 Texture2D diffuseColor : register(t0);
@@ -37,10 +41,10 @@ void PSMain(
     PSInput input,
     out float4 outTarget0 : SV_TARGET0,
     out float4 outTarget1 : SV_TARGET1,
-    out float4 outTarget2 : SV_TARGET2
+    out float2 outTarget2 : SV_TARGET2
 )
 {
     outTarget0 = diffuseColor.Sample(sampler0, input.texcoord);
-    outTarget1 = float4(input.position.xyz, 1.0);
-    outTarget2 = float4(normalize(input.normal), 1.0);
+    outTarget1 = packPosition(input.position, boundsMin.xyz, boundsSize.xyz);
+    outTarget2 = packNormal(normalize(input.normal));
 }
@@ -0,0 +1,53 @@
+// Lists the tiles of a VisibleTiles mask for an indirect dispatch, a group
+// per tile. The marks are a frame old, so the tiles next to a marked one are
+// listed too; allTiles lists every used tile whatever the mask holds. With
+// useCoverage, only the tiles the uv layout covers are listed.
+
+cbuffer cb0 : register(b0)
+{
+    uint tilesX;  // of the mask
+    uint usedX;   // the shaded part of the texture space
+    uint usedY;
+    uint allTiles;
+    uint useCoverage;
+};
+
+ByteAddressBuffer mask : register(t0);
+ByteAddressBuffer coverage : register(t1);  // the level of the shaded size
+RWByteAddressBuffer tiles : register(u0);
+RWByteAddressBuffer args : register(u1);  // D3D12_DISPATCH_ARGUMENTS
+
+bool isSet(ByteAddressBuffer bits, uint2 tile)
+{
+    uint bit = tile.y * tilesX + tile.x;
+    return (bits.Load((bit >> 5) * 4) & (1u << (bit & 31))) != 0;
+}
+
+bool isMarked(int2 tile)
+{
+    if (any(tile < 0) || tile.x >= int(usedX) || tile.y >= int(usedY))
+        return false;
+    return isSet(mask, uint2(tile));
+}
+
+[numthreads(8, 8, 1)]
+void CSMain(uint3 tile : SV_DispatchThreadID)
+{
+    if (tile.x >= usedX || tile.y >= usedY)
+        return;
+    if (useCoverage != 0 && !isSet(coverage, tile.xy))
+        return;
+
+    bool visible = allTiles != 0;
+    for (int y = -1; y <= 1 && !visible; ++y)
+    {
+        for (int x = -1; x <= 1 && !visible; ++x)
+            visible = isMarked(int2(tile.xy) + int2(x, y));
+    }
+    if (!visible)
+        return;
+
+    uint slot;
+    args.InterlockedAdd(0, 1, slot);
+    tiles.Store(slot * 4, tile.x | (tile.y << 16));
+}
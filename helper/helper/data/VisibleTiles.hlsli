@@ -0,0 +1,18 @@
+// Marks of the texture space tiles seen on screen, see VisibleTiles in
+// Helper.h and TileMask.h for the CPU reference.
+
+static const uint tileSize = 8;  // VisibleTiles::tileSize
+
+// a bit per tile of the texture of size texels, row after row; the mask
+// starts maskOffset bytes into masks. uv wraps as the sampler does.
+void markTile(RWByteAddressBuffer masks, uint maskOffset, float2 uv,
+              uint2 size)
+{
+    uint2 texel = min(uint2(frac(uv) * size), size - 1);
+    uint2 tile = texel / tileSize;
+    uint bit = tile.y * ((size.x + tileSize - 1) / tileSize) + tile.x;
+    uint address = maskOffset + (bit >> 5) * 4;
+    // most pixels find their bit set, skip the atomic then
+    if ((masks.Load(address) & (1u << (bit & 31))) == 0)
+        masks.InterlockedOr(address, 1u << (bit & 31));
+}
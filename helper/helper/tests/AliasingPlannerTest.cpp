@@ -0,0 +1,151 @@
+#include "AliasingPlanner.h"
+
+#include <random>
+
+#include "Check.h"
+
+namespace {
+
+bool overlapLifetime(const AliasingPlanner::Request& a,
+                     const AliasingPlanner::Request& b) {
+  return a.firstPass <= b.lastPass && b.firstPass <= a.lastPass;
+}
+
+// what plan() must hold for any set of requests
+void checkPlan(const AliasingPlanner& planner) {
+  uint64_t naive = 0;
+  for (uint32_t i = 0; i < planner.count(); ++i) {
+    const AliasingPlanner::Request& a = planner.getRequest(i);
+    uint64_t aBegin = planner.getPlacement(i).offset;
+    CHECK(aBegin % a.alignment == 0);
+    CHECK(aBegin + a.size <= planner.getHeapSize());
+    CHECK(a.alignment <= planner.getHeapAlignment());
+    naive += a.size;
+
+    bool shared = false;
+    for (uint32_t j = 0; j < planner.count(); ++j) {
+      if (i == j) continue;
+      const AliasingPlanner::Request& b = planner.getRequest(j);
+      uint64_t bBegin = planner.getPlacement(j).offset;
+      bool overlapMemory = aBegin < bBegin + b.size && bBegin < aBegin + a.size;
+      CHECK(!(overlapMemory && overlapLifetime(a, b)));
+      shared |= overlapMemory;
+    }
+    CHECK(planner.getPlacement(i).aliased == shared);
+  }
+  CHECK(planner.getPeakLiveSize() <= planner.getHeapSize());
+  CHECK(naive <= planner.getNaiveSize());
+}
+
+void testDisjointLifetimes() {
+  // a chain of passes, each resource dies before the next is born
+  AliasingPlanner planner;
+  for (uint32_t pass = 0; pass < 4; ++pass)
+    planner.add({1024, 256, pass, pass});
+  planner.plan();
+  checkPlan(planner);
+
+  for (uint32_t i = 0; i < planner.count(); ++i) {
+    CHECK(planner.getPlacement(i).offset == 0);
+    CHECK(planner.getPlacement(i).aliased);
+  }
+  CHECK(planner.getHeapSize() == 1024);
+  CHECK(planner.getNaiveSize() == 4096);
+  CHECK(planner.getPeakLiveSize() == 1024);
+}
+
+void testOverlappingLifetimes() {
+  // all live at pass 1, they are stacked in size order
+  AliasingPlanner planner;
+  uint32_t small = planner.add({100, 1, 0, 1});
+  uint32_t large = planner.add({300, 1, 1, 2});
+  uint32_t medium = planner.add({200, 1, 1, 1});
+  planner.plan();
+  checkPlan(planner);
+
+  CHECK(planner.getPlacement(large).offset == 0);
+  CHECK(planner.getPlacement(medium).offset == 300);
+  CHECK(planner.getPlacement(small).offset == 500);
+  CHECK(!planner.getPlacement(small).aliased);
+  CHECK(planner.getHeapSize() == 600);
+  CHECK(planner.getPeakLiveSize() == 600);
+}
+
+void testFirstFit() {
+  // a is placed first at 0, c does not meet a and goes under it too, b meets
+  // both and takes the first range above them
+  AliasingPlanner planner;
+  uint32_t a = planner.add({100, 1, 0, 1});
+  uint32_t b = planner.add({50, 1, 0, 3});
+  uint32_t c = planner.add({60, 1, 2, 3});
+  planner.plan();
+  checkPlan(planner);
+
+  CHECK(planner.getPlacement(a).offset == 0);
+  CHECK(planner.getPlacement(c).offset == 0);
+  CHECK(planner.getPlacement(b).offset == 100);
+  CHECK(planner.getPlacement(a).aliased && planner.getPlacement(c).aliased);
+  CHECK(!planner.getPlacement(b).aliased);
+  CHECK(planner.getHeapSize() == 150);
+
+  // a hole left between two live resources is taken by one that fits it
+  planner.clear();
+  uint32_t bottom = planner.add({400, 1, 0, 3});
+  uint32_t gone = planner.add({300, 1, 0, 1});
+  uint32_t top = planner.add({200, 1, 0, 3});
+  uint32_t hole = planner.add({250, 1, 2, 3});
+  planner.plan();
+  checkPlan(planner);
+
+  CHECK(planner.getPlacement(bottom).offset == 0);
+  CHECK(planner.getPlacement(gone).offset == 400);
+  CHECK(planner.getPlacement(top).offset == 700);
+  CHECK(planner.getPlacement(hole).offset == 400);
+  CHECK(planner.getHeapSize() == 900);
+}
+
+void testAlignment() {
+  AliasingPlanner planner;
+  uint32_t odd = planner.add({1000, 1, 0, 2});
+  uint32_t aligned = planner.add({512, 4096, 1, 2});
+  uint32_t later = planner.add({700, 256, 3, 3});
+  planner.plan();
+  checkPlan(planner);
+
+  CHECK(planner.getPlacement(odd).offset == 0);
+  CHECK(planner.getPlacement(aligned).offset == 4096);
+  CHECK(planner.getPlacement(later).offset == 0);
+  CHECK(planner.getHeapAlignment() == 4096);
+  CHECK(planner.getHeapSize() == 4096 + 512);
+  // the naive layout pads each resource to its own alignment
+  CHECK(planner.getNaiveSize() == 4096 + 512 + 700);
+}
+
+void testRandom() {
+  std::mt19937 random(26);
+  AliasingPlanner planner;
+  for (int round = 0; round < 200; ++round) {
+    planner.clear();
+    uint32_t numPasses = 1 + random() % 12;
+    uint32_t numRequests = 1 + random() % 24;
+    for (uint32_t i = 0; i < numRequests; ++i) {
+      uint32_t first = random() % numPasses;
+      uint32_t last = first + random() % (numPasses - first);
+      planner.add({1 + random() % 100000, uint64_t(1) << (random() % 17),
+                   first, last});
+    }
+    planner.plan();
+    checkPlan(planner);
+  }
+}
+
+}  // namespace
+
+int main() {
+  testDisjointLifetimes();
+  testOverlappingLifetimes();
+  testFirstFit();
+  testAlignment();
+  testRandom();
+  return checkResult();
+}
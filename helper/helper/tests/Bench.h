@@ -0,0 +1,29 @@
+#pragma once
+#include <chrono>
+#include <cstdio>
+
+// Timing for the benchmarks : the best of a few runs, the others are what
+// the machine did meanwhile.
+template <typename Func>
+double bestMs(int runs, Func&& func) {
+  double best = 1e30;
+  for (int i = 0; i < runs; ++i) {
+    auto start = std::chrono::steady_clock::now();
+    func();
+    std::chrono::duration<double, std::milli> ms =
+        std::chrono::steady_clock::now() - start;
+    if (ms.count() < best) best = ms.count();
+  }
+  return best;
+}
+
+// keeps a result alive without the optimizer seeing through it
+template <typename T>
+void keep(const T& value) {
+#if defined(__GNUC__)
+  asm volatile("" : : "g"(&value) : "memory");
+#else
+  static volatile const void* sink;
+  sink = &value;
+#endif
+}
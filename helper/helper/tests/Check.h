@@ -0,0 +1,28 @@
+#pragma once
+#include <cstdio>
+
+// The checks of the tests, they report and go on so that a run lists all the
+// failures; main returns checkResult().
+
+inline int& checkFailures() {
+  static int failures = 0;
+  return failures;
+}
+
+#define CHECK(condition)                                             \
+  do {                                                               \
+    if (!(condition)) {                                              \
+      std::printf("%s:%d: CHECK(%s) failed\n", __FILE__, __LINE__,  \
+                  #condition);                                       \
+      ++checkFailures();                                             \
+    }                                                                \
+  } while (0)
+
+inline int checkResult() {
+  if (checkFailures() == 0) {
+    std::printf("passed\n");
+    return 0;
+  }
+  std::printf("%d checks failed\n", checkFailures());
+  return 1;
+}
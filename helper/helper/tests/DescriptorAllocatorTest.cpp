@@ -0,0 +1,200 @@
+#include "DescriptorAllocator.h"
+
+#include <deque>
+#include <random>
+#include <utility>
+#include <vector>
+
+#include "Check.h"
+
+namespace {
+
+void testPool() {
+  DescriptorPool pool(8, 32, 3);
+  DescriptorPool::Slot a = pool.allocate(3);
+  DescriptorPool::Slot b = pool.allocate(5);
+  DescriptorPool::Slot c = pool.allocate(1);
+  CHECK(a.page == 0 && a.index == 0);
+  CHECK(b.page == 0 && b.index == 3);
+  CHECK(c.page == 1 && c.index == 0);
+  CHECK(pool.getOffset(b) == 3 * 32);
+  CHECK(pool.getUsedCount() == 9);
+
+  // freed ranges are reused first and merge with their neighbours
+  pool.free(a, 3);
+  DescriptorPool::Slot d = pool.allocate(2);
+  CHECK(d.page == 0 && d.index == 0);
+  pool.free(b, 5);
+  pool.free(d, 2);
+  DescriptorPool::Slot e = pool.allocate(8);
+  CHECK(e.page == 0 && e.index == 0);
+
+  // a third page, then nothing more
+  DescriptorPool::Slot f = pool.allocate(8);
+  CHECK(f.page == 2 && f.index == 0);
+  CHECK(!pool.allocate(8).valid());
+  CHECK(!pool.allocate(9).valid());
+  CHECK(pool.getPageCount() == 3);
+  CHECK(pool.getUsedCount() == 17);
+}
+
+void testPoolRandom() {
+  const uint32_t pageSize = 64;
+  DescriptorPool pool(pageSize, 1);
+  std::mt19937 random(34);
+  std::vector<std::vector<bool>> taken;
+  std::vector<std::pair<DescriptorPool::Slot, uint32_t>> live;
+  uint32_t used = 0;
+
+  for (int step = 0; step < 20000; ++step) {
+    if (live.empty() || random() % 3) {
+      uint32_t count = 1 + random() % 6;
+      DescriptorPool::Slot slot = pool.allocate(count);
+      CHECK(slot.valid() && slot.index + count <= pageSize);
+      if (!slot.valid()) continue;
+      if (taken.size() <= slot.page) taken.resize(slot.page + 1);
+      taken[slot.page].resize(pageSize, false);
+      for (uint32_t k = 0; k < count; ++k) {
+        CHECK(!taken[slot.page][slot.index + k]);
+        taken[slot.page][slot.index + k] = true;
+      }
+      live.push_back({slot, count});
+      used += count;
+    } else {
+      size_t i = random() % live.size();
+      auto [slot, count] = live[i];
+      for (uint32_t k = 0; k < count; ++k)
+        taken[slot.page][slot.index + k] = false;
+      pool.free(slot, count);
+      live[i] = live.back();
+      live.pop_back();
+      used -= count;
+    }
+    CHECK(pool.getUsedCount() == used);
+  }
+  // pages are only added when the free ranges are too fragmented
+  CHECK(pool.getPageCount() * pageSize < used * 2 + pageSize * 2);
+}
+
+void testRing() {
+  DescriptorRing ring(10, 32);
+  CHECK(ring.allocate(4) == 0);
+  CHECK(ring.allocate(4) == 4);
+  CHECK(ring.getOffset(4) == 4 * 32);
+  ring.endFrame(1);
+  // 2 left at the end, nothing at the start yet
+  CHECK(ring.allocate(3) == DescriptorRing::invalid);
+  CHECK(ring.allocate(2) == 8);
+  ring.endFrame(2);
+  CHECK(ring.getUsedCount() == 10);
+
+  ring.retire(1);
+  CHECK(ring.getUsedCount() == 2);
+  CHECK(ring.allocate(3) == 0);
+  CHECK(ring.allocate(5) == 3);
+  ring.endFrame(3);
+  CHECK(ring.getUsedCount() == 10);
+
+  // full : nothing fits until a frame retires
+  CHECK(ring.allocate(1) == DescriptorRing::invalid);
+  ring.retire(2);
+  CHECK(ring.getUsedCount() == 8);
+  CHECK(ring.allocate(3) == DescriptorRing::invalid);
+  CHECK(ring.allocate(2) == 8);
+  ring.endFrame(4);
+
+  // retiring an older value again changes nothing
+  ring.retire(2);
+  CHECK(ring.getUsedCount() == 10);
+  ring.retire(4);
+  CHECK(ring.getUsedCount() == 0);
+}
+
+void testRingWrap() {
+  // a table that does not fit before the end skips it, the skipped slots
+  // come back with the frame
+  DescriptorRing ring(10, 1);
+  CHECK(ring.allocate(6) == 0);
+  ring.endFrame(1);
+  CHECK(ring.allocate(3) == 6);
+  ring.endFrame(2);
+  ring.retire(1);
+  CHECK(ring.allocate(4) == 0);
+  CHECK(ring.getUsedCount() == 3 + 1 + 4);
+  ring.endFrame(3);
+  // the skipped slot belongs to the frame that skipped it
+  ring.retire(2);
+  CHECK(ring.getUsedCount() == 1 + 4);
+  ring.retire(3);
+  CHECK(ring.getUsedCount() == 0);
+
+  // once empty the whole ring is one range again, even when the last frame
+  // ended near the end
+  CHECK(ring.allocate(8) == 0);
+  ring.endFrame(4);
+  ring.retire(4);
+  CHECK(ring.allocate(10) == 0);
+  ring.endFrame(5);
+  ring.retire(5);
+  CHECK(ring.allocate(9) == 0);
+  ring.endFrame(6);
+  ring.retire(6);
+  CHECK(ring.getUsedCount() == 0);
+}
+
+void testRingRandom() {
+  const uint32_t capacity = 64;
+  DescriptorRing ring(capacity, 1);
+  std::mt19937 random(34);
+  std::vector<bool> taken(capacity, false);
+  using Tables = std::vector<std::pair<uint32_t, uint32_t>>;
+  std::deque<std::pair<uint64_t, Tables>> frames;
+  Tables open;
+  uint64_t fence = 0;
+
+  for (int step = 0; step < 50000; ++step) {
+    int op = random() % 10;
+    if (op < 7) {
+      uint32_t count = 1 + random() % 10;
+      bool empty = ring.getUsedCount() == 0;
+      uint32_t index = ring.allocate(count);
+      // an empty ring takes any table up to its capacity
+      CHECK(!empty || index != DescriptorRing::invalid);
+      if (index == DescriptorRing::invalid) continue;
+      CHECK(index + count <= capacity);
+      for (uint32_t k = 0; k < count; ++k) {
+        CHECK(!taken[index + k]);
+        taken[index + k] = true;
+      }
+      open.push_back({index, count});
+    } else if (op < 9) {
+      ring.endFrame(++fence);
+      frames.push_back({fence, open});
+      open.clear();
+    } else {
+      uint64_t completed = fence > 2 ? fence - random() % 3 : 0;
+      ring.retire(completed);
+      while (!frames.empty() && frames.front().first <= completed) {
+        for (auto [index, count] : frames.front().second)
+          for (uint32_t k = 0; k < count; ++k) taken[index + k] = false;
+        frames.pop_front();
+      }
+    }
+
+    uint32_t inUse = 0;
+    for (bool t : taken) inUse += t;
+    CHECK(ring.getUsedCount() >= inUse);
+    CHECK(ring.getUsedCount() <= capacity);
+  }
+}
+
+}  // namespace
+
+int main() {
+  testPool();
+  testPoolRandom();
+  testRing();
+  testRingWrap();
+  testRingRandom();
+  return checkResult();
+}
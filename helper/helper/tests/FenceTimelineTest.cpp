@@ -0,0 +1,105 @@
+#include "FenceTimeline.h"
+
+#include <memory>
+#include <random>
+#include <vector>
+
+#include "Check.h"
+
+namespace {
+
+void testOrder() {
+  FenceTimeline timeline;
+  std::vector<int> log;
+  timeline.onCompletion(3, [&] { log.push_back(3); });
+  timeline.onCompletion(1, [&] { log.push_back(1); });
+  timeline.onCompletion(3, [&] { log.push_back(33); });
+  timeline.onCompletion(2, [&] {
+    log.push_back(2);
+    // already completed from inside retire(), runs right away
+    timeline.onCompletion(2, [&] { log.push_back(22); });
+    timeline.onCompletion(4, [&] { log.push_back(4); });
+  });
+
+  CHECK(timeline.retire(0) == 0);
+  CHECK(log.empty());
+  CHECK(timeline.retire(2) == 2);
+  CHECK((log == std::vector<int>{1, 2, 22}));
+  CHECK(timeline.pendingCount() == 3 && timeline.lastPendingValue() == 4);
+
+  // the completed value never goes back
+  CHECK(timeline.retire(1) == 0);
+  CHECK(timeline.getCompletedValue() == 2);
+  CHECK(timeline.isCompleted(2) && !timeline.isCompleted(3));
+
+  CHECK(timeline.retire(10) == 3);
+  CHECK((log == std::vector<int>{1, 2, 22, 3, 33, 4}));
+  CHECK(timeline.pendingCount() == 0 && timeline.lastPendingValue() == 0);
+
+  timeline.onCompletion(5, [&] { log.push_back(5); });
+  CHECK(log.back() == 5);
+}
+
+// a resource that records when it is released
+struct Resource {
+  uint64_t lastUse = 0;  // fence value of the last submission using it
+  uint64_t releasedAt = 0;
+};
+
+void testDeferredRelease() {
+  // frames signal 1, 2, 3, ... and the gpu runs up to 2 frames behind; a
+  // resource dropped at a frame is released once the fence passed its last
+  // use, never before
+  std::mt19937 random(31);
+  FenceTimeline timeline;
+  std::vector<std::unique_ptr<Resource>> live;
+  std::vector<std::unique_ptr<Resource>> released;
+  uint64_t gpuValue = 0;
+  size_t dropped = 0;
+
+  for (uint64_t frame = 1; frame <= 1000; ++frame) {
+    for (int i = random() % 3; i > 0; --i)
+      live.push_back(std::make_unique<Resource>());
+    for (auto& resource : live)
+      if (random() % 2) resource->lastUse = frame;
+
+    // drop a few, they wait for their last use
+    for (int i = random() % 3; i > 0 && !live.empty(); --i) {
+      size_t index = random() % live.size();
+      Resource* resource = live[index].release();
+      live.erase(live.begin() + index);
+      ++dropped;
+      timeline.onCompletion(resource->lastUse, [&, resource] {
+        CHECK(timeline.isCompleted(resource->lastUse));
+        CHECK(gpuValue >= resource->lastUse);
+        resource->releasedAt = gpuValue;
+        released.emplace_back(resource);
+      });
+    }
+
+    // the gpu finishes a random amount of the frames submitted
+    uint64_t behind = random() % 3;
+    if (frame > behind) gpuValue = std::max(gpuValue, frame - behind);
+    uint32_t pendingBefore = timeline.pendingCount();
+    uint32_t ran = timeline.retire(gpuValue);
+    CHECK(timeline.pendingCount() == pendingBefore - ran);
+    CHECK(timeline.pendingCount() == 0 ||
+          timeline.lastPendingValue() > gpuValue);
+  }
+
+  // the last frames drain
+  gpuValue = 1000;
+  timeline.retire(gpuValue);
+  CHECK(timeline.pendingCount() == 0);
+  CHECK(released.size() == dropped);
+  for (const auto& resource : released)
+    CHECK(resource->releasedAt >= resource->lastUse);
+}
+
+}  // namespace
+
+int main() {
+  testOrder();
+  testDeferredRelease();
+  return checkResult();
+}
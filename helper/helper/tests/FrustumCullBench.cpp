@@ -0,0 +1,54 @@
+#include "FrustumCull.h"
+
+#include <cmath>
+#include <random>
+#include <vector>
+
+#include "Bench.h"
+#include "Check.h"
+
+// Frustum culling of the bounding spheres of 100k instances spread around
+// the camera, about 6% of them in view : cullSpheres(), four at a time
+// where SSE2 is there, against cullSpheresScalar().
+
+namespace {
+
+const size_t numInstances = 100000;
+
+}  // namespace
+
+int main() {
+  float f = 1.0f / std::tan(0.5f);
+  float q = 100.0f / (100.0f - 0.1f);
+  const float proj[16] = {f, 0, 0, 0, 0, f, 0, 0,
+                          0, 0, q, 1, 0, 0, -0.1f * q, 0};
+  float planes[6][4];
+  frustumPlanes(proj, planes);
+
+  std::mt19937 random(48);
+  std::uniform_real_distribution<float> position(-100.0f, 100.0f);
+  std::uniform_real_distribution<float> radius(0.1f, 5.0f);
+  SphereBatch spheres;
+  for (size_t i = 0; i < numInstances; ++i)
+    spheres.add(position(random), position(random), position(random),
+                radius(random));
+
+  std::vector<uint8_t> simd(numInstances), scalar(numInstances);
+  size_t numSimd = 0, numScalar = 0;
+  double simdMs = bestMs(20, [&] {
+    numSimd = cullSpheres(planes, spheres, simd.data());
+    keep(simd);
+  });
+  double scalarMs = bestMs(20, [&] {
+    numScalar = cullSpheresScalar(planes, spheres, scalar.data());
+    keep(scalar);
+  });
+  CHECK(numSimd == numScalar && simd == scalar);
+
+  printf("%zu spheres, %zu visible\n", numInstances, numSimd);
+  printf("  cullSpheres       : %7.3f ms  %5.2f ns per sphere\n", simdMs,
+         simdMs * 1e6 / numInstances);
+  printf("  cullSpheresScalar : %7.3f ms  %5.2f ns per sphere\n", scalarMs,
+         scalarMs * 1e6 / numInstances);
+  return checkResult();
+}
@@ -0,0 +1,103 @@
+#include "FrustumCull.h"
+
+#include <cmath>
+#include <random>
+
+#include "Check.h"
+
+namespace {
+
+const float identity[16] = {1, 0, 0, 0, 0, 1, 0, 0, 0, 0, 1, 0, 0, 0, 0, 1};
+
+// a perspective projection for row vectors, depth in [0, 1]
+void perspective(float fovy, float zNear, float zFar, float m[16]) {
+  float f = 1.0f / std::tan(fovy / 2);
+  float q = zFar / (zFar - zNear);
+  const float proj[16] = {f, 0, 0, 0, 0, f, 0, 0,
+                          0, 0, q, 1, 0, 0, -zNear * q, 0};
+  for (int i = 0; i < 16; ++i) m[i] = proj[i];
+}
+
+void testPlanes() {
+  // the clip volume itself : x, y in [-1, 1], z in [0, 1]
+  float planes[6][4];
+  frustumPlanes(identity, planes);
+  for (const float* plane : planes) {
+    float length = std::sqrt(plane[0] * plane[0] + plane[1] * plane[1] +
+                             plane[2] * plane[2]);
+    CHECK(std::fabs(length - 1.0f) < 1e-6f);
+  }
+
+  SphereBatch spheres;
+  spheres.add(0, 0, 0.5f, 0.1f);      // inside
+  spheres.add(3, 0, 0.5f, 0.1f);      // right of it
+  spheres.add(1.05f, 0, 0.5f, 0.1f);  // across the right plane
+  spheres.add(0, 0, -0.2f, 0.1f);     // in front of the near plane
+  spheres.add(0, 0, 1.05f, 0.1f);     // across the far plane
+  spheres.add(0, -1.5f, 0.5f, 0.5f);  // touching the bottom plane
+  uint8_t visible[6];
+  CHECK(cullSpheres(planes, spheres, visible) == 4);
+  const uint8_t expected[6] = {1, 0, 1, 0, 1, 1};
+  for (int i = 0; i < 6; ++i) CHECK(visible[i] == expected[i]);
+
+  float proj[16];
+  perspective(1.0f, 0.1f, 100.0f, proj);
+  frustumPlanes(proj, planes);
+  spheres.clear();
+  spheres.add(0, 0, 50, 1);      // ahead
+  spheres.add(0, 0, -5, 1);      // behind
+  spheres.add(0, 0, 101.5f, 1);  // past the far plane
+  spheres.add(40, 0, 50, 1);     // outside the cone
+  CHECK(cullSpheres(planes, spheres, visible) == 1 && visible[0] == 1);
+}
+
+// the four spheres at a time of cullSpheres() and the tail one at a time
+// against the reference, the counts are not multiples of 4
+void testMatchesScalar() {
+  std::mt19937 random(48);
+  std::uniform_real_distribution<float> position(-100.0f, 100.0f);
+  std::uniform_real_distribution<float> radius(0.1f, 5.0f);
+  float proj[16];
+  perspective(1.0f, 0.1f, 100.0f, proj);
+  float planes[6][4];
+  frustumPlanes(proj, planes);
+
+  for (size_t count : {0, 1, 2, 3, 5, 7, 13, 1001, 100003}) {
+    SphereBatch spheres;
+    for (size_t i = 0; i < count; ++i)
+      spheres.add(position(random), position(random), position(random),
+                  radius(random));
+    // past the end, must be left alone
+    std::vector<uint8_t> simd(count + 4, 7), scalar(count + 4, 7);
+    size_t numSimd = cullSpheres(planes, spheres, simd.data());
+    size_t numScalar = cullSpheresScalar(planes, spheres, scalar.data());
+    CHECK(numSimd == numScalar);
+    CHECK(simd == scalar);
+    size_t numVisible = 0;
+    for (size_t i = 0; i < count; ++i) numVisible += simd[i];
+    CHECK(numVisible == numSimd);
+    for (size_t i = count; i < count + 4; ++i) CHECK(simd[i] == 7);
+    if (count > 1000) CHECK(numSimd > 0 && numSimd < count);
+  }
+
+  // on the planes exactly, where >= and < part
+  SphereBatch edges;
+  for (int i = 0; i < 11; ++i) {
+    float offset = float(i - 5) * 0.25f;
+    edges.add(1.0f + offset, 0.0f, 0.5f, 0.5f);
+  }
+  frustumPlanes(identity, planes);
+  uint8_t simd[11], scalar[11];
+  CHECK(cullSpheres(planes, edges, simd) ==
+        cullSpheresScalar(planes, edges, scalar));
+  for (int i = 0; i < 11; ++i) CHECK(simd[i] == scalar[i]);
+  CHECK(simd[7] == 1 && simd[8] == 0);
+}
+
+}  // namespace
+
+int main() {
+  testPlanes();
+  testMatchesScalar();
+  return checkResult();
+}
@@ -0,0 +1,139 @@
+#include "GBufferPacking.h"
+
+#include <random>
+
+#include "Check.h"
+
+namespace {
+
+const float boundsMin[3] = {-10.0f, -5.0f, 0.0f};
+const float boundsSize[3] = {20.0f, 10.0f, 30.0f};
+
+float angleBetween(const float a[3], const float b[3]) {
+  float d = a[0] * b[0] + a[1] * b[1] + a[2] * b[2];
+  return acosf(d > 1.0f ? 1.0f : (d < -1.0f ? -1.0f : d));
+}
+
+float roundTripNormal(const float n[3], float out[3]) {
+  GBufferTexel texel;
+  for (int i = 0; i < 3; ++i) texel.normal[i] = n[i];
+  GBufferTexel decoded =
+      unpackGBuffer(packGBuffer(texel, boundsMin, boundsSize), boundsMin,
+                    boundsSize);
+  for (int i = 0; i < 3; ++i) out[i] = decoded.normal[i];
+  return angleBetween(n, out);
+}
+
+void testEdgeNormals() {
+  // the axes land on the corners and edge midpoints of the octahedron, where
+  // the snorm values are exact
+  const float axes[6][3] = {{1, 0, 0},  {-1, 0, 0}, {0, 1, 0},
+                            {0, -1, 0}, {0, 0, 1},  {0, 0, -1}};
+  for (const float* n : axes) {
+    float e[2];
+    octEncode(n, e);
+    CHECK(fabsf(e[0]) <= 1.0f && fabsf(e[1]) <= 1.0f);
+    float out[3];
+    roundTripNormal(n, out);
+    for (int i = 0; i < 3; ++i) CHECK(fabsf(out[i] - n[i]) < 1e-6f);
+  }
+
+  // +Z is the center, -Z folds to the corners
+  float e[2];
+  const float up[3] = {0, 0, 1};
+  octEncode(up, e);
+  CHECK(e[0] == 0.0f && e[1] == 0.0f);
+  const float down[3] = {0, 0, -1};
+  octEncode(down, e);
+  CHECK(fabsf(e[0]) == 1.0f && fabsf(e[1]) == 1.0f);
+
+  // on the fold z = 0 and just below it the two halves must meet
+  for (int i = 0; i < 64; ++i) {
+    float a = i * 6.2831853f / 64;
+    for (float z : {0.0f, -1e-4f, 1e-4f}) {
+      float n[3] = {cosf(a), sinf(a), z};
+      float len = sqrtf(n[0] * n[0] + n[1] * n[1] + n[2] * n[2]);
+      for (float& c : n) c /= len;
+      float out[3];
+      CHECK(roundTripNormal(n, out) < 1e-3f);
+    }
+  }
+
+  // the most negative snorm decodes to -1 like on the gpu
+  CHECK(snorm16ToFloat(-32768) == -1.0f);
+  CHECK(snorm16ToFloat(-32767) == -1.0f);
+}
+
+void testRandomNormals() {
+  // 16 bits per component of the octahedron keep the angle under 0.06 degree
+  std::mt19937 random(27);
+  std::uniform_real_distribution<float> uniform(-1.0f, 1.0f);
+  float maxAngle = 0.0f;
+  for (int i = 0; i < 200000; ++i) {
+    float n[3] = {uniform(random), uniform(random), uniform(random)};
+    float len = sqrtf(n[0] * n[0] + n[1] * n[1] + n[2] * n[2]);
+    if (len < 1e-3f || len > 1.0f) continue;
+    for (float& c : n) c /= len;
+    float out[3];
+    maxAngle = fmaxf(maxAngle, roundTripNormal(n, out));
+    CHECK(fabsf(out[0] * out[0] + out[1] * out[1] + out[2] * out[2] - 1.0f) <
+          1e-5f);
+  }
+  CHECK(maxAngle < 1e-3f);
+}
+
+void testPositions() {
+  // unorm16 relative to the bounds: half a step of size / 65535
+  std::mt19937 random(27);
+  std::uniform_real_distribution<float> uniform(0.0f, 1.0f);
+  for (int i = 0; i < 100000; ++i) {
+    GBufferTexel texel;
+    for (int k = 0; k < 3; ++k)
+      texel.position[k] = boundsMin[k] + uniform(random) * boundsSize[k];
+    PackedGBufferTexel packed = packGBuffer(texel, boundsMin, boundsSize);
+    CHECK(packed.position[3] == 65535);
+    GBufferTexel decoded = unpackGBuffer(packed, boundsMin, boundsSize);
+    for (int k = 0; k < 3; ++k) {
+      float bound = boundsSize[k] / 65535.0f * 0.5f + 1e-5f;
+      CHECK(fabsf(decoded.position[k] - texel.position[k]) <= bound);
+    }
+  }
+
+  // the corners of the bounds are exact, what is outside clamps to them
+  GBufferTexel texel;
+  for (int k = 0; k < 3; ++k) texel.position[k] = boundsMin[k] - 1.0f;
+  GBufferTexel decoded = unpackGBuffer(
+      packGBuffer(texel, boundsMin, boundsSize), boundsMin, boundsSize);
+  for (int k = 0; k < 3; ++k) CHECK(decoded.position[k] == boundsMin[k]);
+  for (int k = 0; k < 3; ++k)
+    texel.position[k] = boundsMin[k] + boundsSize[k] + 1.0f;
+  decoded = unpackGBuffer(packGBuffer(texel, boundsMin, boundsSize),
+                          boundsMin, boundsSize);
+  for (int k = 0; k < 3; ++k)
+    CHECK(fabsf(decoded.position[k] - (boundsMin[k] + boundsSize[k])) < 1e-5f);
+}
+
+void testDiffuse() {
+  // 8 bit sRGB is coarsest near white, under 0.005 in linear
+  for (int i = 0; i <= 1000; ++i) {
+    float v = i / 1000.0f;
+    GBufferTexel texel;
+    for (int k = 0; k < 4; ++k) texel.diffuse[k] = v;
+    GBufferTexel decoded = unpackGBuffer(
+        packGBuffer(texel, boundsMin, boundsSize), boundsMin, boundsSize);
+    for (int k = 0; k < 3; ++k)
+      CHECK(fabsf(decoded.diffuse[k] - v) < 0.005f);
+    CHECK(fabsf(decoded.diffuse[3] - v) <= 0.5f / 255.0f + 1e-6f);
+  }
+  for (int v = 0; v < 256; ++v) CHECK(linearToSrgb8(srgb8ToLinear(v)) == v);
+}
+
+}  // namespace
+
+int main() {
+  testEdgeNormals();
+  testRandomNormals();
+  testPositions();
+  testDiffuse();
+  return checkResult();
+}
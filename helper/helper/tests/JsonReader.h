@@ -0,0 +1,147 @@
+#pragma once
+#include <cstdlib>
+#include <string>
+#include <utility>
+#include <vector>
+
+// Reads back the JSON the helper writes, strictly, to check its structure.
+struct JsonValue {
+  enum class Type { null, boolean, number, string, array, object };
+
+  Type type = Type::null;
+  bool boolean = false;
+  double number = 0.0;
+  std::string text;
+  std::vector<JsonValue> items;
+  std::vector<std::pair<std::string, JsonValue>> members;  // in order
+
+  // the member of that name, null when there is none
+  const JsonValue* get(const std::string& name) const {
+    for (const auto& [key, value] : members)
+      if (key == name) return &value;
+    return nullptr;
+  }
+};
+
+class JsonReader {
+  const std::string& text;
+  size_t pos = 0;
+
+  void skipSpace() {
+    while (pos < text.size() && (text[pos] == ' ' || text[pos] == '\n' ||
+                                 text[pos] == '\r' || text[pos] == '\t'))
+      ++pos;
+  }
+  bool expect(char c) {
+    skipSpace();
+    if (pos >= text.size() || text[pos] != c) return false;
+    ++pos;
+    return true;
+  }
+  bool literal(const char* word) {
+    size_t length = std::char_traits<char>::length(word);
+    if (text.compare(pos, length, word) != 0) return false;
+    pos += length;
+    return true;
+  }
+
+  bool readString(std::string* out) {
+    if (!expect('"')) return false;
+    out->clear();
+    while (pos < text.size() && text[pos] != '"') {
+      char c = text[pos++];
+      if (uint8_t(c) < 0x20) return false;  // must be escaped
+      if (c != '\\') {
+        *out += c;
+        continue;
+      }
+      if (pos >= text.size()) return false;
+      char e = text[pos++];
+      if (e == 'n') {
+        *out += '\n';
+      } else if (e == 't') {
+        *out += '\t';
+      } else if (e == 'r') {
+        *out += '\r';
+      } else if (e == 'b') {
+        *out += '\b';
+      } else if (e == 'f') {
+        *out += '\f';
+      } else if (e == 'u') {
+        if (pos + 4 > text.size()) return false;
+        // the helper only escapes control characters this way
+        *out += char(strtol(text.substr(pos, 4).c_str(), nullptr, 16));
+        pos += 4;
+      } else if (e == '"' || e == '\\' || e == '/') {
+        *out += e;
+      } else {
+        return false;
+      }
+    }
+    return expect('"');
+  }
+
+  bool readValue(JsonValue* value) {
+    skipSpace();
+    if (pos >= text.size()) return false;
+    char c = text[pos];
+    if (c == '{') {
+      ++pos;
+      value->type = JsonValue::Type::object;
+      if (expect('}')) return true;
+      do {
+        std::string key;
+        JsonValue member;
+        skipSpace();
+        if (!readString(&key) || !expect(':') || !readValue(&member))
+          return false;
+        value->members.emplace_back(std::move(key), std::move(member));
+      } while (expect(','));
+      return expect('}');
+    }
+    if (c == '[') {
+      ++pos;
+      value->type = JsonValue::Type::array;
+      if (expect(']')) return true;
+      do {
+        value->items.emplace_back();
+        if (!readValue(&value->items.back())) return false;
+      } while (expect(','));
+      return expect(']');
+    }
+    if (c == '"') {
+      value->type = JsonValue::Type::string;
+      return readString(&value->text);
+    }
+    if (literal("true")) {
+      value->type = JsonValue::Type::boolean;
+      value->boolean = true;
+      return true;
+    }
+    if (literal("false")) {
+      value->type = JsonValue::Type::boolean;
+      return true;
+    }
+    if (literal("null")) return true;
+
+    const char* begin = text.c_str() + pos;
+    char* end = nullptr;
+    value->type = JsonValue::Type::number;
+    value->number = strtod(begin, &end);
+    if (end == begin) return false;
+    pos += size_t(end - begin);
+    return true;
+  }
+
+ public:
+  explicit JsonReader(const std::string& text) : text(text) {}
+
+  // false when the text is not one JSON value
+  bool read(JsonValue* value) {
+    pos = 0;
+    *value = JsonValue{};
+    if (!readValue(value)) return false;
+    skipSpace();
+    return pos == text.size();
+  }
+};
@@ -0,0 +1,164 @@
+#include "MemoryRegistry.h"
+
+#include <algorithm>
+#include <set>
+#include <thread>
+
+#include "Check.h"
+#include "JsonReader.h"
+
+namespace {
+
+const size_t numCategories = size_t(MemoryCategory::count);
+
+void testCategories() {
+  // every category reports under a name of its own
+  std::set<std::string> names;
+  for (size_t c = 0; c < numCategories; ++c) {
+    std::string name = memoryCategoryName(MemoryCategory(c));
+    CHECK(!name.empty());
+    names.insert(name);
+  }
+  CHECK(names.size() == numCategories);
+  CHECK(std::string(memoryCategoryName(MemoryCategory::indirect)) ==
+        "indirect");
+  CHECK(std::string(memoryCategoryName(MemoryCategory::tileMask)) ==
+        "tile mask");
+}
+
+void testTotals() {
+  MemoryRegistry registry;
+  MemoryRegistry::Id vertices =
+      registry.add("vertices", "buffer", MemoryCategory::mesh, 1000, "a");
+  MemoryRegistry::Id commands =
+      registry.add("commands", "buffer", MemoryCategory::indirect, 300, "b");
+  MemoryRegistry::Id masks =
+      registry.add("masks", "buffer", MemoryCategory::tileMask, 200, "c");
+  MemoryRegistry::Id candidates = registry.add(
+      "candidates", "buffer", MemoryCategory::indirect, 100, "d");
+  CHECK(vertices != MemoryRegistry::invalid && vertices != commands);
+
+  MemoryRegistry::Totals totals = registry.getTotals();
+  CHECK(totals.live[size_t(MemoryCategory::mesh)] == 1000);
+  CHECK(totals.live[size_t(MemoryCategory::indirect)] == 400);
+  CHECK(totals.liveCount[size_t(MemoryCategory::indirect)] == 2);
+  CHECK(totals.live[size_t(MemoryCategory::tileMask)] == 200);
+  CHECK(totals.live[size_t(MemoryCategory::staging)] == 0);
+  CHECK(totals.liveTotal == 1600 && totals.peakTotal == 1600);
+
+  // peaks stay after a release
+  registry.release(commands);
+  registry.release(vertices);
+  totals = registry.getTotals();
+  CHECK(totals.live[size_t(MemoryCategory::indirect)] == 100);
+  CHECK(totals.peak[size_t(MemoryCategory::indirect)] == 400);
+  CHECK(totals.liveCount[size_t(MemoryCategory::mesh)] == 0);
+  CHECK(totals.liveTotal == 300 && totals.peakTotal == 1600);
+
+  MemoryRegistry::Record record;
+  CHECK(!registry.find(vertices, &record));
+  CHECK(registry.find(masks, &record));
+  CHECK(record.name == "masks" && record.category == MemoryCategory::tileMask);
+  CHECK(record.size == 200 && record.creator == "c");
+  (void)candidates;
+}
+
+void testFramesAndDiff() {
+  MemoryRegistry registry;
+  MemoryRegistry::Id kept =
+      registry.add("kept", "R8G8B8A8_UNORM", MemoryCategory::texture, 64, "");
+  MemoryRegistry::Id dropped =
+      registry.add("dropped", "buffer", MemoryCategory::staging, 32, "");
+  MemoryRegistry::Snapshot before = registry.snapshot();
+
+  registry.beginFrame();
+  registry.beginFrame();
+  CHECK(registry.getFrame() == 2);
+  registry.release(dropped);
+  MemoryRegistry::Id added =
+      registry.add("added", "buffer", MemoryCategory::tileMask, 16, "");
+  MemoryRegistry::Snapshot after = registry.snapshot();
+  CHECK(before.frame == 0 && after.frame == 2);
+
+  MemoryRegistry::Diff diff = MemoryRegistry::diff(before, after);
+  CHECK(diff.added.size() == 1 && diff.added[0].id == added);
+  CHECK(diff.added[0].createdFrame == 2);
+  CHECK(diff.removed.size() == 1 && diff.removed[0].id == dropped);
+  CHECK(diff.delta[size_t(MemoryCategory::tileMask)] == 16);
+  CHECK(diff.delta[size_t(MemoryCategory::staging)] == -32);
+  CHECK(diff.delta[size_t(MemoryCategory::texture)] == 0);
+  CHECK(diff.deltaTotal == -16);
+  CHECK(MemoryRegistry::diff(after, after).added.empty());
+  (void)kept;
+}
+
+void testReport() {
+  MemoryRegistry registry(2);
+  registry.add("small", "buffer", MemoryCategory::indirect, 10, "f:1");
+  registry.add("large \"quoted\"", "buffer", MemoryCategory::mesh, 99, "f:2");
+  for (int i = 0; i < 3; ++i) {
+    registry.beginFrame();
+    registry.release(registry.add("temp" + std::to_string(i), "buffer",
+                                  MemoryCategory::staging, 5, "f:3"));
+  }
+
+  JsonValue root;
+  CHECK(JsonReader(registry.reportJson()).read(&root));
+  CHECK(root.get("frame")->number == 3);
+  CHECK(root.get("liveTotal")->number == 109);
+  CHECK(root.get("peakTotal")->number == 114);
+
+  const JsonValue* categories = root.get("categories");
+  CHECK(categories && categories->members.size() == numCategories);
+  const JsonValue* indirect = categories->get("indirect");
+  CHECK(indirect && indirect->get("live")->number == 10 &&
+        indirect->get("count")->number == 1);
+  CHECK(categories->get("tile mask") != nullptr);
+  CHECK(categories->get("staging")->get("peak")->number == 5);
+
+  // live by size, the released ones only the last maxReleased
+  const JsonValue* live = root.get("live");
+  CHECK(live && live->items.size() == 2);
+  CHECK(live->items[0].get("name")->text == "large \"quoted\"");
+  CHECK(live->items[1].get("category")->text == "indirect");
+  CHECK(live->items[0].get("releasedFrame") == nullptr);
+  const JsonValue* released = root.get("released");
+  CHECK(released && released->items.size() == 2);
+  CHECK(released->items[0].get("name")->text == "temp1");
+  CHECK(released->items[1].get("createdFrame")->number == 3);
+  CHECK(released->items[1].get("releasedFrame")->number == 3);
+
+  // one line per category and the total
+  std::string text = registry.describe();
+  CHECK(size_t(std::count(text.begin(), text.end(), '\n')) ==
+        numCategories + 1);
+  CHECK(text.find("indirect") != std::string::npos);
+}
+
+void testThreads() {
+  MemoryRegistry registry;
+  std::vector<std::thread> threads;
+  for (int t = 0; t < 4; ++t) {
+    threads.emplace_back([&] {
+      for (int i = 0; i < 1000; ++i) {
+        registry.release(
+            registry.add("x", "buffer", MemoryCategory::mesh, 1, ""));
+      }
+    });
+  }
+  for (std::thread& thread : threads) thread.join();
+  MemoryRegistry::Totals totals = registry.getTotals();
+  CHECK(totals.liveTotal == 0);
+  CHECK(totals.peakTotal >= 1 && totals.peakTotal <= 4);
+}
+
+}  // namespace
+
+int main() {
+  testCategories();
+  testTotals();
+  testFramesAndDiff();
+  testReport();
+  testThreads();
+  return checkResult();
+}
@@ -0,0 +1,103 @@
+#include "NameHash.h"
+
+#include <algorithm>
+#include <any>
+#include <cstring>
+#include <map>
+#include <vector>
+
+#include "Bench.h"
+#include "Check.h"
+
+// Binding root parameters by name, as RootSignature::set did before names
+// were hashed at compile time and as it does now, without the device.
+
+static_assert(hashName("") == 2166136261u);
+static_assert(hashName("a") == 0xe40c292cu);
+static_assert(distinctHashes({"data", "diffuse", "position", "normal"}));
+static_assert(distinctHashes({"data", "data"}));
+
+namespace {
+
+// the constants of LightSpaceCompute, bound every frame per instance
+struct ConstantData {
+  float position[4];
+  float normal[4];
+  float cameraPos[3];
+  float intensity;
+  float boundsMin[4];
+  float boundsSize[4];
+};
+
+const char* const names[] = {"data", "diffuse", "position", "normal"};
+const int numBinds = 1000000;
+
+// a std::map of the names, looked up for each use, and the data through a
+// std::any that allocates for anything larger than a pointer
+struct MapSignature {
+  std::map<std::string_view, unsigned> indices;
+  std::vector<ConstantData> storage;
+
+  MapSignature() : storage(std::size(names)) {
+    for (unsigned i = 0; i < std::size(names); ++i)
+      indices.emplace(names[i], i);
+  }
+  void set(std::string_view name, const ConstantData& data) {
+    std::any anyData = data;
+    // the kind of the parameter, then the parameter
+    if (indices[name] < storage.size())
+      storage[indices[name]] = std::any_cast<ConstantData>(anyData);
+  }
+};
+
+// the hashes in parameter order and the data copied in place
+struct HashSignature {
+  std::vector<uint32_t> nameHashes;
+  std::vector<ConstantData> storage;
+
+  HashSignature() : storage(std::size(names)) {
+    for (const char* name : names) nameHashes.push_back(hashName(name));
+  }
+  unsigned find(StaticName name) const {
+    for (unsigned i = 0; i < nameHashes.size(); ++i)
+      if (nameHashes[i] == name.hash) return i;
+    return 0;
+  }
+  void set(StaticName name, const ConstantData& data) {
+    memcpy(&storage[find(name)], &data, sizeof(data));
+  }
+};
+
+}  // namespace
+
+int main() {
+  ConstantData data{};
+  MapSignature before;
+  HashSignature after;
+
+  double mapMs = bestMs(5, [&] {
+    for (int i = 0; i < numBinds; ++i) {
+      data.intensity = float(i);
+      before.set("normal", data);
+      keep(before.storage);
+    }
+  });
+  double hashMs = bestMs(5, [&] {
+    for (int i = 0; i < numBinds; ++i) {
+      data.intensity = float(i);
+      after.set("normal", data);
+      keep(after.storage);
+    }
+  });
+
+  // both bound the same parameter
+  CHECK(before.storage[3].intensity == after.storage[3].intensity);
+  CHECK(after.find("data") == 0 && after.find("normal") == 3);
+
+  printf("%d binds by name\n", numBinds);
+  printf("  std::map + std::any : %8.2f ms  %6.1f ns per bind\n", mapMs,
+         mapMs * 1e6 / numBinds);
+  printf("  StaticName          : %8.2f ms  %6.1f ns per bind\n", hashMs,
+         hashMs * 1e6 / numBinds);
+  return checkResult();
+}
@@ -0,0 +1,131 @@
+#include "OcclusionCuller.h"
+
+#include <algorithm>
+#include <cmath>
+#include <random>
+
+#include "Bench.h"
+#include "Check.h"
+
+// Occlusion culling of spheres in front of the camera at the resolution of
+// the renderer, each one the occluder of the others through its simplified
+// mesh : the time to add the occluders, to rasterize them alone and on a
+// pool of 3 threads, and to test the boxes.
+
+namespace {
+
+const uint32_t width = 256;
+const uint32_t height = 192;
+
+struct Instance {
+  float mvp[16];
+  float boxMin[3];
+  float boxMax[3];
+};
+
+std::vector<Instance> makeScene(int numInstances, const float viewProj[16]) {
+  std::mt19937 random(49);
+  std::uniform_real_distribution<float> unit(-1.0f, 1.0f);
+  std::vector<Instance> instances(numInstances);
+  for (Instance& inst : instances) {
+    float x = unit(random) * 20.0f;
+    float y = unit(random) * 15.0f;
+    float z = 30.0f + unit(random) * 25.0f;
+    float scale = 1.0f + 0.5f * unit(random);
+    const float model[16] = {scale, 0, 0, 0, 0, scale, 0, 0,
+                             0, 0, scale, 0, x, y, z, 1};
+    for (int i = 0; i < 4; ++i) {
+      for (int j = 0; j < 4; ++j) {
+        inst.mvp[i * 4 + j] = 0.0f;
+        for (int k = 0; k < 4; ++k)
+          inst.mvp[i * 4 + j] += model[i * 4 + k] * viewProj[k * 4 + j];
+      }
+    }
+    const float center[3] = {x, y, z};
+    for (int j = 0; j < 3; ++j) {
+      inst.boxMin[j] = center[j] - scale;
+      inst.boxMax[j] = center[j] + scale;
+    }
+  }
+  return instances;
+}
+
+}  // namespace
+
+int main() {
+  float f = 1.0f / std::tan(0.5f);
+  float q = 100.0f / (100.0f - 0.1f);
+  const float viewProj[16] = {f * 0.75f, 0, 0, 0, 0, f, 0, 0,
+                              0, 0, q, 1, 0, 0, -0.1f * q, 0};
+
+  // a unit sphere of 24 x 24 quads, simplified on a grid of 8 cells a side
+  const int segments = 24;
+  std::vector<float> vertices;
+  std::vector<uint32_t> indices;
+  for (int i = 0; i <= segments; ++i) {
+    for (int j = 0; j <= segments; ++j) {
+      float theta = 3.14159265f * i / segments;
+      float phi = 6.28318531f * j / segments;
+      vertices.insert(vertices.end(),
+                      {std::sin(theta) * std::cos(phi), std::cos(theta),
+                       std::sin(theta) * std::sin(phi)});
+    }
+  }
+  for (int i = 0; i < segments; ++i) {
+    for (int j = 0; j < segments; ++j) {
+      uint32_t a = uint32_t(i * (segments + 1) + j);
+      uint32_t b = a + uint32_t(segments) + 1;
+      indices.insert(indices.end(), {a, b, a + 1, a + 1, b, b + 1});
+    }
+  }
+  OccluderMesh occluder =
+      simplifyOccluder(vertices.data(), 3, indices.data(), indices.size(), 8);
+  printf("occluder : %zu triangles of %zu\n", occluder.indices.size() / 3,
+         indices.size() / 3);
+
+  OcclusionCuller culler(width, height);
+  TaskPool pool(3);
+  printf("  instances  add ms   raster ms  pool ms  test ms  culled\n");
+  for (int numInstances : {500, 2000, 8000}) {
+    std::vector<Instance> instances = makeScene(numInstances, viewProj);
+    auto addAll = [&] {
+      culler.clear();
+      for (const Instance& inst : instances) {
+        culler.addOccluder(occluder.positions.data(), 3,
+                           occluder.indices.data(), occluder.indices.size(),
+                           inst.mvp);
+      }
+    };
+    // the occluders are added again before each rasterize(), untimed
+    auto rasterizeMs = [&](TaskPool* taskPool) {
+      double best = 1e30;
+      for (int run = 0; run < 5; ++run) {
+        addAll();
+        best = std::min(best, bestMs(1, [&] { culler.rasterize(taskPool); }));
+      }
+      return best;
+    };
+    double addMs = bestMs(5, addAll);
+    double rasterMs = rasterizeMs(nullptr);
+    std::vector<float> serial(size_t(width) * height);
+    for (uint32_t y = 0; y < height; ++y)
+      for (uint32_t x = 0; x < width; ++x)
+        serial[y * width + x] = culler.getDepth(x, y);
+    double poolMs = rasterizeMs(&pool);
+    bool same = true;
+    for (uint32_t y = 0; y < height; ++y)
+      for (uint32_t x = 0; x < width; ++x)
+        same &= serial[y * width + x] == culler.getDepth(x, y);
+    CHECK(same);
+
+    uint32_t culled = 0;
+    double testMs = bestMs(5, [&] {
+      culled = 0;
+      for (const Instance& inst : instances)
+        culled += !culler.testBox(inst.boxMin, inst.boxMax, viewProj);
+    });
+    printf("  %-9d  %-7.3f  %-9.3f  %-7.3f  %-7.3f  %u\n", numInstances,
+           addMs, rasterMs, poolMs, testMs, culled);
+  }
+  return checkResult();
+}
@@ -0,0 +1,440 @@
+#include "OcclusionCuller.h"
+
+#include <algorithm>
+#include <array>
+#include <cmath>
+#include <random>
+
+#include "Check.h"
+
+namespace {
+
+const uint32_t width = 256;
+const uint32_t height = 192;
+
+// a perspective projection for row vectors, depth in [0, 1]
+void perspective(float fovy, float aspect, float zNear, float zFar,
+                 float m[16]) {
+  float f = 1.0f / std::tan(fovy / 2);
+  float q = zFar / (zFar - zNear);
+  const float proj[16] = {f / aspect, 0, 0, 0, 0, f, 0, 0,
+                          0, 0, q, 1, 0, 0, -zNear * q, 0};
+  std::copy(proj, proj + 16, m);
+}
+
+// scaled by scale, moved to (x, y, z), then projected
+void placed(const float viewProj[16], float x, float y, float z, float scale,
+            float m[16]) {
+  const float model[16] = {scale, 0, 0, 0, 0, scale, 0, 0,
+                           0, 0, scale, 0, x, y, z, 1};
+  for (int i = 0; i < 4; ++i) {
+    for (int j = 0; j < 4; ++j) {
+      m[i * 4 + j] = 0.0f;
+      for (int k = 0; k < 4; ++k)
+        m[i * 4 + j] += model[i * 4 + k] * viewProj[k * 4 + j];
+    }
+  }
+}
+
+// a unit sphere of latitude and longitude rings, position and texcoord
+void unitSphere(int segments, std::vector<float>* vertices,
+                std::vector<uint32_t>* indices) {
+  for (int i = 0; i <= segments; ++i) {
+    for (int j = 0; j <= segments; ++j) {
+      float theta = 3.14159265f * i / segments;
+      float phi = 6.28318531f * j / segments;
+      vertices->insert(vertices->end(),
+                       {std::sin(theta) * std::cos(phi), std::cos(theta),
+                        std::sin(theta) * std::sin(phi), 0.0f, 0.0f});
+    }
+  }
+  for (int i = 0; i < segments; ++i) {
+    for (int j = 0; j < segments; ++j) {
+      uint32_t a = uint32_t(i * (segments + 1) + j);
+      uint32_t b = a + uint32_t(segments) + 1;
+      indices->insert(indices->end(), {a, b, a + 1, a + 1, b, b + 1});
+    }
+  }
+}
+
+// The depth buffer the culler has to produce, a pixel and a triangle at a
+// time in double : the pixel centers inside a triangle that is in front of
+// the near plane take its nearest z / w. The centers closer than a
+// thousandth of a pixel to an edge may go either way, so each pixel gets
+// the depth without them and the nearest with them.
+struct ReferenceDepth {
+  std::vector<double> depth = std::vector<double>(width * height, 1.0);
+  std::vector<double> nearestDepth = std::vector<double>(width * height, 1.0);
+
+  void add(const std::vector<float>& positions,
+           const std::vector<uint32_t>& indices, const float mvp[16]) {
+    for (size_t t = 0; t < indices.size(); t += 3) {
+      double x[3], y[3], z[3];
+      bool nearClipped = false;
+      for (int v = 0; v < 3; ++v) {
+        const float* p = &positions[indices[t + v] * 3];
+        double clip[4];
+        for (int j = 0; j < 4; ++j) {
+          clip[j] = double(p[0]) * mvp[j] + double(p[1]) * mvp[4 + j] +
+                    double(p[2]) * mvp[8 + j] + mvp[12 + j];
+        }
+        nearClipped |= clip[2] < 0.0 || clip[3] <= 0.0;
+        x[v] = (clip[0] / clip[3] * 0.5 + 0.5) * width;
+        y[v] = (0.5 - clip[1] / clip[3] * 0.5) * height;
+        z[v] = clip[2] / clip[3];
+      }
+      if (nearClipped) continue;
+      double area =
+          (x[1] - x[0]) * (y[2] - y[0]) - (x[2] - x[0]) * (y[1] - y[0]);
+      if (std::fabs(area) < 1e-6) continue;
+
+      int x0 = std::max(int(std::floor(std::min({x[0], x[1], x[2]}))), 0);
+      int x1 = std::min(int(std::ceil(std::max({x[0], x[1], x[2]}))),
+                        int(width) - 1);
+      int y0 = std::max(int(std::floor(std::min({y[0], y[1], y[2]}))), 0);
+      int y1 = std::min(int(std::ceil(std::max({y[0], y[1], y[2]}))),
+                        int(height) - 1);
+      for (int py = y0; py <= y1; ++py) {
+        for (int px = x0; px <= x1; ++px) {
+          double cx = px + 0.5, cy = py + 0.5;
+          // barycentrics, and the distance in pixels to the nearest edge
+          double w[3];
+          double distance = 1e30;
+          for (int e = 0; e < 3; ++e) {
+            int a = (e + 1) % 3, b = (e + 2) % 3;
+            double edge =
+                (x[b] - x[a]) * (cy - y[a]) - (y[b] - y[a]) * (cx - x[a]);
+            double length = std::hypot(x[b] - x[a], y[b] - y[a]);
+            w[e] = edge / area;
+            distance = std::min(distance, std::fabs(edge) / length);
+          }
+          bool inside = w[0] >= 0.0 && w[1] >= 0.0 && w[2] >= 0.0;
+          if (!inside && distance >= 1e-3) continue;
+          size_t pixel = size_t(py) * width + px;
+          double at = w[0] * z[0] + w[1] * z[1] + w[2] * z[2];
+          nearestDepth[pixel] = std::min(nearestDepth[pixel], at);
+          if (distance >= 1e-3) depth[pixel] = std::min(depth[pixel], at);
+        }
+      }
+    }
+  }
+
+  // every pixel the screen rectangle of the box touches is nearer than it,
+  // as far as the culler may tell
+  bool hides(const float boxMin[3], const float boxMax[3],
+             const float viewProj[16]) const {
+    double minX = 1e30, minY = 1e30, maxX = -1e30, maxY = -1e30;
+    double nearest = 1e30;
+    for (int i = 0; i < 8; ++i) {
+      double corner[3] = {(i & 1) ? boxMax[0] : boxMin[0],
+                          (i & 2) ? boxMax[1] : boxMin[1],
+                          (i & 4) ? boxMax[2] : boxMin[2]};
+      double clip[4];
+      for (int j = 0; j < 4; ++j) {
+        clip[j] = corner[0] * viewProj[j] + corner[1] * viewProj[4 + j] +
+                  corner[2] * viewProj[8 + j] + viewProj[12 + j];
+      }
+      if (clip[2] < 0.0 || clip[3] <= 0.0) return false;
+      double x = (clip[0] / clip[3] * 0.5 + 0.5) * width;
+      double y = (0.5 - clip[1] / clip[3] * 0.5) * height;
+      minX = std::min(minX, x);
+      maxX = std::max(maxX, x);
+      minY = std::min(minY, y);
+      maxY = std::max(maxY, y);
+      nearest = std::min(nearest, clip[2] / clip[3]);
+    }
+    if (maxX < 0.0 || maxY < 0.0 || minX >= width || minY >= height)
+      return false;
+    int x0 = std::max(int(minX), 0);
+    int x1 = std::min(int(maxX), int(width) - 1);
+    int y0 = std::max(int(minY), 0);
+    int y1 = std::min(int(maxY), int(height) - 1);
+    for (int y = y0; y <= y1; ++y) {
+      for (int x = x0; x <= x1; ++x) {
+        size_t pixel = size_t(y) * width + x;
+        // with the benefit of the doubt on the edges
+        if (nearest <= nearestDepth[pixel] + 1e-5) return false;
+      }
+    }
+    return true;
+  }
+};
+
+void testWall() {
+  float viewProj[16];
+  perspective(1.0f, 4.0f / 3.0f, 0.1f, 100.0f, viewProj);
+  // a wall at z = 10 over x and y in [-3, 3]
+  const float wall[] = {-3, -3, 10, 3, -3, 10, 3, 3, 10, -3, 3, 10};
+  const uint32_t front[] = {0, 1, 2, 0, 2, 3};
+  const uint32_t back[] = {0, 2, 1, 0, 3, 2};
+  OcclusionCuller culler(width, height);
+  culler.addOccluder(wall, 3, front, 6, viewProj);
+  culler.rasterize();
+
+  auto visible = [&](float x, float y, float z, float half) {
+    const float boxMin[3] = {x - half, y - half, z - half};
+    const float boxMax[3] = {x + half, y + half, z + half};
+    return culler.testBox(boxMin, boxMax, viewProj);
+  };
+  CHECK(!visible(0, 0, 20, 1));        // behind
+  CHECK(!visible(0, 0, 10.5f, 0.4f));  // just behind
+  CHECK(visible(0, 0, 5, 1));          // in front
+  CHECK(visible(0, 0, 10, 1));         // through it
+  CHECK(visible(10, 0, 20, 1));        // beside
+  CHECK(visible(5.5f, 0, 20, 0.5f));   // past its edge
+  CHECK(visible(0, 0, -5, 1));         // behind the camera
+  CHECK(visible(0, 0, 0.05f, 0.1f));   // across the near plane
+  CHECK(culler.getStats().testedBoxes == 8);
+  CHECK(culler.getStats().occludedBoxes == 2);
+
+  // either winding
+  OcclusionCuller reversed(width, height);
+  reversed.addOccluder(wall, 3, back, 6, viewProj);
+  reversed.rasterize();
+  bool same = true;
+  for (uint32_t y = 0; y < height; ++y)
+    for (uint32_t x = 0; x < width; ++x)
+      same &= reversed.getDepth(x, y) == culler.getDepth(x, y);
+  CHECK(same);
+
+  // a triangle across the near plane is not drawn
+  const float across[] = {-3, -3, -1, 3, -3, 5, 0, 3, 5};
+  const uint32_t one[] = {0, 1, 2};
+  OcclusionCuller clipped(64, 48);
+  clipped.addOccluder(across, 3, one, 3, viewProj);
+  clipped.rasterize();
+  CHECK(clipped.getStats().occluderTriangles == 1);
+  CHECK(clipped.getStats().rasterizedTriangles == 0);
+}
+
+void testSimplify() {
+  std::vector<float> vertices;
+  std::vector<uint32_t> indices;
+  unitSphere(24, &vertices, &indices);
+  OccluderMesh occluder =
+      simplifyOccluder(vertices.data(), 5, indices.data(), indices.size(), 6);
+  CHECK(occluder.indices.size() > 0);
+  CHECK(occluder.indices.size() < indices.size() / 4);
+  // the cells lie inside, so a sphere never hides its own bounds
+  for (size_t i = 0; i < occluder.positions.size(); i += 3) {
+    float r = std::sqrt(occluder.positions[i] * occluder.positions[i] +
+                        occluder.positions[i + 1] * occluder.positions[i + 1] +
+                        occluder.positions[i + 2] * occluder.positions[i + 2]);
+    CHECK(r <= 1.0001f);
+  }
+  for (size_t i = 0; i < occluder.indices.size(); i += 3) {
+    CHECK(occluder.indices[i] != occluder.indices[i + 1]);
+    CHECK(occluder.indices[i + 1] != occluder.indices[i + 2]);
+    CHECK(occluder.indices[i] != occluder.indices[i + 2]);
+  }
+}
+
+// a torus around y, position only
+void torus(float major, float minor, int rings, int sides,
+           std::vector<float>* vertices, std::vector<uint32_t>* indices) {
+  for (int i = 0; i < rings; ++i) {
+    for (int j = 0; j < sides; ++j) {
+      float phi = 6.28318531f * i / rings;
+      float theta = 6.28318531f * j / sides;
+      float r = major + minor * std::cos(theta);
+      vertices->insert(vertices->end(), {r * std::cos(phi),
+                                         minor * std::sin(theta),
+                                         r * std::sin(phi)});
+    }
+  }
+  for (int i = 0; i < rings; ++i) {
+    for (int j = 0; j < sides; ++j) {
+      uint32_t a = uint32_t(i * sides + j);
+      uint32_t b = uint32_t((i + 1) % rings * sides + j);
+      uint32_t a1 = uint32_t(i * sides + (j + 1) % sides);
+      uint32_t b1 = uint32_t((i + 1) % rings * sides + (j + 1) % sides);
+      indices->insert(indices->end(), {a, b, a1, a1, b, b1});
+    }
+  }
+}
+
+// the nearest hit of the ray from o along d with the mesh, as a multiple of
+// d; infinity if none
+double nearestHit(const std::vector<float>& positions,
+                  const std::vector<uint32_t>& indices, const double o[3],
+                  const double d[3]) {
+  auto sub = [](const double* a, const double* b, double* out) {
+    for (int j = 0; j < 3; ++j) out[j] = a[j] - b[j];
+  };
+  auto cross = [](const double* a, const double* b, double* out) {
+    out[0] = a[1] * b[2] - a[2] * b[1];
+    out[1] = a[2] * b[0] - a[0] * b[2];
+    out[2] = a[0] * b[1] - a[1] * b[0];
+  };
+  auto dot = [](const double* a, const double* b) {
+    return a[0] * b[0] + a[1] * b[1] + a[2] * b[2];
+  };
+  double nearest = HUGE_VAL;
+  for (size_t i = 0; i < indices.size(); i += 3) {
+    double p[3][3];
+    for (int v = 0; v < 3; ++v)
+      for (int j = 0; j < 3; ++j) p[v][j] = positions[indices[i + v] * 3 + j];
+    double e1[3], e2[3], h[3], s[3], q[3];
+    sub(p[1], p[0], e1);
+    sub(p[2], p[0], e2);
+    cross(d, e2, h);
+    double det = dot(e1, h);
+    if (det == 0.0) continue;
+    sub(o, p[0], s);
+    double u = dot(s, h) / det;
+    cross(s, e1, q);
+    double v = dot(d, q) / det;
+    if (u < 0.0 || v < 0.0 || u + v > 1.0) continue;
+    double t = dot(e2, q) / det;
+    if (t > 0.0) nearest = std::min(nearest, t);
+  }
+  return nearest;
+}
+
+// the occluder of a concave mesh lies behind its surface seen from anywhere :
+// from cameras around a torus and in its hole, the ray to every vertex,
+// edge middle and triangle center of the occluder meets the torus first
+void testConcave() {
+  std::vector<float> vertices;
+  std::vector<uint32_t> indices;
+  torus(1.0f, 0.45f, 48, 24, &vertices, &indices);
+  for (uint32_t gridCells : {8u, 16u}) {
+    OccluderMesh occluder = simplifyOccluder(
+        vertices.data(), 3, indices.data(), indices.size(), gridCells);
+    CHECK(occluder.indices.size() > 0);
+
+    std::vector<std::array<double, 3>> points;
+    const std::vector<float>& p = occluder.positions;
+    for (size_t t = 0; t < occluder.indices.size(); t += 3) {
+      const float* v[3];
+      for (int i = 0; i < 3; ++i) v[i] = &p[occluder.indices[t + i] * 3];
+      for (int i = 0; i < 3; ++i) {
+        const float* a = v[i];
+        const float* b = v[(i + 1) % 3];
+        points.push_back({a[0], a[1], a[2]});
+        points.push_back({(a[0] + b[0]) / 2.0, (a[1] + b[1]) / 2.0,
+                          (a[2] + b[2]) / 2.0});
+      }
+      points.push_back({(v[0][0] + v[1][0] + v[2][0]) / 3.0,
+                        (v[0][1] + v[1][1] + v[2][1]) / 3.0,
+                        (v[0][2] + v[1][2] + v[2][2]) / 3.0});
+    }
+    const double cameras[][3] = {{0, 0, 0},    {0, 0.3, 0},   {0.2, 0, 0.1},
+                                 {5, 0, 0},    {0, 5, 0},     {0, -4, 1},
+                                 {3, 3, 3},    {-4, 1, -2},   {0.5, 2, 0.5}};
+    uint32_t inFront = 0;
+    for (const double* camera : cameras) {
+      for (const std::array<double, 3>& point : points) {
+        const double d[3] = {point[0] - camera[0], point[1] - camera[1],
+                             point[2] - camera[2]};
+        inFront += nearestHit(vertices, indices, camera, d) > 1.0;
+      }
+    }
+    CHECK(inFront == 0);
+  }
+
+  // an open mesh closes nothing
+  const float quad[] = {-1, -1, 0, 1, -1, 0, 1, 1, 0, -1, 1, 0};
+  const uint32_t two[] = {0, 1, 2, 0, 2, 3};
+  CHECK(simplifyOccluder(quad, 3, two, 6, 8).indices.empty());
+}
+
+// random spheres through their simplified occluders, against the reference
+void testAgainstReference() {
+  float viewProj[16];
+  perspective(1.0f, 4.0f / 3.0f, 0.1f, 100.0f, viewProj);
+  std::vector<float> vertices;
+  std::vector<uint32_t> indices;
+  unitSphere(24, &vertices, &indices);
+  // fine enough that the cells inside cover whole tiles of the far spheres
+  OccluderMesh occluder =
+      simplifyOccluder(vertices.data(), 5, indices.data(), indices.size(), 12);
+
+  std::mt19937 random(49);
+  std::uniform_real_distribution<float> unit(-1.0f, 1.0f);
+  const int numInstances = 400;
+  struct Instance {
+    float x, y, z, scale;
+  };
+  std::vector<Instance> instances(numInstances);
+  for (Instance& inst : instances) {
+    inst = {unit(random) * 20.0f, unit(random) * 15.0f,
+            30.0f + unit(random) * 25.0f, 1.0f + 0.5f * unit(random)};
+  }
+
+  OcclusionCuller culler(width, height);
+  OcclusionCuller serial(width, height);
+  ReferenceDepth reference;
+  TaskPool pool(3);
+  for (const Instance& inst : instances) {
+    float mvp[16];
+    placed(viewProj, inst.x, inst.y, inst.z, inst.scale, mvp);
+    culler.addOccluder(occluder.positions.data(), 3, occluder.indices.data(),
+                       occluder.indices.size(), mvp);
+    serial.addOccluder(occluder.positions.data(), 3, occluder.indices.data(),
+                       occluder.indices.size(), mvp);
+    reference.add(occluder.positions, occluder.indices, mvp);
+  }
+  culler.rasterize(&pool);
+  serial.rasterize();
+
+  // the depth of every pixel, the bands the same in parallel
+  uint32_t wrong = 0, sameAsSerial = 0, drawn = 0;
+  for (uint32_t y = 0; y < height; ++y) {
+    for (uint32_t x = 0; x < width; ++x) {
+      size_t pixel = size_t(y) * width + x;
+      float depth = culler.getDepth(x, y);
+      sameAsSerial += depth == serial.getDepth(x, y);
+      drawn += depth < 1.0f;
+      if (depth > reference.depth[pixel] + 1e-5 ||
+          depth < reference.nearestDepth[pixel] - 1e-5)
+        ++wrong;
+    }
+  }
+  CHECK(wrong == 0);
+  CHECK(sameAsSerial == width * height);
+  CHECK(drawn > width * height / 4 && drawn < width * height);
+
+  // the tiles keep the farthest of their pixels
+  const uint32_t tile = OcclusionCuller::tileSize;
+  bool tilesMatch = true;
+  for (uint32_t ty = 0; ty < height / tile; ++ty) {
+    for (uint32_t tx = 0; tx < width / tile; ++tx) {
+      float farthest = 0.0f;
+      for (uint32_t y = ty * tile; y < (ty + 1) * tile; ++y)
+        for (uint32_t x = tx * tile; x < (tx + 1) * tile; ++x)
+          farthest = std::max(farthest, culler.getDepth(x, y));
+      tilesMatch &= culler.getTileMax(tx, ty) == farthest;
+    }
+  }
+  CHECK(tilesMatch);
+
+  // every box culled is hidden by the reference; the reference goes by
+  // pixels and the culler by tiles, a tile with a pixel of the background
+  // hides nothing, so it culls only part of them
+  uint32_t hidden = 0, culled = 0;
+  for (const Instance& inst : instances) {
+    const float boxMin[3] = {inst.x - inst.scale, inst.y - inst.scale,
+                             inst.z - inst.scale};
+    const float boxMax[3] = {inst.x + inst.scale, inst.y + inst.scale,
+                             inst.z + inst.scale};
+    bool hides = reference.hides(boxMin, boxMax, viewProj);
+    bool visible = culler.testBox(boxMin, boxMax, viewProj);
+    if (!visible) CHECK(hides);
+    hidden += hides;
+    culled += !visible;
+  }
+  CHECK(hidden > 0);
+
+  CHECK(culled * 4 >= hidden);
+}
+
+}  // namespace
+
+int main() {
+  testWall();
+  testSimplify();
+  testConcave();
+  testAgainstReference();
+  return checkResult();
+}
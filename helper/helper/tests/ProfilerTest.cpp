@@ -0,0 +1,140 @@
+#include "Profiler.h"
+
+#include <thread>
+
+#include "Check.h"
+#include "JsonReader.h"
+
+namespace {
+
+void testStats() {
+  Profiler profiler(100, 1000);
+  uint32_t track = profiler.getThreadTrack();
+  for (int i = 1; i <= 100; ++i) profiler.record("a", i * 10.0, i * 1000.0);
+  ScopeStats stats = profiler.getStats(track, "a");
+  CHECK(stats.count == 100);
+  CHECK(stats.p50 == 50.0 && stats.p99 == 99.0);
+  CHECK(stats.mean == 50.5 && stats.last == 100.0);
+
+  // the window keeps the last 100 samples
+  for (int i = 0; i < 50; ++i) profiler.record("a", 0.0, 200000.0);
+  stats = profiler.getStats(track, "a");
+  CHECK(stats.count == 100);
+  CHECK(stats.p50 == 100.0 && stats.p99 == 200.0);
+  CHECK(profiler.getStats(track, "b").count == 0);
+  CHECK(profiler.getEvents().size() == 150);
+
+  // and the trace the last maxEvents
+  Profiler small(4, 3);
+  for (int i = 0; i < 5; ++i) small.record(std::to_string(i), i, 1.0);
+  std::vector<Profiler::Event> events = small.getEvents();
+  CHECK(events.size() == 3 && events[0].name == "2" && events[2].name == "4");
+}
+
+void testNesting() {
+  Profiler profiler;
+  {
+    CpuScope outer(&profiler, "outer");
+    { CpuScope inner(&profiler, "inner"); }
+    { CpuScope second(&profiler, "second"); }
+  }
+  std::thread worker([&] { CpuScope scope(&profiler, "worker"); });
+  worker.join();
+  CpuScope none(nullptr, "nothing");
+
+  // inner scopes end first
+  std::vector<Profiler::Event> events = profiler.getEvents();
+  CHECK(events.size() == 4);
+  if (events.size() != 4) return;
+  const Profiler::Event& inner = events[0];
+  const Profiler::Event& second = events[1];
+  const Profiler::Event& outer = events[2];
+  CHECK(inner.name == "inner" && second.name == "second");
+  CHECK(outer.name == "outer" && events[3].name == "worker");
+  CHECK(inner.track == outer.track && second.track == outer.track);
+  CHECK(events[3].track != outer.track);
+  for (const Profiler::Event* child : {&inner, &second}) {
+    CHECK(child->start >= outer.start);
+    CHECK(child->start + child->duration <= outer.start + outer.duration);
+  }
+  CHECK(second.start >= inner.start + inner.duration);
+  CHECK(profiler.getTrackName(outer.track) == "main");
+  CHECK(profiler.getTrackName(events[3].track) == "thread 2");
+}
+
+void testChromeTrace() {
+  Profiler profiler;
+  uint32_t cpu = profiler.getThreadTrack();
+  uint32_t gpu = profiler.addTrack("gpu \"direct\"");
+  profiler.record(cpu, "frame", 100.0, 50.0);
+  profiler.record(cpu, "update", 110.0, 10.0);
+  profiler.record(gpu, "pass\n\"1\"\\\x01", 120.0, 20.5);
+
+  // the reader is strict : trailing commas, raw control characters
+  JsonValue root;
+  CHECK(!JsonReader("{\"a\":[1,]}").read(&root));
+  CHECK(!JsonReader("[\"\n\"]").read(&root));
+  CHECK(!JsonReader("{} {}").read(&root));
+
+  CHECK(JsonReader(profiler.exportChromeTrace()).read(&root));
+  CHECK(root.type == JsonValue::Type::object);
+  const JsonValue* unit = root.get("displayTimeUnit");
+  CHECK(unit && unit->text == "ms");
+  const JsonValue* trace = root.get("traceEvents");
+  CHECK(trace && trace->type == JsonValue::Type::array);
+  if (!trace || trace->items.size() != 5) {
+    CHECK(false);
+    return;
+  }
+
+  // the tracks as thread names first, then the scopes as complete events
+  const char* trackNames[] = {"main", "gpu \"direct\""};
+  for (uint32_t track = 0; track < 2; ++track) {
+    const JsonValue& meta = trace->items[track];
+    CHECK(meta.get("ph")->text == "M");
+    CHECK(meta.get("name")->text == "thread_name");
+    CHECK(meta.get("tid")->number == track);
+    CHECK(meta.get("args")->get("name")->text == trackNames[track]);
+  }
+  struct Expected {
+    const char* name;
+    uint32_t track;
+    double ts;
+    double dur;
+  };
+  const Expected expected[] = {{"frame", cpu, 100.0, 50.0},
+                               {"update", cpu, 110.0, 10.0},
+                               {"pass\n\"1\"\\\x01", gpu, 120.0, 20.5}};
+  for (int i = 0; i < 3; ++i) {
+    const JsonValue& event = trace->items[2 + i];
+    CHECK(event.get("ph")->text == "X");
+    CHECK(event.get("name")->text == expected[i].name);
+    CHECK(event.get("pid")->number == 1);
+    CHECK(event.get("tid")->number == expected[i].track);
+    CHECK(event.get("ts")->number == expected[i].ts);
+    CHECK(event.get("dur")->number == expected[i].dur);
+  }
+  // update is inside frame on the same tid, which is what nests it
+  const JsonValue& frame = trace->items[2];
+  const JsonValue& update = trace->items[3];
+  CHECK(update.get("ts")->number >= frame.get("ts")->number);
+  CHECK(update.get("ts")->number + update.get("dur")->number <=
+        frame.get("ts")->number + frame.get("dur")->number);
+
+  // an empty profiler still writes a valid trace
+  profiler.clear();
+  CHECK(JsonReader(profiler.exportChromeTrace()).read(&root));
+  CHECK(root.get("traceEvents")->items.size() == 2);
+  Profiler empty;
+  CHECK(JsonReader(empty.exportChromeTrace()).read(&root));
+  CHECK(root.get("traceEvents")->items.empty());
+}
+
+}  // namespace
+
+int main() {
+  testStats();
+  testNesting();
+  testChromeTrace();
+  return checkResult();
+}
@@ -0,0 +1,425 @@
+#include "RenderGraph.h"
+
+#include "AliasingPlanner.h"
+#include "Check.h"
+
+namespace {
+
+using Usage = ResourceUsage;
+
+uint32_t position(const RenderGraph& graph, RenderGraph::PassId pass) {
+  const std::vector<RenderGraph::PassId>& order = graph.getOrder();
+  for (uint32_t pos = 0; pos < order.size(); ++pos)
+    if (order[pos] == pass) return pos;
+  return RenderGraph::invalid;
+}
+
+void testCulling() {
+  RenderGraph graph;
+  auto back = graph.importResource("back", Usage::present, Usage::present);
+  auto used = graph.createTransient("used");
+  auto unused = graph.createTransient("unused");
+  auto dead = graph.createTransient("dead");
+
+  auto produce = graph.addPass("produce");
+  graph.write(produce, used);
+  auto orphan = graph.addPass("orphan");
+  graph.write(orphan, unused);
+  // reads something but only writes what nobody reads
+  auto chain = graph.addPass("chain");
+  graph.read(chain, unused);
+  graph.write(chain, dead);
+  auto query = graph.addPass("query", true);
+  graph.read(query, used);
+  auto draw = graph.addPass("draw");
+  graph.read(draw, used);
+  graph.write(draw, back);
+
+  CHECK(graph.compile());
+  CHECK(!graph.isCulled(produce));
+  CHECK(graph.isCulled(orphan));
+  CHECK(graph.isCulled(chain));
+  CHECK(!graph.isCulled(query));
+  CHECK(!graph.isCulled(draw));
+  CHECK(graph.getOrder().size() == 3);
+  CHECK(graph.getFirstUse(unused) == RenderGraph::invalid);
+  CHECK(graph.getFirstUse(dead) == RenderGraph::invalid);
+}
+
+void testOrdering() {
+  // declared out of order : the readers come before the writers
+  RenderGraph graph;
+  auto back = graph.importResource("back", Usage::present, Usage::present);
+  auto light = graph.createTransient("light");
+  auto gbuffer = graph.createTransient("gbuffer");
+
+  auto draw = graph.addPass("draw");
+  graph.read(draw, light);
+  graph.write(draw, back);
+  auto shade = graph.addPass("shade");
+  graph.read(shade, gbuffer);
+  graph.write(shade, light, Usage::unorderedAccess);
+  auto fill = graph.addPass("fill");
+  graph.write(fill, gbuffer);
+
+  CHECK(graph.compile());
+  CHECK(graph.getOrder().size() == 3);
+  CHECK(position(graph, fill) == 0);
+  CHECK(position(graph, shade) == 1);
+  CHECK(position(graph, draw) == 2);
+
+  // a graph declared in order keeps it, even where passes are independent
+  graph.clear();
+  back = graph.importResource("back", Usage::present, Usage::present);
+  auto a = graph.createTransient("a");
+  auto b = graph.createTransient("b");
+  auto writeB = graph.addPass("writeB");
+  graph.write(writeB, b);
+  auto writeA = graph.addPass("writeA");
+  graph.write(writeA, a);
+  auto merge = graph.addPass("merge");
+  graph.read(merge, a);
+  graph.read(merge, b);
+  graph.write(merge, back);
+  CHECK(graph.compile());
+  CHECK(position(graph, writeB) == 0);
+  CHECK(position(graph, writeA) == 1);
+  CHECK(position(graph, merge) == 2);
+
+  // write after read : the second write waits for the readers of the first
+  graph.clear();
+  back = graph.importResource("back", Usage::present, Usage::present);
+  auto depth = graph.importResource("depth", Usage::depthWrite);
+  auto first = graph.addPass("first");
+  graph.write(first, depth, Usage::depthWrite);
+  graph.write(first, back);
+  auto test = graph.addPass("test");
+  graph.read(test, depth, Usage::depthRead);
+  graph.write(test, back);
+  auto second = graph.addPass("second");
+  graph.write(second, depth, Usage::depthWrite);
+  graph.write(second, back);
+  CHECK(graph.compile());
+  CHECK(position(graph, first) < position(graph, test));
+  CHECK(position(graph, test) < position(graph, second));
+}
+
+void testErrors() {
+  RenderGraph graph;
+  auto back = graph.importResource("back", Usage::present, Usage::present);
+  auto never = graph.createTransient("never");
+  auto pass = graph.addPass("pass");
+  graph.read(pass, never);
+  graph.write(pass, back);
+  CHECK(!graph.compile());
+  CHECK(graph.getError() == "pass pass reads never that no pass writes\n");
+
+  // each reads what the other writes after it
+  graph.clear();
+  back = graph.importResource("back", Usage::present, Usage::present);
+  auto x = graph.createTransient("x");
+  auto y = graph.createTransient("y");
+  auto a = graph.addPass("a");
+  graph.read(a, x);
+  graph.write(a, y);
+  auto b = graph.addPass("b");
+  graph.read(b, y);
+  graph.write(b, x);
+  graph.write(b, back);
+  CHECK(!graph.compile());
+  CHECK(graph.getError() == "cycle : a -> b -> a\n" ||
+        graph.getError() == "cycle : b -> a -> b\n");
+
+  // imported resources hold something before the first pass
+  graph.clear();
+  back = graph.importResource("back", Usage::present, Usage::present);
+  auto history = graph.importResource("history", Usage::shaderResource);
+  pass = graph.addPass("pass");
+  graph.read(pass, history);
+  graph.write(pass, back);
+  CHECK(graph.compile());
+  CHECK(graph.getError().empty());
+}
+
+void testLifetimesAndBarriers() {
+  RenderGraph graph;
+  auto back = graph.importResource("back", Usage::present, Usage::present);
+  auto depth = graph.importResource("depth", Usage::depthWrite);
+  auto gbuffer = graph.createTransient("gbuffer");
+  auto light = graph.createTransient("light");
+  auto temp = graph.createTransient("temp");
+
+  auto clear = graph.addPass("clear");
+  graph.write(clear, back);
+  graph.write(clear, depth, Usage::depthWrite);
+  auto fill = graph.addPass("fill");
+  graph.write(fill, gbuffer);
+  auto shade = graph.addPass("shade");
+  graph.read(shade, gbuffer);
+  graph.write(shade, light, Usage::unorderedAccess);
+  auto blur = graph.addPass("blur");
+  graph.read(blur, light);
+  graph.write(blur, temp);
+  auto draw = graph.addPass("draw");
+  graph.read(draw, temp);
+  graph.write(draw, back);
+  graph.write(draw, depth, Usage::depthWrite);
+
+  CHECK(graph.compile());
+  CHECK(graph.getOrder().size() == 5);
+  CHECK(graph.getFirstUse(gbuffer) == 1 && graph.getLastUse(gbuffer) == 2);
+  CHECK(graph.getFirstUse(light) == 2 && graph.getLastUse(light) == 3);
+  CHECK(graph.getFirstUse(temp) == 3 && graph.getLastUse(temp) == 4);
+  CHECK(graph.getFirstUse(back) == 0 && graph.getLastUse(back) == 4);
+
+  // present -> renderTarget at clear, renderTarget -> shaderResource for
+  // each read transient, back to present at the end; depth stays
+  const std::vector<RenderGraph::Barrier>& atClear = graph.getBarriers(clear);
+  CHECK(atClear.size() == 1 && atClear[0].resource == back &&
+        atClear[0].before == Usage::present &&
+        atClear[0].after == Usage::renderTarget);
+  CHECK(graph.getBarriers(draw).size() == 1);
+  CHECK(graph.getBarriers(shade).size() == 2);
+  const std::vector<RenderGraph::Barrier>& atEnd = graph.getFinalBarriers();
+  CHECK(atEnd.size() == 1 && atEnd[0].resource == back &&
+        atEnd[0].after == Usage::present);
+  CHECK(graph.getBarrierCount() == 1 + 1 + 2 + 2 + 1 + 1);
+}
+
+// the runs of one frame, by position in the order
+std::vector<bool> runFrame(PassCache* cache, const RenderGraph& graph,
+                           const std::vector<uint64_t>& hashes,
+                           std::vector<uint8_t> enabled = {}) {
+  if (enabled.empty()) enabled.assign(graph.passCount(), 1);
+  std::vector<bool> runs;
+  cache->update(hashes, enabled, &runs);
+  return runs;
+}
+
+using Activations = std::vector<std::vector<RenderGraph::ResourceId>>;
+
+Activations activations(const RenderGraph& graph,
+                        const std::vector<bool>& runs) {
+  Activations result;
+  graph.getActivations(runs, &result);
+  return result;
+}
+
+void testPassCache() {
+  RenderGraph graph;
+  auto back = graph.importResource("back", Usage::present, Usage::present);
+  auto gbuffer = graph.createTransient("gbuffer");
+  auto light = graph.createTransient("light");
+  auto fill = graph.addPass("fill");
+  graph.write(fill, gbuffer);
+  graph.setCached(fill);
+  auto shade = graph.addPass("shade");
+  graph.read(shade, gbuffer);
+  graph.write(shade, light, Usage::unorderedAccess);
+  graph.setCached(shade);
+  auto draw = graph.addPass("draw");
+  graph.read(draw, light);
+  graph.write(draw, back);
+  CHECK(graph.compile());
+
+  // draw runs every frame and reads light; only cached shade reads gbuffer
+  CHECK(graph.isPersistent(light) && !graph.isPersistent(gbuffer));
+  CHECK(graph.getFirstUse(light) == 0 && graph.getLastUse(light) == 2);
+  CHECK(graph.getFirstUse(gbuffer) == 0 && graph.getLastUse(gbuffer) == 1);
+
+  PassCache cache(&graph);
+  auto frame = [&](uint64_t fillHash, uint64_t shadeHash) {
+    std::vector<uint64_t> hashes(graph.passCount(), 0);
+    hashes[fill] = fillHash;
+    hashes[shade] = shadeHash;
+    return runFrame(&cache, graph, hashes);
+  };
+  CHECK((frame(1, 1) == std::vector<bool>{true, true, true}));
+  CHECK((frame(1, 1) == std::vector<bool>{false, false, true}));
+  // gbuffer did not survive the skipped frame, fill writes it again
+  CHECK((frame(1, 2) == std::vector<bool>{true, true, true}));
+  CHECK((frame(1, 2) == std::vector<bool>{false, false, true}));
+  // a change reaches what is downstream
+  CHECK((frame(3, 2) == std::vector<bool>{true, true, true}));
+  cache.touch(light);
+  CHECK((frame(3, 2) == std::vector<bool>{false, false, true}));
+  cache.invalidate();
+  CHECK((frame(3, 2) == std::vector<bool>{true, true, true}));
+  CHECK(cache.getSkipCount() == 6);
+  CHECK(cache.getRunCount() == 15);
+
+  // a disabled writer is not run for its reader, and is not counted
+  CHECK((runFrame(&cache, graph, {3, 4, 0}, {0, 1, 1}) ==
+         std::vector<bool>{false, true, true}));
+  CHECK(cache.getSkipCount() == 6 && cache.getRunCount() == 17);
+}
+
+void testPersistence() {
+  RenderGraph graph;
+  auto back = graph.importResource("back", Usage::present, Usage::present);
+  auto gbuffer = graph.createTransient("gbuffer");
+  auto light = graph.createTransient("light");
+  auto fill = graph.addPass("fill");
+  graph.write(fill, gbuffer);
+  graph.setCached(fill);
+  auto shade = graph.addPass("shade");
+  graph.read(shade, gbuffer);
+  graph.write(shade, light, Usage::unorderedAccess);
+  graph.setCached(shade);
+  // reads gbuffer every frame, so it has to be kept
+  auto debug = graph.addPass("debug");
+  graph.read(debug, gbuffer);
+  graph.read(debug, light);
+  graph.write(debug, back);
+  CHECK(graph.compile());
+  CHECK(graph.isPersistent(gbuffer) && graph.isPersistent(light));
+  CHECK(graph.getFirstUse(gbuffer) == 0 && graph.getLastUse(gbuffer) == 2);
+
+  PassCache cache(&graph);
+  CHECK((runFrame(&cache, graph, {1, 1, 0}) ==
+         std::vector<bool>{true, true, true}));
+  CHECK((runFrame(&cache, graph, {1, 2, 0}) ==
+         std::vector<bool>{false, true, true}));
+  CHECK(!graph.isPersistent(back));
+}
+
+void testActivations() {
+  RenderGraph graph;
+  auto back = graph.importResource("back", Usage::present, Usage::present);
+  auto gbuffer = graph.createTransient("gbuffer");
+  auto light = graph.createTransient("light");
+  auto fill = graph.addPass("fill");
+  graph.write(fill, gbuffer);
+  graph.setCached(fill);
+  auto shade = graph.addPass("shade");
+  graph.read(shade, gbuffer);
+  graph.write(shade, light, Usage::unorderedAccess);
+  graph.setCached(shade);
+  auto draw = graph.addPass("draw");
+  graph.read(draw, light);
+  graph.write(draw, back);
+  CHECK(graph.compile());
+
+  // light is kept, it never shares memory; gbuffer is taken over by fill
+  PassCache cache(&graph);
+  std::vector<bool> runs = runFrame(&cache, graph, {1, 1, 0});
+  CHECK((activations(graph, runs) == Activations{{gbuffer}, {}, {}}));
+  // a cached frame only runs draw, nothing is activated
+  runs = runFrame(&cache, graph, {1, 1, 0});
+  CHECK((runs == std::vector<bool>{false, false, true}));
+  CHECK((activations(graph, runs) == Activations{{}, {}, {}}));
+
+  // kept, gbuffer lets shade run alone
+  graph.setPersistent(gbuffer);
+  CHECK(graph.compile());
+  CHECK(graph.isPersistent(gbuffer));
+  CHECK(graph.getFirstUse(gbuffer) == 0 && graph.getLastUse(gbuffer) == 2);
+  PassCache keptCache(&graph);
+  runs = runFrame(&keptCache, graph, {1, 1, 0});
+  CHECK((runs == std::vector<bool>{true, true, true}));
+  CHECK((activations(graph, runs) == Activations{{}, {}, {}}));
+  CHECK((runFrame(&keptCache, graph, {1, 2, 0}) ==
+         std::vector<bool>{false, true, true}));
+  CHECK((runFrame(&keptCache, graph, {1, 2, 0}) ==
+         std::vector<bool>{false, false, true}));
+  graph.setPersistent(gbuffer, false);
+  CHECK(graph.compile());
+  CHECK(!graph.isPersistent(gbuffer));
+}
+
+// instances out of view have their passes disabled, as the renderer does
+void testDisabledActivations() {
+  RenderGraph graph;
+  auto back = graph.importResource("back", Usage::present, Usage::present);
+  std::vector<RenderGraph::ResourceId> gbuffers, lights;
+  std::vector<RenderGraph::PassId> fills, shades;
+  for (uint32_t i = 0; i < 2; ++i) {
+    gbuffers.push_back(graph.createTransient("gbuffer"));
+    lights.push_back(graph.createTransient("light"));
+    fills.push_back(graph.addPass("fill"));
+    graph.write(fills[i], gbuffers[i]);
+    shades.push_back(graph.addPass("shade"));
+    graph.read(shades[i], gbuffers[i]);
+    graph.write(shades[i], lights[i], Usage::unorderedAccess);
+    auto draw = graph.addPass("draw");
+    graph.read(draw, lights[i]);
+    graph.write(draw, back);
+  }
+  CHECK(graph.compile());
+
+  PassCache cache(&graph);
+  std::vector<uint64_t> hashes(graph.passCount(), 0);
+  std::vector<uint8_t> enabled = {1, 1, 1, 0, 0, 0};
+  std::vector<bool> runs = runFrame(&cache, graph, hashes, enabled);
+  Activations active = activations(graph, runs);
+  CHECK((active == Activations{{gbuffers[0]}, {lights[0]}, {}, {}, {}, {}}));
+
+  // an enabled reader of a disabled writer takes the target over itself
+  enabled = {1, 1, 1, 0, 1, 1};
+  runs = runFrame(&cache, graph, hashes, enabled);
+  active = activations(graph, runs);
+  CHECK(active[position(graph, fills[1])].empty());
+  CHECK((active[position(graph, shades[1])] ==
+         std::vector<RenderGraph::ResourceId>{gbuffers[1], lights[1]}));
+}
+
+// the graph of the renderer : per instance a cached texture space pass
+// writing a g-buffer and a cached light pass, then a draw of all of them
+void testCachingAliases() {
+  const uint32_t numInstances = 4;
+  for (bool cached : {false, true}) {
+    RenderGraph graph;
+    auto back = graph.importResource("back", Usage::present, Usage::present);
+    std::vector<RenderGraph::ResourceId> gbuffers, lights;
+    auto draw = graph.addPass("draw");
+    for (uint32_t i = 0; i < numInstances; ++i) {
+      auto gbuffer = graph.createTransient("gbuffer");
+      auto light = graph.createTransient("light");
+      auto ts = graph.addPass("texture space");
+      graph.write(ts, gbuffer);
+      auto shade = graph.addPass("light space");
+      graph.read(shade, gbuffer);
+      graph.write(shade, light, Usage::unorderedAccess);
+      graph.setCached(ts, cached);
+      graph.setCached(shade, cached);
+      graph.read(draw, light);
+      gbuffers.push_back(gbuffer);
+      lights.push_back(light);
+    }
+    graph.write(draw, back);
+    CHECK(graph.compile());
+    CHECK(graph.getOrder().size() == 2 * numInstances + 1);
+
+    AliasingPlanner planner;
+    for (RenderGraph::ResourceId r = 0; r < graph.resourceCount(); ++r) {
+      if (graph.isImported(r)) continue;
+      planner.add({1000, 1, graph.getFirstUse(r), graph.getLastUse(r)});
+    }
+    planner.plan();
+    // the planner ids follow the transients, gbuffer then light
+    uint32_t aliasedGbuffers = 0;
+    for (uint32_t i = 0; i < numInstances; ++i) {
+      CHECK(!graph.isPersistent(gbuffers[i]));
+      CHECK(graph.isPersistent(lights[i]) == cached);
+      aliasedGbuffers += planner.getPlacement(2 * i).aliased;
+    }
+    CHECK(aliasedGbuffers == numInstances);
+    CHECK(planner.getHeapSize() < planner.getNaiveSize());
+    CHECK(planner.getHeapSize() == (numInstances + 1) * 1000);
+  }
+}
+
+}  // namespace
+
+int main() {
+  testCulling();
+  testOrdering();
+  testErrors();
+  testLifetimesAndBarriers();
+  testPassCache();
+  testPersistence();
+  testActivations();
+  testDisabledActivations();
+  testCachingAliases();
+  return checkResult();
+}
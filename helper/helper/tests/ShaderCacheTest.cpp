@@ -0,0 +1,208 @@
+#include "ShaderCache.h"
+
+#include <filesystem>
+#include <fstream>
+#include <map>
+
+#include "Check.h"
+
+namespace {
+
+namespace fs = std::filesystem;
+
+// the shader sources, in memory
+std::map<std::string, std::string> files;
+
+bool readMemory(const std::string& path, std::string* text) {
+  auto it = files.find(path);
+  if (it == files.end()) return false;
+  *text = it->second;
+  return true;
+}
+
+std::string tempDir() {
+  fs::path dir = fs::temp_directory_path() / "ShaderCacheTest";
+  fs::remove_all(dir);
+  return dir.string();
+}
+
+void testFindIncludes() {
+  std::vector<std::string> names = ShaderCache::findIncludes(
+      "#include \"a.hlsli\"\n"
+      "  #  include <b.hlsli>\n"
+      "// #include \"comment.hlsli\"\n"
+      "#define X\n"
+      "#include \"unclosed.hlsli\n"
+      "#include \"dir/c.hlsli\"");
+  CHECK((names == std::vector<std::string>{"a.hlsli", "b.hlsli",
+                                           "dir/c.hlsli"}));
+  CHECK(ShaderCache::resolveInclude("data/pass.hlsl", "x.hlsli") ==
+        "data/x.hlsli");
+  CHECK(ShaderCache::resolveInclude("data\\pass.hlsl", "x.hlsli") ==
+        "data\\x.hlsli");
+  CHECK(ShaderCache::resolveInclude("pass.hlsl", "x.hlsli") == "x.hlsli");
+}
+
+void testHashChanges() {
+  files.clear();
+  files["data/pass.hlsl"] = "#include \"common.hlsli\"\nfloat4 main();\n";
+  files["data/common.hlsli"] = "#include \"packing.hlsli\"\n";
+  files["data/packing.hlsli"] = "#pragma once\nfloat pack();\n";
+  ShaderCache cache(tempDir(), readMemory);
+
+  ShaderKey key{"data/pass.hlsl", "PSMain", "ps_5_0", 0, 1};
+  uint64_t hash = cache.hashSource(key);
+  CHECK(hash != 0);
+  CHECK(cache.hashSource(key) == hash);
+
+  // an edit of an include two levels down
+  files["data/packing.hlsli"] = "#pragma once\nfloat pack(float v);\n";
+  uint64_t edited = cache.hashSource(key);
+  CHECK(edited != hash);
+  files["data/packing.hlsli"] = "#pragma once\nfloat pack();\n";
+  CHECK(cache.hashSource(key) == hash);
+
+  // the key counts as much as the text
+  ShaderKey other = key;
+  other.entry = "VSMain";
+  CHECK(cache.hashSource(other) != hash);
+  other = key;
+  other.flags = 1;
+  CHECK(cache.hashSource(other) != hash);
+  other = key;
+  other.compilerVersion = 2;
+  CHECK(cache.hashSource(other) != hash);
+
+  // a missing include that shows up later
+  files["data/pass.hlsl"] += "#include \"later.hlsli\"\n";
+  uint64_t missing = cache.hashSource(key);
+  files["data/later.hlsli"] = "";
+  CHECK(cache.hashSource(key) != missing);
+
+  // includes that include each other are hashed once
+  files["data/common.hlsli"] += "#include \"common.hlsli\"\n";
+  CHECK(cache.hashSource(key) != 0);
+
+  ShaderKey absent{"data/absent.hlsl", "main", "cs_5_0", 0, 1};
+  CHECK(cache.hashSource(absent) == 0);
+}
+
+void testStoreAndLoad() {
+  files.clear();
+  files["pass.hlsl"] = "#include \"common.hlsli\"\n";
+  files["common.hlsli"] = "float a;\n";
+  ShaderCache cache(tempDir(), readMemory);
+  ShaderKey key{"pass.hlsl", "main", "cs_5_0", 0, 1};
+  const uint8_t code[] = {0x44, 0x58, 0x42, 0x43, 1, 2, 3, 4, 5, 6, 7};
+
+  uint64_t hash = cache.hashSource(key);
+  std::vector<uint8_t> loaded;
+  CHECK(!cache.load(hash, &loaded));
+  CHECK(cache.store(hash, code, sizeof(code)));
+  CHECK(cache.load(hash, &loaded));
+  CHECK(loaded == std::vector<uint8_t>(code, code + sizeof(code)));
+
+  // an edited include names another entry : a miss
+  files["common.hlsli"] = "float b;\n";
+  CHECK(!cache.load(cache.hashSource(key), &loaded));
+  files["common.hlsli"] = "float a;\n";
+  CHECK(cache.load(cache.hashSource(key), &loaded));
+  CHECK(cache.getHitCount() == 2 && cache.getMissCount() == 2);
+}
+
+std::vector<char> readBytes(const std::string& path) {
+  std::ifstream file(path, std::ios::binary);
+  return std::vector<char>(std::istreambuf_iterator<char>(file), {});
+}
+
+void writeBytes(const std::string& path, const std::vector<char>& bytes) {
+  std::ofstream file(path, std::ios::binary | std::ios::trunc);
+  file.write(bytes.data(), std::streamsize(bytes.size()));
+}
+
+void testDamagedEntries() {
+  ShaderCache cache(tempDir());
+  const uint64_t hash = 0x1234;
+  const uint8_t code[64] = {1, 2, 3};
+  CHECK(cache.store(hash, code, sizeof(code)));
+  const std::vector<char> good = readBytes(cache.getPath(hash));
+  std::vector<uint8_t> loaded;
+  CHECK(cache.load(hash, &loaded));
+
+  // the header is magic, reserved, hash, size and the hash of the code
+  std::vector<char> bad = good;
+  bad[0] ^= 1;
+  writeBytes(cache.getPath(hash), bad);
+  CHECK(!cache.load(hash, &loaded));
+
+  // an entry renamed to another hash
+  bad = good;
+  bad[8] ^= 1;
+  writeBytes(cache.getPath(hash), bad);
+  CHECK(!cache.load(hash, &loaded));
+
+  // a size past the end of the file
+  bad = good;
+  bad[16] = char(0xff);
+  writeBytes(cache.getPath(hash), bad);
+  CHECK(!cache.load(hash, &loaded));
+
+  // cut short, in the header and in the code
+  writeBytes(cache.getPath(hash), std::vector<char>(good.begin(),
+                                                    good.begin() + 12));
+  CHECK(!cache.load(hash, &loaded));
+  writeBytes(cache.getPath(hash), std::vector<char>(good.begin(),
+                                                    good.end() - 1));
+  CHECK(!cache.load(hash, &loaded));
+
+  // a flipped bit of the code
+  bad = good;
+  bad.back() ^= 1;
+  writeBytes(cache.getPath(hash), bad);
+  CHECK(!cache.load(hash, &loaded));
+
+  writeBytes(cache.getPath(hash), good);
+  CHECK(cache.load(hash, &loaded));
+}
+
+void testStoreIsAtomic() {
+  ShaderCache cache(tempDir());
+  const uint64_t hash = 0x5678;
+  const uint8_t first[16] = {1};
+  const uint8_t second[16] = {2};
+  CHECK(cache.store(hash, first, sizeof(first)));
+
+  // the entry is written next to its place : when that fails the entry in
+  // place is left whole
+  std::string tmpPath = cache.getPath(hash) + ".tmp";
+  fs::create_directory(tmpPath);
+  CHECK(!cache.store(hash, second, sizeof(second)));
+  std::vector<uint8_t> loaded;
+  CHECK(cache.load(hash, &loaded) && loaded[0] == 1);
+  fs::remove(tmpPath);
+
+  // then renamed over the old one, nothing is left aside
+  CHECK(cache.store(hash, second, sizeof(second)));
+  CHECK(cache.load(hash, &loaded) && loaded[0] == 2);
+  CHECK(!fs::exists(tmpPath));
+  size_t entries = 0;
+  for (const fs::directory_entry& entry :
+       fs::directory_iterator(cache.getDir())) {
+    CHECK(entry.path().extension() == ".cso");
+    ++entries;
+  }
+  CHECK(entries == 1);
+
+  fs::remove_all(cache.getDir());
+}
+
+}  // namespace
+
+int main() {
+  testFindIncludes();
+  testHashChanges();
+  testStoreAndLoad();
+  testDamagedEntries();
+  testStoreIsAtomic();
+  return checkResult();
+}
@@ -0,0 +1,149 @@
+#include "SoftRender.h"
+
+#include <cmath>
+#include <cstdio>
+#include <cstring>
+
+#include "Check.h"
+
+// The passes of SoftRender on a sphere of 64 x 64 quads, unwrapped into a
+// 1024 x 1024 G-buffer and drawn on a 1280 x 720 frame with the light
+// rectangle in front : the throughput of each pass in place and on a pool
+// of 3 threads, the best of 5 runs.
+
+namespace {
+
+const uint32_t texSize = 1024;
+const uint32_t width = 1280;
+const uint32_t height = 720;
+const int runs = 5;
+
+void multiply(const float a[16], const float b[16], float out[16]) {
+  for (int i = 0; i < 4; ++i) {
+    for (int j = 0; j < 4; ++j) {
+      out[i * 4 + j] = 0.0f;
+      for (int k = 0; k < 4; ++k) out[i * 4 + j] += a[i * 4 + k] * b[k * 4 + j];
+    }
+  }
+}
+
+struct Results {
+  SoftPassStats best[4];
+  SoftTexture light{texSize, texSize};
+  SoftTexture target{width, height};
+};
+
+void keepBest(SoftPassStats* best, const SoftPassStats& run) {
+  if (best->ms == 0.0 || run.ms < best->ms) *best = run;
+}
+
+}  // namespace
+
+int main() {
+  // a unit sphere scaled by 10, position, normal, texcoord
+  const int segments = 64;
+  std::vector<float> vertices;
+  std::vector<uint32_t> indices;
+  for (int i = 0; i <= segments; ++i) {
+    for (int j = 0; j <= segments; ++j) {
+      float theta = 3.14159265f * i / segments;
+      float phi = 6.28318531f * j / segments;
+      float n[3] = {std::sin(theta) * std::cos(phi), std::cos(theta),
+                    std::sin(theta) * std::sin(phi)};
+      vertices.insert(vertices.end(),
+                      {n[0] * 10, n[1] * 10, n[2] * 10, n[0], n[1], n[2],
+                       0.01f + 0.98f * j / segments,
+                       0.01f + 0.98f * i / segments});
+    }
+  }
+  for (int i = 0; i < segments; ++i) {
+    for (int j = 0; j < segments; ++j) {
+      uint32_t a = uint32_t(i * (segments + 1) + j);
+      uint32_t b = a + uint32_t(segments) + 1;
+      indices.insert(indices.end(), {a, b, a + 1, a + 1, b, b + 1});
+    }
+  }
+  SoftMesh mesh{vertices.data(), 8, uint32_t(vertices.size() / 8),
+                indices.data(), indices.size()};
+
+  SoftTexture skin(256, 256);
+  for (uint32_t y = 0; y < 256; ++y) {
+    for (uint32_t x = 0; x < 256; ++x) {
+      float* t = skin.texel(x, y);
+      t[0] = ((x / 16 + y / 16) & 1) ? 0.8f : 0.2f;
+      t[1] = x / 255.0f;
+      t[2] = y / 255.0f;
+      t[3] = 1.0f;
+    }
+  }
+
+  float f = 1.0f / std::tan(0.5f);
+  float q = 1000.0f / (1000.0f - 0.1f);
+  const float viewProj[16] = {f * height / width, 0, 0, 0, 0, f, 0, 0,
+                              0, 0, q, 1, 0, 0, -0.1f * q, 0};
+  // the sphere 25 in front of the camera, over about half of the frame
+  const float model[16] = {1, 0, 0, 0, 0, 1, 0, 0, 0, 0, 1, 0, 0, 0, 25, 1};
+  SoftTextureSpace::ConstantData textureSpace;
+  memcpy(textureSpace.M, model, sizeof(model));
+  const float boundsMin[4] = {-10.5f, -10.5f, 14.5f, 0};
+  const float boundsSize[4] = {21, 21, 21, 0};
+  memcpy(textureSpace.boundsMin, boundsMin, sizeof(boundsMin));
+  memcpy(textureSpace.boundsSize, boundsSize, sizeof(boundsSize));
+  SoftLightSpace::ConstantData light = {
+      {20, 150, 50, 1}, {0, 0, -1, 1}, {0, 0, -100}, 2000, {}, {}};
+  memcpy(light.boundsMin, boundsMin, sizeof(boundsMin));
+  memcpy(light.boundsSize, boundsSize, sizeof(boundsSize));
+  SoftMeshDraw::ConstantData meshDraw;
+  multiply(model, viewProj, meshDraw.MVP);
+  SoftRectDraw::ConstantData rect;
+  const float rectModel[16] = {10, 0, 0, 0, 0, 10, 0, 0,
+                               0, 0, 1, 0, 5, 0, 10, 1};
+  multiply(rectModel, viewProj, rect.MVP);
+  const float color[4] = {1.0f, 1.0f, 1.0f, 0.5f};
+  memcpy(rect.color, color, sizeof(color));
+
+  TaskPool pool(3);
+  Results results[2];
+  for (int p = 0; p < 2; ++p) {
+    TaskPool* taskPool = p ? &pool : nullptr;
+    Results& result = results[p];
+    SoftRasterizer raster(taskPool);
+    SoftTexture gbuffer[3] = {{texSize, texSize}, {texSize, texSize},
+                              {texSize, texSize}};
+    SoftTexture* targets[3] = {&gbuffer[0], &gbuffer[1], &gbuffer[2]};
+    const SoftTexture* texels[3] = {&gbuffer[0], &gbuffer[1], &gbuffer[2]};
+    SoftDepth depth(width, height);
+    for (int run = 0; run < runs; ++run) {
+      raster.setViewport(texSize, texSize);
+      keepBest(&result.best[0], SoftTextureSpace::render(
+                                    &raster, mesh, textureSpace, skin,
+                                    targets));
+      keepBest(&result.best[1],
+               SoftLightSpace::render(taskPool, light, texels, texSize,
+                                      texSize, &result.light));
+      raster.setViewport(width, height);
+      depth.clear();
+      keepBest(&result.best[2],
+               SoftMeshDraw::render(&raster, mesh, meshDraw, result.light,
+                                    &result.target, &depth));
+      keepBest(&result.best[3],
+               SoftRectDraw::render(&raster, rect, &result.target, &depth));
+    }
+    printf("%s\n", p ? "pool of 3 threads" : "in place");
+    const char* names[4] = {"texture space", "light space", "mesh draw",
+                            "light rect"};
+    for (int i = 0; i < 4; ++i)
+      printf("  %s", result.best[i].describe(names[i]).c_str());
+  }
+
+  // the pool only changes the time
+  for (int i = 0; i < 4; ++i)
+    CHECK(results[0].best[i].pixels == results[1].best[i].pixels);
+  SoftDiff diff = compareTextures(results[0].light, results[1].light, texSize,
+                                  texSize, 0.0f);
+  CHECK(diff.overTolerance == 0);
+  diff = compareTextures(results[0].target, results[1].target, width, height,
+                         0.0f);
+  CHECK(diff.overTolerance == 0);
+  return checkResult();
+}
@@ -0,0 +1,516 @@
+#include "SoftRender.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <random>
+
+#include "Check.h"
+
+namespace {
+
+const float pi = 3.14159265f;
+
+// a perspective projection for row vectors, depth in [0, w]
+void perspective(float fovY, float aspect, float zNear, float zFar,
+                 float out[16]) {
+  float f = 1.0f / std::tan(fovY / 2);
+  float q = zFar / (zFar - zNear);
+  const float m[16] = {f / aspect, 0, 0, 0, 0, f, 0, 0,
+                       0, 0, q, 1, 0, 0, -zNear * q, 0};
+  memcpy(out, m, sizeof(m));
+}
+
+void multiply(const float a[16], const float b[16], float out[16]) {
+  for (int i = 0; i < 4; ++i) {
+    for (int j = 0; j < 4; ++j) {
+      out[i * 4 + j] = 0.0f;
+      for (int k = 0; k < 4; ++k) out[i * 4 + j] += a[i * 4 + k] * b[k * 4 + j];
+    }
+  }
+}
+
+// a sphere of the given radius and segments x segments quads, as the mesh
+// has its vertices : position, normal, texcoord in [0.01, 0.99]
+void makeSphere(int segments, float radius, std::vector<float>* vertices,
+                std::vector<uint32_t>* indices) {
+  for (int i = 0; i <= segments; ++i) {
+    for (int j = 0; j <= segments; ++j) {
+      float theta = pi * i / segments;
+      float phi = 2.0f * pi * j / segments;
+      float n[3] = {std::sin(theta) * std::cos(phi), std::cos(theta),
+                    std::sin(theta) * std::sin(phi)};
+      vertices->insert(vertices->end(),
+                       {n[0] * radius, n[1] * radius, n[2] * radius, n[0],
+                        n[1], n[2], 0.01f + 0.98f * j / segments,
+                        0.01f + 0.98f * i / segments});
+    }
+  }
+  for (int i = 0; i < segments; ++i) {
+    for (int j = 0; j < segments; ++j) {
+      uint32_t a = uint32_t(i * (segments + 1) + j);
+      uint32_t b = a + uint32_t(segments) + 1;
+      indices->insert(indices->end(), {a, b, a + 1, a + 1, b, b + 1});
+    }
+  }
+}
+
+// a vertex at the pixel x, y of a width x height viewport
+SoftVertex atPixel(float x, float y, uint32_t width, uint32_t height,
+                   float z = 0.5f) {
+  SoftVertex v = {};
+  v.clip[0] = x / width * 2.0f - 1.0f;
+  v.clip[1] = 1.0f - y / height * 2.0f;
+  v.clip[2] = z;
+  v.clip[3] = 1.0f;
+  return v;
+}
+
+// how many times each pixel is shaded
+std::vector<uint32_t> countHits(SoftRasterizer* raster,
+                                const std::vector<SoftVertex>& vertices,
+                                const std::vector<uint32_t>& indices) {
+  uint32_t width = raster->getWidth();
+  std::vector<uint32_t> hits(size_t(width) * raster->getHeight());
+  raster->draw(vertices.data(), indices.data(), indices.size(), 0, nullptr,
+               [&](uint32_t x, uint32_t y, const float*) {
+    ++hits[size_t(y) * width + x];
+  });
+  return hits;
+}
+
+void testCoverage() {
+  // a grid of triangles over the viewport, the inner vertices moved at
+  // random, some of them onto pixel centers and some triangles turned
+  // over : each pixel center is shaded by exactly one of them. The sizes
+  // are powers of 2 for the centers to be exact in clip space
+  const uint32_t width = 128;
+  const uint32_t height = 64;
+  const int cells = 8;
+  std::mt19937 random(50);
+  std::uniform_real_distribution<float> jitter(-0.2f, 0.2f);
+  TaskPool pool(3);
+  for (int trial = 0; trial < 20; ++trial) {
+    std::vector<SoftVertex> vertices;
+    for (int i = 0; i <= cells; ++i) {
+      for (int j = 0; j <= cells; ++j) {
+        float x = float(j) / cells;
+        float y = float(i) / cells;
+        if (i > 0 && i < cells && j > 0 && j < cells) {
+          x += jitter(random) / cells;
+          y += jitter(random) / cells;
+        }
+        x *= width;
+        y *= height;
+        if (trial % 2) {
+          x = std::floor(x) + 0.5f;
+          y = std::floor(y) + 0.5f;
+        }
+        vertices.push_back(atPixel(x, y, width, height));
+      }
+    }
+    std::vector<uint32_t> indices;
+    for (int i = 0; i < cells; ++i) {
+      for (int j = 0; j < cells; ++j) {
+        uint32_t a = uint32_t(i * (cells + 1) + j);
+        uint32_t b = a + cells + 1;
+        bool flip = random() % 2;
+        if (flip) {
+          indices.insert(indices.end(), {a, a + 1, b, a + 1, b + 1, b});
+        } else {
+          indices.insert(indices.end(), {a, b, a + 1, a + 1, b, b + 1});
+        }
+      }
+    }
+    SoftRasterizer raster(trial % 4 < 2 ? &pool : nullptr);
+    raster.setViewport(width, height);
+    std::vector<uint32_t> hits = countHits(&raster, vertices, indices);
+    CHECK(std::all_of(hits.begin(), hits.end(),
+                      [](uint32_t n) { return n == 1; }));
+    CHECK(raster.getStats().pixels == uint64_t(width) * height);
+    CHECK(raster.getStats().triangles == uint64_t(cells) * cells * 2);
+  }
+
+  // a fan around a vertex on a pixel center, in both windings
+  const uint32_t size = 64;
+  std::vector<SoftVertex> fan = {atPixel(32.5f, 32.5f, size, size)};
+  const float ring[8][2] = {{0, 0},   {32, 0},  {64, 0}, {64, 32},
+                            {64, 64}, {32, 64}, {0, 64}, {0, 32}};
+  for (const float* p : ring) fan.push_back(atPixel(p[0], p[1], size, size));
+  std::vector<uint32_t> indices;
+  for (uint32_t i = 0; i < 8; ++i) {
+    uint32_t next = 1 + (i + 1) % 8;
+    if (i % 2) {
+      indices.insert(indices.end(), {0, 1 + i, next});
+    } else {
+      indices.insert(indices.end(), {0, next, 1 + i});
+    }
+  }
+  SoftRasterizer raster;
+  raster.setViewport(size, size);
+  std::vector<uint32_t> hits = countHits(&raster, fan, indices);
+  CHECK(std::count(hits.begin(), hits.end(), 1u) == size * size);
+
+  // a degenerate triangle and one outside the viewport shade nothing
+  std::vector<SoftVertex> none = {
+      atPixel(10, 10, size, size), atPixel(20, 20, size, size),
+      atPixel(30, 30, size, size), atPixel(70, 0, size, size),
+      atPixel(90, 0, size, size), atPixel(80, 30, size, size)};
+  hits = countHits(&raster, none, {0, 1, 2, 3, 4, 5});
+  CHECK(std::count(hits.begin(), hits.end(), 0u) == size * size);
+}
+
+void testDepth() {
+  // two quads, the near one over the left half of the far one
+  const uint32_t size = 64;
+  auto quad = [&](float x0, float x1, float z, float id) {
+    std::vector<SoftVertex> quad = {
+        atPixel(x0, 0, size, size, z), atPixel(x1, 0, size, size, z),
+        atPixel(x0, size, size, size, z), atPixel(x1, size, size, size, z)};
+    for (SoftVertex& v : quad) v.varyings[0] = id;
+    return quad;
+  };
+  const uint32_t indices[6] = {0, 1, 2, 2, 1, 3};
+  std::vector<SoftVertex> nearQuad = quad(0, 32, 0.25f, 1.0f);
+  std::vector<SoftVertex> farQuad = quad(0, 64, 0.75f, 2.0f);
+
+  TaskPool pool(3);
+  SoftRasterizer raster(&pool);
+  raster.setViewport(size, size);
+  std::vector<float> ids(size * size);
+  auto write = [&](uint32_t x, uint32_t y, const float* in) {
+    ids[y * size + x] = in[0];
+  };
+  for (bool nearFirst : {true, false}) {
+    SoftDepth depth(size, size);
+    const std::vector<SoftVertex>* order[2] = {&farQuad, &nearQuad};
+    if (nearFirst) std::swap(order[0], order[1]);
+    raster.resetStats();
+    for (const std::vector<SoftVertex>* q : order)
+      raster.draw(q->data(), indices, 6, 1, &depth, write);
+    bool nearLeft = true;
+    bool farRight = true;
+    for (uint32_t y = 0; y < size; ++y) {
+      for (uint32_t x = 0; x < size; ++x) {
+        float id = ids[y * size + x];
+        if (x < 32) {
+          nearLeft &= id == 1.0f && depth.at(x, y) == 0.25f;
+        } else {
+          farRight &= id == 2.0f && depth.at(x, y) == 0.75f;
+        }
+      }
+    }
+    CHECK(nearLeft && farRight);
+    // the far texels behind the near quad fail the test when it comes first
+    CHECK(raster.getStats().pixels ==
+          (nearFirst ? 1 : 2) * 32 * size + 32 * size);
+  }
+
+  // without a depth buffer the last one drawn stays
+  raster.draw(nearQuad.data(), indices, 6, 1, nullptr, write);
+  raster.draw(farQuad.data(), indices, 6, 1, nullptr, write);
+  CHECK(std::all_of(ids.begin(), ids.end(),
+                    [](float id) { return id == 2.0f; }));
+}
+
+void testNearClip() {
+  const uint32_t width = 160;
+  const uint32_t height = 120;
+  float viewProj[16];
+  perspective(1.0f, float(width) / height, 0.1f, 1000.0f, viewProj);
+
+  // a floor 5 below the camera from z = -50 behind it to z = 100, the
+  // varying its z / 100 : below the horizon each pixel sees it through its
+  // ray, above none
+  const float corners[4][3] = {
+      {-500, -5, -50}, {500, -5, -50}, {-500, -5, 100}, {500, -5, 100}};
+  SoftVertex floor[4];
+  for (int i = 0; i < 4; ++i) {
+    for (int j = 0; j < 4; ++j) {
+      floor[i].clip[j] = corners[i][0] * viewProj[j] +
+                         corners[i][1] * viewProj[4 + j] +
+                         corners[i][2] * viewProj[8 + j] + viewProj[12 + j];
+    }
+    floor[i].varyings[0] = corners[i][2] / 100.0f;
+  }
+  const uint32_t indices[6] = {0, 1, 2, 2, 1, 3};
+  SoftRasterizer raster;
+  raster.setViewport(width, height);
+  std::vector<float> u(width * height, -1.0f);
+  raster.draw(floor, indices, 6, 1, nullptr,
+              [&](uint32_t x, uint32_t y, const float* in) {
+    u[y * width + x] = in[0];
+  });
+
+  float maxError = 0.0f;
+  bool aboveEmpty = true;
+  bool nearRowsFull = true;
+  for (uint32_t y = 0; y < height; ++y) {
+    // the ray of the row rises dy per unit of z
+    float dy = (1.0f - (y + 0.5f) / height * 2.0f) / viewProj[5];
+    for (uint32_t x = 0; x < width; ++x) {
+      float value = u[y * width + x];
+      if (dy >= 0.0f) {
+        aboveEmpty &= value < 0.0f;
+        continue;
+      }
+      float z = -5.0f / dy;
+      if (z < 90.0f) nearRowsFull &= value >= 0.0f;
+      if (value >= 0.0f)
+        maxError = std::max(maxError, std::fabs(value - z / 100.0f));
+    }
+  }
+  CHECK(aboveEmpty && nearRowsFull);
+  // the varyings are perspective correct
+  CHECK(maxError < 1e-3f);
+
+  // from inside a sphere its far side covers the whole view
+  std::vector<float> vertices;
+  std::vector<uint32_t> sphereIndices;
+  makeSphere(32, 10.0f, &vertices, &sphereIndices);
+  SoftMesh mesh{vertices.data(), 8, uint32_t(vertices.size() / 8),
+                sphereIndices.data(), sphereIndices.size()};
+  SoftTexture shaded(16, 16);
+  SoftTexture target(width, height);
+  SoftDepth depth(width, height);
+  SoftMeshDraw::ConstantData data;
+  const float model[16] = {1, 0, 0, 0, 0, 1, 0, 0, 0, 0, 1, 0, 0, 0, 3, 1};
+  multiply(model, viewProj, data.MVP);
+  SoftMeshDraw::render(&raster, mesh, data, shaded, &target, &depth);
+  uint32_t covered = 0;
+  for (uint32_t y = 0; y < height; ++y)
+    for (uint32_t x = 0; x < width; ++x) covered += depth.at(x, y) < 1.0f;
+  CHECK(covered == width * height);
+}
+
+// the passes of one instance on a sphere, as Render runs them
+struct Scene {
+  static const uint32_t texSize = 512;
+  static const uint32_t shadedSize = 448;  // the part the viewport covers
+  static const uint32_t width = 320;
+  static const uint32_t height = 240;
+
+  std::vector<float> vertices;
+  std::vector<uint32_t> indices;
+  SoftMesh mesh;
+  SoftTexture skin{256, 256};
+  float viewProj[16];
+  SoftTextureSpace::ConstantData textureSpace;
+  SoftLightSpace::ConstantData light = {
+      {20, 150, 50, 1}, {0, 0, -1, 1}, {0, 0, -100}, 2000, {}, {}};
+
+  Scene() {
+    makeSphere(48, 10.0f, &vertices, &indices);
+    mesh = {vertices.data(), 8, uint32_t(vertices.size() / 8), indices.data(),
+            indices.size()};
+    for (uint32_t y = 0; y < 256; ++y) {
+      for (uint32_t x = 0; x < 256; ++x) {
+        float* t = skin.texel(x, y);
+        t[0] = ((x / 16 + y / 16) & 1) ? 0.8f : 0.2f;
+        t[1] = x / 255.0f;
+        t[2] = y / 255.0f;
+        t[3] = 1.0f;
+      }
+    }
+    perspective(1.0f, float(width) / height, 0.1f, 1000.0f, viewProj);
+    // the sphere 40 in front of the camera
+    const float model[16] = {1, 0, 0, 0, 0, 1, 0, 0, 0, 0, 1, 0, 0, 0, 40, 1};
+    memcpy(textureSpace.M, model, sizeof(model));
+    const float boundsMin[4] = {-10.5f, -10.5f, 29.5f, 0};
+    const float boundsSize[4] = {21, 21, 21, 0};
+    for (auto* constants : {&textureSpace.boundsMin, &light.boundsMin})
+      memcpy(*constants, boundsMin, sizeof(boundsMin));
+    for (auto* constants : {&textureSpace.boundsSize, &light.boundsSize})
+      memcpy(*constants, boundsSize, sizeof(boundsSize));
+  }
+};
+
+struct Frame {
+  SoftTexture gbuffer[3] = {{Scene::texSize, Scene::texSize},
+                            {Scene::texSize, Scene::texSize},
+                            {Scene::texSize, Scene::texSize}};
+  SoftTexture light{Scene::texSize, Scene::texSize};
+  SoftTexture target{Scene::width, Scene::height};
+  SoftDepth depth{Scene::width, Scene::height};
+  SoftDepth meshDepth;  // before the rect
+  SoftPassStats stats[4];
+
+  void render(const Scene& scene, TaskPool* pool) {
+    SoftRasterizer raster(pool);
+    SoftTexture* targets[3] = {&gbuffer[0], &gbuffer[1], &gbuffer[2]};
+    raster.setViewport(Scene::shadedSize, Scene::shadedSize);
+    stats[0] = SoftTextureSpace::render(&raster, scene.mesh,
+                                        scene.textureSpace, scene.skin,
+                                        targets);
+    const SoftTexture* texels[3] = {&gbuffer[0], &gbuffer[1], &gbuffer[2]};
+    stats[1] = SoftLightSpace::render(pool, scene.light, texels,
+                                      Scene::shadedSize, Scene::shadedSize,
+                                      &light);
+    SoftMeshDraw::ConstantData meshDraw;
+    multiply(scene.textureSpace.M, scene.viewProj, meshDraw.MVP);
+    meshDraw.uvScale = float(Scene::shadedSize) / Scene::texSize;
+    raster.setViewport(Scene::width, Scene::height);
+    stats[2] = SoftMeshDraw::render(&raster, scene.mesh, meshDraw, light,
+                                    &target, &depth);
+    meshDepth = depth;
+    // a half transparent rectangle in front of the right of the sphere
+    SoftRectDraw::ConstantData rect;
+    const float rectModel[16] = {10, 0, 0, 0, 0, 10, 0, 0,
+                                 0, 0, 1, 0, 8, 0, 20, 1};
+    multiply(rectModel, scene.viewProj, rect.MVP);
+    const float color[4] = {1.0f, 1.0f, 0.0f, 0.5f};
+    memcpy(rect.color, color, sizeof(color));
+    stats[3] = SoftRectDraw::render(&raster, rect, &target, &depth);
+  }
+};
+
+bool sameTexels(const SoftTexture& a, const SoftTexture& b) {
+  return memcmp(a.getData(), b.getData(),
+                size_t(a.getWidth()) * a.getHeight() * 4 * sizeof(float)) ==
+         0;
+}
+
+void testPasses() {
+  Scene scene;
+  TaskPool pool(3);
+  Frame frame;
+  frame.render(scene, &pool);
+
+  // texture space : each covered texel written once, at a point of the
+  // sphere, none out of the shaded part
+  uint64_t covered = 0;
+  float positionError = 0.0f;
+  for (uint32_t y = 0; y < Scene::texSize; ++y) {
+    for (uint32_t x = 0; x < Scene::texSize; ++x) {
+      const float* packed = frame.gbuffer[1].texel(x, y);
+      if (packed[3] == 0.0f) continue;
+      CHECK(x < Scene::shadedSize && y < Scene::shadedSize);
+      ++covered;
+      float r2 = 0.0f;
+      for (int i = 0; i < 3; ++i) {
+        float p = scene.textureSpace.boundsMin[i] +
+                  packed[i] * scene.textureSpace.boundsSize[i] -
+                  scene.textureSpace.M[12 + i];
+        r2 += p * p;
+      }
+      positionError = std::max(positionError, std::fabs(std::sqrt(r2) - 10));
+    }
+  }
+  CHECK(frame.stats[0].pixels == covered);
+  CHECK(frame.stats[0].triangles == scene.indices.size() / 3);
+  // the texcoords span [0.01, 0.99] of the shaded part
+  CHECK(covered > uint64_t(0.97 * 0.97 * Scene::shadedSize *
+                           Scene::shadedSize));
+  // the quads are flat, inside the sphere by up to about 1 - cos(pi / 48)
+  // along their diagonal
+  CHECK(positionError < 0.05f);
+
+  // light space : every texel of the shaded part
+  CHECK(frame.stats[1].pixels == uint64_t(Scene::shadedSize) *
+                                     Scene::shadedSize);
+  CHECK(frame.light.texel(100, 100)[3] == 1.0f);
+
+  // mesh draw : the silhouette is the disc of the sphere, the nearest
+  // point at the center is the front of it, 30 away
+  uint64_t drawn = 0;
+  for (uint32_t y = 0; y < Scene::height; ++y) {
+    for (uint32_t x = 0; x < Scene::width; ++x)
+      drawn += frame.meshDepth.at(x, y) < 1.0f;
+  }
+  double radius = std::tan(std::asin(0.25)) * scene.viewProj[5] *
+                  Scene::height / 2;
+  double disc = pi * radius * radius;
+  CHECK(std::fabs(drawn - disc) / disc < 0.03);
+  float centerDepth = frame.meshDepth.at(Scene::width / 2, Scene::height / 2);
+  float expected = (30.0f * scene.viewProj[10] + scene.viewProj[14]) / 30.0f;
+  CHECK(std::fabs(centerDepth - expected) < 1e-4f);
+
+  // rect draw : in front of all, blended by its alpha of 0.5
+  CHECK(frame.stats[3].triangles == 2 && frame.stats[3].pixels > 0);
+  uint32_t blended = 0;
+  for (uint32_t y = 0; y < Scene::height; ++y) {
+    for (uint32_t x = 0; x < Scene::width; ++x) {
+      const float* p = frame.target.texel(x, y);
+      if (p[3] != 128 / 255.0f) continue;
+      ++blended;
+      CHECK(p[0] >= 0.5f && p[1] >= 0.5f);
+    }
+  }
+  CHECK(blended == frame.stats[3].pixels);
+}
+
+void testPoolMatchesSerial() {
+  // the tiles on a pool give the same bits as in place, in every pass
+  Scene scene;
+  TaskPool pool(3);
+  Frame pooled;
+  Frame serial;
+  pooled.render(scene, &pool);
+  serial.render(scene, nullptr);
+  for (int i = 0; i < 3; ++i)
+    CHECK(sameTexels(pooled.gbuffer[i], serial.gbuffer[i]));
+  CHECK(sameTexels(pooled.target, serial.target));
+  for (int i = 0; i < 4; ++i)
+    CHECK(pooled.stats[i].pixels == serial.stats[i].pixels);
+
+  // the light targets as Render compared the gpu one : the covered texels
+  // of the shaded part within 1%, here exactly
+  SoftDiff diff = compareTextures(pooled.light, serial.light,
+                                  Scene::shadedSize, Scene::shadedSize, 0.01f,
+                                  &serial.gbuffer[1]);
+  CHECK(diff.compared == pooled.stats[0].pixels);
+  CHECK(diff.overTolerance == 0 && diff.maxError == 0.0f);
+}
+
+void testCompare() {
+  SoftTexture a(8, 8);
+  const float grey[4] = {0.5f, 0.5f, 0.5f, 1.0f};
+  a.fill(grey);
+  SoftTexture b = a;
+  SoftDiff diff = compareTextures(a, b, 8, 8, 0.01f);
+  CHECK(diff.compared == 64 && diff.overTolerance == 0);
+  CHECK(diff.maxError == 0.0f && diff.meanError == 0.0f);
+
+  // one texel off by 0.1 in green, one by 0.005 : under the tolerance
+  b.texel(3, 4)[1] = 0.6f;
+  b.texel(5, 5)[2] = 0.505f;
+  diff = compareTextures(a, b, 8, 8, 0.01f);
+  CHECK(diff.overTolerance == 1);
+  CHECK(std::fabs(diff.maxError - 0.1f) < 1e-6f);
+  CHECK(std::fabs(diff.meanError - 0.105f / 64) < 1e-6f);
+  // alpha is not compared, nor what is past width x height
+  b.texel(0, 0)[3] = 0.0f;
+  CHECK(compareTextures(a, b, 8, 8, 0.01f).overTolerance == 1);
+  CHECK(compareTextures(a, b, 3, 8, 0.01f).overTolerance == 0);
+
+  // only where the coverage alpha is not 0
+  SoftTexture coverage(8, 8);
+  for (uint32_t x = 0; x < 8; ++x) coverage.texel(x, 2)[3] = 1.0f;
+  coverage.texel(3, 4)[3] = 1.0f;
+  diff = compareTextures(a, b, 8, 8, 0.01f, &coverage);
+  CHECK(diff.compared == 9 && diff.overTolerance == 1);
+  coverage.texel(3, 4)[3] = 0.0f;
+  CHECK(compareTextures(a, b, 8, 8, 0.01f, &coverage).overTolerance == 0);
+
+  // above 1 the error is relative
+  const float bright[4] = {10.0f, 10.0f, 10.0f, 1.0f};
+  a.fill(bright);
+  b.fill(bright);
+  b.texel(1, 1)[0] = 10.05f;
+  diff = compareTextures(a, b, 8, 8, 0.01f);
+  CHECK(diff.overTolerance == 0 && std::fabs(diff.maxError - 0.005f) < 1e-4f);
+  b.texel(1, 1)[0] = 10.5f;
+  CHECK(compareTextures(a, b, 8, 8, 0.01f).overTolerance == 1);
+}
+
+}  // namespace
+
+int main() {
+  testCoverage();
+  testDepth();
+  testNearClip();
+  testPasses();
+  testPoolMatchesSerial();
+  testCompare();
+  return checkResult();
+}
@@ -0,0 +1,110 @@
+#include "StateTracker.h"
+
+#include <map>
+
+#include "Check.h"
+
+namespace {
+
+// states as a list would use them
+enum : StateTracker::State { common, renderTarget, shaderResource, copy };
+
+// the resources are told apart by their address only
+const int a = 0, b = 0, c = 0;
+
+struct States {
+  std::map<StateTracker::Resource, StateTracker::State> shared;
+
+  void resolve(StateTracker* tracker,
+               std::vector<StateTracker::Barrier>* barriers) {
+    tracker->resolve(
+        [&](StateTracker::Resource resource) { return shared[resource]; },
+        [&](StateTracker::Resource resource, StateTracker::State state) {
+          shared[resource] = state;
+        },
+        barriers);
+  }
+};
+
+bool isTransition(const StateTracker::Barrier& barrier, const void* resource,
+                  StateTracker::State before, StateTracker::State after) {
+  return !barrier.aliasing && barrier.resource == resource &&
+         barrier.before == before && barrier.after == after;
+}
+
+void testTransitions() {
+  StateTracker tracker;
+  // the first use only notes the state, the later ones go from the last
+  CHECK(tracker.change(&a, renderTarget) == renderTarget);
+  CHECK(tracker.change(&a, shaderResource) == renderTarget);
+  CHECK(tracker.change(&b, copy) == copy);
+  CHECK(tracker.change(&a, renderTarget) == shaderResource);
+  CHECK(tracker.isTracked(&a) && !tracker.isTracked(&c));
+
+  // b is already where the list expects it
+  States states;
+  states.shared[&a] = shaderResource;
+  states.shared[&b] = copy;
+  std::vector<StateTracker::Barrier> barriers;
+  states.resolve(&tracker, &barriers);
+  CHECK(barriers.size() == 1);
+  CHECK(isTransition(barriers[0], &a, shaderResource, renderTarget));
+  CHECK(states.shared[&a] == renderTarget && states.shared[&b] == copy);
+  CHECK(!tracker.isTracked(&a));
+
+  // the next list starts from there
+  tracker.change(&a, shaderResource);
+  tracker.change(&b, renderTarget);
+  barriers.clear();
+  states.resolve(&tracker, &barriers);
+  CHECK(barriers.size() == 2);
+  CHECK(isTransition(barriers[0], &a, renderTarget, shaderResource));
+  CHECK(isTransition(barriers[1], &b, copy, renderTarget));
+}
+
+void testActivation() {
+  // b is used first, then a placed target is activated and cleared : its
+  // aliasing barrier comes right before its transition, after b's
+  StateTracker tracker;
+  tracker.change(&b, shaderResource);
+  tracker.activate(&a);
+  CHECK(tracker.isTracked(&a));
+  CHECK(tracker.change(&a, renderTarget) == renderTarget);
+  CHECK(tracker.change(&a, shaderResource) == renderTarget);
+
+  States states;
+  states.shared[&a] = shaderResource;
+  states.shared[&b] = renderTarget;
+  std::vector<StateTracker::Barrier> barriers;
+  states.resolve(&tracker, &barriers);
+  CHECK(barriers.size() == 3);
+  if (barriers.size() != 3) return;
+  CHECK(isTransition(barriers[0], &b, renderTarget, shaderResource));
+  CHECK(barriers[1].aliasing && barriers[1].resource == &a);
+  CHECK(isTransition(barriers[2], &a, shaderResource, renderTarget));
+  CHECK(states.shared[&a] == shaderResource);
+
+  // already in its first state : only the aliasing barrier
+  tracker.activate(&a);
+  tracker.change(&a, renderTarget);
+  states.shared[&a] = renderTarget;
+  barriers.clear();
+  states.resolve(&tracker, &barriers);
+  CHECK(barriers.size() == 1 && barriers[0].aliasing);
+
+  // activated but never moved, its state is left alone
+  tracker.activate(&c);
+  states.shared[&c] = copy;
+  barriers.clear();
+  states.resolve(&tracker, &barriers);
+  CHECK(barriers.size() == 1 && barriers[0].resource == &c);
+  CHECK(states.shared[&c] == copy);
+}
+
+}  // namespace
+
+int main() {
+  testTransitions();
+  testActivation();
+  return checkResult();
+}
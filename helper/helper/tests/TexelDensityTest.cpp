@@ -0,0 +1,73 @@
+#include "TexelDensity.h"
+
+#include <cmath>
+#include <initializer_list>
+#include <limits>
+
+#include "Check.h"
+
+namespace {
+
+void testProjectedDiameter() {
+  // a 90 degree field of view, the sphere at twice its radius : the half
+  // angle is 30 degrees, tan = 1 / sqrt(3)
+  float d = projectedDiameter(1.0f, 2.0f, 1.57079633f, 1000.0f);
+  CHECK(std::fabs(d - 1000.0f / std::sqrt(3.0f)) < 0.01f);
+  // twice as far, about half as large
+  float far = projectedDiameter(1.0f, 4.0f, 1.57079633f, 1000.0f);
+  CHECK(far < d * 0.5f && far > d * 0.4f);
+  CHECK(std::isinf(projectedDiameter(1.0f, 0.5f, 1.57079633f, 1000.0f)));
+}
+
+void testPick() {
+  ResolutionSelector selector(32, 1024);
+  CHECK(selector.pick(0.0f) == 32);
+  CHECK(selector.pick(32.0f) == 32);
+  CHECK(selector.pick(33.0f) == 64);
+  CHECK(selector.pick(1000.0f) == 1024);
+  CHECK(selector.pick(5000.0f) == 1024);
+}
+
+void testUpdate() {
+  // 256 stays over [256 / 2 * 0.75, 256 * 1.25] = [96, 320]
+  ResolutionSelector selector(32, 1024, 0.25f);
+  for (float required : {96.0f, 100.0f, 128.0f, 200.0f, 256.0f, 300.0f,
+                         320.0f})
+    CHECK(selector.update(256, required) == 256);
+
+  // a step up past the band, to the smallest size covering it
+  CHECK(selector.update(256, 321.0f) == 512);
+  CHECK(selector.update(256, 600.0f) == 1024);
+  // a step down
+  CHECK(selector.update(256, 95.0f) == 128);
+  CHECK(selector.update(256, 40.0f) == 64);
+
+  // a size picked right at a threshold does not flip back and forth
+  uint32_t size = selector.update(256, 321.0f);
+  CHECK(selector.update(size, 300.0f) == 512);
+  CHECK(selector.update(size, 321.0f) == 512);
+}
+
+void testClamp() {
+  ResolutionSelector selector(32, 1024, 0.25f);
+  // no larger than the max, nor smaller than the min, however far past
+  CHECK(selector.update(1024, 1e6f) == 1024);
+  CHECK(selector.update(512, 1e6f) == 1024);
+  CHECK(selector.update(32, 0.0f) == 32);
+  CHECK(selector.update(64, 0.0f) == 32);
+  CHECK(selector.update(256, std::numeric_limits<float>::infinity()) == 1024);
+  // a size out of range is picked again
+  CHECK(selector.update(2048, 300.0f) == 512);
+  CHECK(selector.update(16, 300.0f) == 512);
+  CHECK(selector.update(100, 300.0f) == 512);
+}
+
+}  // namespace
+
+int main() {
+  testProjectedDiameter();
+  testPick();
+  testUpdate();
+  testClamp();
+  return checkResult();
+}
@@ -0,0 +1,276 @@
+#include "TileMask.h"
+
+#include <algorithm>
+#include <random>
+
+#include "Check.h"
+
+namespace {
+
+// vertices as the mesh has them : position, normal, texcoord
+const uint32_t stride = 8;
+const uint32_t uvOffset = 6;
+
+void addVertex(std::vector<float>* vertices, float x, float y, float u,
+               float v) {
+  const float vertex[stride] = {x, y, 0.5f, 0.0f, 0.0f, 0.0f, u, v};
+  vertices->insert(vertices->end(), vertex, vertex + stride);
+}
+
+const float identity[16] = {1, 0, 0, 0, 0, 1, 0, 0, 0, 0, 1, 0, 0, 0, 0, 1};
+
+void testLayout() {
+  TileMask mask(64, 36, 8);
+  CHECK(mask.getTilesX() == 8 && mask.getTilesY() == 5);
+  CHECK(mask.getWords().size() == 2);
+  CHECK(mask.count() == 0);
+
+  // row after row, 32 tiles to a word
+  mask.mark(3, 2);
+  CHECK(mask.isMarked(3, 2) && !mask.isMarked(2, 3));
+  CHECK(mask.getWords()[0] == 1u << 19);
+  mask.mark(0, 4);
+  CHECK(mask.getWords()[1] == 1u << 0);
+  CHECK(mask.count() == 2);
+  mask.clear();
+  CHECK(mask.count() == 0);
+}
+
+void testCompact() {
+  TileMask mask(64, 36, 8);
+  mask.mark(3, 2);
+  // the marked tile and its 8 neighbours, in row order
+  std::vector<uint32_t> tiles = mask.compact(8, 5);
+  CHECK(tiles.size() == 9);
+  CHECK(tiles.front() == (2 | 1 << 16) && tiles.back() == (4 | 3 << 16));
+  auto rowOrder = [](uint32_t a, uint32_t b) {
+    return (a >> 16) != (b >> 16) ? (a >> 16) < (b >> 16)
+                                  : (a & 0xffff) < (b & 0xffff);
+  };
+  CHECK(std::is_sorted(tiles.begin(), tiles.end(), rowOrder));
+  // only the used columns
+  tiles = mask.compact(3, 5);
+  CHECK((tiles == std::vector<uint32_t>{2 | 1 << 16, 2 | 2 << 16,
+                                        2 | 3 << 16}));
+  // a neighbour outside the used part still counts
+  CHECK(mask.compact(2, 5).empty());
+  tiles = mask.compact(3, 2);
+  CHECK((tiles == std::vector<uint32_t>{2 | 1 << 16}));
+
+  // clipped at the edges
+  mask.clear();
+  mask.mark(0, 0);
+  CHECK(mask.compact(8, 5).size() == 4);
+  mask.mark(7, 4);
+  CHECK(mask.compact(8, 5).size() == 8);
+  CHECK(mask.compact(100, 100).size() == 8);
+}
+
+void testVisibleTiles() {
+  // a quad over the whole view with the texcoords of [0, 0.5], and a
+  // triangle out of view in the other corner of the texture space
+  std::vector<float> vertices;
+  addVertex(&vertices, -1, -1, 0.0f, 0.0f);
+  addVertex(&vertices, 1, -1, 0.5f, 0.0f);
+  addVertex(&vertices, 1, 1, 0.5f, 0.5f);
+  addVertex(&vertices, -1, 1, 0.0f, 0.5f);
+  addVertex(&vertices, 5, 5, 0.9f, 0.9f);
+  addVertex(&vertices, 6, 5, 1.0f, 0.9f);
+  addVertex(&vertices, 6, 6, 1.0f, 1.0f);
+  const uint32_t indices[] = {0, 1, 2, 0, 2, 3, 4, 5, 6};
+
+  // texels [0, 32] : the tiles 0 to 4, 32 is on the edge of tile 4
+  TileMask mask(64, 64, 8);
+  markVisibleTiles(vertices.data(), stride, uvOffset, indices, 9, identity,
+                   1.0f, &mask);
+  CHECK(mask.count() == 25);
+  CHECK(mask.isMarked(0, 0) && mask.isMarked(4, 4));
+  CHECK(!mask.isMarked(5, 0) && !mask.isMarked(7, 7));
+
+  // the shaded part of the texture space is half of it
+  TileMask half(64, 64, 8);
+  markVisibleTiles(vertices.data(), stride, uvOffset, indices, 9, identity,
+                   0.5f, &half);
+  CHECK(half.count() == 9);
+  CHECK(half.isMarked(2, 2) && !half.isMarked(3, 0));
+
+  // behind the camera, or the whole quad moved out of view
+  const float behind[16] = {1, 0, 0, 0, 0, 1, 0, 0, 0, 0, -1, 0, 0, 0, 0, 1};
+  const float right[16] = {1, 0, 0, 0, 0, 1, 0, 0, 0, 0, 1, 0, 3, 0, 0, 1};
+  for (const float* mvp : {behind, right}) {
+    TileMask none(64, 64, 8);
+    markVisibleTiles(vertices.data(), stride, uvOffset, indices, 9, mvp,
+                     1.0f, &none);
+    CHECK(none.count() == 0);
+  }
+}
+
+// whether the texel center is inside the texel space triangle
+bool covers(const float uv[3][2], float x, float y) {
+  float sign = 0.0f;
+  for (int e = 0; e < 3; ++e) {
+    const float* p = uv[e];
+    const float* q = uv[(e + 1) % 3];
+    float side = (q[0] - p[0]) * (y - p[1]) - (q[1] - p[1]) * (x - p[0]);
+    if (side == 0.0f) continue;
+    if (sign == 0.0f) sign = side;
+    if ((side < 0.0f) != (sign < 0.0f)) return false;
+  }
+  return true;
+}
+
+void testUvTiles() {
+  // half of the atlas
+  std::vector<float> vertices;
+  addVertex(&vertices, 0, 0, 0.0f, 0.0f);
+  addVertex(&vertices, 0, 0, 1.0f, 0.0f);
+  addVertex(&vertices, 0, 0, 0.0f, 1.0f);
+  const uint32_t indices[] = {0, 1, 2};
+
+  TileMask tiles(64, 64, 8);
+  markUvTiles(vertices.data(), stride, uvOffset, indices, 3, 1.0f, 0.0f,
+              &tiles);
+  // on and above the diagonal, the tiles it only touches at a corner too
+  CHECK(tiles.count() == 36 + 7);
+  for (uint32_t y = 0; y < 8; ++y)
+    for (uint32_t x = 0; x < 8; ++x)
+      CHECK(tiles.isMarked(x, y) == (x + y < 9));
+
+  // grown by 4 texels on each axis the diagonal moves by 8 along x + y, a
+  // tile further; by 2 it only reaches the tiles it touched already. Past
+  // the left and top edges the growth wraps to the last column and row.
+  TileMask grown(64, 64, 8);
+  markUvTiles(vertices.data(), stride, uvOffset, indices, 3, 1.0f, 2.0f,
+              &grown);
+  for (uint32_t y = 0; y < 8; ++y)
+    for (uint32_t x = 0; x < 8; ++x)
+      CHECK(grown.isMarked(x, y) == (x + y < 9 || x == 7 || y == 7));
+  grown.clear();
+  markUvTiles(vertices.data(), stride, uvOffset, indices, 3, 1.0f, 4.0f,
+              &grown);
+  CHECK(grown.count() == 36 + 7 + 6 + 9);
+  for (uint32_t y = 0; y < 8; ++y) {
+    for (uint32_t x = 0; x < 8; ++x) {
+      if (tiles.isMarked(x, y)) CHECK(grown.isMarked(x, y));
+      CHECK(grown.isMarked(x, y) == (x + y < 10 || x == 7 || y == 7));
+    }
+  }
+
+  // a tile size of 1 is a texel mask
+  TileMask texels(64, 64, 1);
+  markUvTiles(vertices.data(), stride, uvOffset, indices, 3, 1.0f, 0.0f,
+              &texels);
+  CHECK(texels.count() == 64 * 65 / 2 + 63);
+}
+
+void testWrap() {
+  // across the right edge of the texture space, and the same triangle a
+  // texture size to the left and two down
+  std::vector<float> vertices;
+  addVertex(&vertices, 0, 0, 0.9f, 0.1f);
+  addVertex(&vertices, 0, 0, 1.1f, 0.1f);
+  addVertex(&vertices, 0, 0, 0.9f, 0.3f);
+  addVertex(&vertices, 0, 0, -0.1f, 2.1f);
+  addVertex(&vertices, 0, 0, 0.1f, 2.1f);
+  addVertex(&vertices, 0, 0, -0.1f, 2.3f);
+  const uint32_t across[] = {0, 1, 2};
+  const uint32_t moved[] = {3, 4, 5};
+
+  // texels x in [57.6, 70.4], the last tile and the first, y in [6.4, 19.2]
+  TileMask mask(64, 64, 8);
+  markUvTiles(vertices.data(), stride, uvOffset, across, 3, 1.0f, 0.0f,
+              &mask);
+  CHECK(mask.isMarked(7, 0) && mask.isMarked(7, 2));
+  CHECK(mask.isMarked(0, 0) && mask.isMarked(0, 1));
+  CHECK(!mask.isMarked(1, 0) && !mask.isMarked(6, 0) && !mask.isMarked(0, 3));
+  TileMask other(64, 64, 8);
+  markUvTiles(vertices.data(), stride, uvOffset, moved, 3, 1.0f, 0.0f,
+              &other);
+  CHECK(other.getWords() == mask.getWords());
+
+  // the marks of the draw wrap the same way
+  const float clip[] = {0, 0, 0.5f, 0, 0, 0, 0, 0, 0, 0, 0.5f, 0, 0, 0, 0, 1};
+  TileMask visible(64, 64, 8);
+  markVisibleTiles(vertices.data(), stride, uvOffset, moved, 3, clip, 1.0f,
+                   &visible);
+  CHECK(visible.getWords() == mask.getWords());
+
+  // grown across the bottom edge into the first row
+  TileMask grown(64, 64, 8);
+  addVertex(&vertices, 0, 0, 0.3f, 0.95f);
+  addVertex(&vertices, 0, 0, 0.4f, 0.95f);
+  addVertex(&vertices, 0, 0, 0.3f, 0.98f);
+  const uint32_t bottom[] = {6, 7, 8};
+  markUvTiles(vertices.data(), stride, uvOffset, bottom, 3, 1.0f, 0.0f,
+              &grown);
+  CHECK(grown.isMarked(2, 7) && !grown.isMarked(2, 0));
+  markUvTiles(vertices.data(), stride, uvOffset, bottom, 3, 1.0f, 4.0f,
+              &grown);
+  CHECK(grown.isMarked(2, 0) && !grown.isMarked(2, 1));
+}
+
+// random triangles against texel centers : what is covered is marked, and
+// what is marked is inside the bounds grown by the dilation, the texcoords
+// wrapped
+void testUvTilesRandom() {
+  std::mt19937 random(46);
+  std::uniform_real_distribution<float> coord(-0.1f, 1.1f);
+  for (int trial = 0; trial < 200; ++trial) {
+    std::vector<float> vertices;
+    for (int v = 0; v < 3; ++v)
+      addVertex(&vertices, 0, 0, coord(random), coord(random));
+    const uint32_t indices[] = {0, 1, 2};
+    const float dilation = float(trial % 4);
+    const uint32_t tileSize = 1 + trial % 8;
+    const uint32_t size = 48;
+
+    TileMask mask(size, size, tileSize);
+    markUvTiles(vertices.data(), stride, uvOffset, indices, 3, 1.0f,
+                dilation, &mask);
+    float uv[3][2];
+    for (int v = 0; v < 3; ++v)
+      for (int j = 0; j < 2; ++j)
+        uv[v][j] = vertices[v * stride + uvOffset + j] * size;
+    float minX = std::min({uv[0][0], uv[1][0], uv[2][0]}) - dilation;
+    float maxX = std::max({uv[0][0], uv[1][0], uv[2][0]}) + dilation;
+    float minY = std::min({uv[0][1], uv[1][1], uv[2][1]}) - dilation;
+    float maxY = std::max({uv[0][1], uv[1][1], uv[2][1]}) + dilation;
+
+    // the coordinates stay within a texture size of [0, size]
+    const float periods[3] = {-float(size), 0.0f, float(size)};
+    for (uint32_t y = 0; y < size; ++y) {
+      for (uint32_t x = 0; x < size; ++x) {
+        bool covered = false;
+        for (float py : periods)
+          for (float px : periods)
+            covered |= covers(uv, x + 0.5f + px, y + 0.5f + py);
+        if (covered) CHECK(mask.isMarked(x / tileSize, y / tileSize));
+      }
+    }
+    for (uint32_t ty = 0; ty < mask.getTilesY(); ++ty) {
+      for (uint32_t tx = 0; tx < mask.getTilesX(); ++tx) {
+        if (!mask.isMarked(tx, ty)) continue;
+        bool insideX = false, insideY = false;
+        for (float p : periods) {
+          insideX |= float((tx + 1) * tileSize) + p >= minX &&
+                     float(tx * tileSize) + p <= maxX;
+          insideY |= float((ty + 1) * tileSize) + p >= minY &&
+                     float(ty * tileSize) + p <= maxY;
+        }
+        CHECK(insideX && insideY);
+      }
+    }
+  }
+}
+
+}  // namespace
+
+int main() {
+  testLayout();
+  testCompact();
+  testVisibleTiles();
+  testUvTiles();
+  testWrap();
+  testUvTilesRandom();
+  return checkResult();
+}
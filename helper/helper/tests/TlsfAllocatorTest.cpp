@@ -0,0 +1,156 @@
+#include "TlsfAllocator.h"
+
+#include <algorithm>
+#include <map>
+#include <random>
+#include <vector>
+
+#include "Check.h"
+
+namespace {
+
+uint64_t alignUp(uint64_t value, uint64_t alignment) {
+  return (value + alignment - 1) & ~(alignment - 1);
+}
+
+// what the allocator should hold, offset -> allocation
+using Model = std::map<uint64_t, TlsfAllocator::Allocation>;
+
+void checkState(const TlsfAllocator& tlsf, const Model& model) {
+  CHECK(tlsf.validate());
+  uint64_t used = 0;
+  uint64_t end = 0;
+  for (const auto& [offset, allocation] : model) {
+    CHECK(offset >= end);  // no overlap
+    end = offset + allocation.size;
+    used += allocation.size;
+  }
+  CHECK(end <= tlsf.getSize());
+  CHECK(tlsf.getUsedSize() == used);
+  CHECK(tlsf.getAllocationCount() == model.size());
+
+  auto it = model.begin();
+  tlsf.forEachAllocation([&](const TlsfAllocator::Allocation& allocation) {
+    CHECK(it != model.end());
+    if (it == model.end()) return;
+    CHECK(allocation.offset == it->second.offset);
+    CHECK(allocation.size == it->second.size);
+    CHECK(allocation.block == it->second.block);
+    ++it;
+  });
+  CHECK(it == model.end());
+}
+
+// where allocateBelow() has to place size at alignment : the first free
+// range from the bottom starting below limit that fits, by the model
+uint64_t lowestFit(const TlsfAllocator& tlsf, const Model& model,
+                   uint64_t limit, uint64_t size, uint64_t alignment) {
+  uint64_t gapBegin = 0;
+  for (const auto& [offset, allocation] : model) {
+    if (gapBegin >= limit) break;
+    if (alignUp(gapBegin, alignment) + size <= offset)
+      return alignUp(gapBegin, alignment);
+    gapBegin = offset + allocation.size;
+  }
+  uint64_t offset = alignUp(gapBegin, alignment);
+  if (gapBegin < limit && offset + size <= tlsf.getSize()) return offset;
+  return UINT64_MAX;
+}
+
+void testBasic() {
+  TlsfAllocator tlsf(1 << 20, 256);
+  Model model;
+  TlsfAllocator::Allocation a = tlsf.allocate(1000);
+  CHECK(a.valid() && a.offset == 0 && a.size == 1024);
+  TlsfAllocator::Allocation b = tlsf.allocate(256, 4096);
+  CHECK(b.valid() && b.offset == 4096 && b.size == 256);
+  model[a.offset] = a;
+  model[b.offset] = b;
+  checkState(tlsf, model);
+
+  // the padding in front of b is a free block of its own
+  TlsfAllocator::Allocation c = tlsf.allocate(2048);
+  CHECK(c.valid() && c.offset == 1024);
+  model[c.offset] = c;
+  checkState(tlsf, model);
+
+  tlsf.free(a);
+  tlsf.free(c);
+  model.erase(a.offset);
+  model.erase(c.offset);
+  checkState(tlsf, model);
+  tlsf.free(b);
+  model.clear();
+  checkState(tlsf, model);
+  CHECK(tlsf.getLargestFreeSize() == tlsf.getSize());
+
+  // too large, or too large once aligned
+  CHECK(!tlsf.allocate((1 << 20) + 1).valid());
+  CHECK(tlsf.allocate(1 << 20).valid());
+  CHECK(!tlsf.allocate(256).valid());
+}
+
+void testRandom() {
+  struct Live {
+    TlsfAllocator::Allocation allocation;
+    uint64_t alignment;
+  };
+  std::mt19937_64 random(39);
+  for (int trial = 0; trial < 20; ++trial) {
+    TlsfAllocator tlsf(16ull << 20, 256);
+    Model model;
+    std::vector<Live> live;
+
+    for (int step = 0; step < 3000; ++step) {
+      uint32_t op = random() % 8;
+      if (live.empty() || op < 4) {
+        uint64_t size = 1 + random() % (uint64_t(1) << (random() % 21));
+        uint64_t alignment = uint64_t(1) << (random() % 17);
+        TlsfAllocator::Allocation allocation = tlsf.allocate(size, alignment);
+        if (allocation.valid()) {
+          alignment = std::max<uint64_t>(alignment, 256);
+          CHECK(allocation.offset % alignment == 0);
+          CHECK(allocation.size >= size && allocation.size % 256 == 0);
+          live.push_back({allocation, alignment});
+          model[allocation.offset] = allocation;
+        }
+      } else if (op < 7) {
+        size_t k = random() % live.size();
+        tlsf.free(live[k].allocation);
+        model.erase(live[k].allocation.offset);
+        live[k] = live.back();
+        live.pop_back();
+      } else {
+        // the defragmentation move : a copy lower down, then the old one goes
+        size_t k = random() % live.size();
+        TlsfAllocator::Allocation old = live[k].allocation;
+        uint64_t expected =
+            lowestFit(tlsf, model, old.offset, old.size, live[k].alignment);
+        TlsfAllocator::Allocation moved = tlsf.allocateBelow(old);
+        CHECK(moved.valid() == (expected != UINT64_MAX));
+        if (moved.valid()) {
+          CHECK(moved.offset == expected && moved.size == old.size);
+          model[moved.offset] = moved;
+          checkState(tlsf, model);
+          tlsf.free(old);
+          model.erase(old.offset);
+          live[k].allocation = moved;
+        }
+      }
+      checkState(tlsf, model);
+    }
+
+    for (const Live& l : live) tlsf.free(l.allocation);
+    model.clear();
+    checkState(tlsf, model);
+    CHECK(tlsf.getLargestFreeSize() == tlsf.getSize());
+  }
+}
+
+}  // namespace
+
+int main() {
+  testBasic();
+  testRandom();
+  return checkResult();
+}